@@ -13,8 +13,11 @@
         return NULL; \
     } \
     node->type = nodeType; \
+    node->refs = 1; \
     node->line = line; \
-    node->column = column;
+    node->column = column; \
+    node->offset = 0; \
+    node->length = 0;
 
 /// Helper macro for allocating memory for string copies and copying
 /// strings for AST nodes that have idents.
@@ -43,8 +46,11 @@ ASTNode* create_file_node(ASTNode** stmts, size_t stmtCount) {
     }
 
     node->type = NODE_FILE;
+    node->refs = 1;
     node->line = 1;
     node->column = 1;
+    node->offset = 0;
+    node->length = 0;
     node->data.file.stmts = stmts;
     node->data.file.stmtCount = stmtCount;
     return node;
@@ -227,7 +233,7 @@ ASTNode* create_literal_node(size_t line, size_t column, TokenType type,
 }
 
 void free_ast_node(ASTNode* node) {
-    if (node == NULL) {
+    if (node == NULL || --node->refs > 0) {
         return;
     }
 
@@ -325,6 +331,275 @@ void free_ast_node(ASTNode* node) {
     free(node);
 }
 
+ASTNode* share_ast_node(ASTNode* node) {
+    if (node != NULL) {
+        node->refs++;
+    }
+    return node;
+}
+
+/// Moves node and its descendants by the difference between from and
+/// to, the positions the node being moved starts at before and after.
+static void move_tree(ASTNode* node, const ASTNode* from,
+    const ASTNode* to) {
+    if (node == NULL) {
+        return;
+    }
+
+    // Nodes made after parsing may have no span to move
+    if (node->length > 0) {
+        node->offset = node->offset - from->offset + to->offset;
+    }
+    if (node->line == from->line) {
+        node->column = node->column - from->column + to->column;
+    }
+    node->line = node->line - from->line + to->line;
+
+    switch (node->type) {
+        case NODE_FILE:
+            for (size_t i = 0; i < node->data.file.stmtCount; i++) {
+                move_tree(node->data.file.stmts[i], from, to);
+            }
+            break;
+        case NODE_FUNCTION_DECL:
+            for (size_t i = 0; i < node->data.functionDecl.paramCount; i++) {
+                move_tree(node->data.functionDecl.params[i], from, to);
+            }
+            move_tree(node->data.functionDecl.body, from, to);
+            break;
+        case NODE_VARIABLE_DECL:
+            move_tree(node->data.variableDecl.initializer, from, to);
+            break;
+        case NODE_BLOCK_STMT:
+            for (size_t i = 0; i < node->data.blockStmt.stmtCount; i++) {
+                move_tree(node->data.blockStmt.stmts[i], from, to);
+            }
+            break;
+        case NODE_RETURN_STMT:
+            move_tree(node->data.returnStmt.expr, from, to);
+            break;
+        case NODE_IF_STMT:
+            move_tree(node->data.ifStmt.condition, from, to);
+            move_tree(node->data.ifStmt.thenBranch, from, to);
+            move_tree(node->data.ifStmt.elseBranch, from, to);
+            break;
+        case NODE_EXPR_STMT:
+            move_tree(node->data.exprStmt.expr, from, to);
+            break;
+        case NODE_BINARY_EXPR:
+            move_tree(node->data.binaryExpr.left, from, to);
+            move_tree(node->data.binaryExpr.right, from, to);
+            break;
+        case NODE_UNARY_EXPR:
+            move_tree(node->data.unaryExpr.operand, from, to);
+            break;
+        case NODE_CALL_EXPR:
+            move_tree(node->data.callExpr.callee, from, to);
+            for (size_t i = 0; i < node->data.callExpr.argCount; i++) {
+                move_tree(node->data.callExpr.args[i], from, to);
+            }
+            break;
+        case NODE_ASSIGN_EXPR:
+            move_tree(node->data.assignExpr.target, from, to);
+            move_tree(node->data.assignExpr.value, from, to);
+            break;
+        case NODE_CAST_EXPR:
+            move_tree(node->data.castExpr.expr, from, to);
+            break;
+        default:
+            break;
+    }
+}
+
+void move_ast_node(ASTNode* node, size_t offset, size_t line,
+    size_t column) {
+    if (node == NULL) {
+        return;
+    }
+
+    ASTNode from = *node;
+    ASTNode to = *node;
+    to.offset = offset;
+    to.line = line;
+    to.column = column;
+    move_tree(node, &from, &to);
+}
+
+/// Copies str to out. NULL is copied as NULL. Returns false on
+/// allocation failure, leaving out NULL.
+static bool copy_string(const char* str, char** out) {
+    *out = NULL;
+    if (str == NULL) {
+        return true;
+    }
+
+    size_t len = strlen(str);
+    *out = malloc(len + 1);
+    if (*out == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+    memcpy(*out, str, len + 1);
+    return true;
+}
+
+/// Copies node and its descendants to out. NULL is copied as NULL.
+/// Returns false on allocation failure, leaving out NULL.
+static bool copy_tree(const ASTNode* node, ASTNode** out);
+
+/// Copies the count nodes of an array to a new array in out. Returns
+/// false on allocation failure, leaving out NULL.
+static bool copy_nodes(ASTNode* const* nodes, size_t count,
+    ASTNode*** out) {
+    *out = NULL;
+    if (nodes == NULL) {
+        return true;
+    }
+
+    ASTNode** copies = calloc(count > 0 ? count : 1, sizeof(ASTNode*));
+    if (copies == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!copy_tree(nodes[i], &copies[i])) {
+            for (size_t j = 0; j < i; j++) {
+                free_ast_node(copies[j]);
+            }
+            free(copies);
+            return false;
+        }
+    }
+    *out = copies;
+    return true;
+}
+
+static bool copy_tree(const ASTNode* node, ASTNode** out) {
+    *out = NULL;
+    if (node == NULL) {
+        return true;
+    }
+
+    ASTNode* copy = malloc(sizeof(ASTNode));
+    if (copy == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for node\n");
+        return false;
+    }
+
+    // The pointers are cleared first so a partial copy can be freed
+    *copy = *node;
+    copy->refs = 1;
+    memset(&copy->data, 0, sizeof(copy->data));
+    bool ok = true;
+    switch (node->type) {
+        case NODE_FILE:
+            copy->data.file.stmtCount = node->data.file.stmtCount;
+            ok = copy_nodes(node->data.file.stmts, node->data.file.stmtCount,
+                &copy->data.file.stmts);
+            break;
+        case NODE_FUNCTION_DECL: {
+            const FunctionDecl* decl = &node->data.functionDecl;
+            copy->data.functionDecl.paramCount = decl->paramCount;
+            copy->data.functionDecl.returnType = decl->returnType;
+            ok = copy_string(decl->name, &copy->data.functionDecl.name) &&
+                copy_nodes(decl->params, decl->paramCount,
+                    &copy->data.functionDecl.params) &&
+                copy_tree(decl->body, &copy->data.functionDecl.body);
+            break;
+        }
+        case NODE_VARIABLE_DECL: {
+            const VariableDecl* decl = &node->data.variableDecl;
+            copy->data.variableDecl.type = decl->type;
+            copy->data.variableDecl.mutable = decl->mutable;
+            ok = copy_string(decl->name, &copy->data.variableDecl.name) &&
+                copy_tree(decl->initializer,
+                    &copy->data.variableDecl.initializer);
+            break;
+        }
+        case NODE_PARAMETER_DECL:
+            copy->data.parameterDecl.type = node->data.parameterDecl.type;
+            ok = copy_string(node->data.parameterDecl.name,
+                &copy->data.parameterDecl.name);
+            break;
+        case NODE_BLOCK_STMT:
+            copy->data.blockStmt.stmtCount = node->data.blockStmt.stmtCount;
+            ok = copy_nodes(node->data.blockStmt.stmts,
+                node->data.blockStmt.stmtCount, &copy->data.blockStmt.stmts);
+            break;
+        case NODE_RETURN_STMT:
+            ok = copy_tree(node->data.returnStmt.expr,
+                &copy->data.returnStmt.expr);
+            break;
+        case NODE_IF_STMT:
+            ok = copy_tree(node->data.ifStmt.condition,
+                    &copy->data.ifStmt.condition) &&
+                copy_tree(node->data.ifStmt.thenBranch,
+                    &copy->data.ifStmt.thenBranch) &&
+                copy_tree(node->data.ifStmt.elseBranch,
+                    &copy->data.ifStmt.elseBranch);
+            break;
+        case NODE_EXPR_STMT:
+            ok = copy_tree(node->data.exprStmt.expr,
+                &copy->data.exprStmt.expr);
+            break;
+        case NODE_BINARY_EXPR:
+            copy->data.binaryExpr.op = node->data.binaryExpr.op;
+            ok = copy_tree(node->data.binaryExpr.left,
+                    &copy->data.binaryExpr.left) &&
+                copy_tree(node->data.binaryExpr.right,
+                    &copy->data.binaryExpr.right);
+            break;
+        case NODE_UNARY_EXPR:
+            copy->data.unaryExpr.op = node->data.unaryExpr.op;
+            copy->data.unaryExpr.isPostfix = node->data.unaryExpr.isPostfix;
+            ok = copy_tree(node->data.unaryExpr.operand,
+                &copy->data.unaryExpr.operand);
+            break;
+        case NODE_CALL_EXPR:
+            copy->data.callExpr.argCount = node->data.callExpr.argCount;
+            ok = copy_tree(node->data.callExpr.callee,
+                    &copy->data.callExpr.callee) &&
+                copy_nodes(node->data.callExpr.args,
+                    node->data.callExpr.argCount, &copy->data.callExpr.args);
+            break;
+        case NODE_ASSIGN_EXPR:
+            copy->data.assignExpr.op = node->data.assignExpr.op;
+            ok = copy_tree(node->data.assignExpr.target,
+                    &copy->data.assignExpr.target) &&
+                copy_tree(node->data.assignExpr.value,
+                    &copy->data.assignExpr.value);
+            break;
+        case NODE_CAST_EXPR:
+            copy->data.castExpr.type = node->data.castExpr.type;
+            ok = copy_tree(node->data.castExpr.expr,
+                &copy->data.castExpr.expr);
+            break;
+        case NODE_IDENT:
+            ok = copy_string(node->data.ident.name,
+                &copy->data.ident.name);
+            break;
+        case NODE_LITERAL:
+            copy->data.literal.type = node->data.literal.type;
+            ok = copy_string(node->data.literal.value,
+                &copy->data.literal.value);
+            break;
+        default:
+            break;
+    }
+
+    if (!ok) {
+        free_ast_node(copy);
+        return false;
+    }
+    *out = copy;
+    return true;
+}
+
+ASTNode* copy_ast_node(const ASTNode* node) {
+    ASTNode* copy;
+    return copy_tree(node, &copy) ? copy : NULL;
+}
+
 /// Simple helper function to print indentation for AST nodes.
 static void print_indent(int indent) {
     if (indent < 0) {
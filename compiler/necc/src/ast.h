@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "token.h"
 
 typedef enum NodeType {
@@ -164,10 +165,19 @@ typedef struct Literal {
 struct ASTNode {
     /// The type of the node.
     NodeType type;
+    /// The number of references to the node, more than one only for an
+    /// expression shared through a NodeTable. A shared node must not be
+    /// changed, and its position is that of where it first appeared.
+    uint32_t refs;
     /// The line number where the node starts.
     size_t line;
     /// The column number where the node starts.
     size_t column;
+    /// The byte offset in the source of the first token of the node and
+    /// the number of bytes up to the end of its last token. Both are 0
+    /// for nodes not made by the parser.
+    size_t offset;
+    size_t length;
     /// The data associated with the node.
     union {
         File file;
@@ -275,9 +285,23 @@ ASTNode* create_ident_node(size_t line, size_t column, const char* name);
 ASTNode* create_literal_node(size_t line, size_t column, TokenType type,
     const char* value);
 
-/// Recursively frees all memory associated with the given AST node.
-/// Safely handles NULL.
+/// Drops a reference to the given AST node, recursively freeing all
+/// memory associated with it once none are left. Safely handles NULL.
 void free_ast_node(ASTNode* node);
+/// Returns node with one more reference to it, for another parent to
+/// hold. Safely handles NULL.
+ASTNode* share_ast_node(ASTNode* node);
+/// Moves a node parsed from one place in the source to another, as
+/// when text before it was edited, so it starts at the given offset,
+/// line and column. Its descendants move with it, those on its first
+/// line changing column too.
+void move_ast_node(ASTNode* node, size_t offset, size_t line,
+    size_t column);
+/// Returns a copy of the given AST node and its descendants, spans
+/// included, for a pass to change while the original is kept. Nothing
+/// in the copy is shared. Returns NULL for NULL or on allocation
+/// failure.
+ASTNode* copy_ast_node(const ASTNode* node);
 /// Recursively prints the given AST node with the given indentation.
 /// Expected to be 0 for the root node.
 void print_ast_node(ASTNode* node, int indent);
@@ -0,0 +1,839 @@
+#include "bytecode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+
+/// How values of a type are stored and operated on.
+typedef enum Kind {
+    KIND_I64,
+    KIND_U64,
+    KIND_I32,
+    KIND_U32,
+    KIND_I16,
+    KIND_U16,
+    KIND_I8,
+    KIND_U8,
+    KIND_F64,
+    KIND_F32,
+    KIND_I128,
+    KIND_U128,
+    KIND_COUNT,
+} Kind;
+
+/// Marks a kind without a matching op.
+#define NO_OP BC_OP_COUNT
+
+static const uint16_t addOps[KIND_COUNT] = {
+    BC_ADD_64, BC_ADD_64, BC_ADD_I32, BC_ADD_U32, BC_ADD_I16, BC_ADD_U16,
+    BC_ADD_I8, BC_ADD_U8, BC_ADD_F64, BC_ADD_F32, BC_ADD_128, BC_ADD_128,
+};
+static const uint16_t subOps[KIND_COUNT] = {
+    BC_SUB_64, BC_SUB_64, BC_SUB_I32, BC_SUB_U32, BC_SUB_I16, BC_SUB_U16,
+    BC_SUB_I8, BC_SUB_U8, BC_SUB_F64, BC_SUB_F32, BC_SUB_128, BC_SUB_128,
+};
+static const uint16_t mulOps[KIND_COUNT] = {
+    BC_MUL_64, BC_MUL_64, BC_MUL_I32, BC_MUL_U32, BC_MUL_I16, BC_MUL_U16,
+    BC_MUL_I8, BC_MUL_U8, BC_MUL_F64, BC_MUL_F32, BC_MUL_128, BC_MUL_128,
+};
+// Narrow unsigned quotients never exceed their operands, so they share
+// the 64-bit op
+static const uint16_t divOps[KIND_COUNT] = {
+    BC_DIV_I64, BC_DIV_U64, BC_DIV_I32, BC_DIV_U64, BC_DIV_I16, BC_DIV_U64,
+    BC_DIV_I8, BC_DIV_U64, BC_DIV_F64, BC_DIV_F32, BC_DIV_I128, BC_DIV_U128,
+};
+static const uint16_t modOps[KIND_COUNT] = {
+    BC_MOD_I64, BC_MOD_U64, BC_MOD_I64, BC_MOD_U64, BC_MOD_I64, BC_MOD_U64,
+    BC_MOD_I64, BC_MOD_U64, BC_MOD_F64, BC_MOD_F32, BC_MOD_I128, BC_MOD_U128,
+};
+static const uint16_t addiOps[KIND_COUNT] = {
+    BC_ADDI_64, BC_ADDI_64, BC_ADDI_I32, BC_ADDI_U32, BC_ADDI_I16,
+    BC_ADDI_U16, BC_ADDI_I8, BC_ADDI_U8, NO_OP, NO_OP, NO_OP, NO_OP,
+};
+static const uint16_t negOps[KIND_COUNT] = {
+    BC_NEG_64, BC_NEG_64, BC_NEG_I32, BC_NEG_U32, BC_NEG_I16, BC_NEG_U16,
+    BC_NEG_I8, BC_NEG_U8, BC_NEG_F, BC_NEG_F, BC_NEG_128, BC_NEG_128,
+};
+
+static const char* const opNames[] = {
+#define BC_NAME_ENTRY(name) #name,
+    BC_OP_LIST(BC_NAME_ENTRY)
+#undef BC_NAME_ENTRY
+};
+
+/// State used while compiling one function.
+typedef struct Compiler {
+    const IRModule* module;
+    IRFunction* ir;
+    BCFunction* out;
+    uint32_t codeCap;
+    uint32_t constCap;
+    /// The first slot of each IR value, IR_NONE if it has none.
+    uint32_t* slots;
+    /// The number of instructions using each IR value.
+    uint32_t* uses;
+    /// The first instruction of each block.
+    uint32_t* blockPc;
+    /// Jumps whose c operand still holds a block id.
+    uint32_t* patches;
+    uint32_t patchCount;
+    uint32_t patchCap;
+    /// Two scratch pairs used to materialise constant operands.
+    uint32_t scratch;
+    bool ok;
+} Compiler;
+
+/// Compiles a single function into out. Returns false on failure.
+static bool compile_function(const IRModule* module, IRFunction* ir,
+    BCFunction* out);
+/// Assigns window slots to parameters and values.
+static bool assign_slots(Compiler* cc);
+/// Compiles one instruction. Returns the number of instructions it
+/// consumed, which is two when a comparison is fused into a branch.
+static uint32_t compile_inst(Compiler* cc, uint32_t index);
+/// Compiles a comparison, or when target is a branch the fused compare
+/// and jump.
+static void compile_compare(Compiler* cc, const IRInst* inst, uint32_t dst,
+    const IRInst* branch, uint32_t nextBlock);
+/// Compiles a switch into a jump table or a key search followed by the
+/// jumps to its blocks.
+static void compile_switch(Compiler* cc, const IRInst* inst,
+    uint32_t block);
+/// Emits the copies into the phis of a successor for the edge from
+/// block.
+static void emit_phi_copies(Compiler* cc, uint32_t block, uint32_t succ);
+/// Emits a jump to a block, patched once block positions are known.
+static void emit_jump(Compiler* cc, BCOp op, uint32_t a, uint32_t b,
+    uint32_t block);
+/// Appends an instruction. Returns its index.
+static uint32_t emit(Compiler* cc, BCOp op, uint32_t a, uint32_t b,
+    uint32_t c);
+/// Returns the slot holding a value, loading constants into scratch pair
+/// which.
+static uint32_t operand(Compiler* cc, uint32_t value, uint32_t which);
+/// Loads the constant value into slot.
+static void load_const(Compiler* cc, uint32_t slot, uint32_t value);
+/// Appends count words to the constants. Returns the index of the
+/// first.
+static uint32_t add_consts(Compiler* cc, const VMValue* values,
+    uint32_t count);
+/// Copies value into slot unless it is already there.
+static void move_value(Compiler* cc, uint32_t slot, uint32_t value);
+/// Stores a constant as its canonical slot representation, lo and hi.
+static void const_slots(const IRFunction* ir, uint32_t value,
+    VMValue* lo, VMValue* hi);
+/// Returns true if value is a constant that fits an immediate, storing
+/// it in imm.
+static bool const_imm(const IRFunction* ir, uint32_t value, int32_t* imm);
+/// Returns true if a cast leaves the canonical representation unchanged.
+static bool is_noop_cast(TokenType from, TokenType to);
+/// Returns how values of the type are stored.
+static Kind type_kind(TokenType type);
+/// Returns the number of slots a value of the type takes.
+static uint32_t type_slots(TokenType type);
+
+BCModule* bc_compile(const IRModule* module) {
+    BCModule* result = calloc(1, sizeof(BCModule));
+    if (result == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for bytecode\n");
+        return NULL;
+    }
+
+    result->funcs = calloc(module->funcCount + 1, sizeof(BCFunction));
+    if (result->funcs == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(result);
+        return NULL;
+    }
+    result->funcCount = module->funcCount;
+
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        if (!compile_function(module, module->funcs[i],
+            &result->funcs[i])) {
+            free_bc_module(result);
+            return NULL;
+        }
+    }
+
+    return result;
+}
+
+void free_bc_module(BCModule* module) {
+    if (module == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        free(module->funcs[i].code);
+        free(module->funcs[i].consts);
+    }
+    free(module->funcs);
+    free(module);
+}
+
+void print_bc_module(const BCModule* module) {
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        const BCFunction* func = &module->funcs[i];
+        if (i > 0) {
+            printf("\n");
+        }
+        printf("fn %s (%u slots, %u consts)\n", func->name, func->frameSize,
+            func->constCount);
+
+        for (uint32_t pc = 0; pc < func->codeCount; pc++) {
+            const BCInst* inst = &func->code[pc];
+            printf("    %04u %-8s %u %u %u\n", pc,
+                bc_op_name((BCOp)inst->op), inst->a, inst->b, inst->c);
+        }
+    }
+}
+
+const char* bc_op_name(BCOp op) {
+    return op < BC_OP_COUNT ? opNames[op] : "UNKNOWN";
+}
+
+/* --- Helper Functions --- */
+
+static bool compile_function(const IRModule* module, IRFunction* ir,
+    BCFunction* out) {
+    Compiler cc = { 0 };
+    cc.module = module;
+    cc.ir = ir;
+    cc.out = out;
+    cc.ok = true;
+    out->name = ir->name;
+    out->returnType = ir->returnType;
+
+    cc.slots = malloc((ir->instCount + 1) * sizeof(uint32_t));
+    cc.uses = calloc(ir->instCount + 1, sizeof(uint32_t));
+    cc.blockPc = malloc((ir->blockCount + 1) * sizeof(uint32_t));
+    if (cc.slots == NULL || cc.uses == NULL || cc.blockPc == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        cc.ok = false;
+    }
+
+    if (cc.ok) {
+        for (uint32_t i = 0; i < ir->instCount; i++) {
+            uint32_t* ops;
+            uint32_t count = ir_get_operands(ir, &ir->insts[i], &ops);
+            for (uint32_t j = 0; j < count; j++) {
+                if (!ir_is_const(ops[j])) {
+                    cc.uses[ops[j]]++;
+                }
+            }
+        }
+        cc.ok = assign_slots(&cc);
+    }
+
+    for (uint32_t b = 0; cc.ok && b < ir->blockCount; b++) {
+        cc.blockPc[b] = out->codeCount;
+        uint32_t i = ir->blocks[b].start;
+        while (cc.ok && i < ir->blocks[b].end) {
+            i += compile_inst(&cc, i);
+        }
+    }
+
+    if (cc.ok && (out->codeCount > UINT16_MAX ||
+        out->constCount > UINT16_MAX)) {
+        fprintf(stderr, "Error: Function '%s' is too large for bytecode\n",
+            ir->name);
+        cc.ok = false;
+    }
+    for (uint32_t i = 0; cc.ok && i < cc.patchCount; i++) {
+        BCInst* inst = &out->code[cc.patches[i]];
+        inst->c = (uint16_t)cc.blockPc[inst->c];
+    }
+
+    free(cc.slots);
+    free(cc.uses);
+    free(cc.blockPc);
+    free(cc.patches);
+    return cc.ok;
+}
+
+static bool assign_slots(Compiler* cc) {
+    IRFunction* ir = cc->ir;
+    uint32_t next = 0;
+
+    uint32_t* paramSlots = malloc((ir->paramCount + 1) * sizeof(uint32_t));
+    if (paramSlots == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+    for (uint32_t i = 0; i < ir->paramCount; i++) {
+        paramSlots[i] = next;
+        next += type_slots(ir->paramTypes[i]);
+    }
+    cc->out->paramSlots = next;
+
+    for (uint32_t i = 0; i < ir->instCount; i++) {
+        const IRInst* inst = &ir->insts[i];
+        uint32_t arg = inst->args[0];
+        cc->slots[i] = IR_NONE;
+
+        if (inst->op == IR_PARAM) {
+            cc->slots[i] = paramSlots[arg];
+        } else if (inst->op == IR_CAST && !ir_is_const(arg) &&
+            ((inst->flags & IR_FLAG_EXACT) ||
+            is_noop_cast(ir_value_type(ir, arg), (TokenType)inst->type))) {
+            // Shares the slot of its operand, no code is needed
+            cc->slots[i] = cc->slots[arg];
+        } else if (inst->type != TOK_INVALID) {
+            cc->slots[i] = next;
+            next += type_slots((TokenType)inst->type);
+        }
+    }
+    free(paramSlots);
+
+    cc->scratch = next;
+    next += 4;
+    cc->out->frameSize = next;
+
+    // Outgoing arguments are placed right after the frame
+    uint32_t outgoing = 0;
+    for (uint32_t i = 0; i < ir->instCount; i++) {
+        if (ir->insts[i].op == IR_CALL) {
+            uint32_t callee = ir->operands[ir->insts[i].args[0]];
+            uint32_t argSlots = cc->module->funcs[callee]->paramCount * 2;
+            outgoing = argSlots > outgoing ? argSlots : outgoing;
+        }
+    }
+    cc->out->stackSize = next + outgoing;
+
+    if (cc->out->stackSize > UINT16_MAX) {
+        fprintf(stderr, "Error: Function '%s' has too many values for"\
+            " bytecode\n", ir->name);
+        return false;
+    }
+
+    return true;
+}
+
+static uint32_t compile_inst(Compiler* cc, uint32_t index) {
+    IRFunction* ir = cc->ir;
+    const IRInst* inst = &ir->insts[index];
+    TokenType type = (TokenType)inst->type;
+    uint32_t dst = cc->slots[index];
+    uint32_t block = ir_block_of(ir, index);
+    uint32_t nextBlock = block + 1;
+
+    switch ((IROp)inst->op) {
+        case IR_NOP:
+        case IR_PARAM:
+        case IR_PHI:
+            // Phis are filled by their predecessors
+            return 1;
+        case IR_ADD:
+        case IR_SUB: {
+            Kind kind = type_kind(type);
+            int32_t imm;
+            bool isSub = inst->op == IR_SUB;
+            if (addiOps[kind] != NO_OP &&
+                const_imm(ir, inst->args[1], &imm) &&
+                (!isSub || imm != INT16_MIN)) {
+                emit(cc, (BCOp)addiOps[kind], dst,
+                    operand(cc, inst->args[0], 0),
+                    (uint16_t)(int16_t)(isSub ? -imm : imm));
+                return 1;
+            }
+            if (!isSub && addiOps[kind] != NO_OP &&
+                const_imm(ir, inst->args[0], &imm)) {
+                emit(cc, (BCOp)addiOps[kind], dst,
+                    operand(cc, inst->args[1], 0), (uint16_t)(int16_t)imm);
+                return 1;
+            }
+            emit(cc, (BCOp)(isSub ? subOps[kind] : addOps[kind]), dst,
+                operand(cc, inst->args[0], 0), operand(cc, inst->args[1], 1));
+            return 1;
+        }
+        case IR_MUL:
+        case IR_DIV:
+        case IR_MOD: {
+            const uint16_t* ops = inst->op == IR_MUL ? mulOps :
+                inst->op == IR_DIV ? divOps : modOps;
+            emit(cc, (BCOp)ops[type_kind(type)], dst,
+                operand(cc, inst->args[0], 0), operand(cc, inst->args[1], 1));
+            return 1;
+        }
+        case IR_NEG:
+            emit(cc, (BCOp)negOps[type_kind(type)], dst,
+                operand(cc, inst->args[0], 0), 0);
+            return 1;
+        case IR_NOT:
+            emit(cc, BC_NOT, dst, operand(cc, inst->args[0], 0), 0);
+            return 1;
+        case IR_EQ:
+        case IR_NEQ:
+        case IR_LT:
+        case IR_LTE:
+        case IR_GT:
+        case IR_GTE: {
+            // A comparison only feeding the branch right after it becomes
+            // a single compare and jump
+            const IRInst* next = index + 1 < ir->blocks[block].end ?
+                &ir->insts[index + 1] : NULL;
+            Kind kind = type_kind(ir_value_type(ir, inst->args[0]));
+            if (next != NULL && next->op == IR_BR &&
+                next->args[0] == index && cc->uses[index] == 1 &&
+                kind <= KIND_U8) {
+                compile_compare(cc, inst, dst, next, nextBlock);
+                return 2;
+            }
+            compile_compare(cc, inst, dst, NULL, nextBlock);
+            return 1;
+        }
+        case IR_CAST: {
+            // A value that fits the new type is already stored as it
+            TokenType from = ir_value_type(ir, inst->args[0]);
+            bool noop = (inst->flags & IR_FLAG_EXACT) ||
+                is_noop_cast(from, type);
+            if (ir_is_const(inst->args[0]) && noop) {
+                load_const(cc, dst, inst->args[0]);
+            } else if (!noop) {
+                emit(cc, BC_CONV, dst, operand(cc, inst->args[0], 0),
+                    (uint32_t)from | (uint32_t)type << 8);
+            }
+            return 1;
+        }
+        case IR_CALL: {
+            const uint32_t* pool = ir->operands + inst->args[0];
+            const IRFunction* callee = cc->module->funcs[pool[0]];
+            uint32_t slot = cc->out->frameSize;
+            for (uint32_t i = 0; i < inst->args[1]; i++) {
+                move_value(cc, slot, pool[1 + i]);
+                slot += type_slots(callee->paramTypes[i]);
+            }
+            emit(cc, BC_CALL, dst == IR_NONE ? 0 : dst, pool[0],
+                cc->out->frameSize);
+            return 1;
+        }
+        case IR_JMP:
+            emit_phi_copies(cc, block, inst->args[0]);
+            if (inst->args[0] != nextBlock) {
+                emit_jump(cc, BC_JMP, 0, 0, inst->args[0]);
+            }
+            return 1;
+        case IR_BR: {
+            const uint32_t* targets = ir->operands + inst->args[1];
+            emit_phi_copies(cc, block, targets[0]);
+            emit_phi_copies(cc, block, targets[1]);
+
+            uint32_t cond = operand(cc, inst->args[0], 0);
+            if (targets[0] == nextBlock) {
+                emit_jump(cc, BC_JF, cond, 0, targets[1]);
+            } else {
+                emit_jump(cc, BC_JT, cond, 0, targets[0]);
+                if (targets[1] != nextBlock) {
+                    emit_jump(cc, BC_JMP, 0, 0, targets[1]);
+                }
+            }
+            return 1;
+        }
+        case IR_SWITCH:
+            compile_switch(cc, inst, block);
+            return 1;
+        case IR_RET:
+            if (inst->args[0] == IR_NONE) {
+                emit(cc, BC_RETV, 0, 0, 0);
+            } else {
+                emit(cc, type_slots(ir->returnType) == 2 ? BC_RET2 : BC_RET,
+                    operand(cc, inst->args[0], 0), 0, 0);
+            }
+            return 1;
+        default:
+            fprintf(stderr, "Error: Unsupported IR op '%s' in bytecode\n",
+                ir_op_name((IROp)inst->op));
+            cc->ok = false;
+            return 1;
+    }
+}
+
+static void compile_compare(Compiler* cc, const IRInst* inst, uint32_t dst,
+    const IRInst* branch, uint32_t nextBlock) {
+    IRFunction* ir = cc->ir;
+    Kind kind = type_kind(ir_value_type(ir, inst->args[0]));
+    IROp op = (IROp)inst->op;
+    uint32_t left = inst->args[0];
+    uint32_t right = inst->args[1];
+
+    uint32_t thenBlock = IR_NONE;
+    uint32_t elseBlock = IR_NONE;
+    if (branch != NULL) {
+        const uint32_t* targets = ir->operands + branch->args[1];
+        thenBlock = targets[0];
+        elseBlock = targets[1];
+        uint32_t block = ir_block_of(ir, (uint32_t)(branch - ir->insts));
+        emit_phi_copies(cc, block, thenBlock);
+        emit_phi_copies(cc, block, elseBlock);
+
+        // Jump on the negated condition when the then block follows,
+        // integer comparisons have exact negations
+        if (thenBlock == nextBlock) {
+            static const IROp negated[] = {
+                [IR_EQ] = IR_NEQ, [IR_NEQ] = IR_EQ, [IR_LT] = IR_GTE,
+                [IR_LTE] = IR_GT, [IR_GT] = IR_LTE, [IR_GTE] = IR_LT,
+            };
+            op = negated[op];
+            thenBlock = elseBlock;
+            elseBlock = nextBlock;
+        }
+    }
+
+    // Immediate forms compare signed 64-bit values, which holds for
+    // every kind narrower than 64 bits and for i64
+    int32_t imm;
+    bool immOk = kind <= KIND_U8 && kind != KIND_U64;
+    if (immOk && const_imm(ir, left, &imm) && !ir_is_const(right)) {
+        static const IROp swapped[] = {
+            [IR_EQ] = IR_EQ, [IR_NEQ] = IR_NEQ, [IR_LT] = IR_GT,
+            [IR_LTE] = IR_GTE, [IR_GT] = IR_LT, [IR_GTE] = IR_LTE,
+        };
+        op = swapped[op];
+        uint32_t tmp = left;
+        left = right;
+        right = tmp;
+    }
+    if (immOk && const_imm(ir, right, &imm)) {
+        static const uint16_t immOps[] = {
+            [IR_EQ] = BC_EQ_I, [IR_NEQ] = BC_NE_I, [IR_LT] = BC_LT_I,
+            [IR_LTE] = BC_LE_I, [IR_GT] = BC_GT_I, [IR_GTE] = BC_GE_I,
+        };
+        static const uint16_t jumpOps[] = {
+            [IR_EQ] = BC_JEQ_I, [IR_NEQ] = BC_JNE_I, [IR_LT] = BC_JLT_I,
+            [IR_LTE] = BC_JLE_I, [IR_GT] = BC_JGT_I, [IR_GTE] = BC_JGE_I,
+        };
+        uint32_t a = operand(cc, left, 0);
+        uint16_t b = (uint16_t)(int16_t)imm;
+        if (branch == NULL) {
+            emit(cc, (BCOp)immOps[op], dst, a, b);
+            return;
+        }
+        emit_jump(cc, (BCOp)jumpOps[op], a, b, thenBlock);
+        if (elseBlock != nextBlock) {
+            emit_jump(cc, BC_JMP, 0, 0, elseBlock);
+        }
+        return;
+    }
+
+    // Greater than is less than with the operands swapped
+    if (op == IR_GT || op == IR_GTE) {
+        op = op == IR_GT ? IR_LT : IR_LTE;
+        uint32_t tmp = left;
+        left = right;
+        right = tmp;
+    }
+    uint32_t a = operand(cc, left, 0);
+    uint32_t b = operand(cc, right, 1);
+
+    if (branch != NULL) {
+        bool isSigned = kind == KIND_I64 || kind == KIND_I32 ||
+            kind == KIND_I16 || kind == KIND_I8;
+        BCOp jump;
+        switch (op) {
+            case IR_EQ: jump = BC_JEQ; break;
+            case IR_NEQ: jump = BC_JNE; break;
+            case IR_LT: jump = isSigned ? BC_JLT_S : BC_JLT_U; break;
+            default: jump = isSigned ? BC_JLE_S : BC_JLE_U; break;
+        }
+        emit_jump(cc, jump, a, b, thenBlock);
+        if (elseBlock != nextBlock) {
+            emit_jump(cc, BC_JMP, 0, 0, elseBlock);
+        }
+        return;
+    }
+
+    // Rows are EQ, NEQ, LT, LTE for each comparison class
+    static const uint16_t classOps[5][4] = {
+        { BC_EQ, BC_NE, BC_LT_S, BC_LE_S },
+        { BC_EQ, BC_NE, BC_LT_U, BC_LE_U },
+        { BC_EQ_F, BC_NE_F, BC_LT_F, BC_LE_F },
+        { BC_EQ_128, BC_NE_128, BC_LT_S128, BC_LE_S128 },
+        { BC_EQ_128, BC_NE_128, BC_LT_U128, BC_LE_U128 },
+    };
+    int row;
+    switch (kind) {
+        case KIND_I64:
+        case KIND_I32:
+        case KIND_I16:
+        case KIND_I8:
+            row = 0;
+            break;
+        case KIND_F64:
+        case KIND_F32:
+            row = 2;
+            break;
+        case KIND_I128:
+            row = 3;
+            break;
+        case KIND_U128:
+            row = 4;
+            break;
+        default:
+            row = 1;
+            break;
+    }
+    int column = op == IR_EQ ? 0 : op == IR_NEQ ? 1 : op == IR_LT ? 2 : 3;
+    emit(cc, (BCOp)classOps[row][column], dst, a, b);
+}
+
+static void compile_switch(Compiler* cc, const IRInst* inst,
+    uint32_t block) {
+    IRFunction* ir = cc->ir;
+    const uint32_t* cases = ir->operands + inst->args[1];
+    uint32_t count = cases[0];
+    const uint32_t* targets = cases + 2;
+    const uint32_t* keys = cases + 2 + count;
+    for (uint32_t k = 0; k <= count; k++) {
+        emit_phi_copies(cc, block, cases[1 + k]);
+    }
+
+    uint32_t value = operand(cc, inst->args[0], 0);
+    VMValue* words = malloc((count + 1) * sizeof(VMValue));
+    if (words == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        cc->ok = false;
+        return;
+    }
+    for (uint32_t k = 0; k < count; k++) {
+        VMValue hi;
+        const_slots(ir, keys[k], &words[k], &hi);
+    }
+
+    if (ir_switch_is_dense(ir, inst)) {
+        // Keys missing from the range jump to the default block too
+        uint32_t span = (uint32_t)(words[count - 1].u - words[0].u) + 1;
+        emit(cc, BC_JTAB, value, add_consts(cc, words, 1), span);
+        emit_jump(cc, BC_JMP, 0, 0, cases[1]);
+        uint32_t next = 0;
+        for (uint32_t k = 0; k < span; k++) {
+            bool hit = words[next].u - words[0].u == k;
+            emit_jump(cc, BC_JMP, 0, 0, hit ? targets[next] : cases[1]);
+            next += hit ? 1 : 0;
+        }
+    } else {
+        // Narrower unsigned keys are zero extended, so only u64 needs an
+        // unsigned search
+        BCOp op = ir_value_type(ir, keys[0]) == TOK_U64 ? BC_JSEARCH_U :
+            BC_JSEARCH_S;
+        emit(cc, op, value, add_consts(cc, words, count), count);
+        emit_jump(cc, BC_JMP, 0, 0, cases[1]);
+        for (uint32_t k = 0; k < count; k++) {
+            emit_jump(cc, BC_JMP, 0, 0, targets[k]);
+        }
+    }
+    free(words);
+}
+
+static void emit_phi_copies(Compiler* cc, uint32_t block, uint32_t succ) {
+    IRFunction* ir = cc->ir;
+    uint32_t count;
+    IRMove* moves = ir_phi_moves(ir, block, succ, cc->slots, &count);
+    if (moves == NULL) {
+        cc->ok = false;
+        return;
+    }
+
+    // The first scratch pair holds a phi saved to break a cycle
+    for (uint32_t i = 0; i < count; i++) {
+        const IRMove* move = &moves[i];
+        uint32_t phi = move->dst != IR_NONE ? move->dst : move->src;
+        BCOp op = type_slots((TokenType)ir->insts[phi].type) == 2 ?
+            BC_MOV2 : BC_MOV;
+        if (move->dst == IR_NONE) {
+            emit(cc, op, cc->scratch, cc->slots[move->src], 0);
+        } else if (move->src == IR_NONE) {
+            emit(cc, op, cc->slots[move->dst], cc->scratch, 0);
+        } else {
+            move_value(cc, cc->slots[move->dst], move->src);
+        }
+    }
+    free(moves);
+}
+
+static void emit_jump(Compiler* cc, BCOp op, uint32_t a, uint32_t b,
+    uint32_t block) {
+    uint32_t index = emit(cc, op, a, b, block);
+    if (!cc->ok) {
+        return;
+    }
+
+    if (cc->patchCount == cc->patchCap) {
+        uint32_t newCap = cc->patchCap == 0 ? 16 : cc->patchCap * 2;
+        uint32_t* grown = realloc(cc->patches, newCap * sizeof(uint32_t));
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            cc->ok = false;
+            return;
+        }
+        cc->patches = grown;
+        cc->patchCap = newCap;
+    }
+    cc->patches[cc->patchCount++] = index;
+}
+
+static uint32_t emit(Compiler* cc, BCOp op, uint32_t a, uint32_t b,
+    uint32_t c) {
+    BCFunction* out = cc->out;
+    if (out->codeCount == cc->codeCap) {
+        uint32_t newCap = cc->codeCap == 0 ? 64 : cc->codeCap * 2;
+        BCInst* grown = realloc(out->code, newCap * sizeof(BCInst));
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            cc->ok = false;
+            return 0;
+        }
+        out->code = grown;
+        cc->codeCap = newCap;
+    }
+
+    BCInst* inst = &out->code[out->codeCount];
+    inst->op = (uint16_t)op;
+    inst->a = (uint16_t)a;
+    inst->b = (uint16_t)b;
+    inst->c = (uint16_t)c;
+    return out->codeCount++;
+}
+
+static uint32_t operand(Compiler* cc, uint32_t value, uint32_t which) {
+    if (!ir_is_const(value)) {
+        return cc->slots[value];
+    }
+
+    uint32_t slot = cc->scratch + which * 2;
+    load_const(cc, slot, value);
+    return slot;
+}
+
+static void load_const(Compiler* cc, uint32_t slot, uint32_t value) {
+    int32_t imm;
+    if (const_imm(cc->ir, value, &imm)) {
+        emit(cc, BC_LOADI, slot, (uint16_t)(int16_t)imm, 0);
+        return;
+    }
+
+    uint32_t wide = type_slots(ir_value_type(cc->ir, value));
+    VMValue words[2];
+    const_slots(cc->ir, value, &words[0], &words[1]);
+    emit(cc, wide == 2 ? BC_LOADK2 : BC_LOADK, slot,
+        add_consts(cc, words, wide), 0);
+}
+
+static uint32_t add_consts(Compiler* cc, const VMValue* values,
+    uint32_t count) {
+    BCFunction* out = cc->out;
+    if (out->constCount + count > cc->constCap) {
+        uint32_t newCap = cc->constCap == 0 ? 16 : cc->constCap * 2;
+        while (newCap < out->constCount + count) {
+            newCap *= 2;
+        }
+        VMValue* grown = realloc(out->consts, newCap * sizeof(VMValue));
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            cc->ok = false;
+            return 0;
+        }
+        out->consts = grown;
+        cc->constCap = newCap;
+    }
+
+    memcpy(&out->consts[out->constCount], values, count * sizeof(VMValue));
+    out->constCount += count;
+    return out->constCount - count;
+}
+
+static void move_value(Compiler* cc, uint32_t slot, uint32_t value) {
+    if (ir_is_const(value)) {
+        load_const(cc, slot, value);
+    } else if (cc->slots[value] != slot) {
+        bool wide = type_slots(ir_value_type(cc->ir, value)) == 2;
+        emit(cc, wide ? BC_MOV2 : BC_MOV, slot, cc->slots[value], 0);
+    }
+}
+
+static void const_slots(const IRFunction* ir, uint32_t value,
+    VMValue* lo, VMValue* hi) {
+    const IRConst* entry = ir_get_const(ir, value);
+    ConstValue constValue = ir_const_value(ir, value);
+    if (type_is_float(entry->type)) {
+        lo->f = constValue.f;
+        hi->u = 0;
+        return;
+    }
+
+    // Constants are stored wrapped to their type, so the low word is
+    // already sign or zero extended
+    lo->u = constValue.i.lo;
+    hi->u = constValue.i.hi;
+}
+
+static bool const_imm(const IRFunction* ir, uint32_t value, int32_t* imm) {
+    if (!ir_is_const(value)) {
+        return false;
+    }
+
+    TokenType type = ir_value_type(ir, value);
+    if (!type_is_integer(type) || type_slots(type) != 1) {
+        return false;
+    }
+
+    VMValue lo;
+    VMValue hi;
+    const_slots(ir, value, &lo, &hi);
+    if (lo.i < INT16_MIN || lo.i > INT16_MAX) {
+        return false;
+    }
+
+    *imm = (int32_t)lo.i;
+    return true;
+}
+
+static bool is_noop_cast(TokenType from, TokenType to) {
+    if (from == to) {
+        return true;
+    }
+    if (type_is_float(from) || type_is_float(to)) {
+        return from == TOK_F32 && to == TOK_F64;
+    }
+    if (to == TOK_BOOL && from != TOK_BOOL) {
+        return false;
+    }
+
+    size_t fromBits = from == TOK_BOOL ? 1 : type_bit_width(from);
+    size_t toBits = type_bit_width(to);
+    if (fromBits > 64 || toBits > 64) {
+        return false;
+    }
+
+    // Every canonical value reads correctly as a 64-bit value, and a
+    // narrower target keeps it when it is in range and extended the same
+    if (toBits == 64) {
+        return true;
+    }
+    if (from == TOK_BOOL || !type_is_signed(from)) {
+        return fromBits < toBits ||
+            (fromBits == toBits && !type_is_signed(to));
+    }
+
+    return type_is_signed(to) && fromBits <= toBits;
+}
+
+static Kind type_kind(TokenType type) {
+    switch (type) {
+        case TOK_I64: return KIND_I64;
+        case TOK_U64: return KIND_U64;
+        case TOK_I32: return KIND_I32;
+        case TOK_U32: return KIND_U32;
+        case TOK_I16: return KIND_I16;
+        case TOK_U16: return KIND_U16;
+        case TOK_I8: return KIND_I8;
+        case TOK_F64: return KIND_F64;
+        case TOK_F32: return KIND_F32;
+        case TOK_I128: return KIND_I128;
+        case TOK_U128: return KIND_U128;
+        default: return KIND_U8;
+    }
+}
+
+static uint32_t type_slots(TokenType type) {
+    return type == TOK_I128 || type == TOK_U128 ? 2 : 1;
+}
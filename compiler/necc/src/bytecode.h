@@ -0,0 +1,133 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ir.h"
+
+// Register based bytecode for the interpreter. Each function runs in a
+// window of 64-bit register slots. Integers up to 64 bits are kept sign
+// or zero extended to 64 bits by their own signedness, bool and char as
+// zero extended u8, f32 and f64 as a double (f32 rounded to single
+// precision) and i128/u128 in two consecutive slots, low word first.
+// Ops are specialised per width so every result is already in that
+// canonical form.
+//
+// Operands a, b and c are slot numbers relative to the window unless
+// noted. An imm operand is the field read as int16_t, and jump targets
+// are instruction indices within the function.
+
+/// The list of ops, expanded with a macro taking the op name.
+#define BC_OP_LIST(X) \
+    /* a = b, one or two slots */ \
+    X(MOV) X(MOV2) \
+    /* a = constant b, one or two slots */ \
+    X(LOADK) X(LOADK2) \
+    /* a = (int16_t)b */ \
+    X(LOADI) \
+    /* Arithmetic a = b op c, wrapped to the width */ \
+    X(ADD_64) X(ADD_I32) X(ADD_U32) X(ADD_I16) X(ADD_U16) X(ADD_I8) \
+    X(ADD_U8) X(ADD_F64) X(ADD_F32) X(ADD_128) \
+    X(SUB_64) X(SUB_I32) X(SUB_U32) X(SUB_I16) X(SUB_U16) X(SUB_I8) \
+    X(SUB_U8) X(SUB_F64) X(SUB_F32) X(SUB_128) \
+    X(MUL_64) X(MUL_I32) X(MUL_U32) X(MUL_I16) X(MUL_U16) X(MUL_I8) \
+    X(MUL_U8) X(MUL_F64) X(MUL_F32) X(MUL_128) \
+    /* Division and modulo panic on an integer zero divisor */ \
+    X(DIV_I64) X(DIV_I32) X(DIV_I16) X(DIV_I8) X(DIV_U64) X(DIV_F64) \
+    X(DIV_F32) X(DIV_I128) X(DIV_U128) \
+    X(MOD_I64) X(MOD_U64) X(MOD_F64) X(MOD_F32) X(MOD_I128) X(MOD_U128) \
+    /* a = b + imm */ \
+    X(ADDI_64) X(ADDI_I32) X(ADDI_U32) X(ADDI_I16) X(ADDI_U16) \
+    X(ADDI_I8) X(ADDI_U8) \
+    /* a = -b */ \
+    X(NEG_64) X(NEG_I32) X(NEG_U32) X(NEG_I16) X(NEG_U16) X(NEG_I8) \
+    X(NEG_U8) X(NEG_F) X(NEG_128) \
+    /* a = !b */ \
+    X(NOT) \
+    /* Comparisons a = b op c. S and U compare 64-bit signed and */ \
+    /* unsigned values, F doubles */ \
+    X(EQ) X(NE) X(EQ_F) X(NE_F) X(LT_S) X(LE_S) X(LT_U) X(LE_U) \
+    X(LT_F) X(LE_F) X(EQ_128) X(NE_128) X(LT_S128) X(LE_S128) \
+    X(LT_U128) X(LE_U128) \
+    /* Signed comparisons with an immediate a = b op imm c */ \
+    X(EQ_I) X(NE_I) X(LT_I) X(LE_I) X(GT_I) X(GE_I) \
+    /* a = (to)b where c is from | to << 8 as TokenTypes */ \
+    X(CONV) \
+    /* Jumps to c, conditional ones test a */ \
+    X(JMP) X(JT) X(JF) \
+    /* Compare and jump to c if a op b */ \
+    X(JEQ) X(JNE) X(JLT_S) X(JLE_S) X(JLT_U) X(JLE_U) \
+    /* Compare and jump to c if a op imm b */ \
+    X(JEQ_I) X(JNE_I) X(JLT_I) X(JLE_I) X(JGT_I) X(JGE_I) \
+    /* Multiway jumps on a, followed by the JMP to the default block */ \
+    /* and c more JMPs. JTAB takes JMP a - consts[b] of those, JSEARCH */ \
+    /* the one of the key equal to a among c ascending keys from */ \
+    /* consts[b] */ \
+    X(JTAB) X(JSEARCH_S) X(JSEARCH_U) \
+    /* Calls function b with a new window starting at slot c, which */ \
+    /* holds the arguments, and stores the result in a */ \
+    X(CALL) \
+    /* Returns a, one or two slots, or nothing */ \
+    X(RET) X(RET2) X(RETV)
+
+#define BC_ENUM_ENTRY(name) BC_##name,
+
+typedef enum BCOp {
+    BC_OP_LIST(BC_ENUM_ENTRY)
+    BC_OP_COUNT
+} BCOp;
+
+/// A single instruction, 8 bytes.
+typedef struct BCInst {
+    uint16_t op;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+} BCInst;
+
+/// A register slot.
+typedef union VMValue {
+    int64_t i;
+    uint64_t u;
+    double f;
+} VMValue;
+
+typedef struct BCFunction {
+    /// The name of the function, borrowed from the IR function.
+    const char* name;
+    /// The instructions.
+    BCInst* code;
+    uint32_t codeCount;
+    /// The constants loaded by LOADK and LOADK2.
+    VMValue* consts;
+    uint32_t constCount;
+    /// The number of slots the window needs, excluding outgoing call
+    /// arguments. Calls start the callee window at this slot.
+    uint32_t frameSize;
+    /// The number of slots including the outgoing call arguments.
+    uint32_t stackSize;
+    /// The number of slots holding the parameters, which start the
+    /// window.
+    uint32_t paramSlots;
+    /// The return type, TOK_INVALID for void functions.
+    TokenType returnType;
+} BCFunction;
+
+typedef struct BCModule {
+    /// The functions, in the order of the IR module.
+    BCFunction* funcs;
+    uint32_t funcCount;
+} BCModule;
+
+/// Compiles every function of a verified IR module to bytecode. The
+/// module must outlive the result, which borrows its names. Returns NULL
+/// on failure.
+BCModule* bc_compile(const IRModule* module);
+/// Frees a bytecode module. Safely handles NULL.
+void free_bc_module(BCModule* module);
+/// Prints a readable listing of the module.
+void print_bc_module(const BCModule* module);
+/// Returns the name of an op, such as "ADD_I32".
+const char* bc_op_name(BCOp op);
+
+#endif // BYTECODE_H
@@ -0,0 +1,255 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utf8.h"
+
+#ifndef _WIN32
+#define CACHE_STAT 1
+#include <sys/stat.h>
+#else
+#define CACHE_STAT 0
+#endif
+
+// A file is only read again when stat reports a different size, time or
+// inode, which is what build systems and editors change when they write
+// a file. Reading it again and finding the same bytes, as after a touch,
+// keeps everything built from it. New bytes are taken as one edit
+// replacing everything between the prefix and suffix the old and new
+// contents share, which is what a save after typing in one place gives.
+
+/// Reads a whole file into a null-terminated string, storing its length
+/// in len. Returns NULL on failure.
+static char* read_source(const char* path, size_t* len);
+/// Frees the tokens, tree and module built from an entry's source.
+static void clear_entry(CacheEntry* entry);
+/// Replaces the source of an entry with the len bytes of src, relexing
+/// its tokens over the bytes that differ. Takes ownership of src.
+static void edit_entry(CacheEntry* entry, char* src, size_t len);
+/// Frees an entry.
+static void free_entry(CacheEntry* entry);
+/// Stores the stat identity of path in entry. Returns false if the file
+/// cannot be stat'ed, or stat is not supported, leaving entry as it was.
+static bool stat_entry(const char* path, CacheEntry* entry);
+
+SourceCache* create_source_cache(void) {
+    SourceCache* cache = calloc(1, sizeof(SourceCache));
+    if (cache == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+    return cache;
+}
+
+void free_source_cache(SourceCache* cache) {
+    if (cache == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < cache->count; i++) {
+        free_entry(cache->entries[i]);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+CacheEntry* cache_load(SourceCache* cache, const char* path) {
+    CacheEntry* entry = NULL;
+    for (uint32_t i = 0; i < cache->count; i++) {
+        if (strcmp(cache->entries[i]->path, path) == 0) {
+            entry = cache->entries[i];
+            break;
+        }
+    }
+
+    CacheEntry current = { 0 };
+    bool hasStat = stat_entry(path, &current);
+    if (entry != NULL && hasStat && entry->device == current.device &&
+        entry->inode == current.inode && entry->size == current.size &&
+        entry->mtimeSec == current.mtimeSec &&
+        entry->mtimeNsec == current.mtimeNsec) {
+        cache->hits++;
+        return entry;
+    }
+
+    size_t len;
+    char* src = read_source(path, &len);
+    if (src == NULL) {
+        return NULL;
+    }
+    cache->misses++;
+
+    if (entry == NULL) {
+        if (cache->count == cache->cap) {
+            uint32_t newCap = cache->cap == 0 ? 8 : cache->cap * 2;
+            CacheEntry** grown = realloc(cache->entries,
+                newCap * sizeof(CacheEntry*));
+            if (grown == NULL) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                free(src);
+                return NULL;
+            }
+            cache->entries = grown;
+            cache->cap = newCap;
+        }
+        entry = calloc(1, sizeof(CacheEntry));
+        char* copy = malloc(strlen(path) + 1);
+        if (entry == NULL || copy == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            free(entry);
+            free(copy);
+            free(src);
+            return NULL;
+        }
+        strcpy(copy, path);
+        entry->path = copy;
+        cache->entries[cache->count++] = entry;
+    }
+
+    if (entry->src != NULL && entry->srcLen == len &&
+        memcmp(entry->src, src, len) == 0) {
+        free(src);
+    } else {
+        edit_entry(entry, src, len);
+    }
+    if (hasStat) {
+        entry->device = current.device;
+        entry->inode = current.inode;
+        entry->size = current.size;
+        entry->mtimeSec = current.mtimeSec;
+        entry->mtimeNsec = current.mtimeNsec;
+    }
+    return entry;
+}
+
+bool cache_set_module(CacheEntry* entry, IRModule* module, const char* key) {
+    char* copy = malloc(strlen(key) + 1);
+    if (copy == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free_ir_module(module);
+        return false;
+    }
+    strcpy(copy, key);
+    free_ir_module(entry->module);
+    free(entry->moduleKey);
+    entry->module = module;
+    entry->moduleKey = copy;
+    return true;
+}
+
+/* --- Helper Functions --- */
+
+static char* read_source(const char* path, size_t* len) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Failed to open input file '%s'\n", path);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < 0) {
+        fprintf(stderr, "Error: Failed to read input file '%s'\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    char* src = malloc((size_t)size + 1);
+    if (src == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        fclose(file);
+        return NULL;
+    }
+    *len = fread(src, 1, (size_t)size, file);
+    src[*len] = '\0';
+    fclose(file);
+
+    // Checked once here, relexing an edit can take the text as valid
+    if (!utf8_check(src, *len)) {
+        free(src);
+        return NULL;
+    }
+    return src;
+}
+
+static void clear_entry(CacheEntry* entry) {
+    free_token_stream(entry->tokens);
+    free_ast_node(entry->ast);
+    free_ir_module(entry->module);
+    free(entry->moduleKey);
+    entry->tokens = NULL;
+    entry->ast = NULL;
+    entry->stale = false;
+    entry->module = NULL;
+    entry->moduleKey = NULL;
+}
+
+static void edit_entry(CacheEntry* entry, char* src, size_t len) {
+    free_ir_module(entry->module);
+    free(entry->moduleKey);
+    entry->module = NULL;
+    entry->moduleKey = NULL;
+
+    size_t prefix = 0;
+    size_t suffix = 0;
+    if (entry->tokens != NULL) {
+        size_t shorter = entry->srcLen < len ? entry->srcLen : len;
+        while (prefix < shorter && entry->src[prefix] == src[prefix]) {
+            prefix++;
+        }
+        while (suffix < shorter - prefix &&
+            entry->src[entry->srcLen - suffix - 1] ==
+            src[len - suffix - 1]) {
+            suffix++;
+        }
+    }
+
+    // A tree already stale would need both edits, so it is parsed anew,
+    // as is everything when relexing fails
+    if (entry->stale) {
+        free_ast_node(entry->ast);
+        entry->ast = NULL;
+        entry->stale = false;
+    }
+    if (entry->tokens == NULL ||
+        !relex_token_stream(entry->tokens, prefix,
+            entry->srcLen - prefix - suffix, src + prefix,
+            len - prefix - suffix)) {
+        clear_entry(entry);
+    } else if (entry->ast != NULL) {
+        entry->stale = true;
+    }
+
+    free(entry->src);
+    entry->src = src;
+    entry->srcLen = len;
+}
+
+static void free_entry(CacheEntry* entry) {
+    clear_entry(entry);
+    free(entry->path);
+    free(entry->src);
+    free(entry);
+}
+
+static bool stat_entry(const char* path, CacheEntry* entry) {
+#if CACHE_STAT
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        return false;
+    }
+    entry->device = (uint64_t)info.st_dev;
+    entry->inode = (uint64_t)info.st_ino;
+    entry->size = (uint64_t)info.st_size;
+    entry->mtimeSec = (int64_t)info.st_mtim.tv_sec;
+    entry->mtimeNsec = (int64_t)info.st_mtim.tv_nsec;
+    return true;
+#else
+    (void)path;
+    (void)entry;
+    return false;
+#endif
+}
@@ -0,0 +1,66 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+#include "ir.h"
+#include "relex.h"
+
+/// A source file kept in memory by a long running compiler, with what
+/// was built from it.
+typedef struct CacheEntry {
+    /// A null-terminated copy of the path the file was read from.
+    char* path;
+    /// The device, inode, size and modification time of the file when it
+    /// was last checked, to tell when it needs to be read again.
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtimeSec;
+    int64_t mtimeNsec;
+    /// The null-terminated contents of the file.
+    char* src;
+    size_t srcLen;
+    /// The tokens of src, or NULL if it was not lexed yet. Tokens with
+    /// lexer errors are never kept, so the errors are printed each build.
+    TokenStream* tokens;
+    /// The syntax tree of src as parsed, before folding, or NULL if it
+    /// was not parsed yet. A stale tree was parsed before the edit
+    /// tokens->change describes and needs reparsing.
+    ASTNode* ast;
+    bool stale;
+    /// The optimized IR of ast, or NULL, and a null-terminated
+    /// description of the options it was built with.
+    IRModule* module;
+    char* moduleKey;
+} CacheEntry;
+
+typedef struct SourceCache {
+    CacheEntry** entries;
+    uint32_t count;
+    uint32_t cap;
+    /// Counts of lookups that found the file unchanged and lookups that
+    /// had to read it.
+    size_t hits;
+    size_t misses;
+} SourceCache;
+
+/// Creates an empty cache. Returns NULL if memory allocation fails.
+SourceCache* create_source_cache(void);
+/// Frees a cache with every file, tree and module in it. Safely handles
+/// NULL.
+void free_source_cache(SourceCache* cache);
+
+/// Returns the entry of the file at path. A file whose size, time or
+/// identity changed since it was last read is read again, and if its
+/// contents differ its module is dropped and its tokens are relexed
+/// over the bytes that changed, leaving its tree stale. Returns NULL if
+/// the file cannot be read.
+CacheEntry* cache_load(SourceCache* cache, const char* path);
+/// Replaces the module of an entry, taking ownership of module and
+/// copying key. Returns false on allocation failure, freeing module.
+bool cache_set_module(CacheEntry* entry, IRModule* module, const char* key);
+
+#endif // CACHE_H
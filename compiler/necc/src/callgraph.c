@@ -0,0 +1,327 @@
+#include "callgraph.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Tarjan's algorithm finishes a component only after every component
+// reachable from it, so the order it emits them in is already bottom-up.
+// The search keeps its own stack of functions and edge positions, deep
+// call chains cannot overflow the native stack. Levels are then found
+// in a single pass over the components, since those a component calls
+// into come before it.
+
+/// Collects the distinct callees of every function. Returns false on
+/// allocation failure.
+static bool collect_callees(CallGraph* graph, const IRModule* module);
+/// Finds the strongly connected components. Returns false on allocation
+/// failure.
+static bool find_components(CallGraph* graph);
+/// Groups the components by level. Returns false on allocation failure.
+static bool find_levels(CallGraph* graph);
+/// Returns true if an op other than a call has no side effects.
+static bool is_pure_op(IROp op);
+
+CallGraph* create_call_graph(const IRModule* module) {
+    CallGraph* graph = calloc(1, sizeof(CallGraph));
+    if (graph == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return NULL;
+    }
+    graph->funcCount = module->funcCount;
+
+    if (!collect_callees(graph, module) || !find_components(graph) ||
+        !find_levels(graph)) {
+        free_call_graph(graph);
+        return NULL;
+    }
+    return graph;
+}
+
+void free_call_graph(CallGraph* graph) {
+    if (graph == NULL) {
+        return;
+    }
+
+    free(graph->calleeStart);
+    free(graph->callees);
+    free(graph->sccStart);
+    free(graph->sccFuncs);
+    free(graph->sccOf);
+    free(graph->recursive);
+    free(graph->levelStart);
+    free(graph->levelSccs);
+    free(graph);
+}
+
+bool run_bottom_up(const CallGraph* graph, uint32_t threads, PoolTask task,
+    void* ctx) {
+    for (uint32_t level = 0; level < graph->levelCount; level++) {
+        uint32_t start = graph->levelStart[level];
+        if (!pool_run(graph->levelSccs + start,
+            graph->levelStart[level + 1] - start, threads, task, ctx)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool* find_pure_functions(const IRModule* module, const CallGraph* graph) {
+    bool* pure = malloc((module->funcCount + 1) * sizeof(bool));
+    if (pure == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return NULL;
+    }
+
+    // Calls inside a component are assumed pure, any impure instruction
+    // or callee below it makes the whole component impure
+    for (uint32_t scc = 0; scc < graph->sccCount; scc++) {
+        bool sccPure = true;
+        for (uint32_t i = graph->sccStart[scc]; sccPure &&
+            i < graph->sccStart[scc + 1]; i++) {
+            uint32_t index = graph->sccFuncs[i];
+            const IRFunction* func = module->funcs[index];
+            for (uint32_t j = 0; sccPure && j < func->instCount; j++) {
+                sccPure = is_pure_op((IROp)func->insts[j].op);
+            }
+            for (uint32_t j = graph->calleeStart[index]; sccPure &&
+                j < graph->calleeStart[index + 1]; j++) {
+                uint32_t callee = graph->callees[j];
+                sccPure = graph->sccOf[callee] == scc || pure[callee];
+            }
+        }
+        for (uint32_t i = graph->sccStart[scc]; i < graph->sccStart[scc + 1];
+            i++) {
+            pure[graph->sccFuncs[i]] = sccPure;
+        }
+    }
+    return pure;
+}
+
+void print_call_graph(const CallGraph* graph, const IRModule* module) {
+    for (uint32_t level = 0; level < graph->levelCount; level++) {
+        printf("level %u:\n", level);
+        for (uint32_t k = graph->levelStart[level];
+            k < graph->levelStart[level + 1]; k++) {
+            uint32_t scc = graph->levelSccs[k];
+            printf("    component %u%s:\n", scc,
+                graph->recursive[scc] ? " (recursive)" : "");
+            for (uint32_t i = graph->sccStart[scc];
+                i < graph->sccStart[scc + 1]; i++) {
+                uint32_t func = graph->sccFuncs[i];
+                printf("        %s", module->funcs[func]->name);
+                for (uint32_t e = graph->calleeStart[func];
+                    e < graph->calleeStart[func + 1]; e++) {
+                    printf("%s%s", e == graph->calleeStart[func] ?
+                        " -> " : ", ", module->funcs[graph->callees[e]]->name);
+                }
+                printf("\n");
+            }
+        }
+    }
+}
+
+/* --- Helper Functions --- */
+
+static bool collect_callees(CallGraph* graph, const IRModule* module) {
+    uint32_t n = graph->funcCount;
+    size_t total = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        total += module->funcs[i]->instCount;
+    }
+
+    // Every call adds at most one edge, so the instruction count bounds
+    // the edge count
+    graph->calleeStart = malloc((n + 1) * sizeof(uint32_t));
+    graph->callees = malloc((total + 1) * sizeof(uint32_t));
+    uint32_t* seen = malloc((n + 1) * sizeof(uint32_t));
+    if (graph->calleeStart == NULL || graph->callees == NULL ||
+        seen == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(seen);
+        return false;
+    }
+    memset(seen, 0xff, (n + 1) * sizeof(uint32_t));
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        const IRFunction* func = module->funcs[i];
+        graph->calleeStart[i] = count;
+        for (uint32_t j = 0; j < func->instCount; j++) {
+            const IRInst* inst = &func->insts[j];
+            if (inst->op != IR_CALL) {
+                continue;
+            }
+            uint32_t callee = func->operands[inst->args[0]];
+            if (seen[callee] != i) {
+                seen[callee] = i;
+                graph->callees[count++] = callee;
+            }
+        }
+    }
+    graph->calleeStart[n] = count;
+
+    free(seen);
+    return true;
+}
+
+static bool find_components(CallGraph* graph) {
+    uint32_t n = graph->funcCount;
+    graph->sccStart = malloc((n + 1) * sizeof(uint32_t));
+    graph->sccFuncs = malloc((n + 1) * sizeof(uint32_t));
+    graph->sccOf = malloc((n + 1) * sizeof(uint32_t));
+    graph->recursive = calloc(n + 1, sizeof(bool));
+    uint32_t* index = malloc((n + 1) * sizeof(uint32_t));
+    uint32_t* low = malloc((n + 1) * sizeof(uint32_t));
+    uint32_t* next = malloc((n + 1) * sizeof(uint32_t));
+    uint32_t* frames = malloc((n + 1) * sizeof(uint32_t));
+    uint32_t* stack = malloc((n + 1) * sizeof(uint32_t));
+    bool* onStack = calloc(n + 1, sizeof(bool));
+    bool ok = graph->sccStart != NULL && graph->sccFuncs != NULL &&
+        graph->sccOf != NULL && graph->recursive != NULL && index != NULL &&
+        low != NULL && next != NULL && frames != NULL && stack != NULL &&
+        onStack != NULL;
+    if (!ok) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+
+    uint32_t counter = 0;
+    uint32_t stackCount = 0;
+    uint32_t funcCount = 0;
+    graph->sccCount = 0;
+    if (ok) {
+        memset(index, 0xff, (n + 1) * sizeof(uint32_t));
+    }
+    for (uint32_t root = 0; ok && root < n; root++) {
+        if (index[root] != UINT32_MAX) {
+            continue;
+        }
+
+        uint32_t frameCount = 0;
+        frames[frameCount++] = root;
+        index[root] = low[root] = counter++;
+        next[root] = graph->calleeStart[root];
+        stack[stackCount++] = root;
+        onStack[root] = true;
+
+        while (frameCount > 0) {
+            uint32_t func = frames[frameCount - 1];
+            if (next[func] < graph->calleeStart[func + 1]) {
+                uint32_t callee = graph->callees[next[func]++];
+                if (index[callee] == UINT32_MAX) {
+                    frames[frameCount++] = callee;
+                    index[callee] = low[callee] = counter++;
+                    next[callee] = graph->calleeStart[callee];
+                    stack[stackCount++] = callee;
+                    onStack[callee] = true;
+                } else if (onStack[callee] && index[callee] < low[func]) {
+                    low[func] = index[callee];
+                }
+                continue;
+            }
+
+            frameCount--;
+            if (frameCount > 0 && low[func] < low[frames[frameCount - 1]]) {
+                low[frames[frameCount - 1]] = low[func];
+            }
+            if (low[func] != index[func]) {
+                continue;
+            }
+
+            // func is the root of a component, which is everything above
+            // it on the stack
+            uint32_t scc = graph->sccCount++;
+            graph->sccStart[scc] = funcCount;
+            uint32_t member;
+            do {
+                member = stack[--stackCount];
+                onStack[member] = false;
+                graph->sccOf[member] = scc;
+                graph->sccFuncs[funcCount++] = member;
+            } while (member != func);
+
+            bool recursive = funcCount - graph->sccStart[scc] > 1;
+            for (uint32_t i = graph->calleeStart[func];
+                !recursive && i < graph->calleeStart[func + 1]; i++) {
+                recursive = graph->callees[i] == func;
+            }
+            graph->recursive[scc] = recursive;
+        }
+    }
+    if (ok) {
+        graph->sccStart[graph->sccCount] = funcCount;
+    }
+
+    free(index);
+    free(low);
+    free(next);
+    free(frames);
+    free(stack);
+    free(onStack);
+    return ok;
+}
+
+static bool find_levels(CallGraph* graph) {
+    uint32_t n = graph->sccCount;
+    uint32_t* level = malloc((n + 1) * sizeof(uint32_t));
+    graph->levelStart = calloc(n + 2, sizeof(uint32_t));
+    graph->levelSccs = malloc((n + 1) * sizeof(uint32_t));
+    if (level == NULL || graph->levelStart == NULL ||
+        graph->levelSccs == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(level);
+        return false;
+    }
+
+    graph->levelCount = 0;
+    for (uint32_t scc = 0; scc < n; scc++) {
+        level[scc] = 0;
+        for (uint32_t i = graph->sccStart[scc]; i < graph->sccStart[scc + 1];
+            i++) {
+            uint32_t func = graph->sccFuncs[i];
+            for (uint32_t j = graph->calleeStart[func];
+                j < graph->calleeStart[func + 1]; j++) {
+                uint32_t callee = graph->sccOf[graph->callees[j]];
+                if (callee != scc && level[callee] + 1 > level[scc]) {
+                    level[scc] = level[callee] + 1;
+                }
+            }
+        }
+        if (level[scc] + 1 > graph->levelCount) {
+            graph->levelCount = level[scc] + 1;
+        }
+        graph->levelStart[level[scc] + 1]++;
+    }
+
+    // Filling in component order keeps each level bottom-up
+    for (uint32_t l = 0; l < graph->levelCount; l++) {
+        graph->levelStart[l + 1] += graph->levelStart[l];
+    }
+    for (uint32_t scc = 0; scc < n; scc++) {
+        graph->levelSccs[graph->levelStart[level[scc]]++] = scc;
+    }
+    for (uint32_t l = graph->levelCount; l > 0; l--) {
+        graph->levelStart[l] = graph->levelStart[l - 1];
+    }
+    graph->levelStart[0] = 0;
+
+    free(level);
+    return true;
+}
+
+static bool is_pure_op(IROp op) {
+    switch (op) {
+        case IR_NOP:
+        case IR_DIV:
+        case IR_MOD:
+        case IR_CALL:
+        case IR_JMP:
+        case IR_BR:
+        case IR_SWITCH:
+        case IR_RET:
+            // Division only panics, and calls are checked against their
+            // callee
+            return true;
+        default:
+            return ir_is_pure(op);
+    }
+}
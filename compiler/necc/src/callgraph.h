@@ -0,0 +1,65 @@
+#ifndef CALLGRAPH_H
+#define CALLGRAPH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ir.h"
+#include "pool.h"
+
+/// The calls between the functions of a module and its strongly
+/// connected components. Edge and component lists are stored in
+/// compressed sparse row form like IRCfg.
+typedef struct CallGraph {
+    uint32_t funcCount;
+    /// The distinct callees of function f are
+    /// callees[calleeStart[f], calleeStart[f + 1]).
+    uint32_t* calleeStart;
+    uint32_t* callees;
+
+    /// Components in bottom-up order, every component comes after the
+    /// components it calls into. The functions of component c are
+    /// sccFuncs[sccStart[c], sccStart[c + 1]).
+    uint32_t sccCount;
+    uint32_t* sccStart;
+    uint32_t* sccFuncs;
+    /// The component of each function.
+    uint32_t* sccOf;
+    /// True for components with a cycle, more than one function or a
+    /// function that calls itself.
+    bool* recursive;
+
+    /// Components by level, a component's level being one above the
+    /// highest level of the components it calls into. Components of the
+    /// same level never call each other. The components of level l are
+    /// levelSccs[levelStart[l], levelStart[l + 1]), in bottom-up order.
+    uint32_t levelCount;
+    uint32_t* levelStart;
+    uint32_t* levelSccs;
+} CallGraph;
+
+/// Builds the call graph of a module from its call instructions and
+/// finds its strongly connected components with an iterative Tarjan
+/// search. Returns NULL on failure.
+CallGraph* create_call_graph(const IRModule* module);
+/// Frees a call graph. Safely handles NULL.
+void free_call_graph(CallGraph* graph);
+/// Runs task on every component of the graph bottom-up, a level at a
+/// time, the components of a level spread over up to threads workers as
+/// pool_run() does. A task may change the functions of its component and
+/// read those of the components below it, which are finished. Returns
+/// false if a task failed, leaving the levels above it undone.
+bool run_bottom_up(const CallGraph* graph, uint32_t threads, PoolTask task,
+    void* ctx);
+/// Decides which functions of the module are pure, bottom-up over the
+/// components of its call graph. A function is pure if it only does
+/// arithmetic, control flow and calls of other pure functions, so a call
+/// of it with the same arguments gives the same result, unless it
+/// panics or never returns. Returns an array of funcCount flags, which
+/// the caller frees, or NULL on failure.
+bool* find_pure_functions(const IRModule* module, const CallGraph* graph);
+/// Prints the components of the graph level by level, bottom-up, with
+/// the callees of each of their functions. module names the functions
+/// and must be the one the graph was built from.
+void print_call_graph(const CallGraph* graph, const IRModule* module);
+
+#endif // CALLGRAPH_H
@@ -0,0 +1,414 @@
+#include "consteval.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "callgraph.h"
+#include "hash.h"
+#include "types.h"
+
+// The evaluator interprets IR directly, with the same constant
+// arithmetic the folder uses, so results are exactly what the program
+// would compute. It never touches the module while running and only
+// accepts functions made of instructions it knows to be free of side
+// effects, any other op added later makes its function impure.
+
+/// How deep evaluated calls may nest, deeper recursion is left for
+/// runtime.
+#define EVAL_MAX_DEPTH 256
+
+/// The result of a finished call.
+typedef struct MemoEntry {
+    uint32_t func;
+    /// Index of the first argument in the argument pool.
+    size_t args;
+    uint64_t hash;
+    ConstValue result;
+} MemoEntry;
+
+typedef struct Evaluator {
+    const IRModule* module;
+    /// True for functions that can be evaluated.
+    bool* pure;
+    /// Instructions left to run.
+    uint64_t steps;
+    uint32_t depth;
+
+    MemoEntry* entries;
+    uint32_t entryCount;
+    uint32_t entryCap;
+    ConstValue* argPool;
+    size_t argCount;
+    size_t argCap;
+    /// Open addressing table of entry indices plus one.
+    uint32_t* slots;
+    uint32_t slotCount;
+} Evaluator;
+
+/// Replaces the pure calls with constant arguments in a function and
+/// folds the instructions that become constant. Returns the number of
+/// calls replaced.
+static size_t fold_function(Evaluator* eval, IRFunction* func);
+/// Runs a pure function on constant arguments. Returns false if it could
+/// not be finished within the budget and nesting limit or would panic.
+static bool eval_call(Evaluator* eval, uint32_t index,
+    const ConstValue* args, ConstValue* result);
+/// Returns the value of an operand while evaluating func.
+static ConstValue value_of(const IRFunction* func, const ConstValue* values,
+    uint32_t value);
+/// Hashes the arguments of a call of func.
+static uint64_t hash_args(const IRFunction* func, uint32_t index,
+    const ConstValue* args);
+/// Returns true if both values of the type are the same.
+static bool same_value(ConstValue a, ConstValue b, TokenType type);
+/// Returns the remembered entry for the call, or NULL if there is none.
+static const MemoEntry* memo_find(const Evaluator* eval, uint32_t index,
+    const ConstValue* args, uint64_t hash);
+/// Remembers the result of a call. Failing to only costs speed.
+static void memo_add(Evaluator* eval, uint32_t index, const ConstValue* args,
+    uint64_t hash, ConstValue result);
+
+size_t evaluate_pure_calls(IRModule* module, uint64_t steps,
+    uint64_t* used) {
+    if (steps == 0 || module->funcCount == 0) {
+        return 0;
+    }
+    CallGraph* graph = create_call_graph(module);
+    if (graph == NULL) {
+        return 0;
+    }
+
+    Evaluator eval;
+    memset(&eval, 0, sizeof(Evaluator));
+    eval.module = module;
+    eval.steps = steps;
+    size_t replaced = 0;
+    eval.pure = find_pure_functions(module, graph);
+    if (eval.pure != NULL) {
+        // Callees come first, so their bodies are already folded when
+        // their callers evaluate them
+        for (uint32_t i = 0; i < graph->sccStart[graph->sccCount]; i++) {
+            replaced += fold_function(&eval,
+                module->funcs[graph->sccFuncs[i]]);
+        }
+    }
+    *used += steps - eval.steps;
+
+    free_call_graph(graph);
+    free(eval.pure);
+    free(eval.entries);
+    free(eval.argPool);
+    free(eval.slots);
+    return replaced;
+}
+
+/* --- Helper Functions --- */
+
+static size_t fold_function(Evaluator* eval, IRFunction* func) {
+    ConstValue* args = malloc((func->operandCount + 1) * sizeof(ConstValue));
+    if (args == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 0;
+    }
+
+    size_t replaced = 0;
+    bool changed = false;
+    for (uint32_t i = 0; i < func->instCount; i++) {
+        IRInst* inst = &func->insts[i];
+        IROp op = (IROp)inst->op;
+        TokenType type = (TokenType)inst->type;
+        ConstValue result;
+        bool constant = false;
+
+        if (op == IR_CALL) {
+            const uint32_t* pool = func->operands + inst->args[0];
+            constant = eval->pure[pool[0]];
+            for (uint32_t k = 0; constant && k < inst->args[1]; k++) {
+                constant = ir_is_const(pool[1 + k]);
+                if (constant) {
+                    args[k] = ir_const_value(func, pool[1 + k]);
+                }
+            }
+            constant = constant && eval_call(eval, pool[0], args, &result);
+            replaced += constant ? 1 : 0;
+        } else if ((ir_is_binary(op) || op == IR_NEG || op == IR_NOT ||
+            op == IR_CAST) && ir_is_const(inst->args[0]) &&
+            (!ir_is_binary(op) || ir_is_const(inst->args[1]))) {
+            ConstValue a = ir_const_value(func, inst->args[0]);
+            ConstValue b = ir_is_binary(op) ?
+                ir_const_value(func, inst->args[1]) : a;
+            constant = ir_eval_op(op, type, ir_value_type(func,
+                inst->args[0]), a, b, &result);
+        }
+        if (!constant) {
+            continue;
+        }
+
+        // Later instructions see the constant, so results chain
+        if (type != TOK_INVALID) {
+            uint32_t value = ir_const(func, type, result);
+            if (value == IR_NONE) {
+                continue;
+            }
+            ir_replace_uses(func, i, value);
+        }
+        inst->op = IR_NOP;
+        changed = true;
+    }
+
+    free(args);
+    if (changed && !ir_compact(func)) {
+        return 0;
+    }
+    return replaced;
+}
+
+static bool eval_call(Evaluator* eval, uint32_t index,
+    const ConstValue* args, ConstValue* result) {
+    const IRFunction* func = eval->module->funcs[index];
+    uint64_t hash = hash_args(func, index, args);
+    const MemoEntry* entry = memo_find(eval, index, args, hash);
+    if (entry != NULL) {
+        *result = entry->result;
+        return true;
+    }
+    if (eval->depth >= EVAL_MAX_DEPTH) {
+        return false;
+    }
+
+    // Scratch space for phi inputs and call arguments, neither of which
+    // can outnumber the operand pool
+    ConstValue* values = malloc((func->instCount + 1) * sizeof(ConstValue));
+    ConstValue* scratch = malloc((func->operandCount + 1) *
+        sizeof(ConstValue));
+    if (values == NULL || scratch == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(values);
+        free(scratch);
+        return false;
+    }
+
+    eval->depth++;
+    uint32_t block = 0;
+    uint32_t prev = IR_NONE;
+    bool ok = true;
+    bool done = false;
+    while (ok && !done) {
+        const IRBlock* range = &func->blocks[block];
+        uint32_t next = IR_NONE;
+
+        // Phis read all their inputs before any of them is written
+        uint32_t i = range->start;
+        for (; i < range->end && func->insts[i].op == IR_PHI; i++) {
+            const IRInst* phi = &func->insts[i];
+            const uint32_t* pool = func->operands + phi->args[0];
+            for (uint32_t k = 0; k < phi->args[1]; k++) {
+                if (pool[k] == prev) {
+                    scratch[i - range->start] = value_of(func, values,
+                        pool[phi->args[1] + k]);
+                    break;
+                }
+            }
+        }
+        for (uint32_t j = range->start; j < i; j++) {
+            values[j] = scratch[j - range->start];
+        }
+
+        for (; ok && next == IR_NONE && !done && i < range->end; i++) {
+            if (eval->steps == 0) {
+                ok = false;
+                break;
+            }
+            eval->steps--;
+
+            const IRInst* inst = &func->insts[i];
+            IROp op = (IROp)inst->op;
+            switch (op) {
+                case IR_NOP:
+                    break;
+                case IR_PARAM:
+                    values[i] = args[inst->args[0]];
+                    break;
+                case IR_CALL: {
+                    const uint32_t* pool = func->operands + inst->args[0];
+                    for (uint32_t k = 0; k < inst->args[1]; k++) {
+                        scratch[k] = value_of(func, values, pool[1 + k]);
+                    }
+                    ok = eval->pure[pool[0]] &&
+                        eval_call(eval, pool[0], scratch, &values[i]);
+                    break;
+                }
+                case IR_JMP:
+                    next = inst->args[0];
+                    break;
+                case IR_BR: {
+                    ConstValue cond = value_of(func, values, inst->args[0]);
+                    next = func->operands[inst->args[1] +
+                        (i128_is_zero(cond.i) ? 1 : 0)];
+                    break;
+                }
+                case IR_SWITCH: {
+                    const uint32_t* cases = func->operands + inst->args[1];
+                    ConstValue key = value_of(func, values, inst->args[0]);
+                    next = cases[1];
+                    for (uint32_t k = 0; k < cases[0]; k++) {
+                        if (i128_eq(key.i, ir_const_value(func,
+                            cases[2 + cases[0] + k]).i)) {
+                            next = cases[2 + k];
+                            break;
+                        }
+                    }
+                    break;
+                }
+                case IR_RET:
+                    memset(result, 0, sizeof(ConstValue));
+                    if (inst->args[0] != IR_NONE) {
+                        *result = value_of(func, values, inst->args[0]);
+                    }
+                    done = true;
+                    break;
+                default: {
+                    ConstValue a = value_of(func, values, inst->args[0]);
+                    ConstValue b = ir_is_binary(op) ?
+                        value_of(func, values, inst->args[1]) : a;
+                    ok = ir_eval_op(op, (TokenType)inst->type,
+                        ir_value_type(func, inst->args[0]), a, b,
+                        &values[i]);
+                    break;
+                }
+            }
+        }
+        prev = block;
+        block = next;
+    }
+    eval->depth--;
+
+    free(values);
+    free(scratch);
+    if (ok) {
+        memo_add(eval, index, args, hash, *result);
+    }
+    return ok;
+}
+
+static ConstValue value_of(const IRFunction* func, const ConstValue* values,
+    uint32_t value) {
+    return ir_is_const(value) ? ir_const_value(func, value) : values[value];
+}
+
+static uint64_t hash_args(const IRFunction* func, uint32_t index,
+    const ConstValue* args) {
+    // The function index and the bits of each argument
+    uint64_t hash = HASH_SEED;
+    uint64_t words[2] = { index, 0 };
+    for (uint32_t k = 0; k <= func->paramCount; k++) {
+        if (k > 0 && type_is_float(func->paramTypes[k - 1])) {
+            memcpy(&words[0], &args[k - 1].f, sizeof(double));
+            words[1] = 0;
+        } else if (k > 0) {
+            words[0] = args[k - 1].i.lo;
+            words[1] = args[k - 1].i.hi;
+        }
+        hash = hash_bytes(hash, words, sizeof(words));
+    }
+    return hash;
+}
+
+static bool same_value(ConstValue a, ConstValue b, TokenType type) {
+    if (type_is_float(type)) {
+        // Bitwise, so -0.0 and 0.0 stay apart
+        return memcmp(&a.f, &b.f, sizeof(double)) == 0;
+    }
+    return i128_eq(a.i, b.i);
+}
+
+static const MemoEntry* memo_find(const Evaluator* eval, uint32_t index,
+    const ConstValue* args, uint64_t hash) {
+    if (eval->slotCount == 0) {
+        return NULL;
+    }
+
+    const IRFunction* func = eval->module->funcs[index];
+    uint32_t mask = eval->slotCount - 1;
+    for (uint32_t slot = (uint32_t)hash & mask; eval->slots[slot] != 0;
+        slot = (slot + 1) & mask) {
+        const MemoEntry* entry = &eval->entries[eval->slots[slot] - 1];
+        if (entry->hash != hash || entry->func != index) {
+            continue;
+        }
+        bool same = true;
+        for (uint32_t k = 0; same && k < func->paramCount; k++) {
+            same = same_value(eval->argPool[entry->args + k], args[k],
+                func->paramTypes[k]);
+        }
+        if (same) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void memo_add(Evaluator* eval, uint32_t index, const ConstValue* args,
+    uint64_t hash, ConstValue result) {
+    uint32_t paramCount = eval->module->funcs[index]->paramCount;
+    if (eval->entryCount == eval->entryCap) {
+        uint32_t cap = eval->entryCap == 0 ? 64 : eval->entryCap * 2;
+        MemoEntry* entries = realloc(eval->entries, cap * sizeof(MemoEntry));
+        if (entries == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return;
+        }
+        eval->entries = entries;
+        eval->entryCap = cap;
+    }
+    if (eval->argCount + paramCount > eval->argCap) {
+        size_t cap = eval->argCap == 0 ? 256 : eval->argCap * 2;
+        while (cap < eval->argCount + paramCount) {
+            cap *= 2;
+        }
+        ConstValue* pool = realloc(eval->argPool, cap * sizeof(ConstValue));
+        if (pool == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return;
+        }
+        eval->argPool = pool;
+        eval->argCap = cap;
+    }
+
+    // Kept at most half full
+    if ((eval->entryCount + 1) * 2 > eval->slotCount) {
+        uint32_t count = eval->slotCount == 0 ? 128 : eval->slotCount * 2;
+        uint32_t* slots = calloc(count, sizeof(uint32_t));
+        if (slots == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return;
+        }
+        for (uint32_t i = 0; i < eval->entryCount; i++) {
+            uint32_t slot = (uint32_t)eval->entries[i].hash & (count - 1);
+            while (slots[slot] != 0) {
+                slot = (slot + 1) & (count - 1);
+            }
+            slots[slot] = i + 1;
+        }
+        free(eval->slots);
+        eval->slots = slots;
+        eval->slotCount = count;
+    }
+
+    MemoEntry* entry = &eval->entries[eval->entryCount];
+    entry->func = index;
+    entry->args = eval->argCount;
+    entry->hash = hash;
+    entry->result = result;
+    if (paramCount > 0) {
+        memcpy(&eval->argPool[eval->argCount], args,
+            paramCount * sizeof(ConstValue));
+    }
+    eval->argCount += paramCount;
+
+    uint32_t mask = eval->slotCount - 1;
+    uint32_t slot = (uint32_t)hash & mask;
+    while (eval->slots[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    eval->slots[slot] = ++eval->entryCount;
+}
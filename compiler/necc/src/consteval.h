@@ -0,0 +1,27 @@
+#ifndef CONSTEVAL_H
+#define CONSTEVAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ir.h"
+
+/// The default number of instructions compile time evaluation may run
+/// for the whole module.
+#define CONSTEVAL_STEPS 100000
+
+/// Replaces calls of pure functions with constant arguments by their
+/// results, computed by interpreting the IR at compile time. A function
+/// is pure if it only does arithmetic, control flow and calls of other
+/// pure functions, which the call graph's components decide bottom-up.
+/// The interpreter works on its own copies of the values, gives up on
+/// anything that would panic at runtime, such as division by zero, and
+/// remembers the result of every call it finishes by function and
+/// arguments. Instructions whose operands become constant are folded so
+/// results feed further calls. All evaluation shares a budget of steps
+/// instructions, once it is spent the remaining calls are left for
+/// runtime. A budget of 0 disables the pass. Returns the number of calls
+/// that were replaced and adds the instructions run to used.
+size_t evaluate_pure_calls(IRModule* module, uint64_t steps,
+    uint64_t* used);
+
+#endif // CONSTEVAL_H
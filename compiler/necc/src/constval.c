@@ -0,0 +1,180 @@
+#include "constval.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+
+bool const_from_literal(const ASTNode* node, TokenType type,
+    ConstValue* out) {
+    const char* text = node->data.literal.value;
+    ConstValue value = { { 0, 0 }, 0.0 };
+
+    switch (node->data.literal.type) {
+        case TOK_INT_LIT:
+            if (!i128_parse(text, &value.i)) {
+                return false;
+            }
+            if (type_is_float(type)) {
+                value.f = i128_to_double(value.i, true);
+                if (type == TOK_F32) {
+                    value.f = (double)(float)value.f;
+                }
+                value.i = i128_from_u64(0);
+            } else if (!type_is_integer(type) || type == TOK_BOOL) {
+                return false;
+            } else {
+                value.i = i128_wrap(value.i, type);
+            }
+            break;
+        case TOK_FLOAT_LIT:
+            if (!type_is_float(type)) {
+                return false;
+            }
+            value.f = strtod(text, NULL);
+            if (type == TOK_F32) {
+                value.f = (double)(float)value.f;
+            }
+            break;
+        case TOK_BOOL_LIT:
+            value.i = i128_from_u64(!strcmp(text, "true") ? 1 : 0);
+            return const_convert(value, TOK_BOOL, type, false, out);
+        case TOK_CHAR_LIT:
+            value.i = i128_from_u64((unsigned char)text[0]);
+            return const_convert(value, TOK_CHAR, type, false, out);
+        default:
+            return false;
+    }
+
+    *out = value;
+    return true;
+}
+
+bool const_convert(ConstValue value, TokenType from, TokenType to,
+    bool isExplicit, ConstValue* out) {
+    if (!isExplicit && !type_is_lossless(from, to)) {
+        return false;
+    }
+
+    ConstValue result = { { 0, 0 }, 0.0 };
+    if (type_is_float(from)) {
+        if (type_is_float(to)) {
+            result.f = to == TOK_F32 ? (double)(float)value.f : value.f;
+        } else if (to == TOK_BOOL) {
+            result.i = i128_from_u64(value.f != 0.0 ? 1 : 0);
+        } else if (!type_is_integer(to) ||
+            !i128_from_double(value.f, to, &result.i)) {
+            return false;
+        }
+    } else if (type_is_float(to)) {
+        result.f = i128_to_double(value.i, type_is_signed(from));
+        if (to == TOK_F32) {
+            result.f = (double)(float)result.f;
+        }
+    } else if (type_is_integer(to)) {
+        result.i = i128_wrap(value.i, to);
+    } else {
+        return false;
+    }
+
+    *out = result;
+    return true;
+}
+
+bool const_arith(TokenType op, ConstValue a, ConstValue b,
+    TokenType type, ConstValue* out) {
+    ConstValue result = { { 0, 0 }, 0.0 };
+
+    if (type_is_float(type)) {
+        switch (op) {
+            case TOK_ADD: result.f = a.f + b.f; break;
+            case TOK_SUB: result.f = a.f - b.f; break;
+            case TOK_MUL: result.f = a.f * b.f; break;
+            case TOK_DIV: result.f = a.f / b.f; break;
+            case TOK_MOD: result.f = fmod(a.f, b.f); break;
+            default: return false;
+        }
+        if (type == TOK_F32) {
+            result.f = (double)(float)result.f;
+        }
+        *out = result;
+        return true;
+    }
+
+    bool isSigned = type_is_signed(type);
+    switch (op) {
+        case TOK_ADD: result.i = i128_add(a.i, b.i); break;
+        case TOK_SUB: result.i = i128_sub(a.i, b.i); break;
+        case TOK_MUL: result.i = i128_mul(a.i, b.i); break;
+        case TOK_DIV:
+        case TOK_MOD: {
+            if (i128_is_zero(b.i)) {
+                return false;
+            }
+            Int128 rem;
+            Int128 quot = isSigned ? i128_sdivmod(a.i, b.i, &rem) :
+                i128_udivmod(a.i, b.i, &rem);
+            result.i = op == TOK_DIV ? quot : rem;
+            break;
+        }
+        default:
+            return false;
+    }
+
+    result.i = i128_wrap(result.i, type);
+    *out = result;
+    return true;
+}
+
+bool const_compare(TokenType op, ConstValue a, ConstValue b,
+    TokenType type) {
+    if (type_is_float(type)) {
+        switch (op) {
+            case TOK_EQ: return a.f == b.f;
+            case TOK_NEQ: return a.f != b.f;
+            case TOK_LT: return a.f < b.f;
+            case TOK_LTE: return a.f <= b.f;
+            case TOK_GT: return a.f > b.f;
+            case TOK_GTE: return a.f >= b.f;
+            default: return false;
+        }
+    }
+
+    bool isSigned = type_is_signed(type);
+    bool less = isSigned ? i128_slt(a.i, b.i) : i128_ult(a.i, b.i);
+    bool equal = i128_eq(a.i, b.i);
+    switch (op) {
+        case TOK_EQ: return equal;
+        case TOK_NEQ: return !equal;
+        case TOK_LT: return less;
+        case TOK_LTE: return less || equal;
+        case TOK_GT: return !less && !equal;
+        case TOK_GTE: return !less;
+        default: return false;
+    }
+}
+
+ASTNode* const_to_literal(ConstValue value, TokenType type, size_t line,
+    size_t column) {
+    char buf[64];
+
+    if (type == TOK_BOOL) {
+        return create_literal_node(line, column, TOK_BOOL_LIT,
+            i128_is_zero(value.i) ? "false" : "true");
+    }
+
+    if (type_is_float(type)) {
+        if (!isfinite(value.f)) {
+            return NULL;
+        }
+        snprintf(buf, sizeof(buf), type == TOK_F32 ? "%.9g" : "%.17g",
+            value.f);
+        if (strpbrk(buf, ".e") == NULL) {
+            strcat(buf, ".0");
+        }
+        return create_literal_node(line, column, TOK_FLOAT_LIT, buf);
+    }
+
+    return create_literal_node(line, column, TOK_INT_LIT,
+        i128_to_str(value.i, type_is_signed(type), buf));
+}
@@ -0,0 +1,42 @@
+#ifndef CONSTVAL_H
+#define CONSTVAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "ast.h"
+#include "int128.h"
+#include "token.h"
+
+/// A compile time value. Integers, bool and char use i, which is kept
+/// wrapped to the width of its type. Floats use f, f32 values are kept
+/// rounded to single precision.
+typedef struct ConstValue {
+    Int128 i;
+    double f;
+} ConstValue;
+
+/// Evaluates a literal node in the given type. Integer literals wrap
+/// into the type. Returns false if the literal cannot implicitly take
+/// that type.
+bool const_from_literal(const ASTNode* node, TokenType type,
+    ConstValue* out);
+/// Converts a value from one type to another. Explicit conversions
+/// follow the cast semantics, implicit ones must be lossless. Returns
+/// false if the conversion is not allowed or cannot be done at compile
+/// time, such as a float that does not fit the target integer type.
+bool const_convert(ConstValue value, TokenType from, TokenType to,
+    bool isExplicit, ConstValue* out);
+/// Applies an arithmetic operator in the given type. Returns false on
+/// integer division by zero.
+bool const_arith(TokenType op, ConstValue a, ConstValue b, TokenType type,
+    ConstValue* out);
+/// Applies a comparison operator to two values of the given type.
+bool const_compare(TokenType op, ConstValue a, ConstValue b,
+    TokenType type);
+/// Creates a literal node holding the value in the given type. Returns
+/// NULL if the value has no literal form, such as a float that is not
+/// finite, or on allocation failure.
+ASTNode* const_to_literal(ConstValue value, TokenType type, size_t line,
+    size_t column);
+
+#endif // CONSTVAL_H
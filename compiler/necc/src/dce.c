@@ -0,0 +1,302 @@
+#include "dce.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "callgraph.h"
+
+// Each function is cleaned in three steps that feed each other: folding
+// constant branches cuts edges, cutting edges leaves blocks unreachable,
+// and removing blocks drops the uses their instructions made. Liveness
+// is then marked from the instructions with side effects backwards
+// through operands, so whatever is not marked has no effect on the
+// program. Functions are removed last, once the calls in removed code
+// are gone.
+
+/// Cleans a function, adding what was removed to stats.
+static void clean_function(IRFunction* func, DeadCodeStats* stats);
+/// Turns branches and switches on constants into jumps. Returns the
+/// number folded.
+static size_t fold_branches(IRFunction* func);
+/// Removes the inputs of the phis of block coming from pred.
+static void drop_phi_inputs(IRFunction* func, uint32_t block, uint32_t pred);
+/// Removes the blocks the entry does not reach. Returns the number
+/// removed, or 0 on failure.
+static size_t remove_unreachable(IRFunction* func);
+/// Replaces phis left with a single input from a block that is still
+/// there by that input.
+static void forward_phis(IRFunction* func);
+/// Removes the instructions no side effect depends on. Returns false on
+/// allocation failure.
+static bool remove_dead_values(IRFunction* func);
+/// Returns true if the instruction must stay even if its value is
+/// unused.
+static bool has_effect(const IRFunction* func, const IRInst* inst);
+/// Removes the functions main does not reach. Returns the number
+/// removed.
+static size_t remove_unused_functions(IRModule* module);
+
+void eliminate_dead_code(IRModule* module, DeadCodeStats* stats) {
+    memset(stats, 0, sizeof(DeadCodeStats));
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        eliminate_function_dead_code(module->funcs[i], stats);
+    }
+    stats->funcs = remove_unused_functions(module);
+}
+
+void eliminate_function_dead_code(IRFunction* func, DeadCodeStats* stats) {
+    clean_function(func, stats);
+}
+
+/* --- Helper Functions --- */
+
+static void clean_function(IRFunction* func, DeadCodeStats* stats) {
+    size_t before = 0;
+    for (uint32_t i = 0; i < func->instCount; i++) {
+        before += func->insts[i].op != IR_NOP;
+    }
+
+    stats->branches += fold_branches(func);
+    stats->blocks += remove_unreachable(func);
+    forward_phis(func);
+    if (!remove_dead_values(func) || !ir_compact(func)) {
+        return;
+    }
+    stats->insts += before - func->instCount;
+}
+
+static size_t fold_branches(IRFunction* func) {
+    size_t folded = 0;
+    for (uint32_t b = 0; b < func->blockCount; b++) {
+        if (func->blocks[b].start == IR_NONE) {
+            continue;
+        }
+        IRInst* inst = &func->insts[func->blocks[b].end - 1];
+        if ((inst->op != IR_BR && inst->op != IR_SWITCH) ||
+            !ir_is_const(inst->args[0])) {
+            continue;
+        }
+
+        uint32_t* succs;
+        uint32_t count = ir_get_successors(func, inst, &succs);
+        Int128 bits = ir_get_const(func, inst->args[0])->bits;
+        uint32_t target;
+        if (inst->op == IR_BR) {
+            target = succs[i128_is_zero(bits) ? 1 : 0];
+        } else {
+            // The default block comes first, then the cases
+            const uint32_t* pool = func->operands + inst->args[1];
+            target = succs[0];
+            for (uint32_t k = 0; k < pool[0]; k++) {
+                if (i128_eq(ir_get_const(func, pool[2 + pool[0] + k])->bits,
+                    bits)) {
+                    target = pool[2 + k];
+                }
+            }
+        }
+
+        for (uint32_t k = 0; k < count; k++) {
+            if (succs[k] != target) {
+                drop_phi_inputs(func, succs[k], b);
+            }
+        }
+        inst->op = IR_JMP;
+        inst->args[0] = target;
+        inst->args[1] = 0;
+        folded++;
+    }
+    return folded;
+}
+
+static void drop_phi_inputs(IRFunction* func, uint32_t block,
+    uint32_t pred) {
+    for (uint32_t i = func->blocks[block].start;
+        i < func->blocks[block].end && func->insts[i].op == IR_PHI; i++) {
+        IRInst* phi = &func->insts[i];
+        uint32_t* pool = func->operands + phi->args[0];
+        uint32_t count = phi->args[1];
+
+        // The last input takes the place of the dropped one, then the
+        // values move down over the freed block entry
+        for (uint32_t k = 0; k < count;) {
+            if (pool[k] != pred) {
+                k++;
+                continue;
+            }
+            count--;
+            pool[k] = pool[count];
+            pool[count + 1 + k] = pool[count * 2 + 1];
+            for (uint32_t j = 0; j < count; j++) {
+                pool[count + j] = pool[count + 1 + j];
+            }
+        }
+        phi->args[1] = count;
+    }
+}
+
+static size_t remove_unreachable(IRFunction* func) {
+    IRCfg* cfg = create_ir_cfg(func);
+    if (cfg == NULL) {
+        return 0;
+    }
+
+    size_t removed = 0;
+    for (uint32_t b = 0; b < func->blockCount; b++) {
+        if (cfg->rpoIndex[b] == IR_NONE && func->blocks[b].start != IR_NONE) {
+            func->blocks[b].start = IR_NONE;
+            removed++;
+        }
+    }
+    free_ir_cfg(cfg);
+    return removed;
+}
+
+static void forward_phis(IRFunction* func) {
+    for (uint32_t b = 0; b < func->blockCount; b++) {
+        const IRBlock* block = &func->blocks[b];
+        for (uint32_t i = block->start; block->start != IR_NONE &&
+            i < block->end && func->insts[i].op == IR_PHI; i++) {
+            const uint32_t* pool = func->operands + func->insts[i].args[0];
+            uint32_t count = func->insts[i].args[1];
+            uint32_t value = IR_NONE;
+            uint32_t inputs = 0;
+            for (uint32_t k = 0; k < count; k++) {
+                if (func->blocks[pool[k]].start != IR_NONE) {
+                    value = pool[count + k];
+                    inputs++;
+                }
+            }
+            // The phi itself is left unused and removed with dead values
+            if (inputs == 1 && value != i) {
+                ir_replace_uses(func, i, value);
+            }
+        }
+    }
+}
+
+static bool remove_dead_values(IRFunction* func) {
+    bool* live = calloc(func->instCount + 1, sizeof(bool));
+    uint32_t* work = malloc((func->instCount + 1) * sizeof(uint32_t));
+    if (live == NULL || work == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(live);
+        free(work);
+        return false;
+    }
+
+    uint32_t top = 0;
+    for (uint32_t b = 0; b < func->blockCount; b++) {
+        if (func->blocks[b].start == IR_NONE) {
+            continue;
+        }
+        for (uint32_t i = func->blocks[b].start; i < func->blocks[b].end;
+            i++) {
+            if (has_effect(func, &func->insts[i])) {
+                live[i] = true;
+                work[top++] = i;
+            }
+        }
+    }
+
+    while (top > 0) {
+        uint32_t* ops;
+        uint32_t count = ir_get_operands(func, &func->insts[work[--top]],
+            &ops);
+        for (uint32_t j = 0; j < count; j++) {
+            if (!ir_is_const(ops[j]) && !live[ops[j]]) {
+                live[ops[j]] = true;
+                work[top++] = ops[j];
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < func->instCount; i++) {
+        if (!live[i]) {
+            func->insts[i].op = IR_NOP;
+        }
+    }
+    free(live);
+    free(work);
+    return true;
+}
+
+static bool has_effect(const IRFunction* func, const IRInst* inst) {
+    IROp op = (IROp)inst->op;
+    if (op == IR_DIV || op == IR_MOD) {
+        // Only a division by a constant other than zero cannot trap, the
+        // most negative value divided by -1 wraps
+        return !ir_is_const(inst->args[1]) ||
+            i128_is_zero(ir_get_const(func, inst->args[1])->bits);
+    }
+    // Parameters stay so every function keeps its signature
+    return op != IR_NOP && (op == IR_PARAM || !ir_is_pure(op));
+}
+
+static size_t remove_unused_functions(IRModule* module) {
+    uint32_t entry = IR_NONE;
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        if (strcmp(module->funcs[i]->name, "main") == 0) {
+            entry = i;
+        }
+    }
+    // Without a main every function may be called from outside
+    if (entry == IR_NONE) {
+        return 0;
+    }
+
+    CallGraph* graph = create_call_graph(module);
+    uint32_t* map = malloc(module->funcCount * sizeof(uint32_t));
+    uint32_t* work = malloc(module->funcCount * sizeof(uint32_t));
+    if (graph == NULL || map == NULL || work == NULL) {
+        if (graph != NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+        }
+        free_call_graph(graph);
+        free(map);
+        free(work);
+        return 0;
+    }
+
+    // map holds IR_NONE for functions not reached yet
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        map[i] = IR_NONE;
+    }
+    uint32_t top = 0;
+    map[entry] = 0;
+    work[top++] = entry;
+    while (top > 0) {
+        uint32_t func = work[--top];
+        for (uint32_t k = graph->calleeStart[func];
+            k < graph->calleeStart[func + 1]; k++) {
+            if (map[graph->callees[k]] == IR_NONE) {
+                map[graph->callees[k]] = 0;
+                work[top++] = graph->callees[k];
+            }
+        }
+    }
+    free_call_graph(graph);
+    free(work);
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        if (map[i] == IR_NONE) {
+            free_ir_function(module->funcs[i]);
+            continue;
+        }
+        map[i] = kept;
+        module->funcs[kept++] = module->funcs[i];
+    }
+    size_t removed = module->funcCount - kept;
+    module->funcCount = kept;
+
+    for (uint32_t f = 0; removed > 0 && f < kept; f++) {
+        IRFunction* func = module->funcs[f];
+        for (uint32_t i = 0; i < func->instCount; i++) {
+            if (func->insts[i].op == IR_CALL) {
+                uint32_t* callee = func->operands + func->insts[i].args[0];
+                *callee = map[*callee];
+            }
+        }
+    }
+    free(map);
+    return removed;
+}
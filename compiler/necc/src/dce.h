@@ -0,0 +1,34 @@
+#ifndef DCE_H
+#define DCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "ir.h"
+
+/// What eliminate_dead_code() removed.
+typedef struct DeadCodeStats {
+    /// Branches and switches on constants turned into jumps.
+    size_t branches;
+    /// Blocks no longer reachable from the entry.
+    size_t blocks;
+    /// Instructions removed, including those of removed blocks.
+    size_t insts;
+    /// Functions never called from main.
+    size_t funcs;
+} DeadCodeStats;
+
+/// Removes code that cannot run or whose result is never used. Branches
+/// and switches on constants become jumps to the block they always take,
+/// blocks the entry no longer reaches are removed, phis left with one
+/// input are replaced by it, and instructions without side effects that
+/// no side effect depends on are removed, including cycles of phis only
+/// feeding each other. Calls and divisions that can trap stay. If the
+/// module has a main, which is then the only function exported,
+/// functions it never reaches through calls are removed as well. Fills
+/// stats with the counts.
+void eliminate_dead_code(IRModule* module, DeadCodeStats* stats);
+/// Removes the dead code of a single function like eliminate_dead_code(),
+/// leaving every function in place, and adds what it removed to stats.
+void eliminate_function_dead_code(IRFunction* func, DeadCodeStats* stats);
+
+#endif // DCE_H
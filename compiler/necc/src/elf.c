@@ -0,0 +1,432 @@
+#include "elf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+
+// The fixed section layout of every object
+enum {
+    SECTION_NULL,
+    SECTION_TEXT,
+    SECTION_RELA_TEXT,
+    SECTION_SYMTAB,
+    SECTION_STRTAB,
+    SECTION_SHSTRTAB,
+    SECTION_NOTE_STACK,
+    SECTION_COUNT,
+};
+
+// Local symbols written before the object's own symbols
+enum {
+    SYMBOL_NULL,
+    SYMBOL_FILE,
+    SYMBOL_TEXT,
+    SYMBOL_LOCAL_COUNT,
+};
+
+#define ELF_HEADER_SIZE 64
+#define SECTION_HEADER_SIZE 64
+#define SYMBOL_SIZE 24
+#define RELA_SIZE 24
+
+/// A growable byte buffer the file is assembled in.
+typedef struct Buffer {
+    uint8_t* data;
+    size_t size;
+    size_t cap;
+    bool ok;
+} Buffer;
+
+/// Reserves count bytes at the end of the buffer, returning them or NULL
+/// on allocation failure.
+static uint8_t* buffer_reserve(Buffer* buffer, size_t count);
+/// Appends bytes to the buffer.
+static void put_bytes(Buffer* buffer, const void* bytes, size_t count);
+/// Appends little endian integers to the buffer.
+static void put_u8(Buffer* buffer, uint8_t value);
+static void put_u16(Buffer* buffer, uint16_t value);
+static void put_u32(Buffer* buffer, uint32_t value);
+static void put_u64(Buffer* buffer, uint64_t value);
+/// Pads the buffer with zeros to a multiple of align.
+static void put_align(Buffer* buffer, size_t align);
+/// Appends a null-terminated string. Returns its offset in the buffer.
+static uint32_t put_string(Buffer* buffer, const char* str);
+/// Appends a section header.
+static void put_section(Buffer* buffer, uint32_t name, uint32_t type,
+    uint64_t flags, uint64_t offset, uint64_t size, uint32_t link,
+    uint32_t info, uint64_t align, uint64_t entsize);
+/// Appends a symbol table entry.
+static void put_symbol(Buffer* buffer, uint32_t name, uint8_t info,
+    uint16_t section, uint64_t value, uint64_t size);
+/// Grows an array to hold at least one more element.
+static bool grow(void** data, uint32_t* cap, uint32_t count, size_t size);
+/// Doubles the symbol hash table and reinserts every symbol. Returns false
+/// on allocation failure.
+static bool grow_slots(ElfObject* obj);
+
+ElfObject* create_elf_object(void) {
+    ElfObject* obj = calloc(1, sizeof(ElfObject));
+    if (obj == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for object\n");
+        return NULL;
+    }
+
+    return obj;
+}
+
+void free_elf_object(ElfObject* obj) {
+    if (obj == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < obj->symbolCount; i++) {
+        free(obj->symbols[i].name);
+    }
+    free(obj->symbols);
+    free(obj->slots);
+    free(obj->relocs);
+    free(obj->text);
+    free(obj);
+}
+
+bool elf_append(ElfObject* obj, const uint8_t* bytes, size_t count) {
+    if (obj->textSize + count > obj->textCap) {
+        size_t newCap = obj->textCap == 0 ? 4096 : obj->textCap * 2;
+        while (newCap < obj->textSize + count) {
+            newCap *= 2;
+        }
+        uint8_t* grown = realloc(obj->text, newCap);
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return false;
+        }
+        obj->text = grown;
+        obj->textCap = newCap;
+    }
+
+    memcpy(obj->text + obj->textSize, bytes, count);
+    obj->textSize += count;
+    return true;
+}
+
+uint32_t elf_symbol(ElfObject* obj, const char* name) {
+    // Kept at most half full, so a probe always ends at an empty slot
+    if ((obj->symbolCount + 1) * 2 > obj->slotCount && !grow_slots(obj)) {
+        return UINT32_MAX;
+    }
+
+    uint32_t slot = (uint32_t)hash_string(HASH_SEED, name) &
+        (obj->slotCount - 1);
+    while (obj->slots[slot] != 0) {
+        uint32_t index = obj->slots[slot] - 1;
+        if (strcmp(obj->symbols[index].name, name) == 0) {
+            return index;
+        }
+        slot = (slot + 1) & (obj->slotCount - 1);
+    }
+
+    if (!grow((void**)&obj->symbols, &obj->symbolCap, obj->symbolCount,
+        sizeof(ElfSymbol))) {
+        return UINT32_MAX;
+    }
+
+    size_t len = strlen(name);
+    char* copy = malloc(len + 1);
+    if (copy == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return UINT32_MAX;
+    }
+    memcpy(copy, name, len + 1);
+
+    ElfSymbol* symbol = &obj->symbols[obj->symbolCount];
+    symbol->name = copy;
+    symbol->offset = 0;
+    symbol->size = 0;
+    symbol->defined = false;
+    obj->slots[slot] = ++obj->symbolCount;
+    return obj->symbolCount - 1;
+}
+
+void elf_define_symbol(ElfObject* obj, uint32_t symbol, uint64_t offset,
+    uint64_t size) {
+    obj->symbols[symbol].offset = offset;
+    obj->symbols[symbol].size = size;
+    obj->symbols[symbol].defined = true;
+}
+
+bool elf_add_reloc(ElfObject* obj, uint64_t offset, uint32_t symbol,
+    uint32_t type, int64_t addend) {
+    if (!grow((void**)&obj->relocs, &obj->relocCap, obj->relocCount,
+        sizeof(ElfReloc))) {
+        return false;
+    }
+
+    ElfReloc* reloc = &obj->relocs[obj->relocCount++];
+    reloc->offset = offset;
+    reloc->symbol = symbol;
+    reloc->type = type;
+    reloc->addend = addend;
+    return true;
+}
+
+bool write_elf_object(const ElfObject* obj, const char* path,
+    const char* sourceName) {
+    Buffer file = { NULL, 0, 0, true };
+
+    // The header is filled in last, once the section offsets are known
+    buffer_reserve(&file, ELF_HEADER_SIZE);
+
+    put_align(&file, 16);
+    uint64_t textOffset = file.size;
+    put_bytes(&file, obj->text, obj->textSize);
+
+    put_align(&file, 8);
+    uint64_t relaOffset = file.size;
+    for (uint32_t i = 0; i < obj->relocCount; i++) {
+        const ElfReloc* reloc = &obj->relocs[i];
+        put_u64(&file, reloc->offset);
+        put_u64(&file, (uint64_t)(reloc->symbol + SYMBOL_LOCAL_COUNT) << 32 |
+            reloc->type);
+        put_u64(&file, (uint64_t)reloc->addend);
+    }
+    uint64_t relaSize = file.size - relaOffset;
+
+    Buffer strtab = { NULL, 0, 0, true };
+    put_u8(&strtab, 0);
+    uint32_t fileName = put_string(&strtab, sourceName);
+    uint32_t* names = malloc((obj->symbolCount + 1) * sizeof(uint32_t));
+    if (names == NULL) {
+        file.ok = false;
+    }
+    for (uint32_t i = 0; names != NULL && i < obj->symbolCount; i++) {
+        names[i] = put_string(&strtab, obj->symbols[i].name);
+    }
+
+    put_align(&file, 8);
+    uint64_t symtabOffset = file.size;
+    put_symbol(&file, 0, 0, 0, 0, 0);
+    // Local file and section symbols, STT_FILE and STT_SECTION
+    put_symbol(&file, fileName, 4, 0xfff1, 0, 0);
+    put_symbol(&file, 0, 3, SECTION_TEXT, 0, 0);
+    for (uint32_t i = 0; names != NULL && i < obj->symbolCount; i++) {
+        const ElfSymbol* symbol = &obj->symbols[i];
+        // Global functions, or global untyped undefined symbols
+        put_symbol(&file, names[i], symbol->defined ? 0x12 : 0x10,
+            symbol->defined ? SECTION_TEXT : 0, symbol->offset,
+            symbol->size);
+    }
+    uint64_t symtabSize = file.size - symtabOffset;
+    free(names);
+
+    uint64_t strtabOffset = file.size;
+    put_bytes(&file, strtab.data, strtab.size);
+    file.ok = file.ok && strtab.ok;
+    free(strtab.data);
+
+    uint64_t shstrtabOffset = file.size;
+    put_u8(&file, 0);
+    uint32_t textName = (uint32_t)(put_string(&file, ".text") -
+        shstrtabOffset);
+    uint32_t relaName = (uint32_t)(put_string(&file, ".rela.text") -
+        shstrtabOffset);
+    uint32_t symtabName = (uint32_t)(put_string(&file, ".symtab") -
+        shstrtabOffset);
+    uint32_t strtabName = (uint32_t)(put_string(&file, ".strtab") -
+        shstrtabOffset);
+    uint32_t shstrtabName = (uint32_t)(put_string(&file, ".shstrtab") -
+        shstrtabOffset);
+    uint32_t noteName = (uint32_t)(put_string(&file, ".note.GNU-stack") -
+        shstrtabOffset);
+    uint64_t shstrtabSize = file.size - shstrtabOffset;
+
+    put_align(&file, 8);
+    uint64_t sectionsOffset = file.size;
+    put_section(&file, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    // SHT_PROGBITS with SHF_ALLOC | SHF_EXECINSTR
+    put_section(&file, textName, 1, 0x6, textOffset, obj->textSize, 0, 0,
+        16, 0);
+    // SHT_RELA with SHF_INFO_LINK
+    put_section(&file, relaName, 4, 0x40, relaOffset, relaSize,
+        SECTION_SYMTAB, SECTION_TEXT, 8, RELA_SIZE);
+    put_section(&file, symtabName, 2, 0, symtabOffset, symtabSize,
+        SECTION_STRTAB, SYMBOL_LOCAL_COUNT, 8, SYMBOL_SIZE);
+    put_section(&file, strtabName, 3, 0, strtabOffset,
+        shstrtabOffset - strtabOffset, 0, 0, 1, 0);
+    put_section(&file, shstrtabName, 3, 0, shstrtabOffset, shstrtabSize,
+        0, 0, 1, 0);
+    // Marks the stack as not executable
+    put_section(&file, noteName, 1, 0, shstrtabOffset + shstrtabSize, 0,
+        0, 0, 1, 0);
+
+    if (!file.ok) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(file.data);
+        return false;
+    }
+
+    // Now the header, a little endian ELF64 relocatable for x86-64
+    Buffer header = { NULL, 0, 0, true };
+    static const uint8_t ident[16] = { 0x7f, 'E', 'L', 'F', 2, 1, 1 };
+    put_bytes(&header, ident, sizeof(ident));
+    put_u16(&header, 1);
+    put_u16(&header, 62);
+    put_u32(&header, 1);
+    put_u64(&header, 0);
+    put_u64(&header, 0);
+    put_u64(&header, sectionsOffset);
+    put_u32(&header, 0);
+    put_u16(&header, ELF_HEADER_SIZE);
+    put_u16(&header, 0);
+    put_u16(&header, 0);
+    put_u16(&header, SECTION_HEADER_SIZE);
+    put_u16(&header, SECTION_COUNT);
+    put_u16(&header, SECTION_SHSTRTAB);
+    if (!header.ok) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(file.data);
+        return false;
+    }
+    memcpy(file.data, header.data, ELF_HEADER_SIZE);
+    free(header.data);
+
+    FILE* output = fopen(path, "wb");
+    bool ok = output != NULL &&
+        fwrite(file.data, 1, file.size, output) == file.size;
+    if (output != NULL && fclose(output) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write output file '%s'\n", path);
+    }
+
+    free(file.data);
+    return ok;
+}
+
+/* --- Helper Functions --- */
+
+static uint8_t* buffer_reserve(Buffer* buffer, size_t count) {
+    if (!buffer->ok) {
+        return NULL;
+    }
+
+    if (buffer->size + count > buffer->cap) {
+        size_t newCap = buffer->cap == 0 ? 1024 : buffer->cap * 2;
+        while (newCap < buffer->size + count) {
+            newCap *= 2;
+        }
+        uint8_t* grown = realloc(buffer->data, newCap);
+        if (grown == NULL) {
+            buffer->ok = false;
+            return NULL;
+        }
+        buffer->data = grown;
+        buffer->cap = newCap;
+    }
+
+    uint8_t* start = buffer->data + buffer->size;
+    memset(start, 0, count);
+    buffer->size += count;
+    return start;
+}
+
+static void put_bytes(Buffer* buffer, const void* bytes, size_t count) {
+    uint8_t* start = buffer_reserve(buffer, count);
+    if (start != NULL && count > 0) {
+        memcpy(start, bytes, count);
+    }
+}
+
+static void put_u8(Buffer* buffer, uint8_t value) {
+    put_bytes(buffer, &value, 1);
+}
+
+static void put_u16(Buffer* buffer, uint16_t value) {
+    put_u8(buffer, (uint8_t)value);
+    put_u8(buffer, (uint8_t)(value >> 8));
+}
+
+static void put_u32(Buffer* buffer, uint32_t value) {
+    put_u16(buffer, (uint16_t)value);
+    put_u16(buffer, (uint16_t)(value >> 16));
+}
+
+static void put_u64(Buffer* buffer, uint64_t value) {
+    put_u32(buffer, (uint32_t)value);
+    put_u32(buffer, (uint32_t)(value >> 32));
+}
+
+static void put_align(Buffer* buffer, size_t align) {
+    size_t padding = (align - buffer->size % align) % align;
+    buffer_reserve(buffer, padding);
+}
+
+static uint32_t put_string(Buffer* buffer, const char* str) {
+    uint32_t offset = (uint32_t)buffer->size;
+    put_bytes(buffer, str, strlen(str) + 1);
+    return offset;
+}
+
+static void put_section(Buffer* buffer, uint32_t name, uint32_t type,
+    uint64_t flags, uint64_t offset, uint64_t size, uint32_t link,
+    uint32_t info, uint64_t align, uint64_t entsize) {
+    put_u32(buffer, name);
+    put_u32(buffer, type);
+    put_u64(buffer, flags);
+    put_u64(buffer, 0);
+    put_u64(buffer, offset);
+    put_u64(buffer, size);
+    put_u32(buffer, link);
+    put_u32(buffer, info);
+    put_u64(buffer, align);
+    put_u64(buffer, entsize);
+}
+
+static void put_symbol(Buffer* buffer, uint32_t name, uint8_t info,
+    uint16_t section, uint64_t value, uint64_t size) {
+    put_u32(buffer, name);
+    put_u8(buffer, info);
+    put_u8(buffer, 0);
+    put_u16(buffer, section);
+    put_u64(buffer, value);
+    put_u64(buffer, size);
+}
+
+static bool grow(void** data, uint32_t* cap, uint32_t count, size_t size) {
+    if (count < *cap) {
+        return true;
+    }
+
+    uint32_t newCap = *cap == 0 ? 16 : *cap * 2;
+    void* grown = realloc(*data, newCap * size);
+    if (grown == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+    *data = grown;
+    *cap = newCap;
+    return true;
+}
+
+static bool grow_slots(ElfObject* obj) {
+    uint32_t slotCount = obj->slotCount == 0 ? 64 : obj->slotCount * 2;
+    uint32_t* slots = calloc(slotCount, sizeof(uint32_t));
+    if (slots == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < obj->symbolCount; i++) {
+        uint32_t slot = (uint32_t)hash_string(HASH_SEED,
+            obj->symbols[i].name) & (slotCount - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slotCount - 1);
+        }
+        slots[slot] = i + 1;
+    }
+
+    free(obj->slots);
+    obj->slots = slots;
+    obj->slotCount = slotCount;
+    return true;
+}
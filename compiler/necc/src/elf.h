@@ -0,0 +1,79 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Relocation types used by the x86-64 backend.
+#define ELF_R_X86_64_PC32 2
+#define ELF_R_X86_64_PLT32 4
+
+typedef struct ElfSymbol {
+    /// A null-terminated copy of the symbol name.
+    char* name;
+    /// The offset of the symbol in .text, if it is defined.
+    uint64_t offset;
+    /// The size of the function in bytes.
+    uint64_t size;
+    /// False for symbols defined by another object.
+    bool defined;
+} ElfSymbol;
+
+typedef struct ElfReloc {
+    /// The offset in .text of the field to patch.
+    uint64_t offset;
+    /// The index of the target symbol in the object.
+    uint32_t symbol;
+    /// One of the ELF_R_X86_64 types.
+    uint32_t type;
+    int64_t addend;
+} ElfReloc;
+
+/// An x86-64 relocatable object being built. All code goes into a single
+/// .text section and every symbol is a global function.
+typedef struct ElfObject {
+    uint8_t* text;
+    size_t textSize;
+    size_t textCap;
+
+    ElfSymbol* symbols;
+    uint32_t symbolCount;
+    uint32_t symbolCap;
+    /// Open addressing hash table of symbol indices plus one by name, zero
+    /// marking an empty slot.
+    uint32_t* slots;
+    /// The number of slots, zero or a power of two.
+    uint32_t slotCount;
+
+    ElfReloc* relocs;
+    uint32_t relocCount;
+    uint32_t relocCap;
+} ElfObject;
+
+/// Creates an empty object. Returns NULL if memory allocation fails.
+ElfObject* create_elf_object(void);
+/// Frees an object and its symbols. Safely handles NULL.
+void free_elf_object(ElfObject* obj);
+
+/// Appends bytes to .text. Returns false on allocation failure.
+bool elf_append(ElfObject* obj, const uint8_t* bytes, size_t count);
+/// Returns the index of the symbol with the given name, adding it as an
+/// undefined symbol if it does not exist yet. Returns UINT32_MAX on
+/// allocation failure.
+uint32_t elf_symbol(ElfObject* obj, const char* name);
+/// Defines a symbol as the function at offset in .text.
+void elf_define_symbol(ElfObject* obj, uint32_t symbol, uint64_t offset,
+    uint64_t size);
+/// Adds a relocation against a symbol. Returns false on allocation
+/// failure.
+bool elf_add_reloc(ElfObject* obj, uint64_t offset, uint32_t symbol,
+    uint32_t type, int64_t addend);
+
+/// Writes the object as an ELF64 relocatable file. sourceName is
+/// recorded as the file symbol. Returns false if the file cannot be
+/// written.
+bool write_elf_object(const ElfObject* obj, const char* path,
+    const char* sourceName);
+
+#endif // ELF_H
@@ -0,0 +1,571 @@
+#include "fold.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "constval.h"
+#include "int128.h"
+#include "scope.h"
+#include "types.h"
+
+/// State shared while folding a single file.
+typedef struct Folder {
+    /// Variables visible at the current position. A symbol value of 1
+    /// marks an immutable variable with a literal initializer.
+    Scope* scope;
+    /// The functions of the file, used to type call expressions.
+    FuncTable* funcs;
+    /// The return type of the function being folded.
+    TokenType returnType;
+    /// The number of expressions replaced so far.
+    size_t folded;
+} Folder;
+
+/// Folds the body of a function declaration.
+static void fold_function(Folder* folder, ASTNode* func);
+/// Folds the expressions of a statement, tracking declarations.
+static void fold_stmt(Folder* folder, ASTNode* stmt);
+/// Folds an expression whose type is given by its context. A context of
+/// TOK_INVALID means the expression is evaluated in its own type.
+static void fold_root(Folder* folder, ASTNode** slot, TokenType context);
+/// Folds the expression in slot, which is evaluated in type. When
+/// hasContext is false the type was derived from the operands, so any
+/// typed subtree that is folded keeps a cast to preserve it.
+static void fold_expr(Folder* folder, ASTNode** slot, TokenType type,
+    bool hasContext);
+/// Folds the shared node in slot as fold_expr() does, through a copy of
+/// the node for slot alone. The copy is kept only if folding changed it.
+static void fold_shared(Folder* folder, ASTNode** slot, TokenType type,
+    bool hasContext);
+/// Returns the type the operand of a cast expression is evaluated in.
+static TokenType cast_operand_type(Folder* folder, const ASTNode* operand);
+/// Evaluates a node whose children have already been folded. Returns
+/// false if the node is not constant.
+static bool eval_node(Folder* folder, const ASTNode* node, TokenType type,
+    ConstValue* out);
+/// Evaluates a folded leaf: a literal, a cast of a literal, or a
+/// constant variable. Returns false for anything else.
+static bool eval_leaf(Folder* folder, const ASTNode* node, TokenType type,
+    ConstValue* out);
+/// Evaluates an operand of a comparison in type like eval_leaf, casting
+/// a signed operand compared with an unsigned one to it.
+static bool eval_compare_operand(Folder* folder, const ASTNode* node,
+    TokenType type, ConstValue* out);
+/// Replaces the node in slot with a literal for the value, wrapped in a
+/// cast to type when it must keep its type.
+static void replace_with_const(Folder* folder, ASTNode** slot,
+    ConstValue value, TokenType type, bool keepType);
+/// Returns true if the node is a literal or a cast of a literal.
+static bool is_folded_leaf(const ASTNode* node);
+/// Returns true if the operator is an arithmetic binary operator.
+static bool is_arith_op(TokenType op);
+
+size_t fold_constants(ASTNode* file) {
+    if (file == NULL || file->type != NODE_FILE) {
+        fprintf(stderr, "Error: Constant folding requires a file node\n");
+        return 0;
+    }
+
+    Folder folder = { 0 };
+    folder.scope = create_scope();
+    folder.funcs = create_func_table(file);
+    if (folder.scope == NULL || folder.funcs == NULL) {
+        destroy_scope(folder.scope);
+        destroy_func_table(folder.funcs);
+        return 0;
+    }
+
+    for (size_t i = 0; i < file->data.file.stmtCount; i++) {
+        ASTNode* stmt = file->data.file.stmts[i];
+        if (stmt != NULL && stmt->type == NODE_FUNCTION_DECL) {
+            fold_function(&folder, stmt);
+        }
+    }
+
+    destroy_scope(folder.scope);
+    destroy_func_table(folder.funcs);
+    return folder.folded;
+}
+
+size_t fold_function_constants(ASTNode* decl, FuncTable* funcs) {
+    if (decl == NULL || decl->type != NODE_FUNCTION_DECL) {
+        fprintf(stderr, "Error: Constant folding requires a function"\
+            " declaration\n");
+        return 0;
+    }
+
+    Folder folder = { 0 };
+    folder.scope = create_scope();
+    folder.funcs = funcs;
+    if (folder.scope == NULL) {
+        return 0;
+    }
+
+    fold_function(&folder, decl);
+    destroy_scope(folder.scope);
+    return folder.folded;
+}
+
+/* --- Helper Functions --- */
+
+static void fold_function(Folder* folder, ASTNode* func) {
+    if (!scope_enter(folder->scope)) {
+        return;
+    }
+
+    for (size_t i = 0; i < func->data.functionDecl.paramCount; i++) {
+        ASTNode* param = func->data.functionDecl.params[i];
+        scope_declare(folder->scope, param->data.parameterDecl.name,
+            param->data.parameterDecl.type, false, param);
+    }
+
+    folder->returnType = func->data.functionDecl.returnType;
+    fold_stmt(folder, func->data.functionDecl.body);
+    scope_exit(folder->scope);
+}
+
+static void fold_stmt(Folder* folder, ASTNode* stmt) {
+    if (stmt == NULL) {
+        return;
+    }
+
+    switch (stmt->type) {
+        case NODE_BLOCK_STMT:
+            if (!scope_enter(folder->scope)) {
+                return;
+            }
+            for (size_t i = 0; i < stmt->data.blockStmt.stmtCount; i++) {
+                fold_stmt(folder, stmt->data.blockStmt.stmts[i]);
+            }
+            scope_exit(folder->scope);
+            break;
+        case NODE_VARIABLE_DECL: {
+            VariableDecl* decl = &stmt->data.variableDecl;
+            fold_root(folder, &decl->initializer, decl->type);
+
+            // Canonicalize literal initializers so constant propagation
+            // always sees values already wrapped into the variable type
+            bool isConst = false;
+            ConstValue value;
+            if (decl->initializer != NULL &&
+                decl->initializer->type == NODE_LITERAL &&
+                const_from_literal(decl->initializer, decl->type, &value)) {
+                ASTNode* canonical = const_to_literal(value, decl->type,
+                    decl->initializer->line, decl->initializer->column);
+                if (canonical != NULL) {
+                    canonical->offset = decl->initializer->offset;
+                    canonical->length = decl->initializer->length;
+                    free_ast_node(decl->initializer);
+                    decl->initializer = canonical;
+                    isConst = !decl->mutable;
+                }
+            }
+
+            Symbol* symbol = scope_declare(folder->scope, decl->name,
+                decl->type, decl->mutable, stmt);
+            if (symbol != NULL) {
+                symbol->value = isConst ? 1 : 0;
+            }
+            break;
+        }
+        case NODE_RETURN_STMT:
+            fold_root(folder, &stmt->data.returnStmt.expr,
+                folder->returnType);
+            break;
+        case NODE_IF_STMT:
+            fold_root(folder, &stmt->data.ifStmt.condition, TOK_BOOL);
+            fold_stmt(folder, stmt->data.ifStmt.thenBranch);
+            fold_stmt(folder, stmt->data.ifStmt.elseBranch);
+            break;
+        case NODE_EXPR_STMT: {
+            ASTNode* expr = stmt->data.exprStmt.expr;
+            if (expr != NULL && expr->type == NODE_ASSIGN_EXPR) {
+                ASTNode* target = expr->data.assignExpr.target;
+                Symbol* symbol = target == NULL ||
+                    target->type != NODE_IDENT ? NULL :
+                    scope_lookup(folder->scope, target->data.ident.name);
+                fold_root(folder, &expr->data.assignExpr.value,
+                    symbol == NULL ? TOK_INVALID : symbol->type);
+            } else {
+                fold_root(folder, &stmt->data.exprStmt.expr, TOK_INVALID);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void fold_root(Folder* folder, ASTNode** slot, TokenType context) {
+    if (*slot == NULL) {
+        return;
+    }
+
+    if (context != TOK_INVALID) {
+        fold_expr(folder, slot, context, true);
+        return;
+    }
+
+    TokenType type = type_default(type_of_expr(*slot, folder->scope,
+        folder->funcs));
+    fold_expr(folder, slot, type, false);
+}
+
+static void fold_expr(Folder* folder, ASTNode** slot, TokenType type,
+    bool hasContext) {
+    ASTNode* node = *slot;
+    if (node == NULL) {
+        return;
+    }
+    if (node->refs > 1 && (node->type == NODE_BINARY_EXPR ||
+        node->type == NODE_UNARY_EXPR || node->type == NODE_CAST_EXPR)) {
+        fold_shared(folder, slot, type, hasContext);
+        return;
+    }
+
+    switch (node->type) {
+        case NODE_LITERAL:
+            return;
+        case NODE_IDENT:
+            break;
+        case NODE_BINARY_EXPR: {
+            BinaryExpr* expr = &node->data.binaryExpr;
+            if (is_arith_op(expr->op)) {
+                fold_expr(folder, &expr->left, type, hasContext);
+                fold_expr(folder, &expr->right, type, hasContext);
+                break;
+            }
+
+            if (expr->op == TOK_AND || expr->op == TOK_OR) {
+                fold_expr(folder, &expr->left, TOK_BOOL, true);
+                fold_expr(folder, &expr->right, TOK_BOOL, true);
+
+                // A constant left operand decides the result or reduces
+                // the expression to its right operand
+                ConstValue left;
+                if (eval_leaf(folder, expr->left, TOK_BOOL, &left)) {
+                    bool isAnd = expr->op == TOK_AND;
+                    if (i128_is_zero(left.i) == isAnd) {
+                        replace_with_const(folder, slot, left, TOK_BOOL,
+                            false);
+                    } else {
+                        ASTNode* right = expr->right;
+                        expr->right = NULL;
+                        free_ast_node(node);
+                        *slot = right;
+                        folder->folded++;
+                    }
+                    return;
+                }
+                break;
+            }
+
+            // Comparisons evaluate their operands in the widest type of
+            // the two. A signed operand compared with an unsigned one is
+            // folded in its own type, the comparison casting it.
+            TokenType leftType = type_of_expr(expr->left, folder->scope,
+                folder->funcs);
+            TokenType rightType = type_of_expr(expr->right, folder->scope,
+                folder->funcs);
+            TokenType operandType = type_default(type_common(leftType,
+                rightType));
+            fold_expr(folder, &expr->left,
+                type_compare_casts(leftType, operandType) ? leftType :
+                operandType, false);
+            fold_expr(folder, &expr->right,
+                type_compare_casts(rightType, operandType) ? rightType :
+                operandType, false);
+            break;
+        }
+        case NODE_UNARY_EXPR:
+            if (node->data.unaryExpr.op == TOK_SUB) {
+                fold_expr(folder, &node->data.unaryExpr.operand, type,
+                    hasContext);
+            } else if (node->data.unaryExpr.op == TOK_NOT) {
+                fold_expr(folder, &node->data.unaryExpr.operand, TOK_BOOL,
+                    true);
+            }
+            break;
+        case NODE_CAST_EXPR:
+            fold_expr(folder, &node->data.castExpr.expr,
+                cast_operand_type(folder, node->data.castExpr.expr), false);
+            break;
+        case NODE_CALL_EXPR: {
+            CallExpr* call = &node->data.callExpr;
+            ASTNode* func = call->callee == NULL ||
+                call->callee->type != NODE_IDENT ? NULL :
+                func_table_lookup(folder->funcs, call->callee->data.ident.name);
+
+            for (size_t i = 0; i < call->argCount; i++) {
+                TokenType paramType = TOK_INVALID;
+                if (func != NULL && i < func->data.functionDecl.paramCount) {
+                    paramType = func->data.functionDecl.params[i]->
+                        data.parameterDecl.type;
+                }
+                fold_root(folder, &call->args[i], paramType);
+            }
+            return;
+        }
+        default:
+            return;
+    }
+
+    ConstValue value;
+    if (eval_node(folder, node, type, &value)) {
+        // Without a context the operand types decided the evaluation
+        // type, so a typed subtree must keep it after folding
+        TokenType natural = type_of_expr(node, folder->scope,
+            folder->funcs);
+        bool keepType = !hasContext && natural != TOK_INT_LIT &&
+            natural != TOK_FLOAT_LIT;
+        replace_with_const(folder, slot, value, type, keepType);
+    }
+}
+
+static void fold_shared(Folder* folder, ASTNode** slot, TokenType type,
+    bool hasContext) {
+    // The same expression folds differently in other places, as with a
+    // variable that is constant in one function only, so folding writes
+    // to a copy holding references to the same children
+    ASTNode* shared = *slot;
+    ASTNode* copy = malloc(sizeof(ASTNode));
+    if (copy == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for node\n");
+        return;
+    }
+    *copy = *shared;
+    copy->refs = 1;
+    ASTNode** children[2] = { NULL, NULL };
+    switch (copy->type) {
+        case NODE_BINARY_EXPR:
+            children[0] = &copy->data.binaryExpr.left;
+            children[1] = &copy->data.binaryExpr.right;
+            break;
+        case NODE_UNARY_EXPR:
+            children[0] = &copy->data.unaryExpr.operand;
+            break;
+        default:
+            children[0] = &copy->data.castExpr.expr;
+            break;
+    }
+    ASTNode* before[2] = { NULL, NULL };
+    for (size_t i = 0; i < 2 && children[i] != NULL; i++) {
+        before[i] = share_ast_node(*children[i]);
+    }
+
+    *slot = copy;
+    fold_expr(folder, slot, type, hasContext);
+
+    // Unchanged, the copy goes and the slot shares the node again
+    bool changed = *slot != copy;
+    for (size_t i = 0; !changed && i < 2 && children[i] != NULL; i++) {
+        changed = *children[i] != before[i];
+    }
+    if (!changed) {
+        free_ast_node(copy);
+        *slot = shared;
+    } else {
+        free_ast_node(shared);
+    }
+}
+
+static TokenType cast_operand_type(Folder* folder, const ASTNode* operand) {
+    // Untyped literals are cast from their exact value rather than
+    // wrapping into i32 first, so (u64)5000000000 keeps its value
+    TokenType type = type_of_expr(operand, folder->scope, folder->funcs);
+    if (type == TOK_INT_LIT) {
+        return TOK_I128;
+    }
+
+    return type_default(type);
+}
+
+static bool eval_node(Folder* folder, const ASTNode* node, TokenType type,
+    ConstValue* out) {
+    switch (node->type) {
+        case NODE_LITERAL:
+        case NODE_IDENT:
+            return eval_leaf(folder, node, type, out);
+        case NODE_CAST_EXPR: {
+            const ASTNode* operand = node->data.castExpr.expr;
+            TokenType operandType = cast_operand_type(folder, operand);
+            ConstValue value;
+            TokenType castType = node->data.castExpr.type;
+            return eval_leaf(folder, operand, operandType, &value) &&
+                const_convert(value, operandType, castType, true, &value) &&
+                const_convert(value, castType, type, false, out);
+        }
+        case NODE_UNARY_EXPR: {
+            ConstValue value;
+            if (node->data.unaryExpr.op == TOK_SUB) {
+                if (type == TOK_BOOL ||
+                    !eval_leaf(folder, node->data.unaryExpr.operand, type,
+                    &value)) {
+                    return false;
+                }
+                ConstValue zero = { { 0, 0 }, 0.0 };
+                if (type_is_float(type)) {
+                    out->i = zero.i;
+                    out->f = type == TOK_F32 ? (double)(float)-value.f :
+                        -value.f;
+                    return true;
+                }
+                return const_arith(TOK_SUB, zero, value, type, out);
+            }
+            if (node->data.unaryExpr.op == TOK_NOT) {
+                if (!eval_leaf(folder, node->data.unaryExpr.operand,
+                    TOK_BOOL, &value)) {
+                    return false;
+                }
+                value.i = i128_from_u64(i128_is_zero(value.i) ? 1 : 0);
+                return const_convert(value, TOK_BOOL, type, false, out);
+            }
+            return false;
+        }
+        case NODE_BINARY_EXPR: {
+            const BinaryExpr* expr = &node->data.binaryExpr;
+            ConstValue left;
+            ConstValue right;
+
+            if (is_arith_op(expr->op)) {
+                return type != TOK_BOOL &&
+                    eval_leaf(folder, expr->left, type, &left) &&
+                    eval_leaf(folder, expr->right, type, &right) &&
+                    const_arith(expr->op, left, right, type, out);
+            }
+
+            bool isLogical = expr->op == TOK_AND || expr->op == TOK_OR;
+            TokenType operandType = TOK_BOOL;
+            if (!isLogical) {
+                operandType = type_default(type_common(
+                    type_of_expr(expr->left, folder->scope, folder->funcs),
+                    type_of_expr(expr->right, folder->scope,
+                    folder->funcs)));
+            }
+            bool evaluated = isLogical ?
+                eval_leaf(folder, expr->left, operandType, &left) &&
+                eval_leaf(folder, expr->right, operandType, &right) :
+                eval_compare_operand(folder, expr->left, operandType,
+                    &left) &&
+                eval_compare_operand(folder, expr->right, operandType,
+                    &right);
+            if (!evaluated) {
+                return false;
+            }
+
+            bool result;
+            if (expr->op == TOK_AND) {
+                result = !i128_is_zero(left.i) && !i128_is_zero(right.i);
+            } else if (expr->op == TOK_OR) {
+                result = !i128_is_zero(left.i) || !i128_is_zero(right.i);
+            } else {
+                result = const_compare(expr->op, left, right, operandType);
+            }
+
+            ConstValue value = { i128_from_u64(result ? 1 : 0), 0.0 };
+            return const_convert(value, TOK_BOOL, type, false, out);
+        }
+        default:
+            return false;
+    }
+}
+
+static bool eval_leaf(Folder* folder, const ASTNode* node, TokenType type,
+    ConstValue* out) {
+    if (node == NULL) {
+        return false;
+    }
+
+    if (node->type == NODE_LITERAL) {
+        return const_from_literal(node, type, out);
+    }
+
+    if (node->type == NODE_CAST_EXPR &&
+        node->data.castExpr.expr != NULL &&
+        node->data.castExpr.expr->type == NODE_LITERAL) {
+        return eval_node(folder, node, type, out);
+    }
+
+    if (node->type == NODE_IDENT) {
+        Symbol* symbol = scope_lookup(folder->scope, node->data.ident.name);
+        if (symbol == NULL || symbol->value != 1) {
+            return false;
+        }
+
+        ConstValue value;
+        return const_from_literal(symbol->decl->data.variableDecl.initializer,
+            symbol->type, &value) &&
+            const_convert(value, symbol->type, type, false, out);
+    }
+
+    return false;
+}
+
+static bool eval_compare_operand(Folder* folder, const ASTNode* node,
+    TokenType type, ConstValue* out) {
+    TokenType own = type_of_expr(node, folder->scope, folder->funcs);
+    if (!type_compare_casts(own, type)) {
+        return eval_leaf(folder, node, type, out);
+    }
+
+    ConstValue value;
+    return eval_leaf(folder, node, own, &value) &&
+        const_convert(value, own, type, true, out);
+}
+
+static void replace_with_const(Folder* folder, ASTNode** slot,
+    ConstValue value, TokenType type, bool keepType) {
+    ASTNode* old = *slot;
+    ASTNode* literal = const_to_literal(value, type, old->line,
+        old->column);
+    if (literal == NULL) {
+        return;
+    }
+    literal->offset = old->offset;
+    literal->length = old->length;
+
+    if (keepType && type != TOK_BOOL) {
+        // Already in folded form, replacing it would change nothing
+        if (is_folded_leaf(old) && old->type == NODE_CAST_EXPR &&
+            old->data.castExpr.type == type &&
+            !strcmp(old->data.castExpr.expr->data.literal.value,
+            literal->data.literal.value)) {
+            free_ast_node(literal);
+            return;
+        }
+
+        ASTNode* cast = create_cast_expr_node(old->line, old->column, type,
+            literal);
+        if (cast == NULL) {
+            free_ast_node(literal);
+            return;
+        }
+        cast->offset = old->offset;
+        cast->length = old->length;
+        literal = cast;
+    }
+
+    free_ast_node(old);
+    *slot = literal;
+    folder->folded++;
+}
+
+static bool is_folded_leaf(const ASTNode* node) {
+    return node->type == NODE_LITERAL ||
+        (node->type == NODE_CAST_EXPR && node->data.castExpr.expr != NULL &&
+        node->data.castExpr.expr->type == NODE_LITERAL);
+}
+
+static bool is_arith_op(TokenType op) {
+    switch (op) {
+        case TOK_ADD:
+        case TOK_SUB:
+        case TOK_MUL:
+        case TOK_DIV:
+        case TOK_MOD:
+            return true;
+        default:
+            return false;
+    }
+}
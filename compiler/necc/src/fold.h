@@ -0,0 +1,23 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include <stddef.h>
+#include "ast.h"
+#include "scope.h"
+
+/// Folds constant expressions in every function of the given file node
+/// in place. Binary, unary and cast expressions whose operands are
+/// literals, or immutable variables initialized with constants, are
+/// replaced with literal nodes. Arithmetic is evaluated in the type of
+/// the target following the spec's conversion rules, wrapping on
+/// overflow. Division by zero and float results that are not finite are
+/// left for runtime. Returns the number of expressions that were
+/// replaced.
+size_t fold_constants(ASTNode* file);
+/// Folds the constant expressions of a single function declaration like
+/// fold_constants(), typing calls with funcs, the functions of its file.
+/// Their declarations only need a signature. Returns the number of
+/// expressions that were replaced.
+size_t fold_function_constants(ASTNode* decl, FuncTable* funcs);
+
+#endif // FOLD_H
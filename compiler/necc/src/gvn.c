@@ -0,0 +1,319 @@
+#include "gvn.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "callgraph.h"
+#include "hash.h"
+
+// Values are numbered by walking the dominator tree with a hash table of
+// the instructions available in the block being walked: those of the
+// block and of the blocks dominating it. An instruction equal to one in
+// the table is replaced by it, anything else is added and removed again
+// when the walk leaves its block, so a value is only reused where its
+// definition dominates. Operands are renamed to the instruction kept for
+// them before hashing, which is what makes the numbering global: once
+// the operands of two instructions are found equal, so are the
+// instructions. Phi inputs coming around a loop are only renamed after
+// the walk, so phis can miss being found equal but never are wrongly.
+
+/// Marks a block on the walk stack whose subtree has been walked.
+#define GVN_LEAVE UINT32_C(0x80000000)
+
+/// An instruction in the form equal instructions share.
+typedef struct Expr {
+    IROp op;
+    TokenType type;
+    uint32_t args[2];
+} Expr;
+
+typedef struct Numbering {
+    IRFunction* func;
+    IRCfg* cfg;
+    /// Whether each function of the module is pure, or NULL.
+    const bool* pure;
+    /// Blocks still to walk, or to leave when GVN_LEAVE is set.
+    uint32_t* pending;
+
+    /// The instruction each instruction was replaced by, itself if it
+    /// was kept.
+    uint32_t* leader;
+    /// The block of each instruction walked so far.
+    uint32_t* blockOf;
+    /// Open addressing table of the available instructions, IR_NONE
+    /// marking an empty slot.
+    uint32_t* slots;
+    uint32_t slotCount;
+    /// The slots filled so far, and how many there were on entering each
+    /// block.
+    uint32_t* filled;
+    uint32_t filledCount;
+    uint32_t* filledMark;
+
+    ValueNumberStats* stats;
+    size_t removed;
+} Numbering;
+
+/// Walks the dominator tree, replacing the instructions found equal to
+/// an available one.
+static void walk(Numbering* num);
+/// Renames the operands of an instruction and replaces it if an equal
+/// one is available, otherwise makes it available.
+static void visit(Numbering* num, uint32_t index, uint32_t block);
+/// Returns true if instructions equal to the instruction can be
+/// replaced by it.
+static bool is_numbered(const Numbering* num, const IRInst* inst);
+/// Returns the instruction with commutative operands ordered and greater
+/// than comparisons turned around.
+static Expr canonical_expr(const IRInst* inst);
+/// Returns the hash of the instruction at index as canonical_expr()
+/// gives it, with the operand pool entries of calls and phis.
+static uint64_t hash_inst(const Numbering* num, uint32_t index);
+/// Returns true if the instructions at a and b compute the same value.
+static bool same_value(const Numbering* num, uint32_t a, uint32_t b);
+
+void number_values(IRModule* module, ValueNumberStats* stats) {
+    memset(stats, 0, sizeof(ValueNumberStats));
+    if (module->funcCount == 0) {
+        return;
+    }
+
+    // Without the call graph calls are left alone, everything else is
+    // still numbered
+    CallGraph* graph = create_call_graph(module);
+    bool* pure = graph != NULL ? find_pure_functions(module, graph) : NULL;
+    free_call_graph(graph);
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        number_function_values(module->funcs[i], pure, stats);
+    }
+    free(pure);
+}
+
+void number_function_values(IRFunction* func, const bool* pure,
+    ValueNumberStats* stats) {
+    Numbering num;
+    memset(&num, 0, sizeof(num));
+    num.func = func;
+    num.pure = pure;
+    num.stats = stats;
+    num.cfg = create_ir_cfg(func);
+    if (num.cfg == NULL) {
+        return;
+    }
+
+    // Kept at most half full, so a probe always ends at an empty slot
+    num.slotCount = 16;
+    while (num.slotCount < func->instCount * 2) {
+        num.slotCount *= 2;
+    }
+    uint32_t values = func->instCount + 1;
+    uint32_t blocks = func->blockCount + 1;
+    num.pending = malloc(blocks * 2 * sizeof(uint32_t));
+    num.leader = malloc(values * sizeof(uint32_t));
+    num.blockOf = malloc(values * sizeof(uint32_t));
+    num.slots = malloc(num.slotCount * sizeof(uint32_t));
+    num.filled = malloc(values * sizeof(uint32_t));
+    num.filledMark = malloc(blocks * sizeof(uint32_t));
+    bool ok = num.pending != NULL && num.leader != NULL &&
+        num.blockOf != NULL && num.slots != NULL && num.filled != NULL &&
+        num.filledMark != NULL;
+    if (!ok) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+
+    if (ok) {
+        for (uint32_t i = 0; i < func->instCount; i++) {
+            num.leader[i] = i;
+        }
+        memset(num.slots, 0xff, num.slotCount * sizeof(uint32_t));
+        walk(&num);
+
+        // Phis and blocks the walk did not reach may use values replaced
+        // after they were walked
+        for (uint32_t i = 0; num.removed > 0 && i < func->instCount; i++) {
+            uint32_t* ops;
+            uint32_t count = ir_get_operands(func, &func->insts[i], &ops);
+            for (uint32_t j = 0; j < count; j++) {
+                if (!ir_is_const(ops[j])) {
+                    ops[j] = num.leader[ops[j]];
+                }
+            }
+        }
+    }
+
+    free_ir_cfg(num.cfg);
+    free(num.pending);
+    free(num.leader);
+    free(num.blockOf);
+    free(num.slots);
+    free(num.filled);
+    free(num.filledMark);
+    if (num.removed > 0 && ir_compact(func)) {
+        stats->insts += num.removed;
+    }
+}
+
+/* --- Helper Functions --- */
+
+static void walk(Numbering* num) {
+    const IRFunction* func = num->func;
+    uint32_t top = 0;
+    num->pending[top++] = num->cfg->rpo[0];
+
+    while (top > 0) {
+        uint32_t block = num->pending[--top];
+        if (block & GVN_LEAVE) {
+            // Emptied in the reverse order of filling, no instruction
+            // left in the table probed past a slot emptied here
+            block &= ~GVN_LEAVE;
+            while (num->filledCount > num->filledMark[block]) {
+                num->slots[num->filled[--num->filledCount]] = IR_NONE;
+            }
+            continue;
+        }
+
+        num->filledMark[block] = num->filledCount;
+        for (uint32_t i = func->blocks[block].start;
+            i < func->blocks[block].end; i++) {
+            if (func->insts[i].op != IR_NOP) {
+                visit(num, i, block);
+            }
+        }
+
+        num->pending[top++] = block | GVN_LEAVE;
+        for (uint32_t k = num->cfg->domStart[block + 1];
+            k > num->cfg->domStart[block]; k--) {
+            num->pending[top++] = num->cfg->domChildren[k - 1];
+        }
+    }
+}
+
+static void visit(Numbering* num, uint32_t index, uint32_t block) {
+    IRInst* inst = &num->func->insts[index];
+    uint32_t* ops;
+    uint32_t count = ir_get_operands(num->func, inst, &ops);
+    for (uint32_t j = 0; j < count; j++) {
+        if (!ir_is_const(ops[j])) {
+            ops[j] = num->leader[ops[j]];
+        }
+    }
+    num->blockOf[index] = block;
+    if (!is_numbered(num, inst)) {
+        return;
+    }
+
+    uint32_t mask = num->slotCount - 1;
+    uint32_t slot = (uint32_t)hash_inst(num, index) & mask;
+    while (num->slots[slot] != IR_NONE) {
+        uint32_t found = num->slots[slot];
+        if (same_value(num, found, index)) {
+            num->leader[index] = found;
+            num->stats->calls += inst->op == IR_CALL;
+            inst->op = IR_NOP;
+            num->removed++;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    num->slots[slot] = index;
+    num->filled[num->filledCount++] = slot;
+}
+
+static bool is_numbered(const Numbering* num, const IRInst* inst) {
+    switch ((IROp)inst->op) {
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_MOD:
+        case IR_NEG:
+        case IR_NOT:
+        case IR_EQ:
+        case IR_NEQ:
+        case IR_LT:
+        case IR_LTE:
+        case IR_GT:
+        case IR_GTE:
+        case IR_CAST:
+        case IR_PHI:
+            return true;
+        case IR_CALL:
+            return num->pure != NULL && inst->type != TOK_INVALID &&
+                num->pure[num->func->operands[inst->args[0]]];
+        default:
+            return false;
+    }
+}
+
+static Expr canonical_expr(const IRInst* inst) {
+    Expr expr = { (IROp)inst->op, (TokenType)inst->type,
+        { inst->args[0], inst->args[1] } };
+    uint32_t first = expr.args[0];
+    switch (expr.op) {
+        case IR_ADD:
+        case IR_MUL:
+        case IR_EQ:
+        case IR_NEQ:
+            if (expr.args[0] > expr.args[1]) {
+                expr.args[0] = expr.args[1];
+                expr.args[1] = first;
+            }
+            break;
+        case IR_GT:
+        case IR_GTE:
+            expr.op = expr.op == IR_GT ? IR_LT : IR_LTE;
+            expr.args[0] = expr.args[1];
+            expr.args[1] = first;
+            break;
+        case IR_NEG:
+        case IR_NOT:
+        case IR_CAST:
+            expr.args[1] = 0;
+            break;
+        default:
+            break;
+    }
+    return expr;
+}
+
+static uint64_t hash_inst(const Numbering* num, uint32_t index) {
+    Expr expr = canonical_expr(&num->func->insts[index]);
+    uint64_t hash = hash_word(HASH_SEED,
+        (uint64_t)expr.op << 8 | (uint64_t)expr.type);
+    if (expr.op != IR_CALL && expr.op != IR_PHI) {
+        hash = hash_word(hash, expr.args[0]);
+        return hash_word(hash, expr.args[1]);
+    }
+
+    // A call's callee and arguments, a phi's blocks and values
+    const uint32_t* pool = num->func->operands + expr.args[0];
+    uint32_t count = expr.op == IR_CALL ? expr.args[1] + 1 :
+        expr.args[1] * 2;
+    if (expr.op == IR_PHI) {
+        hash = hash_word(hash, num->blockOf[index]);
+    }
+    for (uint32_t k = 0; k < count; k++) {
+        hash = hash_word(hash, pool[k]);
+    }
+    return hash;
+}
+
+static bool same_value(const Numbering* num, uint32_t a, uint32_t b) {
+    Expr x = canonical_expr(&num->func->insts[a]);
+    Expr y = canonical_expr(&num->func->insts[b]);
+    if (x.op != y.op || x.type != y.type) {
+        return false;
+    }
+    if (x.op != IR_CALL && x.op != IR_PHI) {
+        return x.args[0] == y.args[0] && x.args[1] == y.args[1];
+    }
+
+    // Phis of different blocks merge different edges
+    if (x.args[1] != y.args[1] ||
+        (x.op == IR_PHI && num->blockOf[a] != num->blockOf[b])) {
+        return false;
+    }
+    uint32_t count = x.op == IR_CALL ? x.args[1] + 1 : x.args[1] * 2;
+    return memcmp(num->func->operands + x.args[0],
+        num->func->operands + y.args[0], count * sizeof(uint32_t)) == 0;
+}
@@ -0,0 +1,33 @@
+#ifndef GVN_H
+#define GVN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "ir.h"
+
+/// What number_values() removed.
+typedef struct ValueNumberStats {
+    /// Instructions replaced by an equal one dominating them, calls
+    /// included.
+    size_t insts;
+    /// Calls of pure functions replaced by an earlier call with the same
+    /// arguments.
+    size_t calls;
+} ValueNumberStats;
+
+/// Replaces every instruction that computes a value an instruction
+/// dominating it already computed by that instruction. Arithmetic,
+/// comparisons, casts and phis of the same block are equal when their
+/// operands are, with the operands of commutative ops in either order
+/// and a > b the same as b < a. Divisions are reused too, since the
+/// dominating one would have panicked first. Calls of functions the call
+/// graph finds pure are reused when their arguments are the same. Fills
+/// stats with the counts.
+void number_values(IRModule* module, ValueNumberStats* stats);
+/// Numbers the values of a single function like number_values(). pure
+/// holds the flags find_pure_functions() gives for the module, or is
+/// NULL to leave every call alone. Adds what it removed to stats.
+void number_function_values(IRFunction* func, const bool* pure,
+    ValueNumberStats* stats);
+
+#endif // GVN_H
@@ -0,0 +1,29 @@
+#include "hash.h"
+
+/// The prime of 64-bit FNV-1a.
+#define HASH_PRIME UINT64_C(1099511628211)
+
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= HASH_PRIME;
+    }
+
+    return hash;
+}
+
+uint64_t hash_string(uint64_t hash, const char* str) {
+    for (const unsigned char* c = (const unsigned char*)str; *c; c++) {
+        hash ^= *c;
+        hash *= HASH_PRIME;
+    }
+
+    return hash;
+}
+
+uint64_t hash_word(uint64_t hash, uint64_t value) {
+    hash ^= value;
+    hash *= HASH_PRIME;
+    return hash ^ (hash >> 29);
+}
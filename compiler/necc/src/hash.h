@@ -0,0 +1,21 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// The value a hash starts from, the offset basis of 64-bit FNV-1a.
+#define HASH_SEED UINT64_C(14695981039346656037)
+
+/// Returns hash with the len bytes at data mixed in a byte at a time, as
+/// FNV-1a does.
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t len);
+/// Returns hash with the bytes of a null-terminated string mixed in as
+/// hash_bytes() does.
+uint64_t hash_string(uint64_t hash, const char* str);
+/// Returns hash with a whole word mixed in at once: a single FNV-1a step
+/// on the word, with the high bits of the product folded into the low
+/// ones a table index keeps.
+uint64_t hash_word(uint64_t hash, uint64_t value);
+
+#endif // HASH_H
@@ -0,0 +1,433 @@
+#include "inline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "callgraph.h"
+
+// Every function is rebuilt into a new IRFunction. Its blocks are copied
+// in order, and a call picked for inlining ends the current block with a
+// jump into a copy of the callee's blocks, whose returns jump on to a
+// new block that continues the caller. Phi nodes are emitted with their
+// incoming lists as placeholders and patched once all blocks of their
+// body are copied, since a predecessor may have been split by an inlined
+// call by then. Components of the same level of the call graph are
+// rebuilt in parallel, each worker with its own inliner, as they only
+// read the functions of the finished levels below.
+
+/// How many levels deep a recursive call is unrolled into its caller.
+#define INLINE_MAX_DEPTH 2
+/// Callers stop taking inlined bodies once they have this many
+/// instructions.
+#define INLINE_MAX_SIZE 4096
+
+typedef struct Inliner {
+    IRModule* module;
+    const CallGraph* graph;
+    uint32_t threshold;
+    /// The function being built and the component of its original.
+    IRFunction* out;
+    uint32_t scc;
+    size_t inlined;
+} Inliner;
+
+/// The returns of an inlined body, the block each one leaves from and
+/// the value it returns.
+typedef struct Returns {
+    uint32_t* blocks;
+    uint32_t* values;
+    uint32_t count;
+    uint32_t cap;
+} Returns;
+
+/// Rebuilds the functions of a component with the inliner of worker, the
+/// PoolTask run_bottom_up() runs. A function that fails keeps its body.
+static bool inline_component(void* ctx, uint32_t worker, uint32_t scc);
+/// Builds a copy of the function with calls inlined. Returns NULL on
+/// failure.
+static IRFunction* rebuild_function(Inliner* inliner, IRFunction* func);
+/// Appends a copy of the blocks of src to the function being built. For
+/// an inlined body args holds the argument of each parameter, the copy is
+/// entered from the current block and its returns jump to exit and are
+/// collected in returns. Otherwise args is NULL and returns stay returns.
+/// Returns false on failure.
+static bool copy_body(Inliner* inliner, IRFunction* src,
+    const uint32_t* args, uint32_t depth, uint32_t exit, Returns* returns);
+/// Copies a call of src, inlining it if it is worth it. value receives
+/// the result. Returns false on failure.
+static bool copy_call(Inliner* inliner, IRFunction* src,
+    const IRInst* inst, const uint32_t* map, uint32_t depth,
+    uint32_t* value);
+/// Appends a copy of the body of callee and continues in a new block
+/// after it. value receives the result. Returns false on failure.
+static bool expand_call(Inliner* inliner, uint32_t callee,
+    const uint32_t* args, uint32_t depth, TokenType type, uint32_t* value);
+/// Returns true if a call at the given inlining depth is cheap enough to
+/// inline.
+static bool should_inline(const Inliner* inliner, uint32_t callee,
+    const uint32_t* args, uint32_t argCount, uint32_t depth);
+/// Returns the value of the function being built that stands for value
+/// of src.
+static uint32_t map_value(Inliner* inliner, const IRFunction* src,
+    const uint32_t* map, uint32_t value);
+/// Returns the constant result of an instruction whose operands are
+/// constants, or IR_NONE if it cannot be folded.
+static uint32_t fold_inst(IRFunction* func, IROp op, TokenType type,
+    uint32_t a, uint32_t b);
+/// Returns the number of instructions of the function that generate
+/// code.
+static uint32_t function_size(const IRFunction* func);
+/// Returns the number of uses of the parameter with the given index.
+static uint32_t param_uses(IRFunction* func, uint32_t index);
+/// Returns true if the function has a return.
+static bool has_return(const IRFunction* func);
+/// Appends a return to the list. Returns false on allocation failure.
+static bool push_return(Returns* returns, uint32_t block, uint32_t value);
+
+size_t inline_functions(IRModule* module, const CallGraph* graph,
+    uint32_t threshold, uint32_t threads) {
+    if (threshold == 0 || module->funcCount == 0) {
+        return 0;
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+    Inliner* inliners = malloc(threads * sizeof(Inliner));
+    if (inliners == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 0;
+    }
+
+    for (uint32_t w = 0; w < threads; w++) {
+        inliners[w] = (Inliner){ module, graph, threshold, NULL, 0, 0 };
+    }
+    run_bottom_up(graph, threads, inline_component, inliners);
+    size_t inlined = 0;
+    for (uint32_t w = 0; w < threads; w++) {
+        inlined += inliners[w].inlined;
+    }
+    free(inliners);
+    return inlined;
+}
+
+/* --- Helper Functions --- */
+
+static bool inline_component(void* ctx, uint32_t worker, uint32_t scc) {
+    Inliner* inliner = (Inliner*)ctx + worker;
+    IRModule* module = inliner->module;
+    const CallGraph* graph = inliner->graph;
+    inliner->scc = scc;
+    for (uint32_t i = graph->sccStart[scc]; i < graph->sccStart[scc + 1];
+        i++) {
+        uint32_t index = graph->sccFuncs[i];
+        IRFunction* func = rebuild_function(inliner, module->funcs[index]);
+        if (func != NULL) {
+            free_ir_function(module->funcs[index]);
+            module->funcs[index] = func;
+        }
+    }
+    return true;
+}
+
+static IRFunction* rebuild_function(Inliner* inliner, IRFunction* func) {
+    IRFunction* out = create_ir_function(func->name, func->returnType,
+        func->paramTypes, func->paramCount);
+    if (out == NULL) {
+        return NULL;
+    }
+
+    inliner->out = out;
+    size_t inlined = inliner->inlined;
+    if (!copy_body(inliner, func, NULL, 0, IR_NONE, NULL) ||
+        !ir_compact(out)) {
+        inliner->inlined = inlined;
+        free_ir_function(out);
+        return NULL;
+    }
+    return out;
+}
+
+static bool copy_body(Inliner* inliner, IRFunction* src,
+    const uint32_t* args, uint32_t depth, uint32_t exit, Returns* returns) {
+    IRFunction* out = inliner->out;
+    uint32_t* map = malloc((src->instCount + 1) * sizeof(uint32_t));
+    uint32_t* blocks = malloc((src->blockCount + 1) * sizeof(uint32_t));
+    uint32_t* exits = malloc((src->blockCount + 1) * sizeof(uint32_t));
+    bool ok = map != NULL && blocks != NULL && exits != NULL;
+    if (!ok) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+
+    for (uint32_t b = 0; ok && b < src->blockCount; b++) {
+        blocks[b] = ir_add_block(out);
+        exits[b] = blocks[b];
+        ok = blocks[b] != IR_NONE;
+    }
+    if (ok && args != NULL) {
+        ir_emit_jmp(out, blocks[0]);
+    }
+
+    for (uint32_t b = 0; ok && b < src->blockCount; b++) {
+        ir_set_block(out, blocks[b]);
+        for (uint32_t i = src->blocks[b].start; ok && i < src->blocks[b].end;
+            i++) {
+            const IRInst* inst = &src->insts[i];
+            TokenType type = (TokenType)inst->type;
+            uint32_t value = IR_NONE;
+            switch ((IROp)inst->op) {
+                case IR_NOP:
+                    break;
+                case IR_PARAM:
+                    value = args != NULL ? args[inst->args[0]] :
+                        ir_emit(out, IR_PARAM, type, inst->args[0], 0);
+                    ok = value != IR_NONE;
+                    break;
+                case IR_PHI:
+                    // Patched below
+                    value = ir_emit_phi(out, type,
+                        &src->operands[inst->args[0]],
+                        &src->operands[inst->args[0] + inst->args[1]],
+                        inst->args[1]);
+                    ok = value != IR_NONE;
+                    break;
+                case IR_CALL:
+                    ok = copy_call(inliner, src, inst, map, depth, &value);
+                    break;
+                case IR_JMP:
+                    exits[b] = out->curBlock;
+                    ir_emit_jmp(out, blocks[inst->args[0]]);
+                    break;
+                case IR_BR:
+                    exits[b] = out->curBlock;
+                    ir_emit_br(out, map_value(inliner, src, map,
+                        inst->args[0]),
+                        blocks[src->operands[inst->args[1]]],
+                        blocks[src->operands[inst->args[1] + 1]]);
+                    break;
+                case IR_SWITCH:
+                    exits[b] = out->curBlock;
+                    ok = ir_copy_switch(out, src, inst, map_value(inliner,
+                        src, map, inst->args[0]), blocks);
+                    break;
+                case IR_RET:
+                    exits[b] = out->curBlock;
+                    value = map_value(inliner, src, map, inst->args[0]);
+                    if (args == NULL) {
+                        ir_emit_ret(out, value);
+                    } else {
+                        ok = push_return(returns, out->curBlock, value);
+                        ir_emit_jmp(out, exit);
+                    }
+                    value = IR_NONE;
+                    break;
+                default: {
+                    uint32_t a = map_value(inliner, src, map, inst->args[0]);
+                    uint32_t c = ir_is_binary((IROp)inst->op) ?
+                        map_value(inliner, src, map, inst->args[1]) :
+                        inst->args[1];
+                    value = fold_inst(out, (IROp)inst->op, type, a, c);
+                    if (value == IR_NONE) {
+                        value = ir_emit(out, (IROp)inst->op, type, a, c);
+                        ok = value != IR_NONE;
+                    }
+                    break;
+                }
+            }
+            map[i] = value;
+        }
+    }
+
+    for (uint32_t i = 0; ok && i < src->instCount; i++) {
+        const IRInst* inst = &src->insts[i];
+        if (inst->op != IR_PHI) {
+            continue;
+        }
+        uint32_t start = out->insts[map[i]].args[0];
+        uint32_t count = inst->args[1];
+        for (uint32_t k = 0; k < count; k++) {
+            uint32_t value = map_value(inliner, src, map,
+                src->operands[inst->args[0] + count + k]);
+            out->operands[start + k] =
+                exits[src->operands[inst->args[0] + k]];
+            out->operands[start + count + k] = value;
+        }
+    }
+
+    free(map);
+    free(blocks);
+    free(exits);
+    return ok;
+}
+
+static bool copy_call(Inliner* inliner, IRFunction* src,
+    const IRInst* inst, const uint32_t* map, uint32_t depth,
+    uint32_t* value) {
+    uint32_t callee = src->operands[inst->args[0]];
+    uint32_t count = inst->args[1];
+    uint32_t* args = malloc((count + 1) * sizeof(uint32_t));
+    if (args == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+    for (uint32_t k = 0; k < count; k++) {
+        args[k] = map_value(inliner, src, map,
+            src->operands[inst->args[0] + 1 + k]);
+    }
+
+    bool ok;
+    if (should_inline(inliner, callee, args, count, depth)) {
+        ok = expand_call(inliner, callee, args, depth,
+            (TokenType)inst->type, value);
+    } else {
+        *value = ir_emit_call(inliner->out, (TokenType)inst->type, callee,
+            args, count);
+        ok = *value != IR_NONE;
+    }
+
+    free(args);
+    return ok;
+}
+
+static bool expand_call(Inliner* inliner, uint32_t callee,
+    const uint32_t* args, uint32_t depth, TokenType type, uint32_t* value) {
+    IRFunction* out = inliner->out;
+    Returns returns = { NULL, NULL, 0, 0 };
+    uint32_t exit = ir_add_block(out);
+    bool ok = exit != IR_NONE && copy_body(inliner,
+        inliner->module->funcs[callee], args, depth + 1, exit, &returns);
+
+    if (ok) {
+        ir_set_block(out, exit);
+        *value = IR_NONE;
+        if (type != TOK_INVALID && returns.count == 1) {
+            *value = returns.values[0];
+        } else if (type != TOK_INVALID) {
+            *value = ir_emit_phi(out, type, returns.blocks, returns.values,
+                returns.count);
+            ok = *value != IR_NONE;
+        }
+        inliner->inlined++;
+    }
+
+    free(returns.blocks);
+    free(returns.values);
+    return ok;
+}
+
+static bool should_inline(const Inliner* inliner, uint32_t callee,
+    const uint32_t* args, uint32_t argCount, uint32_t depth) {
+    const CallGraph* graph = inliner->graph;
+    IRFunction* body = inliner->module->funcs[callee];
+    bool recursive = graph->recursive[inliner->scc] &&
+        graph->sccOf[callee] == inliner->scc;
+
+    // Calls left in an inlined body were already turned down when its
+    // function was built, unless they lead back into this component
+    if ((depth > 0 && !recursive) ||
+        (recursive && depth >= INLINE_MAX_DEPTH) ||
+        inliner->out->instCount >= INLINE_MAX_SIZE || !has_return(body)) {
+        return false;
+    }
+
+    // The call, the return and the argument moves go away, and every use
+    // of a constant argument is likely to fold
+    uint32_t size = function_size(body);
+    uint32_t benefit = argCount + 2;
+    for (uint32_t k = 0; k < argCount; k++) {
+        if (ir_is_const(args[k])) {
+            benefit += param_uses(body, k);
+        }
+    }
+    uint64_t cost = size > benefit ? size - benefit : 0;
+    if (recursive) {
+        cost <<= depth + 1;
+    }
+    return cost <= inliner->threshold;
+}
+
+static uint32_t map_value(Inliner* inliner, const IRFunction* src,
+    const uint32_t* map, uint32_t value) {
+    if (value == IR_NONE) {
+        return IR_NONE;
+    }
+    if (ir_is_const(value)) {
+        return ir_const(inliner->out, ir_get_const(src, value)->type,
+            ir_const_value(src, value));
+    }
+    return map[value];
+}
+
+static uint32_t fold_inst(IRFunction* func, IROp op, TokenType type,
+    uint32_t a, uint32_t b) {
+    if (!ir_is_const(a) || (ir_is_binary(op) && !ir_is_const(b))) {
+        return IR_NONE;
+    }
+
+    ConstValue x = ir_const_value(func, a);
+    ConstValue y = ir_is_binary(op) ? ir_const_value(func, b) : x;
+    ConstValue result;
+    if (!ir_eval_op(op, type, ir_value_type(func, a), x, y, &result)) {
+        return IR_NONE;
+    }
+    return ir_const(func, type, result);
+}
+
+static uint32_t function_size(const IRFunction* func) {
+    uint32_t size = 0;
+    for (uint32_t i = 0; i < func->instCount; i++) {
+        IROp op = (IROp)func->insts[i].op;
+        size += op == IR_PARAM || op == IR_PHI || op == IR_NOP ? 0 : 1;
+    }
+    return size;
+}
+
+static uint32_t param_uses(IRFunction* func, uint32_t index) {
+    uint32_t param = IR_NONE;
+    for (uint32_t i = 0; i < func->instCount && param == IR_NONE; i++) {
+        if (func->insts[i].op == IR_PARAM && func->insts[i].args[0] == index) {
+            param = i;
+        }
+    }
+
+    uint32_t uses = 0;
+    for (uint32_t i = 0; param != IR_NONE && i < func->instCount; i++) {
+        uint32_t* ops;
+        uint32_t count = ir_get_operands(func, &func->insts[i], &ops);
+        for (uint32_t k = 0; k < count; k++) {
+            uses += ops[k] == param ? 1 : 0;
+        }
+    }
+    return uses;
+}
+
+static bool has_return(const IRFunction* func) {
+    for (uint32_t i = 0; i < func->instCount; i++) {
+        if (func->insts[i].op == IR_RET) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool push_return(Returns* returns, uint32_t block, uint32_t value) {
+    if (returns->count == returns->cap) {
+        uint32_t cap = returns->cap == 0 ? 4 : returns->cap * 2;
+        uint32_t* blocks = realloc(returns->blocks, cap * sizeof(uint32_t));
+        if (blocks != NULL) {
+            returns->blocks = blocks;
+        }
+        uint32_t* values = realloc(returns->values, cap * sizeof(uint32_t));
+        if (values != NULL) {
+            returns->values = values;
+        }
+        if (blocks == NULL || values == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return false;
+        }
+        returns->cap = cap;
+    }
+
+    returns->blocks[returns->count] = block;
+    returns->values[returns->count] = value;
+    returns->count++;
+    return true;
+}
@@ -0,0 +1,27 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "callgraph.h"
+#include "ir.h"
+
+/// The default cost up to which a call is inlined.
+#define INLINE_THRESHOLD 40
+
+/// Replaces calls in every function of the module with copies of the
+/// callee's body. Functions are visited bottom-up over the strongly
+/// connected components of graph, the call graph of the module, so
+/// callees are inlined into before their callers, with the
+/// independent components of a level rebuilt on up to threads
+/// workers. A call costs the size of the callee minus the call
+/// overhead saved and the uses of parameters that get constant
+/// arguments, and is inlined if the cost is at most threshold.
+/// Recursive calls are only unrolled a bounded number of times, each
+/// level doubling their cost. Constant arithmetic in the copies is
+/// folded. A threshold of 0 disables the pass. Returns the number of
+/// calls that were inlined, which does not depend on threads.
+size_t inline_functions(IRModule* module, const CallGraph* graph,
+    uint32_t threshold, uint32_t threads);
+
+#endif // INLINE_H
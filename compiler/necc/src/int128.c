@@ -0,0 +1,285 @@
+#include "int128.h"
+#include <math.h>
+#include "types.h"
+
+/// Returns the value shifted left by one bit.
+static Int128 shl1(Int128 value);
+/// Returns the full 128-bit product of two 64-bit values.
+static Int128 mul_64x64(uint64_t a, uint64_t b);
+
+Int128 i128_from_u64(uint64_t value) {
+    Int128 result = { value, 0 };
+    return result;
+}
+
+Int128 i128_from_i64(int64_t value) {
+    Int128 result = { (uint64_t)value, value < 0 ? UINT64_MAX : 0 };
+    return result;
+}
+
+bool i128_is_zero(Int128 value) {
+    return value.lo == 0 && value.hi == 0;
+}
+
+bool i128_is_neg(Int128 value) {
+    return (value.hi >> 63) != 0;
+}
+
+bool i128_eq(Int128 a, Int128 b) {
+    return a.lo == b.lo && a.hi == b.hi;
+}
+
+bool i128_ult(Int128 a, Int128 b) {
+    return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+bool i128_slt(Int128 a, Int128 b) {
+    bool aNeg = i128_is_neg(a);
+    bool bNeg = i128_is_neg(b);
+    if (aNeg != bNeg) {
+        return aNeg;
+    }
+
+    return i128_ult(a, b);
+}
+
+Int128 i128_add(Int128 a, Int128 b) {
+    Int128 result;
+    result.lo = a.lo + b.lo;
+    result.hi = a.hi + b.hi + (result.lo < a.lo ? 1 : 0);
+    return result;
+}
+
+Int128 i128_sub(Int128 a, Int128 b) {
+    Int128 result;
+    result.lo = a.lo - b.lo;
+    result.hi = a.hi - b.hi - (a.lo < b.lo ? 1 : 0);
+    return result;
+}
+
+Int128 i128_mul(Int128 a, Int128 b) {
+    Int128 result = mul_64x64(a.lo, b.lo);
+    result.hi += a.lo * b.hi + a.hi * b.lo;
+    return result;
+}
+
+Int128 i128_neg(Int128 value) {
+    return i128_sub(i128_from_u64(0), value);
+}
+
+Int128 i128_udivmod(Int128 a, Int128 b, Int128* rem) {
+    Int128 quotient = { 0, 0 };
+    Int128 remainder = { 0, 0 };
+
+    if (a.hi == 0 && b.hi == 0) {
+        quotient.lo = a.lo / b.lo;
+        remainder.lo = a.lo % b.lo;
+    } else {
+        // Restoring shift and subtract division
+        for (int bit = 127; bit >= 0; bit--) {
+            remainder = shl1(remainder);
+            uint64_t word = bit >= 64 ? a.hi : a.lo;
+            remainder.lo |= (word >> (bit & 63)) & 1;
+            quotient = shl1(quotient);
+
+            if (!i128_ult(remainder, b)) {
+                remainder = i128_sub(remainder, b);
+                quotient.lo |= 1;
+            }
+        }
+    }
+
+    if (rem != NULL) {
+        *rem = remainder;
+    }
+
+    return quotient;
+}
+
+Int128 i128_sdivmod(Int128 a, Int128 b, Int128* rem) {
+    bool aNeg = i128_is_neg(a);
+    bool bNeg = i128_is_neg(b);
+
+    Int128 remainder;
+    Int128 quotient = i128_udivmod(aNeg ? i128_neg(a) : a,
+        bNeg ? i128_neg(b) : b, &remainder);
+
+    if (aNeg != bNeg) {
+        quotient = i128_neg(quotient);
+    }
+    if (rem != NULL) {
+        *rem = aNeg ? i128_neg(remainder) : remainder;
+    }
+
+    return quotient;
+}
+
+Int128 i128_wrap(Int128 value, TokenType type) {
+    size_t bits = type_bit_width(type);
+    if (type == TOK_BOOL) {
+        Int128 result = { i128_is_zero(value) ? 0 : 1, 0 };
+        return result;
+    }
+    if (bits == 0 || bits >= 128) {
+        return value;
+    }
+
+    Int128 result = { 0, 0 };
+    if (bits == 64) {
+        result.lo = value.lo;
+    } else {
+        result.lo = value.lo & ((UINT64_C(1) << bits) - 1);
+    }
+
+    if (type_is_signed(type) && ((result.lo >> (bits - 1)) & 1)) {
+        if (bits < 64) {
+            result.lo |= ~((UINT64_C(1) << bits) - 1);
+        }
+        result.hi = UINT64_MAX;
+    }
+
+    return result;
+}
+
+double i128_to_double(Int128 value, bool isSigned) {
+    if (isSigned && i128_is_neg(value)) {
+        return -i128_to_double(i128_neg(value), false);
+    }
+
+    return (double)value.hi * 18446744073709551616.0 + (double)value.lo;
+}
+
+bool i128_from_double(double value, TokenType type, Int128* out) {
+    if (!isfinite(value)) {
+        return false;
+    }
+
+    double truncated = trunc(value);
+    double magnitude = fabs(truncated);
+    if (magnitude >= 340282366920938463463374607431768211456.0) {
+        return false;
+    }
+
+    Int128 result;
+    result.hi = (uint64_t)(magnitude / 18446744073709551616.0);
+    result.lo = (uint64_t)(magnitude -
+        (double)result.hi * 18446744073709551616.0);
+    if (truncated < 0) {
+        result = i128_neg(result);
+    }
+
+    // Reject values that do not survive the round trip through the type
+    Int128 wrapped = i128_wrap(result, type);
+    if (!i128_eq(wrapped, result) ||
+        (truncated < 0 && (!type_is_signed(type) ||
+        !i128_is_neg(result))) ||
+        (truncated >= 0 && i128_is_neg(result) && type_is_signed(type))) {
+        return false;
+    }
+
+    *out = result;
+    return true;
+}
+
+Int128 i128_type_limit(TokenType type, bool isMax) {
+    size_t bits = type_bit_width(type);
+    bool isSigned = type_is_signed(type);
+
+    Int128 limit = { UINT64_MAX, 0 };
+    if (bits == 128) {
+        limit.hi = isSigned ? (uint64_t)INT64_MAX : UINT64_MAX;
+    } else {
+        if (bits < 64) {
+            limit.lo = (UINT64_C(1) << bits) - 1;
+        }
+        if (isSigned) {
+            limit.lo >>= 1;
+        }
+    }
+
+    if (isMax) {
+        return limit;
+    }
+    return isSigned ? i128_sub(i128_neg(limit), i128_from_u64(1)) :
+        i128_from_u64(0);
+}
+
+bool i128_parse(const char* str, Int128* out) {
+    bool negative = false;
+    if (*str == '-') {
+        negative = true;
+        str++;
+    }
+
+    if (*str == '\0') {
+        return false;
+    }
+
+    Int128 result = { 0, 0 };
+    Int128 ten = { 10, 0 };
+    for (; *str != '\0'; str++) {
+        if (*str < '0' || *str > '9') {
+            return false;
+        }
+        result = i128_add(i128_mul(result, ten),
+            i128_from_u64((uint64_t)(*str - '0')));
+    }
+
+    *out = negative ? i128_neg(result) : result;
+    return true;
+}
+
+char* i128_to_str(Int128 value, bool isSigned, char* buf) {
+    char digits[INT128_STR_MAX];
+    size_t count = 0;
+    bool negative = isSigned && i128_is_neg(value);
+    if (negative) {
+        value = i128_neg(value);
+    }
+
+    Int128 ten = { 10, 0 };
+    do {
+        Int128 digit;
+        value = i128_udivmod(value, ten, &digit);
+        digits[count++] = (char)('0' + digit.lo);
+    } while (!i128_is_zero(value));
+
+    size_t pos = 0;
+    if (negative) {
+        buf[pos++] = '-';
+    }
+    while (count > 0) {
+        buf[pos++] = digits[--count];
+    }
+    buf[pos] = '\0';
+
+    return buf;
+}
+
+/* --- Helper Functions --- */
+
+static Int128 shl1(Int128 value) {
+    Int128 result;
+    result.hi = (value.hi << 1) | (value.lo >> 63);
+    result.lo = value.lo << 1;
+    return result;
+}
+
+static Int128 mul_64x64(uint64_t a, uint64_t b) {
+    uint64_t aLo = a & 0xffffffffu;
+    uint64_t aHi = a >> 32;
+    uint64_t bLo = b & 0xffffffffu;
+    uint64_t bHi = b >> 32;
+
+    uint64_t loLo = aLo * bLo;
+    uint64_t hiLo = aHi * bLo;
+    uint64_t loHi = aLo * bHi;
+    uint64_t hiHi = aHi * bHi;
+
+    uint64_t cross = (loLo >> 32) + (hiLo & 0xffffffffu) + loHi;
+
+    Int128 result;
+    result.lo = (cross << 32) | (loLo & 0xffffffffu);
+    result.hi = hiHi + (hiLo >> 32) + (cross >> 32);
+    return result;
+}
@@ -0,0 +1,77 @@
+#ifndef INT128_H
+#define INT128_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "token.h"
+
+/// Portable two's complement 128-bit integer. Used wherever the compiler
+/// has to evaluate NeoC integer arithmetic itself, so i128 and u128 are
+/// handled the same way as the narrower types. Narrower values are
+/// stored sign or zero extended to the full 128 bits.
+typedef struct Int128 {
+    /// The low 64 bits of the value.
+    uint64_t lo;
+    /// The high 64 bits of the value.
+    uint64_t hi;
+} Int128;
+
+/// Maximum length of a decimal i128/u128 string, including the sign and
+/// the null terminator.
+#define INT128_STR_MAX 42
+
+/// Returns the value zero extended from a u64.
+Int128 i128_from_u64(uint64_t value);
+/// Returns the value sign extended from an i64.
+Int128 i128_from_i64(int64_t value);
+/// Returns true if the value is zero.
+bool i128_is_zero(Int128 value);
+/// Returns true if the value is negative when interpreted as signed.
+bool i128_is_neg(Int128 value);
+/// Returns true if both values are bitwise equal.
+bool i128_eq(Int128 a, Int128 b);
+/// Returns true if a < b when both are interpreted as unsigned.
+bool i128_ult(Int128 a, Int128 b);
+/// Returns true if a < b when both are interpreted as signed.
+bool i128_slt(Int128 a, Int128 b);
+
+/// Wrapping addition.
+Int128 i128_add(Int128 a, Int128 b);
+/// Wrapping subtraction.
+Int128 i128_sub(Int128 a, Int128 b);
+/// Wrapping multiplication.
+Int128 i128_mul(Int128 a, Int128 b);
+/// Wrapping negation.
+Int128 i128_neg(Int128 value);
+/// Unsigned division. The divisor must not be zero. The remainder is
+/// stored in rem if it is not NULL.
+Int128 i128_udivmod(Int128 a, Int128 b, Int128* rem);
+/// Signed division truncating toward zero, the remainder takes the sign
+/// of the dividend. The divisor must not be zero. Overflow wraps.
+Int128 i128_sdivmod(Int128 a, Int128 b, Int128* rem);
+
+/// Truncates the value to the width of the given integer type, then
+/// sign or zero extends it back to 128 bits depending on the signedness
+/// of the type. This implements the wrapping semantics of the spec.
+Int128 i128_wrap(Int128 value, TokenType type);
+/// Converts the value to a double. Interprets the value as signed if
+/// isSigned is true.
+double i128_to_double(Int128 value, bool isSigned);
+/// Converts a double to an integer of the given type, truncating toward
+/// zero. Returns false if the value is not finite or does not fit in the
+/// type.
+bool i128_from_double(double value, TokenType type, Int128* out);
+/// Returns the largest or smallest value of an integer type, extended to
+/// 128 bits like the values of the type.
+Int128 i128_type_limit(TokenType type, bool isMax);
+
+/// Parses a decimal integer with an optional leading '-'. Values larger
+/// than 128 bits wrap. Returns false if the string is not a valid
+/// decimal integer.
+bool i128_parse(const char* str, Int128* out);
+/// Writes the decimal representation of the value into buf, which must
+/// hold at least INT128_STR_MAX bytes. Returns buf.
+char* i128_to_str(Int128 value, bool isSigned, char* buf);
+
+#endif // INT128_H
@@ -0,0 +1,184 @@
+#include "intern.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+
+// Nodes are interned bottom up as the parser builds them, so two equal
+// subtrees have the same children by address and comparing a node only
+// looks one level down. Sharing is what keeps a node alive, not the
+// table: the table's own reference is dropped when it is destroyed, and
+// a node no tree holds then goes with it.
+
+/// Returns whether the node is an expression interning can share.
+static bool is_internable(const ASTNode* node);
+/// Returns the hash of the fields of node compared by nodes_equal().
+static size_t hash_node(const ASTNode* node);
+/// Returns whether two internable nodes are the same expression.
+static bool nodes_equal(const ASTNode* a, const ASTNode* b);
+/// Doubles the slots of the table and reinserts its nodes. Returns false
+/// on allocation failure.
+static bool grow_table(NodeTable* table);
+
+NodeTable* create_node_table(void) {
+    NodeTable* table = calloc(1, sizeof(NodeTable));
+    if (table == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for node"\
+            " table\n");
+        return NULL;
+    }
+
+    table->slotCount = 256;
+    table->slots = calloc(table->slotCount, sizeof(ASTNode*));
+    if (table->slots == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+void destroy_node_table(NodeTable* table) {
+    if (table == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < table->slotCount; i++) {
+        free_ast_node(table->slots[i]);
+    }
+    free(table->slots);
+    free(table);
+}
+
+ASTNode* intern_ast_node(NodeTable* table, ASTNode* node) {
+    if (node == NULL || !is_internable(node)) {
+        return node;
+    }
+
+    // Kept at most half full, so a probe always ends at an empty slot
+    if ((table->count + 1) * 2 > table->slotCount && !grow_table(table)) {
+        return node;
+    }
+
+    size_t slot = hash_node(node) & (table->slotCount - 1);
+    while (table->slots[slot] != NULL) {
+        ASTNode* found = table->slots[slot];
+        if (nodes_equal(found, node)) {
+            free_ast_node(node);
+            table->shared++;
+            return share_ast_node(found);
+        }
+        slot = (slot + 1) & (table->slotCount - 1);
+    }
+
+    table->slots[slot] = share_ast_node(node);
+    table->count++;
+    return node;
+}
+
+/* --- Helper Functions --- */
+
+static bool is_internable(const ASTNode* node) {
+    switch (node->type) {
+        case NODE_LITERAL:
+        case NODE_IDENT:
+        case NODE_BINARY_EXPR:
+        case NODE_CAST_EXPR:
+            return true;
+        case NODE_UNARY_EXPR:
+            // Increments and decrements write their operand
+            return !node->data.unaryExpr.isPostfix &&
+                (node->data.unaryExpr.op == TOK_SUB ||
+                node->data.unaryExpr.op == TOK_NOT);
+        default:
+            return false;
+    }
+}
+
+static size_t hash_node(const ASTNode* node) {
+    uint64_t hash = hash_word(HASH_SEED, (uint64_t)node->type);
+    switch (node->type) {
+        case NODE_LITERAL:
+            hash = hash_word(hash, (uint64_t)node->data.literal.type);
+            hash = hash_string(hash, node->data.literal.value);
+            break;
+        case NODE_IDENT:
+            hash = hash_string(hash, node->data.ident.name);
+            break;
+        case NODE_BINARY_EXPR:
+            hash = hash_word(hash, (uint64_t)node->data.binaryExpr.op);
+            hash = hash_word(hash,
+                (uint64_t)(uintptr_t)node->data.binaryExpr.left);
+            hash = hash_word(hash,
+                (uint64_t)(uintptr_t)node->data.binaryExpr.right);
+            break;
+        case NODE_UNARY_EXPR:
+            hash = hash_word(hash, (uint64_t)node->data.unaryExpr.op);
+            hash = hash_word(hash,
+                (uint64_t)(uintptr_t)node->data.unaryExpr.operand);
+            break;
+        case NODE_CAST_EXPR:
+            hash = hash_word(hash, (uint64_t)node->data.castExpr.type);
+            hash = hash_word(hash,
+                (uint64_t)(uintptr_t)node->data.castExpr.expr);
+            break;
+        default:
+            break;
+    }
+    return (size_t)hash;
+}
+
+static bool nodes_equal(const ASTNode* a, const ASTNode* b) {
+    if (a->type != b->type) {
+        return false;
+    }
+
+    switch (a->type) {
+        case NODE_LITERAL:
+            return a->data.literal.type == b->data.literal.type &&
+                !strcmp(a->data.literal.value, b->data.literal.value);
+        case NODE_IDENT:
+            return !strcmp(a->data.ident.name, b->data.ident.name);
+        case NODE_BINARY_EXPR:
+            return a->data.binaryExpr.op == b->data.binaryExpr.op &&
+                a->data.binaryExpr.left == b->data.binaryExpr.left &&
+                a->data.binaryExpr.right == b->data.binaryExpr.right;
+        case NODE_UNARY_EXPR:
+            return a->data.unaryExpr.op == b->data.unaryExpr.op &&
+                a->data.unaryExpr.operand == b->data.unaryExpr.operand;
+        case NODE_CAST_EXPR:
+            return a->data.castExpr.type == b->data.castExpr.type &&
+                a->data.castExpr.expr == b->data.castExpr.expr;
+        default:
+            return false;
+    }
+}
+
+static bool grow_table(NodeTable* table) {
+    size_t slotCount = table->slotCount * 2;
+    ASTNode** slots = calloc(slotCount, sizeof(ASTNode*));
+    if (slots == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    for (size_t i = 0; i < table->slotCount; i++) {
+        ASTNode* node = table->slots[i];
+        if (node == NULL) {
+            continue;
+        }
+        size_t slot = hash_node(node) & (slotCount - 1);
+        while (slots[slot] != NULL) {
+            slot = (slot + 1) & (slotCount - 1);
+        }
+        slots[slot] = node;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->slotCount = slotCount;
+    return true;
+}
@@ -0,0 +1,34 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include "ast.h"
+
+/// The expressions built so far that later identical ones share.
+typedef struct NodeTable {
+    /// Open addressing hash table of nodes, NULL marking an empty slot.
+    /// Each node holds a reference for the table.
+    ASTNode** slots;
+    /// The number of slots, always a power of two.
+    size_t slotCount;
+    /// The number of nodes in the table.
+    size_t count;
+    /// The number of nodes interning replaced with one from the table.
+    size_t shared;
+} NodeTable;
+
+/// Creates an empty node table. Returns NULL on failure.
+NodeTable* create_node_table(void);
+/// Drops the references the table holds and frees it, leaving shared
+/// nodes to the trees holding them. Safely handles NULL.
+void destroy_node_table(NodeTable* table);
+/// Returns a node of the table equal to node, freeing node and taking a
+/// reference to the one returned, or adds node to the table and returns
+/// it. Literals, identifiers, casts and the unary and binary operators
+/// without side effects are interned, anything else is returned as it
+/// is. Children are compared by address, so they must have been
+/// interned first for equal subtrees to be found. Returns node if the
+/// table cannot grow.
+ASTNode* intern_ast_node(NodeTable* table, ASTNode* node);
+
+#endif // INTERN_H
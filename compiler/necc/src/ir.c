@@ -0,0 +1,1493 @@
+#include "ir.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+
+/// Grows a dynamic array so it holds at least need elements. Returns
+/// false on failure, leaving the array untouched.
+static bool grow_array(void** array, uint32_t* cap, uint32_t need,
+    size_t elemSize);
+/// Returns the hash of a constant pool entry.
+static uint32_t hash_const(TokenType type, Int128 bits);
+/// Rebuilds the constant hash table with the given number of slots.
+static bool rehash_consts(IRFunction* func, uint32_t slotCount);
+/// Maps an old value id to its compacted id, constants are unchanged.
+static uint32_t remap_value(const uint32_t* valueMap, uint32_t value);
+/// Orders block ids by the position of their first instruction.
+static int compare_block_start(const void* a, const void* b);
+/// Returns the operator token of an arithmetic or comparison op.
+static TokenType op_token(IROp op);
+/// Returns the storage of a non-constant value for ir_phi_moves().
+static uint32_t move_loc(const uint32_t* locs, uint32_t value);
+/// Prints a verifier problem.
+static void report(const IRFunction* func, uint32_t inst,
+    const char* message);
+/// Prints a value operand.
+static void print_value(const IRFunction* func, uint32_t value);
+
+IRFunction* create_ir_function(const char* name, TokenType returnType,
+    const TokenType* paramTypes, uint32_t paramCount) {
+    IRFunction* func = calloc(1, sizeof(IRFunction));
+    if (func == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for IR"\
+            " function\n");
+        return NULL;
+    }
+
+    size_t len = strlen(name);
+    func->name = malloc(len + 1);
+    func->paramTypes = malloc((paramCount + 1) * sizeof(TokenType));
+    if (func->name == NULL || func->paramTypes == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free_ir_function(func);
+        return NULL;
+    }
+
+    memcpy(func->name, name, len + 1);
+    if (paramCount > 0) {
+        memcpy(func->paramTypes, paramTypes, paramCount * sizeof(TokenType));
+    }
+    func->paramCount = paramCount;
+    func->returnType = returnType;
+    func->curBlock = IR_NONE;
+    return func;
+}
+
+void free_ir_function(IRFunction* func) {
+    if (func == NULL) {
+        return;
+    }
+
+    free(func->name);
+    free(func->paramTypes);
+    free(func->insts);
+    free(func->operands);
+    free(func->blocks);
+    free(func->consts);
+    free(func->constSlots);
+    free(func);
+}
+
+IRModule* create_ir_module(void) {
+    IRModule* module = calloc(1, sizeof(IRModule));
+    if (module == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for IR module\n");
+    }
+
+    return module;
+}
+
+bool ir_module_add(IRModule* module, IRFunction* func) {
+    IRFunction** funcs = realloc(module->funcs,
+        (module->funcCount + 1) * sizeof(IRFunction*));
+    if (funcs == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    module->funcs = funcs;
+    module->funcs[module->funcCount++] = func;
+    return true;
+}
+
+void free_ir_module(IRModule* module) {
+    if (module == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        free_ir_function(module->funcs[i]);
+    }
+    free(module->funcs);
+    free(module);
+}
+
+uint32_t ir_add_block(IRFunction* func) {
+    if (!grow_array((void**)&func->blocks, &func->blockCap,
+        func->blockCount + 1, sizeof(IRBlock))) {
+        return IR_NONE;
+    }
+
+    IRBlock* block = &func->blocks[func->blockCount];
+    block->start = IR_NONE;
+    block->end = IR_NONE;
+    return func->blockCount++;
+}
+
+void ir_set_block(IRFunction* func, uint32_t block) {
+    if (func->curBlock != IR_NONE) {
+        fprintf(stderr, "Error: IR block b%u started before b%u was"\
+            " finished\n", block, func->curBlock);
+    }
+
+    func->blocks[block].start = func->instCount;
+    func->blocks[block].end = func->instCount;
+    func->curBlock = block;
+}
+
+uint32_t ir_emit(IRFunction* func, IROp op, TokenType type, uint32_t a,
+    uint32_t b) {
+    if (func->curBlock == IR_NONE) {
+        fprintf(stderr, "Error: IR instruction emitted outside a block\n");
+        return IR_NONE;
+    }
+
+    if (!grow_array((void**)&func->insts, &func->instCap,
+        func->instCount + 1, sizeof(IRInst))) {
+        return IR_NONE;
+    }
+
+    IRInst* inst = &func->insts[func->instCount];
+    inst->op = (uint8_t)op;
+    inst->type = (uint8_t)type;
+    inst->flags = 0;
+    inst->args[0] = a;
+    inst->args[1] = b;
+
+    func->blocks[func->curBlock].end = func->instCount + 1;
+    if (ir_is_terminator(op)) {
+        func->curBlock = IR_NONE;
+    }
+
+    return func->instCount++;
+}
+
+uint32_t ir_add_operands(IRFunction* func, const uint32_t* words,
+    uint32_t count) {
+    if (!grow_array((void**)&func->operands, &func->operandCap,
+        func->operandCount + count, sizeof(uint32_t))) {
+        return IR_NONE;
+    }
+
+    uint32_t start = func->operandCount;
+    if (count > 0) {
+        memcpy(func->operands + start, words, count * sizeof(uint32_t));
+    }
+    func->operandCount += count;
+    return start;
+}
+
+uint32_t ir_const(IRFunction* func, TokenType type, ConstValue value) {
+    Int128 bits = value.i;
+    if (type_is_float(type)) {
+        bits.hi = 0;
+        memcpy(&bits.lo, &value.f, sizeof(double));
+    }
+
+    if (func->constCount * 2 >= func->constSlotCount) {
+        uint32_t slotCount = func->constSlotCount == 0 ? 64 :
+            func->constSlotCount * 2;
+        if (!rehash_consts(func, slotCount)) {
+            return IR_NONE;
+        }
+    }
+
+    uint32_t mask = func->constSlotCount - 1;
+    uint32_t slot = hash_const(type, bits) & mask;
+    while (func->constSlots[slot] != 0) {
+        IRConst* entry = &func->consts[func->constSlots[slot] - 1];
+        if (entry->type == type && i128_eq(entry->bits, bits)) {
+            return (func->constSlots[slot] - 1) | IR_CONST_FLAG;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (!grow_array((void**)&func->consts, &func->constCap,
+        func->constCount + 1, sizeof(IRConst))) {
+        return IR_NONE;
+    }
+
+    func->consts[func->constCount].bits = bits;
+    func->consts[func->constCount].type = type;
+    func->constSlots[slot] = func->constCount + 1;
+    return func->constCount++ | IR_CONST_FLAG;
+}
+
+uint32_t ir_emit_call(IRFunction* func, TokenType type, uint32_t callee,
+    const uint32_t* args, uint32_t argCount) {
+    uint32_t start = ir_add_operands(func, &callee, 1);
+    if (start == IR_NONE || ir_add_operands(func, args, argCount)
+        == IR_NONE) {
+        return IR_NONE;
+    }
+
+    return ir_emit(func, IR_CALL, type, start, argCount);
+}
+
+uint32_t ir_emit_phi(IRFunction* func, TokenType type,
+    const uint32_t* blocks, const uint32_t* values, uint32_t count) {
+    uint32_t start = ir_add_operands(func, blocks, count);
+    if (start == IR_NONE || ir_add_operands(func, values, count)
+        == IR_NONE) {
+        return IR_NONE;
+    }
+
+    return ir_emit(func, IR_PHI, type, start, count);
+}
+
+void ir_emit_br(IRFunction* func, uint32_t cond, uint32_t thenBlock,
+    uint32_t elseBlock) {
+    uint32_t targets[2] = { thenBlock, elseBlock };
+    uint32_t start = ir_add_operands(func, targets, 2);
+    if (start != IR_NONE) {
+        ir_emit(func, IR_BR, TOK_INVALID, cond, start);
+    }
+}
+
+void ir_emit_switch(IRFunction* func, uint32_t value, uint32_t defaultBlock,
+    const uint32_t* blocks, const uint32_t* keys, uint32_t count) {
+    uint32_t header[2] = { count, defaultBlock };
+    uint32_t start = ir_add_operands(func, header, 2);
+    if (start != IR_NONE && ir_add_operands(func, blocks, count) != IR_NONE &&
+        ir_add_operands(func, keys, count) != IR_NONE) {
+        ir_emit(func, IR_SWITCH, TOK_INVALID, value, start);
+    }
+}
+
+bool ir_copy_switch(IRFunction* func, const IRFunction* src,
+    const IRInst* inst, uint32_t value, const uint32_t* blocks) {
+    const uint32_t* cases = src->operands + inst->args[1];
+    uint32_t count = cases[0];
+    uint32_t* words = malloc((count * 2 + 1) * sizeof(uint32_t));
+    if (words == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    bool ok = true;
+    for (uint32_t j = 0; ok && j < count; j++) {
+        uint32_t key = cases[2 + count + j];
+        words[j] = blocks[cases[2 + j]];
+        words[count + j] = ir_const(func, ir_get_const(src, key)->type,
+            ir_const_value(src, key));
+        ok = words[count + j] != IR_NONE;
+    }
+    uint32_t before = func->instCount;
+    if (ok) {
+        ir_emit_switch(func, value, blocks[cases[1]], words, words + count,
+            count);
+        ok = func->instCount > before;
+    }
+    free(words);
+    return ok;
+}
+
+void ir_emit_jmp(IRFunction* func, uint32_t target) {
+    ir_emit(func, IR_JMP, TOK_INVALID, target, 0);
+}
+
+void ir_emit_ret(IRFunction* func, uint32_t value) {
+    ir_emit(func, IR_RET, TOK_INVALID, value, 0);
+}
+
+bool ir_is_const(uint32_t value) {
+    return value != IR_NONE && (value & IR_CONST_FLAG) != 0;
+}
+
+const IRConst* ir_get_const(const IRFunction* func, uint32_t value) {
+    return &func->consts[value & ~IR_CONST_FLAG];
+}
+
+ConstValue ir_const_value(const IRFunction* func, uint32_t value) {
+    const IRConst* entry = ir_get_const(func, value);
+    ConstValue result = { entry->bits, 0.0 };
+    if (type_is_float(entry->type)) {
+        memcpy(&result.f, &entry->bits.lo, sizeof(double));
+        result.i = i128_from_u64(0);
+    }
+
+    return result;
+}
+
+TokenType ir_value_type(const IRFunction* func, uint32_t value) {
+    if (value == IR_NONE) {
+        return TOK_INVALID;
+    }
+    if (ir_is_const(value)) {
+        return ir_get_const(func, value)->type;
+    }
+
+    return (TokenType)func->insts[value].type;
+}
+
+bool ir_is_terminator(IROp op) {
+    return op == IR_JMP || op == IR_BR || op == IR_SWITCH || op == IR_RET;
+}
+
+bool ir_is_binary(IROp op) {
+    return (op >= IR_ADD && op <= IR_MOD) || (op >= IR_EQ && op <= IR_GTE);
+}
+
+bool ir_is_pure(IROp op) {
+    switch (op) {
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_NEG:
+        case IR_NOT:
+        case IR_EQ:
+        case IR_NEQ:
+        case IR_LT:
+        case IR_LTE:
+        case IR_GT:
+        case IR_GTE:
+        case IR_CAST:
+        case IR_PHI:
+        case IR_PARAM:
+            return true;
+        default:
+            // Division can trap on zero so it stays
+            return false;
+    }
+}
+
+bool ir_eval_op(IROp op, TokenType type, TokenType operandType,
+    ConstValue a, ConstValue b, ConstValue* out) {
+    ConstValue result = { { 0, 0 }, 0.0 };
+    switch (op) {
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_MOD:
+            if (!const_arith(op_token(op), a, b, type, &result)) {
+                return false;
+            }
+            break;
+        case IR_NEG:
+            if (type_is_float(type)) {
+                result.f = -a.f;
+            } else if (!const_arith(TOK_SUB, result, a, type, &result)) {
+                return false;
+            }
+            break;
+        case IR_NOT:
+            result.i = i128_from_u64(i128_is_zero(a.i) ? 1 : 0);
+            break;
+        case IR_EQ:
+        case IR_NEQ:
+        case IR_LT:
+        case IR_LTE:
+        case IR_GT:
+        case IR_GTE:
+            result.i = i128_from_u64(const_compare(op_token(op), a, b,
+                operandType) ? 1 : 0);
+            break;
+        case IR_CAST:
+            if (!const_convert(a, operandType, type, true, &result)) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+    }
+
+    if (type_is_float(type) && !isfinite(result.f)) {
+        return false;
+    }
+    *out = result;
+    return true;
+}
+
+bool ir_switch_is_dense(const IRFunction* func, const IRInst* inst) {
+    const uint32_t* cases = func->operands + inst->args[1];
+    uint32_t count = cases[0];
+    const uint32_t* keys = cases + 2 + count;
+
+    // A table at least a third full and small enough for a bytecode
+    // operand, keys fit 64 bits so the span fits the low word
+    Int128 span = i128_sub(ir_get_const(func, keys[count - 1])->bits,
+        ir_get_const(func, keys[0])->bits);
+    return span.hi == 0 && span.lo < UINT16_MAX &&
+        span.lo + 1 <= (uint64_t)count * 3;
+}
+
+uint32_t ir_get_operands(IRFunction* func, IRInst* inst, uint32_t** ops) {
+    switch ((IROp)inst->op) {
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_MOD:
+        case IR_EQ:
+        case IR_NEQ:
+        case IR_LT:
+        case IR_LTE:
+        case IR_GT:
+        case IR_GTE:
+            *ops = inst->args;
+            return 2;
+        case IR_NEG:
+        case IR_NOT:
+        case IR_CAST:
+        case IR_BR:
+        case IR_SWITCH:
+            *ops = inst->args;
+            return 1;
+        case IR_RET:
+            *ops = inst->args;
+            return inst->args[0] == IR_NONE ? 0 : 1;
+        case IR_CALL:
+            *ops = func->operands + inst->args[0] + 1;
+            return inst->args[1];
+        case IR_PHI:
+            *ops = func->operands + inst->args[0] + inst->args[1];
+            return inst->args[1];
+        default:
+            *ops = NULL;
+            return 0;
+    }
+}
+
+uint32_t ir_get_successors(IRFunction* func, IRInst* inst,
+    uint32_t** succs) {
+    switch ((IROp)inst->op) {
+        case IR_JMP:
+            *succs = inst->args;
+            return 1;
+        case IR_BR:
+            *succs = func->operands + inst->args[1];
+            return 2;
+        case IR_SWITCH:
+            *succs = func->operands + inst->args[1] + 1;
+            return func->operands[inst->args[1]] + 1;
+        default:
+            *succs = NULL;
+            return 0;
+    }
+}
+
+uint32_t ir_block_of(const IRFunction* func, uint32_t inst) {
+    uint32_t lo = 0;
+    uint32_t hi = func->blockCount;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (func->blocks[mid].end <= inst) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo < func->blockCount ? lo : IR_NONE;
+}
+
+void ir_replace_uses(IRFunction* func, uint32_t from, uint32_t to) {
+    for (uint32_t i = 0; i < func->instCount; i++) {
+        uint32_t* ops;
+        uint32_t count = ir_get_operands(func, &func->insts[i], &ops);
+        for (uint32_t j = 0; j < count; j++) {
+            if (ops[j] == from) {
+                ops[j] = to;
+            }
+        }
+    }
+}
+
+IRMove* ir_phi_moves(const IRFunction* func, uint32_t block, uint32_t succ,
+    const uint32_t* locs, uint32_t* count) {
+    const IRBlock* target = &func->blocks[succ];
+    // Every phi is copied at most once, and each cycle needs one more
+    // move to save its first phi
+    uint32_t phiCount = 0;
+    while (target->start + phiCount < target->end &&
+        func->insts[target->start + phiCount].op == IR_PHI) {
+        phiCount++;
+    }
+    IRMove* pending = malloc((phiCount + 1) * sizeof(IRMove));
+    IRMove* moves = malloc((phiCount * 2 + 1) * sizeof(IRMove));
+    if (pending == NULL || moves == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(pending);
+        free(moves);
+        return NULL;
+    }
+
+    uint32_t pendingCount = 0;
+    for (uint32_t i = target->start; i < target->start + phiCount; i++) {
+        const IRInst* phi = &func->insts[i];
+        const uint32_t* pool = func->operands + phi->args[0];
+        for (uint32_t j = 0; j < phi->args[1]; j++) {
+            uint32_t value = pool[phi->args[1] + j];
+            if (pool[j] != block || (!ir_is_const(value) &&
+                move_loc(locs, value) == move_loc(locs, i))) {
+                continue;
+            }
+            pending[pendingCount].dst = i;
+            pending[pendingCount].src = value;
+            pendingCount++;
+            break;
+        }
+    }
+
+    // A copy can be made once no other copy still reads its destination.
+    // When none can, the rest are cycles and the scratch location takes
+    // over for one destination.
+    uint32_t moveCount = 0;
+    while (pendingCount > 0) {
+        uint32_t ready = IR_NONE;
+        for (uint32_t k = 0; k < pendingCount && ready == IR_NONE; k++) {
+            uint32_t loc = move_loc(locs, pending[k].dst);
+            ready = k;
+            for (uint32_t m = 0; m < pendingCount; m++) {
+                uint32_t src = pending[m].src;
+                if (m != k && src != IR_NONE && !ir_is_const(src) &&
+                    move_loc(locs, src) == loc) {
+                    ready = IR_NONE;
+                    break;
+                }
+            }
+        }
+
+        if (ready != IR_NONE) {
+            moves[moveCount++] = pending[ready];
+            pending[ready] = pending[--pendingCount];
+            continue;
+        }
+
+        uint32_t saved = pending[0].dst;
+        moves[moveCount].dst = IR_NONE;
+        moves[moveCount].src = saved;
+        moveCount++;
+        for (uint32_t m = 0; m < pendingCount; m++) {
+            uint32_t src = pending[m].src;
+            if (src != IR_NONE && !ir_is_const(src) &&
+                move_loc(locs, src) == move_loc(locs, saved)) {
+                pending[m].src = IR_NONE;
+            }
+        }
+    }
+
+    free(pending);
+    *count = moveCount;
+    return moves;
+}
+
+bool ir_compact(IRFunction* func) {
+    uint32_t* order = malloc((func->blockCount + 1) * 2 * sizeof(uint32_t));
+    uint32_t* blockMap = malloc((func->blockCount + 1) * sizeof(uint32_t));
+    uint32_t* valueMap = malloc((func->instCount + 1) * sizeof(uint32_t));
+    IRInst* insts = malloc((func->instCount + 1) * sizeof(IRInst));
+    IRBlock* blocks = malloc((func->blockCount + 1) * sizeof(IRBlock));
+    uint32_t* operands = malloc((func->operandCount + 1) *
+        sizeof(uint32_t));
+    if (order == NULL || blockMap == NULL || valueMap == NULL ||
+        insts == NULL || blocks == NULL || operands == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(order);
+        free(blockMap);
+        free(valueMap);
+        free(insts);
+        free(blocks);
+        free(operands);
+        return false;
+    }
+
+    // Pairs of (start, id) for every live block, sorted by position
+    uint32_t liveCount = 0;
+    for (uint32_t b = 0; b < func->blockCount; b++) {
+        blockMap[b] = IR_NONE;
+        if (func->blocks[b].start != IR_NONE) {
+            order[liveCount * 2] = func->blocks[b].start;
+            order[liveCount * 2 + 1] = b;
+            liveCount++;
+        }
+    }
+    qsort(order, liveCount, 2 * sizeof(uint32_t), compare_block_start);
+
+    for (uint32_t i = 0; i < func->instCount; i++) {
+        valueMap[i] = IR_NONE;
+    }
+
+    uint32_t instCount = 0;
+    for (uint32_t n = 0; n < liveCount; n++) {
+        uint32_t b = order[n * 2 + 1];
+        blockMap[b] = n;
+        blocks[n].start = instCount;
+        for (uint32_t i = func->blocks[b].start; i < func->blocks[b].end;
+            i++) {
+            if (func->insts[i].op == IR_NOP) {
+                continue;
+            }
+            valueMap[i] = instCount;
+            insts[instCount++] = func->insts[i];
+        }
+        blocks[n].end = instCount;
+    }
+
+    uint32_t operandCount = 0;
+    for (uint32_t i = 0; i < instCount; i++) {
+        IRInst* inst = &insts[i];
+        const uint32_t* old = func->operands + inst->args[0];
+
+        switch ((IROp)inst->op) {
+            case IR_CALL:
+                operands[operandCount] = old[0];
+                for (uint32_t j = 0; j < inst->args[1]; j++) {
+                    operands[operandCount + 1 + j] =
+                        remap_value(valueMap, old[1 + j]);
+                }
+                inst->args[0] = operandCount;
+                operandCount += inst->args[1] + 1;
+                break;
+            case IR_PHI: {
+                uint32_t count = inst->args[1];
+                uint32_t kept = 0;
+                for (uint32_t j = 0; j < count; j++) {
+                    if (blockMap[old[j]] != IR_NONE) {
+                        kept++;
+                    }
+                }
+                uint32_t k = 0;
+                for (uint32_t j = 0; j < count; j++) {
+                    if (blockMap[old[j]] != IR_NONE) {
+                        operands[operandCount + k] = blockMap[old[j]];
+                        operands[operandCount + kept + k] =
+                            remap_value(valueMap, old[count + j]);
+                        k++;
+                    }
+                }
+                inst->args[0] = operandCount;
+                inst->args[1] = kept;
+                operandCount += kept * 2;
+                break;
+            }
+            case IR_BR: {
+                const uint32_t* targets = func->operands + inst->args[1];
+                operands[operandCount] = blockMap[targets[0]];
+                operands[operandCount + 1] = blockMap[targets[1]];
+                inst->args[0] = remap_value(valueMap, inst->args[0]);
+                inst->args[1] = operandCount;
+                operandCount += 2;
+                break;
+            }
+            case IR_SWITCH: {
+                // The keys are constants and need no remapping
+                const uint32_t* cases = func->operands + inst->args[1];
+                uint32_t count = cases[0];
+                operands[operandCount] = count;
+                for (uint32_t j = 0; j <= count; j++) {
+                    operands[operandCount + 1 + j] = blockMap[cases[1 + j]];
+                }
+                memcpy(&operands[operandCount + 2 + count],
+                    &cases[2 + count], count * sizeof(uint32_t));
+                inst->args[0] = remap_value(valueMap, inst->args[0]);
+                inst->args[1] = operandCount;
+                operandCount += 2 + count * 2;
+                break;
+            }
+            case IR_JMP:
+                inst->args[0] = blockMap[inst->args[0]];
+                break;
+            default: {
+                uint32_t* ops;
+                uint32_t count = ir_get_operands(func, inst, &ops);
+                for (uint32_t j = 0; j < count; j++) {
+                    ops[j] = remap_value(valueMap, ops[j]);
+                }
+                break;
+            }
+        }
+    }
+
+    free(func->insts);
+    free(func->blocks);
+    free(func->operands);
+    func->insts = insts;
+    func->instCount = instCount;
+    func->instCap = func->instCount + 1;
+    func->blocks = blocks;
+    func->blockCount = liveCount;
+    func->blockCap = func->blockCount + 1;
+    func->operands = operands;
+    func->operandCount = operandCount;
+    func->operandCap = func->operandCount + 1;
+    if (func->curBlock != IR_NONE) {
+        func->curBlock = blockMap[func->curBlock];
+    }
+
+    free(order);
+    free(blockMap);
+    free(valueMap);
+    return true;
+}
+
+IRCfg* create_ir_cfg(const IRFunction* func) {
+    IRCfg* cfg = calloc(1, sizeof(IRCfg));
+    if (cfg == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for CFG\n");
+        return NULL;
+    }
+
+    uint32_t n = func->blockCount;
+    cfg->blockCount = n;
+    cfg->succStart = calloc(n + 1, sizeof(uint32_t));
+    cfg->predStart = calloc(n + 1, sizeof(uint32_t));
+    cfg->rpo = malloc((n + 1) * sizeof(uint32_t));
+    cfg->rpoIndex = malloc((n + 1) * sizeof(uint32_t));
+    cfg->idom = malloc((n + 1) * sizeof(uint32_t));
+    cfg->domStart = calloc(n + 1, sizeof(uint32_t));
+    cfg->domChildren = malloc((n + 1) * sizeof(uint32_t));
+    uint32_t* stack = malloc((n + 1) * 2 * sizeof(uint32_t));
+    if (cfg->succStart == NULL || cfg->predStart == NULL ||
+        cfg->rpo == NULL || cfg->rpoIndex == NULL || cfg->idom == NULL ||
+        cfg->domStart == NULL || cfg->domChildren == NULL || stack == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(stack);
+        free_ir_cfg(cfg);
+        return NULL;
+    }
+
+    // Count edges, then fill the compressed rows
+    IRFunction* mutableFunc = (IRFunction*)func;
+    uint32_t edgeCount = 0;
+    for (uint32_t b = 0; b < n; b++) {
+        const IRBlock* block = &func->blocks[b];
+        if (block->start == IR_NONE || block->start == block->end) {
+            continue;
+        }
+        uint32_t* targets;
+        uint32_t count = ir_get_successors(mutableFunc,
+            &mutableFunc->insts[block->end - 1], &targets);
+        cfg->succStart[b + 1] = count;
+        edgeCount += count;
+        for (uint32_t s = 0; s < count; s++) {
+            cfg->predStart[targets[s] + 1]++;
+        }
+    }
+    for (uint32_t b = 0; b < n; b++) {
+        cfg->succStart[b + 1] += cfg->succStart[b];
+        cfg->predStart[b + 1] += cfg->predStart[b];
+    }
+
+    cfg->succs = malloc((edgeCount + 1) * sizeof(uint32_t));
+    cfg->preds = malloc((edgeCount + 1) * sizeof(uint32_t));
+    uint32_t* fill = calloc(n + 1, sizeof(uint32_t));
+    if (cfg->succs == NULL || cfg->preds == NULL || fill == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(fill);
+        free(stack);
+        free_ir_cfg(cfg);
+        return NULL;
+    }
+
+    for (uint32_t b = 0; b < n; b++) {
+        const IRBlock* block = &func->blocks[b];
+        if (block->start == IR_NONE || block->start == block->end) {
+            continue;
+        }
+        uint32_t* targets;
+        uint32_t count = ir_get_successors(mutableFunc,
+            &mutableFunc->insts[block->end - 1], &targets);
+        for (uint32_t s = 0; s < count; s++) {
+            cfg->succs[cfg->succStart[b] + s] = targets[s];
+            uint32_t t = targets[s];
+            cfg->preds[cfg->predStart[t] + fill[t]++] = b;
+        }
+    }
+    free(fill);
+
+    // Iterative depth first search for the post order
+    for (uint32_t b = 0; b < n; b++) {
+        cfg->rpoIndex[b] = IR_NONE;
+        cfg->idom[b] = IR_NONE;
+    }
+
+    uint32_t postCount = 0;
+    uint32_t depth = 0;
+    if (n > 0) {
+        stack[0] = 0;
+        stack[1] = 0;
+        depth = 1;
+        cfg->rpoIndex[0] = 0;
+    }
+    while (depth > 0) {
+        uint32_t b = stack[(depth - 1) * 2];
+        uint32_t next = stack[(depth - 1) * 2 + 1];
+        if (cfg->succStart[b] + next < cfg->succStart[b + 1]) {
+            stack[(depth - 1) * 2 + 1]++;
+            uint32_t s = cfg->succs[cfg->succStart[b] + next];
+            if (cfg->rpoIndex[s] == IR_NONE) {
+                cfg->rpoIndex[s] = 0;
+                stack[depth * 2] = s;
+                stack[depth * 2 + 1] = 0;
+                depth++;
+            }
+        } else {
+            cfg->rpo[postCount++] = b;
+            depth--;
+        }
+    }
+    free(stack);
+
+    cfg->rpoCount = postCount;
+    for (uint32_t i = 0; i < postCount / 2; i++) {
+        uint32_t tmp = cfg->rpo[i];
+        cfg->rpo[i] = cfg->rpo[postCount - 1 - i];
+        cfg->rpo[postCount - 1 - i] = tmp;
+    }
+    for (uint32_t i = 0; i < postCount; i++) {
+        cfg->rpoIndex[cfg->rpo[i]] = i;
+    }
+
+    // Cooper, Harvey and Kennedy's iterative dominator algorithm
+    if (postCount > 0) {
+        cfg->idom[cfg->rpo[0]] = cfg->rpo[0];
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t i = 1; i < postCount; i++) {
+            uint32_t b = cfg->rpo[i];
+            uint32_t newIdom = IR_NONE;
+            for (uint32_t p = cfg->predStart[b]; p < cfg->predStart[b + 1];
+                p++) {
+                uint32_t pred = cfg->preds[p];
+                if (cfg->idom[pred] == IR_NONE) {
+                    continue;
+                }
+                if (newIdom == IR_NONE) {
+                    newIdom = pred;
+                    continue;
+                }
+
+                uint32_t x = pred;
+                uint32_t y = newIdom;
+                while (x != y) {
+                    while (cfg->rpoIndex[x] > cfg->rpoIndex[y]) {
+                        x = cfg->idom[x];
+                    }
+                    while (cfg->rpoIndex[y] > cfg->rpoIndex[x]) {
+                        y = cfg->idom[y];
+                    }
+                }
+                newIdom = x;
+            }
+            if (cfg->idom[b] != newIdom) {
+                cfg->idom[b] = newIdom;
+                changed = true;
+            }
+        }
+    }
+
+    // Children are counted at their parent and summed to the end of its
+    // list, which filling backwards in reverse post order moves back to
+    // the start
+    for (uint32_t k = 1; k < postCount; k++) {
+        cfg->domStart[cfg->idom[cfg->rpo[k]]]++;
+    }
+    for (uint32_t b = 1; b <= n; b++) {
+        cfg->domStart[b] += cfg->domStart[b - 1];
+    }
+    for (uint32_t k = postCount; k > 1; k--) {
+        uint32_t b = cfg->rpo[k - 1];
+        cfg->domChildren[--cfg->domStart[cfg->idom[b]]] = b;
+    }
+
+    return cfg;
+}
+
+void free_ir_cfg(IRCfg* cfg) {
+    if (cfg == NULL) {
+        return;
+    }
+
+    free(cfg->succStart);
+    free(cfg->succs);
+    free(cfg->predStart);
+    free(cfg->preds);
+    free(cfg->rpo);
+    free(cfg->rpoIndex);
+    free(cfg->idom);
+    free(cfg->domStart);
+    free(cfg->domChildren);
+    free(cfg);
+}
+
+bool ir_dominates(const IRCfg* cfg, uint32_t a, uint32_t b) {
+    if (cfg->idom[b] == IR_NONE || cfg->idom[a] == IR_NONE) {
+        return false;
+    }
+
+    while (b != a) {
+        uint32_t up = cfg->idom[b];
+        if (up == b) {
+            return false;
+        }
+        b = up;
+    }
+
+    return true;
+}
+
+bool verify_ir_function(const IRFunction* func, const IRModule* module) {
+    IRFunction* f = (IRFunction*)func;
+    bool ok = true;
+
+    if (func->blockCount == 0) {
+        report(func, IR_NONE, "function has no blocks");
+        return false;
+    }
+
+    for (uint32_t b = 0; b < func->blockCount; b++) {
+        const IRBlock* block = &func->blocks[b];
+        if (block->start == IR_NONE || block->start >= block->end ||
+            (b > 0 && block->start != func->blocks[b - 1].end)) {
+            report(func, IR_NONE, "block is empty or not contiguous");
+            return false;
+        }
+
+        bool inPhis = true;
+        for (uint32_t i = block->start; i < block->end; i++) {
+            IROp op = (IROp)func->insts[i].op;
+            if (op == IR_NOP) {
+                report(func, i, "nop in compacted function");
+                ok = false;
+            }
+            if (op == IR_PHI && !inPhis) {
+                report(func, i, "phi after non-phi instruction");
+                ok = false;
+            }
+            if (op != IR_PHI) {
+                inPhis = false;
+            }
+            if (ir_is_terminator(op) != (i == block->end - 1)) {
+                report(func, i, "terminator must end the block");
+                ok = false;
+            }
+            if (op == IR_PARAM && b != 0) {
+                report(func, i, "param outside the entry block");
+                ok = false;
+            }
+        }
+    }
+    if (func->blocks[func->blockCount - 1].end != func->instCount) {
+        report(func, IR_NONE, "instructions outside of any block");
+        return false;
+    }
+    if (!ok) {
+        return false;
+    }
+
+    IRCfg* cfg = create_ir_cfg(func);
+    if (cfg == NULL) {
+        return false;
+    }
+    if (cfg->predStart[1] != cfg->predStart[0]) {
+        report(func, IR_NONE, "entry block has predecessors");
+        ok = false;
+    }
+
+    uint32_t* predUses = calloc(func->blockCount + 1, sizeof(uint32_t));
+    if (predUses == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free_ir_cfg(cfg);
+        return false;
+    }
+
+    for (uint32_t b = 0; b < func->blockCount; b++) {
+        for (uint32_t i = func->blocks[b].start; i < func->blocks[b].end;
+            i++) {
+            IRInst* inst = &f->insts[i];
+            IROp op = (IROp)inst->op;
+            TokenType type = (TokenType)inst->type;
+
+            uint32_t* ops;
+            uint32_t count = ir_get_operands(f, inst, &ops);
+            for (uint32_t j = 0; j < count; j++) {
+                uint32_t v = ops[j];
+                if (ir_is_const(v)) {
+                    if ((v & ~IR_CONST_FLAG) >= func->constCount) {
+                        report(func, i, "constant out of range");
+                        ok = false;
+                    }
+                    continue;
+                }
+                if (v >= func->instCount) {
+                    report(func, i, "operand out of range");
+                    ok = false;
+                    continue;
+                }
+                if (func->insts[v].type == TOK_INVALID) {
+                    report(func, i, "operand defines no value");
+                    ok = false;
+                    continue;
+                }
+
+                // The definition must dominate the use, for phis the
+                // end of the matching predecessor
+                uint32_t defBlock = ir_block_of(func, v);
+                uint32_t useBlock = b;
+                if (op == IR_PHI) {
+                    useBlock = func->operands[inst->args[0] + j];
+                }
+                if (cfg->idom[useBlock] == IR_NONE) {
+                    continue;
+                }
+                if (defBlock == useBlock) {
+                    if (op != IR_PHI && v >= i) {
+                        report(func, i, "use before definition");
+                        ok = false;
+                    }
+                } else if (!ir_dominates(cfg, defBlock, useBlock)) {
+                    report(func, i, "definition does not dominate use");
+                    ok = false;
+                }
+            }
+
+            switch (op) {
+                case IR_ADD:
+                case IR_SUB:
+                case IR_MUL:
+                case IR_DIV:
+                case IR_MOD:
+                    if (ir_value_type(func, ops[0]) != type ||
+                        ir_value_type(func, ops[1]) != type ||
+                        !(type_is_integer(type) || type_is_float(type))) {
+                        report(func, i, "arithmetic type mismatch");
+                        ok = false;
+                    }
+                    break;
+                case IR_NEG:
+                    if (ir_value_type(func, ops[0]) != type) {
+                        report(func, i, "negation type mismatch");
+                        ok = false;
+                    }
+                    break;
+                case IR_NOT:
+                    if (ir_value_type(func, ops[0]) != TOK_BOOL ||
+                        type != TOK_BOOL) {
+                        report(func, i, "not requires bool");
+                        ok = false;
+                    }
+                    break;
+                case IR_EQ:
+                case IR_NEQ:
+                case IR_LT:
+                case IR_LTE:
+                case IR_GT:
+                case IR_GTE:
+                    if (ir_value_type(func, ops[0]) !=
+                        ir_value_type(func, ops[1]) || type != TOK_BOOL) {
+                        report(func, i, "comparison type mismatch");
+                        ok = false;
+                    }
+                    break;
+                case IR_PARAM:
+                    if (inst->args[0] >= func->paramCount ||
+                        func->paramTypes[inst->args[0]] != type) {
+                        report(func, i, "parameter mismatch");
+                        ok = false;
+                    }
+                    break;
+                case IR_CALL: {
+                    if (module == NULL) {
+                        break;
+                    }
+                    uint32_t callee = func->operands[inst->args[0]];
+                    if (callee >= module->funcCount) {
+                        report(func, i, "unknown callee");
+                        ok = false;
+                        break;
+                    }
+                    const IRFunction* target = module->funcs[callee];
+                    if (target->paramCount != count ||
+                        target->returnType != type) {
+                        report(func, i, "call signature mismatch");
+                        ok = false;
+                        break;
+                    }
+                    for (uint32_t j = 0; j < count; j++) {
+                        if (ir_value_type(func, ops[j]) !=
+                            target->paramTypes[j]) {
+                            report(func, i, "argument type mismatch");
+                            ok = false;
+                        }
+                    }
+                    break;
+                }
+                case IR_PHI: {
+                    for (uint32_t j = 0; j < count; j++) {
+                        if (ir_value_type(func, ops[j]) != type) {
+                            report(func, i, "phi input type mismatch");
+                            ok = false;
+                        }
+                    }
+
+                    // Incoming blocks must match the predecessors
+                    const uint32_t* blocks = func->operands + inst->args[0];
+                    uint32_t predCount = cfg->predStart[b + 1] -
+                        cfg->predStart[b];
+                    for (uint32_t p = cfg->predStart[b];
+                        p < cfg->predStart[b + 1]; p++) {
+                        predUses[cfg->preds[p]]++;
+                    }
+                    bool matches = predCount == count;
+                    for (uint32_t j = 0; j < count; j++) {
+                        if (blocks[j] >= func->blockCount ||
+                            predUses[blocks[j]] == 0) {
+                            matches = false;
+                        } else {
+                            predUses[blocks[j]]--;
+                        }
+                    }
+                    for (uint32_t p = cfg->predStart[b];
+                        p < cfg->predStart[b + 1]; p++) {
+                        predUses[cfg->preds[p]] = 0;
+                    }
+                    if (!matches) {
+                        report(func, i, "phi inputs do not match"\
+                            " predecessors");
+                        ok = false;
+                    }
+                    break;
+                }
+                case IR_BR:
+                    if (ir_value_type(func, ops[0]) != TOK_BOOL) {
+                        report(func, i, "branch condition is not bool");
+                        ok = false;
+                    }
+                    break;
+                case IR_SWITCH: {
+                    TokenType valueType = ir_value_type(func, ops[0]);
+                    const uint32_t* cases = func->operands + inst->args[1];
+                    uint32_t caseCount = cases[0];
+                    const uint32_t* keys = cases + 2 + caseCount;
+                    if (!type_is_integer(valueType) ||
+                        type_bit_width(valueType) > 64 || caseCount == 0) {
+                        report(func, i, "invalid switch value");
+                        ok = false;
+                        break;
+                    }
+                    for (uint32_t j = 0; j < caseCount; j++) {
+                        if (!ir_is_const(keys[j]) ||
+                            ir_value_type(func, keys[j]) != valueType ||
+                            (j > 0 && !i128_slt(
+                            ir_get_const(func, keys[j - 1])->bits,
+                            ir_get_const(func, keys[j])->bits))) {
+                            report(func, i, "switch keys are not ascending"\
+                                " constants");
+                            ok = false;
+                            break;
+                        }
+                    }
+
+                    // Distinct targets keep one phi input per edge
+                    bool distinct = true;
+                    for (uint32_t j = 0; j <= caseCount; j++) {
+                        uint32_t target = cases[1 + j];
+                        if (target < func->blockCount) {
+                            distinct = distinct && predUses[target] == 0;
+                            predUses[target] = 1;
+                        }
+                    }
+                    for (uint32_t j = 0; j <= caseCount; j++) {
+                        if (cases[1 + j] < func->blockCount) {
+                            predUses[cases[1 + j]] = 0;
+                        }
+                    }
+                    if (!distinct) {
+                        report(func, i, "switch targets are not distinct");
+                        ok = false;
+                    }
+                    break;
+                }
+                case IR_RET:
+                    if ((count == 0 && func->returnType != TOK_INVALID) ||
+                        (count == 1 && ir_value_type(func, ops[0]) !=
+                        func->returnType)) {
+                        report(func, i, "return type mismatch");
+                        ok = false;
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            uint32_t* targets;
+            uint32_t succCount = ir_get_successors(f, inst, &targets);
+            for (uint32_t s = 0; s < succCount; s++) {
+                if (targets[s] >= func->blockCount || targets[s] == 0) {
+                    report(func, i, "invalid branch target");
+                    ok = false;
+                }
+            }
+        }
+    }
+
+    free(predUses);
+    free_ir_cfg(cfg);
+    return ok;
+}
+
+bool verify_ir_module(const IRModule* module) {
+    bool ok = true;
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        if (!verify_ir_function(module->funcs[i], module)) {
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+void print_ir_function(const IRFunction* func, const IRModule* module) {
+    printf("fn %s(", func->name);
+    for (uint32_t i = 0; i < func->paramCount; i++) {
+        printf("%s%s", i > 0 ? ", " : "", type_name(func->paramTypes[i]));
+    }
+    printf(") %s {\n", type_name(func->returnType));
+
+    for (uint32_t b = 0; b < func->blockCount; b++) {
+        const IRBlock* block = &func->blocks[b];
+        if (block->start == IR_NONE) {
+            continue;
+        }
+        printf("b%u:\n", b);
+
+        for (uint32_t i = block->start; i < block->end; i++) {
+            const IRInst* inst = &func->insts[i];
+            IROp op = (IROp)inst->op;
+            const uint32_t* pool = func->operands + inst->args[0];
+
+            printf("    ");
+            if (inst->type != TOK_INVALID) {
+                printf("%%%u = ", i);
+            }
+            printf("%s", ir_op_name(op));
+            if (inst->flags & IR_FLAG_EXACT) {
+                printf(" exact");
+            }
+            if (inst->type != TOK_INVALID) {
+                printf(" %s", type_name((TokenType)inst->type));
+            }
+
+            switch (op) {
+                case IR_PARAM:
+                    printf(" %u", inst->args[0]);
+                    break;
+                case IR_CALL: {
+                    uint32_t callee = pool[0];
+                    if (module != NULL && callee < module->funcCount) {
+                        printf(" %s(", module->funcs[callee]->name);
+                    } else {
+                        printf(" @%u(", callee);
+                    }
+                    for (uint32_t j = 0; j < inst->args[1]; j++) {
+                        if (j > 0) {
+                            printf(", ");
+                        }
+                        print_value(func, pool[1 + j]);
+                    }
+                    printf(")");
+                    break;
+                }
+                case IR_PHI:
+                    for (uint32_t j = 0; j < inst->args[1]; j++) {
+                        printf("%s [b%u: ", j > 0 ? "," : "", pool[j]);
+                        print_value(func, pool[inst->args[1] + j]);
+                        printf("]");
+                    }
+                    break;
+                case IR_JMP:
+                    printf(" b%u", inst->args[0]);
+                    break;
+                case IR_BR: {
+                    const uint32_t* targets = func->operands + inst->args[1];
+                    printf(" ");
+                    print_value(func, inst->args[0]);
+                    printf(", b%u, b%u", targets[0], targets[1]);
+                    break;
+                }
+                case IR_SWITCH: {
+                    const uint32_t* cases = func->operands + inst->args[1];
+                    printf(" ");
+                    print_value(func, inst->args[0]);
+                    printf(", b%u [", cases[1]);
+                    for (uint32_t j = 0; j < cases[0]; j++) {
+                        if (j > 0) {
+                            printf(", ");
+                        }
+                        print_value(func, cases[2 + cases[0] + j]);
+                        printf(": b%u", cases[2 + j]);
+                    }
+                    printf("]");
+                    break;
+                }
+                default: {
+                    uint32_t* ops;
+                    uint32_t count = ir_get_operands((IRFunction*)func,
+                        (IRInst*)inst, &ops);
+                    for (uint32_t j = 0; j < count; j++) {
+                        printf(j > 0 ? ", " : " ");
+                        print_value(func, ops[j]);
+                    }
+                    break;
+                }
+            }
+            printf("\n");
+        }
+    }
+
+    printf("}\n");
+}
+
+void print_ir_module(const IRModule* module) {
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        if (i > 0) {
+            printf("\n");
+        }
+        print_ir_function(module->funcs[i], module);
+    }
+}
+
+const char* ir_op_name(IROp op) {
+    switch (op) {
+        case IR_NOP: return "nop";
+        case IR_PARAM: return "param";
+        case IR_ADD: return "add";
+        case IR_SUB: return "sub";
+        case IR_MUL: return "mul";
+        case IR_DIV: return "div";
+        case IR_MOD: return "mod";
+        case IR_NEG: return "neg";
+        case IR_NOT: return "not";
+        case IR_EQ: return "eq";
+        case IR_NEQ: return "neq";
+        case IR_LT: return "lt";
+        case IR_LTE: return "lte";
+        case IR_GT: return "gt";
+        case IR_GTE: return "gte";
+        case IR_CAST: return "cast";
+        case IR_CALL: return "call";
+        case IR_PHI: return "phi";
+        case IR_JMP: return "jmp";
+        case IR_BR: return "br";
+        case IR_SWITCH: return "switch";
+        case IR_RET: return "ret";
+        default: return "unknown";
+    }
+}
+
+/* --- Helper Functions --- */
+
+static bool grow_array(void** array, uint32_t* cap, uint32_t need,
+    size_t elemSize) {
+    if (need <= *cap) {
+        return true;
+    }
+
+    uint32_t newCap = *cap == 0 ? 16 : *cap;
+    while (newCap < need) {
+        newCap *= 2;
+    }
+
+    void* grown = realloc(*array, (size_t)newCap * elemSize);
+    if (grown == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    *array = grown;
+    *cap = newCap;
+    return true;
+}
+
+static uint32_t hash_const(TokenType type, Int128 bits) {
+    uint64_t hash = bits.lo * UINT64_C(0x9e3779b97f4a7c15);
+    hash ^= bits.hi + UINT64_C(0x632be59bd9b4e019) + (hash << 6);
+    hash ^= (uint64_t)type * UINT64_C(0xff51afd7ed558ccd);
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static bool rehash_consts(IRFunction* func, uint32_t slotCount) {
+    uint32_t* slots = calloc(slotCount, sizeof(uint32_t));
+    if (slots == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < func->constCount; i++) {
+        uint32_t slot = hash_const(func->consts[i].type,
+            func->consts[i].bits) & (slotCount - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slotCount - 1);
+        }
+        slots[slot] = i + 1;
+    }
+
+    free(func->constSlots);
+    func->constSlots = slots;
+    func->constSlotCount = slotCount;
+    return true;
+}
+
+static uint32_t remap_value(const uint32_t* valueMap, uint32_t value) {
+    if (value == IR_NONE || ir_is_const(value)) {
+        return value;
+    }
+
+    return valueMap[value];
+}
+
+static int compare_block_start(const void* a, const void* b) {
+    uint32_t startA = *(const uint32_t*)a;
+    uint32_t startB = *(const uint32_t*)b;
+    return (startA > startB) - (startA < startB);
+}
+
+static TokenType op_token(IROp op) {
+    switch (op) {
+        case IR_ADD: return TOK_ADD;
+        case IR_SUB: return TOK_SUB;
+        case IR_MUL: return TOK_MUL;
+        case IR_DIV: return TOK_DIV;
+        case IR_MOD: return TOK_MOD;
+        case IR_EQ: return TOK_EQ;
+        case IR_NEQ: return TOK_NEQ;
+        case IR_LT: return TOK_LT;
+        case IR_LTE: return TOK_LTE;
+        case IR_GT: return TOK_GT;
+        case IR_GTE: return TOK_GTE;
+        default: return TOK_INVALID;
+    }
+}
+
+static uint32_t move_loc(const uint32_t* locs, uint32_t value) {
+    return locs != NULL ? locs[value] : value;
+}
+
+static void report(const IRFunction* func, uint32_t inst,
+    const char* message) {
+    if (inst == IR_NONE) {
+        fprintf(stderr, "IR Error [%s]: %s\n", func->name, message);
+    } else {
+        fprintf(stderr, "IR Error [%s:%%%u]: %s\n", func->name, inst,
+            message);
+    }
+}
+
+static void print_value(const IRFunction* func, uint32_t value) {
+    if (value == IR_NONE) {
+        printf("none");
+        return;
+    }
+    if (!ir_is_const(value)) {
+        printf("%%%u", value);
+        return;
+    }
+
+    const IRConst* entry = ir_get_const(func, value);
+    ConstValue constValue = ir_const_value(func, value);
+    char buf[INT128_STR_MAX];
+    if (type_is_float(entry->type)) {
+        printf("%g", constValue.f);
+    } else if (entry->type == TOK_BOOL) {
+        printf(i128_is_zero(constValue.i) ? "false" : "true");
+    } else {
+        printf("%s", i128_to_str(constValue.i, type_is_signed(entry->type),
+            buf));
+    }
+}
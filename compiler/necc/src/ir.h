@@ -0,0 +1,321 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "constval.h"
+#include "token.h"
+
+// The IR is a static single assignment form stored in dense arrays.
+// Every instruction lives in its function's insts array and its index
+// is the id of the value it defines. Operands are 32-bit value ids, and
+// ids with IR_CONST_FLAG set refer to the function's constant pool
+// instead of an instruction. Basic blocks are contiguous index ranges
+// of insts, phi nodes come first in a block and a terminator last.
+// Instructions with a variable number of operands keep them in the
+// function's operand pool.
+
+/// Marks an absent value or block.
+#define IR_NONE UINT32_MAX
+/// Set on value ids that refer to the constant pool.
+#define IR_CONST_FLAG UINT32_C(0x80000000)
+/// Instruction flag set on integer arithmetic and integer to integer
+/// casts whose exact result is known to fit their type, so it needs no
+/// wrapping. The operands and result are at most 64 bits and not bool.
+#define IR_FLAG_EXACT UINT16_C(0x0001)
+
+typedef enum IROp {
+    /// Removed instruction, dropped by ir_compact().
+    IR_NOP,
+    /// Function parameter. args[0] is the parameter index.
+    IR_PARAM,
+
+    // Arithmetic, args[0] and args[1] are the operands and all three
+    // share the instruction type.
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_MOD,
+    /// Negation of args[0].
+    IR_NEG,
+    /// Logical not of the bool args[0].
+    IR_NOT,
+
+    // Comparisons of args[0] and args[1], which share a type. The
+    // instruction type is bool.
+    IR_EQ,
+    IR_NEQ,
+    IR_LT,
+    IR_LTE,
+    IR_GT,
+    IR_GTE,
+
+    /// Converts args[0] to the instruction type with cast semantics.
+    IR_CAST,
+    /// Call. args[0] is the pool index of the callee function index,
+    /// which is followed by args[1] argument values.
+    IR_CALL,
+    /// Phi. args[0] is the pool index of args[1] predecessor blocks,
+    /// which are followed by the args[1] incoming values.
+    IR_PHI,
+
+    // Terminators
+    /// Unconditional jump to block args[0].
+    IR_JMP,
+    /// Branch on the bool args[0]. args[1] is the pool index of the
+    /// then block, which is followed by the else block.
+    IR_BR,
+    /// Multiway branch on the integer args[0], at most 64 bits wide.
+    /// args[1] is the pool index of the case count n, followed by the
+    /// default block, the n case blocks and the n case keys, constants
+    /// of the value's type in ascending order. All n + 1 blocks are
+    /// distinct.
+    IR_SWITCH,
+    /// Return args[0], or nothing if it is IR_NONE.
+    IR_RET,
+} IROp;
+
+/// A single instruction. Kept at 12 bytes so whole functions stay
+/// cache resident.
+typedef struct IRInst {
+    /// The IROp of the instruction.
+    uint8_t op;
+    /// The TokenType of the value the instruction defines, TOK_INVALID
+    /// if it defines none.
+    uint8_t type;
+    /// IR_FLAG_* bits, facts about the instruction found by passes.
+    uint16_t flags;
+    /// Operands, their meaning depends on the op.
+    uint32_t args[2];
+} IRInst;
+
+/// A basic block, the half open range [start, end) of insts.
+typedef struct IRBlock {
+    /// Index of the first instruction, IR_NONE if the block was never
+    /// started or has been removed.
+    uint32_t start;
+    /// Index one past the last instruction.
+    uint32_t end;
+} IRBlock;
+
+/// A constant pool entry.
+typedef struct IRConst {
+    /// The value. Floats hold the bits of a double in the low word.
+    Int128 bits;
+    /// The TokenType of the constant.
+    TokenType type;
+} IRConst;
+
+typedef struct IRFunction {
+    /// A null-terminated copy of the function name.
+    char* name;
+    /// The return type, TOK_INVALID for void functions.
+    TokenType returnType;
+    /// The parameter types.
+    TokenType* paramTypes;
+    /// The number of parameters.
+    uint32_t paramCount;
+
+    /// The instructions, grouped by block.
+    IRInst* insts;
+    uint32_t instCount;
+    uint32_t instCap;
+
+    /// Operand pool for calls, phis and branches.
+    uint32_t* operands;
+    uint32_t operandCount;
+    uint32_t operandCap;
+
+    /// The blocks. Block 0 is the entry block.
+    IRBlock* blocks;
+    uint32_t blockCount;
+    uint32_t blockCap;
+
+    /// The constant pool.
+    IRConst* consts;
+    uint32_t constCount;
+    uint32_t constCap;
+    /// Open addressing table of constant indices plus one, used to
+    /// share identical constants.
+    uint32_t* constSlots;
+    uint32_t constSlotCount;
+
+    /// The block instructions are currently appended to, IR_NONE if
+    /// there is none.
+    uint32_t curBlock;
+} IRFunction;
+
+typedef struct IRModule {
+    /// The functions, indexed by the callee index used in calls.
+    IRFunction** funcs;
+    uint32_t funcCount;
+} IRModule;
+
+/// A copy made on a control flow edge when leaving SSA form. IR_NONE on
+/// either side stands for a scratch location.
+typedef struct IRMove {
+    uint32_t dst;
+    uint32_t src;
+} IRMove;
+
+/// Control flow graph facts derived from a function. Successor and
+/// predecessor lists are stored in compressed sparse row form, the
+/// entries of block b are [start[b], start[b + 1]).
+typedef struct IRCfg {
+    uint32_t blockCount;
+    uint32_t* succStart;
+    uint32_t* succs;
+    uint32_t* predStart;
+    uint32_t* preds;
+    /// Reachable blocks in reverse post order, starting with the entry.
+    uint32_t* rpo;
+    uint32_t rpoCount;
+    /// Position of each block in rpo, IR_NONE if unreachable.
+    uint32_t* rpoIndex;
+    /// Immediate dominator of each block. The entry is its own
+    /// dominator and unreachable blocks have IR_NONE.
+    uint32_t* idom;
+    /// The dominator tree children of block b are the entries
+    /// [domStart[b], domStart[b + 1]) of domChildren, in reverse post
+    /// order.
+    uint32_t* domStart;
+    uint32_t* domChildren;
+} IRCfg;
+
+/// Creates an empty function with the given signature. The name is
+/// copied and the paramTypes array is copied. Returns NULL on failure.
+IRFunction* create_ir_function(const char* name, TokenType returnType,
+    const TokenType* paramTypes, uint32_t paramCount);
+/// Frees the function. Safely handles NULL.
+void free_ir_function(IRFunction* func);
+/// Creates an empty module. Returns NULL on failure.
+IRModule* create_ir_module(void);
+/// Appends a function to the module, which takes ownership of it.
+/// Returns false on failure.
+bool ir_module_add(IRModule* module, IRFunction* func);
+/// Frees the module and all of its functions. Safely handles NULL.
+void free_ir_module(IRModule* module);
+
+/// Creates a new block that has not been started yet. Returns its id,
+/// or IR_NONE on failure.
+uint32_t ir_add_block(IRFunction* func);
+/// Starts the given block, new instructions are appended to it. A block
+/// can only be started once and the previous block must be finished.
+void ir_set_block(IRFunction* func, uint32_t block);
+/// Appends an instruction to the current block. Returns its value id,
+/// or IR_NONE on failure.
+uint32_t ir_emit(IRFunction* func, IROp op, TokenType type, uint32_t a,
+    uint32_t b);
+/// Appends words to the operand pool. Returns the index of the first,
+/// or IR_NONE on failure.
+uint32_t ir_add_operands(IRFunction* func, const uint32_t* words,
+    uint32_t count);
+/// Returns the value id of a constant of the given type, adding it to
+/// the pool if needed. Returns IR_NONE on failure.
+uint32_t ir_const(IRFunction* func, TokenType type, ConstValue value);
+/// Appends a call of the module function callee. Returns its value id.
+uint32_t ir_emit_call(IRFunction* func, TokenType type, uint32_t callee,
+    const uint32_t* args, uint32_t argCount);
+/// Appends a phi with incoming values from the given blocks. Returns its
+/// value id.
+uint32_t ir_emit_phi(IRFunction* func, TokenType type,
+    const uint32_t* blocks, const uint32_t* values, uint32_t count);
+/// Appends a conditional branch, finishing the current block.
+void ir_emit_br(IRFunction* func, uint32_t cond, uint32_t thenBlock,
+    uint32_t elseBlock);
+/// Appends a multiway branch on value to the blocks of the count keys,
+/// which must be ascending, or to defaultBlock, finishing the current
+/// block.
+void ir_emit_switch(IRFunction* func, uint32_t value, uint32_t defaultBlock,
+    const uint32_t* blocks, const uint32_t* keys, uint32_t count);
+/// Appends a copy of the switch inst of src branching on value, with its
+/// targets mapped through blocks and its keys added to func's constants.
+/// Returns false on failure.
+bool ir_copy_switch(IRFunction* func, const IRFunction* src,
+    const IRInst* inst, uint32_t value, const uint32_t* blocks);
+/// Appends an unconditional jump, finishing the current block.
+void ir_emit_jmp(IRFunction* func, uint32_t target);
+/// Appends a return, finishing the current block. value may be IR_NONE.
+void ir_emit_ret(IRFunction* func, uint32_t value);
+
+/// Returns true if the value id refers to the constant pool.
+bool ir_is_const(uint32_t value);
+/// Returns the constant a constant value id refers to.
+const IRConst* ir_get_const(const IRFunction* func, uint32_t value);
+/// Returns the constant pool entry of a constant value id as a
+/// ConstValue.
+ConstValue ir_const_value(const IRFunction* func, uint32_t value);
+/// Returns the type of a value id.
+TokenType ir_value_type(const IRFunction* func, uint32_t value);
+/// Returns true if the op ends a block.
+bool ir_is_terminator(IROp op);
+/// Returns true if the op takes two value operands.
+bool ir_is_binary(IROp op);
+/// Returns true if the op has no side effects and can be removed when
+/// its value is unused. Calls are not considered pure here.
+bool ir_is_pure(IROp op);
+/// Evaluates an arithmetic, comparison, negation, not or cast op on
+/// constant operands, a and b of operandType, giving a result of type.
+/// Returns false if the result is left to runtime: integer division by
+/// zero, a cast the value does not fit and float results that are not
+/// finite.
+bool ir_eval_op(IROp op, TokenType type, TokenType operandType,
+    ConstValue a, ConstValue b, ConstValue* out);
+/// Returns true if the keys of a switch are dense enough to dispatch
+/// through a jump table indexed by key instead of searching them.
+bool ir_switch_is_dense(const IRFunction* func, const IRInst* inst);
+/// Points ops at the value operands of the instruction and returns how
+/// many there are. The operands can be rewritten through the pointer.
+uint32_t ir_get_operands(IRFunction* func, IRInst* inst, uint32_t** ops);
+/// Points succs at the successor blocks of a terminator and returns how
+/// many there are. The targets can be rewritten through the pointer.
+uint32_t ir_get_successors(IRFunction* func, IRInst* inst,
+    uint32_t** succs);
+/// Returns the id of the block containing the instruction, found by
+/// binary search over the block ranges. Requires a compacted function.
+uint32_t ir_block_of(const IRFunction* func, uint32_t inst);
+/// Replaces every use of the value from with the value to.
+void ir_replace_uses(IRFunction* func, uint32_t from, uint32_t to);
+/// Orders the copies into the phis of succ on the edge from block so that
+/// making them one after another has the effect of making them all at
+/// once, which matters when phis of a loop header feed each other. A
+/// cycle of such phis is broken by saving one of them to the scratch
+/// location first. locs gives the storage of each value so that values
+/// sharing storage are seen as one, or is NULL if every value has its
+/// own. Copies of a value onto itself are left out. Returns the moves,
+/// which the caller frees, and their number in count, or NULL on
+/// allocation failure.
+IRMove* ir_phi_moves(const IRFunction* func, uint32_t block, uint32_t succ,
+    const uint32_t* locs, uint32_t* count);
+/// Removes IR_NOP instructions and removed blocks, orders blocks by
+/// their position and renumbers values and blocks densely. Phi inputs
+/// from removed blocks are dropped. Returns false on failure.
+bool ir_compact(IRFunction* func);
+
+/// Builds the control flow graph of a function, including reverse post
+/// order, immediate dominators and the dominator tree. Returns NULL on
+/// failure.
+IRCfg* create_ir_cfg(const IRFunction* func);
+/// Frees a control flow graph. Safely handles NULL.
+void free_ir_cfg(IRCfg* cfg);
+/// Returns true if block a dominates block b.
+bool ir_dominates(const IRCfg* cfg, uint32_t a, uint32_t b);
+
+/// Checks the structural invariants of a function: block shape, operand
+/// validity, types, phi inputs matching predecessors and definitions
+/// dominating their uses. module may be NULL, in which case calls are
+/// not checked against their callee. Prints each problem found and
+/// returns false if there are any.
+bool verify_ir_function(const IRFunction* func, const IRModule* module);
+/// Verifies every function in the module.
+bool verify_ir_module(const IRModule* module);
+/// Prints the function in a readable text form.
+void print_ir_function(const IRFunction* func, const IRModule* module);
+/// Prints every function in the module.
+void print_ir_module(const IRModule* module);
+/// Returns the name of an op as printed, such as "add".
+const char* ir_op_name(IROp op);
+
+#endif // IR_H
@@ -0,0 +1,230 @@
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "jit.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "int128.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_SUPPORTED 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+// The generated code follows the System V ABI, so it can only be called
+// directly on x86-64 System V hosts. Int128 is a struct of two 64-bit
+// integers, which that ABI passes and returns exactly like __int128, so
+// the libgcc helpers the backend calls are built on int128.c.
+
+/// The size of a jump stub, jmp [rip] followed by the 64-bit target,
+/// padded to 16 bytes.
+#define STUB_SIZE 16
+
+/// A function the generated code may call without defining it.
+typedef struct JitHelper {
+    const char* name;
+    void (*address)(void);
+} JitHelper;
+
+static Int128 helper_divti3(Int128 a, Int128 b);
+static Int128 helper_udivti3(Int128 a, Int128 b);
+static Int128 helper_modti3(Int128 a, Int128 b);
+static Int128 helper_umodti3(Int128 a, Int128 b);
+static double helper_floattidf(Int128 value);
+static double helper_floatuntidf(Int128 value);
+static Int128 helper_fixdfti(double value);
+static Int128 helper_fixunsdfti(double value);
+/// Returns the helper with the given name, or NULL if there is none.
+static const JitHelper* find_helper(const char* name);
+
+JitModule* jit_load(const ElfObject* obj, JitResolver resolve, void* ctx) {
+#if !JIT_SUPPORTED
+    (void)obj;
+    (void)resolve;
+    (void)ctx;
+    fprintf(stderr, "Error: The JIT needs an x86-64 System V host\n");
+    return NULL;
+#else
+    JitModule* jit = calloc(1, sizeof(JitModule));
+    if (jit == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return NULL;
+    }
+    jit->symbolCount = obj->symbolCount;
+    jit->addresses = calloc(obj->symbolCount + 1, sizeof(uint8_t*));
+    if (jit->addresses == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free_jit_module(jit);
+        return NULL;
+    }
+
+    // Stubs follow the code, 16 byte aligned
+    size_t stubStart = (obj->textSize + 15) & ~(size_t)15;
+    size_t stubCount = 0;
+    for (uint32_t i = 0; i < obj->symbolCount; i++) {
+        stubCount += obj->symbols[i].defined ? 0 : 1;
+    }
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = stubStart + stubCount * STUB_SIZE;
+    size = (size + pageSize - 1) / pageSize * pageSize;
+
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error: Failed to map memory for the JIT\n");
+        free_jit_module(jit);
+        return NULL;
+    }
+    jit->code = mapping;
+    jit->size = size;
+
+    // Unused space traps like the padding between functions
+    memset(jit->code, 0xcc, size);
+    memcpy(jit->code, obj->text, obj->textSize);
+
+    uint8_t* stub = jit->code + stubStart;
+    for (uint32_t i = 0; i < obj->symbolCount; i++) {
+        const ElfSymbol* symbol = &obj->symbols[i];
+        if (symbol->defined) {
+            jit->addresses[i] = jit->code + symbol->offset;
+            continue;
+        }
+
+        const JitHelper* helper = find_helper(symbol->name);
+        void* target = resolve != NULL && helper == NULL ?
+            resolve(ctx, symbol->name) : NULL;
+        if (helper == NULL && target == NULL) {
+            fprintf(stderr, "Error: Undefined function '%s' in JIT code\n",
+                symbol->name);
+            free_jit_module(jit);
+            return NULL;
+        }
+        // jmp [rip + 0], then the absolute target
+        static const uint8_t jump[] = { 0xff, 0x25, 0, 0, 0, 0 };
+        memcpy(stub, jump, sizeof(jump));
+        if (helper != NULL) {
+            memcpy(stub + sizeof(jump), &helper->address,
+                sizeof(helper->address));
+        } else {
+            memcpy(stub + sizeof(jump), &target, sizeof(target));
+        }
+        jit->addresses[i] = stub;
+        stub += STUB_SIZE;
+    }
+
+    for (uint32_t i = 0; i < obj->relocCount; i++) {
+        const ElfReloc* reloc = &obj->relocs[i];
+        // PC32 and PLT32 both store S + A - P, everything is in reach
+        int64_t value = (int64_t)(jit->addresses[reloc->symbol] -
+            (jit->code + reloc->offset)) + reloc->addend;
+        int32_t field = (int32_t)value;
+        memcpy(jit->code + reloc->offset, &field, sizeof(int32_t));
+    }
+
+    if (mprotect(jit->code, size, PROT_READ | PROT_EXEC) != 0) {
+        fprintf(stderr, "Error: Failed to make JIT code executable\n");
+        free_jit_module(jit);
+        return NULL;
+    }
+    return jit;
+#endif
+}
+
+void free_jit_module(JitModule* jit) {
+    if (jit == NULL) {
+        return;
+    }
+
+#if JIT_SUPPORTED
+    if (jit->code != NULL) {
+        munmap(jit->code, jit->size);
+    }
+#endif
+    free(jit->addresses);
+    free(jit);
+}
+
+bool jit_is_supported(void) {
+    return JIT_SUPPORTED;
+}
+
+int32_t jit_call_i32(const JitModule* jit, uint32_t symbol) {
+    // ISO C has no conversion from object to function pointers, so the
+    // address is copied into one
+    int32_t (*function)(void);
+    memcpy(&function, &jit->addresses[symbol], sizeof(function));
+    return function();
+}
+
+/* --- Helper Functions --- */
+
+static Int128 helper_divti3(Int128 a, Int128 b) {
+    return i128_sdivmod(a, b, NULL);
+}
+
+static Int128 helper_udivti3(Int128 a, Int128 b) {
+    return i128_udivmod(a, b, NULL);
+}
+
+static Int128 helper_modti3(Int128 a, Int128 b) {
+    Int128 rem;
+    i128_sdivmod(a, b, &rem);
+    return rem;
+}
+
+static Int128 helper_umodti3(Int128 a, Int128 b) {
+    Int128 rem;
+    i128_udivmod(a, b, &rem);
+    return rem;
+}
+
+static double helper_floattidf(Int128 value) {
+    return i128_to_double(value, true);
+}
+
+static double helper_floatuntidf(Int128 value) {
+    return i128_to_double(value, false);
+}
+
+static Int128 helper_fixdfti(double value) {
+    // The generated code only converts values that are in range
+    Int128 result = { 0, 0 };
+    i128_from_double(value, TOK_I128, &result);
+    return result;
+}
+
+static Int128 helper_fixunsdfti(double value) {
+    Int128 result = { 0, 0 };
+    i128_from_double(value, TOK_U128, &result);
+    return result;
+}
+
+static const JitHelper* find_helper(const char* name) {
+    // Casting between function pointer types is fine, the stub only
+    // needs the address
+    static const JitHelper helpers[] = {
+        { "fmod", (void (*)(void))fmod },
+        { "fmodf", (void (*)(void))fmodf },
+        { "__divti3", (void (*)(void))helper_divti3 },
+        { "__udivti3", (void (*)(void))helper_udivti3 },
+        { "__modti3", (void (*)(void))helper_modti3 },
+        { "__umodti3", (void (*)(void))helper_umodti3 },
+        { "__floattidf", (void (*)(void))helper_floattidf },
+        { "__floatuntidf", (void (*)(void))helper_floatuntidf },
+        { "__fixdfti", (void (*)(void))helper_fixdfti },
+        { "__fixunsdfti", (void (*)(void))helper_fixunsdfti },
+    };
+
+    for (size_t i = 0; i < sizeof(helpers) / sizeof(helpers[0]); i++) {
+        if (strcmp(helpers[i].name, name) == 0) {
+            return &helpers[i];
+        }
+    }
+    return NULL;
+}
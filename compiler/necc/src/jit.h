@@ -0,0 +1,39 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "elf.h"
+
+/// Machine code loaded into executable memory.
+typedef struct JitModule {
+    /// The mapping, the code of the object followed by a jump stub for
+    /// every function it calls but does not define.
+    uint8_t* code;
+    size_t size;
+    /// The address of each symbol of the object, by symbol index.
+    uint8_t** addresses;
+    uint32_t symbolCount;
+} JitModule;
+
+/// Returns the address of a function loaded earlier, or NULL if there is
+/// no function with the name.
+typedef void* (*JitResolver)(void* ctx, const char* name);
+
+/// Copies the code of an object built by the x86-64 backend into memory
+/// mapped writable, applies its relocations and then flips the mapping
+/// to read and execute only. Calls to symbols the object does not define
+/// go through stubs to the runtime's own fmod, fmodf and 128-bit helpers,
+/// or to the address resolve returns for them if resolve is not NULL.
+/// Only supported on x86-64 System V hosts. Returns NULL on failure.
+JitModule* jit_load(const ElfObject* obj, JitResolver resolve, void* ctx);
+/// Unmaps the code and frees the module. Safely handles NULL.
+void free_jit_module(JitModule* jit);
+/// Returns true if jit_load() can run code on this host.
+bool jit_is_supported(void);
+/// Calls the function at index symbol of the object the module was
+/// loaded from, which must take no arguments and return i32.
+int32_t jit_call_i32(const JitModule* jit, uint32_t symbol);
+
+#endif // JIT_H
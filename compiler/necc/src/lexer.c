@@ -1,14 +1,48 @@
 #include "lexer.h"
-#include <ctype.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// A streaming lexer holds a window of the input, with positions still
+// counted from the start of the input. When the lexer looks past the
+// end of the window, the bytes before the start of the token being read
+// are dropped, the rest are carried over to the front and the next
+// chunk is read after them. A token crossing a chunk boundary is
+// therefore still whole in the window when it is copied, and whitespace
+// and comments are dropped as they are skipped, so the window only
+// grows past a chunk for a token longer than one.
+//
+// All input is checked to be UTF-8 before it is lexed, a whole source
+// when the lexer is created and a chunk of a stream as it is read. The
+// language itself is ASCII, and bytes of 0x80 and above only belong in
+// comments, so past that check a character outside comments needs no
+// more than its lead byte to be known for what it is and skipped whole.
+
 /// Returns the character a given offset from the current position in
 /// the lexer's current source file. Returns '\0' if the position is
 /// beyond the end of the source code.
 static inline char peek(Lexer* lexer, size_t offset);
+/// Reads chunks of the input of a streaming lexer into its window until
+/// it holds the byte offset past the current position or the input
+/// ends. Returns false if the byte is past the end of the input.
+static bool refill(Lexer* lexer, size_t offset);
+/// Marks the lexer failed and ends its window at the current position,
+/// so nothing past it is lexed and every later peek sees the end of the
+/// input. Returns false.
+static bool fail_refill(Lexer* lexer);
+/// Prints a lexer error at line and column, unless a read of the input
+/// failed: the error is then only the input seeming to end early, and
+/// the read already printed what went wrong.
+static void lexer_error(const Lexer* lexer, size_t line, size_t column,
+    const char* format, ...);
+/// Returns whether c is an ASCII letter, digit, or either. Bytes of 0x80
+/// and above are none of these, where the <ctype.h> functions would be
+/// given a negative char.
+static inline bool is_alpha(char c);
+static inline bool is_digit(char c);
+static inline bool is_alnum(char c);
 /// Advances the lexer's position by one character, updating the line
 /// and column tracking accordingly. Stops without advancing if the
 /// current character is '\0' (end of source).
@@ -45,6 +79,11 @@ Lexer* create_lexer(char* src) {
         return NULL;
     }
 
+    size_t srcLen = strlen(src);
+    if (!utf8_check(src, srcLen)) {
+        return NULL;
+    }
+
     Lexer* lexer = malloc(sizeof(Lexer));
     if (lexer == NULL) {
         fprintf(stderr, "Error: Failed to allocate memory for lexer\n");
@@ -52,10 +91,44 @@ Lexer* create_lexer(char* src) {
     }
 
     lexer->src = src;
-    lexer->srcLen = strlen(src);
+    lexer->srcLen = srcLen;
     lexer->pos = 0;
     lexer->column = 1;
     lexer->line = 1;
+    lexer->input = NULL;
+    lexer->chunkSize = 0;
+    lexer->base = 0;
+    lexer->cap = 0;
+    lexer->keep = 0;
+    lexer->eof = true;
+    lexer->failed = false;
+    memset(&lexer->utf8, 0, sizeof(Utf8State));
+
+    return lexer;
+}
+
+Lexer* create_stream_lexer(FILE* input, size_t chunkSize) {
+    if (input == NULL || chunkSize == 0) {
+        fprintf(stderr, "Error: Lexer received no input to read\n");
+        return NULL;
+    }
+
+    char* window = malloc(chunkSize + 1);
+    if (window == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for lexer\n");
+        return NULL;
+    }
+    window[0] = '\0';
+
+    Lexer* lexer = create_lexer(window);
+    if (lexer == NULL) {
+        free(window);
+        return NULL;
+    }
+    lexer->input = input;
+    lexer->chunkSize = chunkSize;
+    lexer->cap = chunkSize + 1;
+    lexer->eof = false;
 
     return lexer;
 }
@@ -84,8 +157,20 @@ Token* get_next_token(Lexer* lexer) {
         return NULL;
     }
 
+    // A byte order mark starting the input is neither a token nor a
+    // column
+    if (lexer->pos == 0 && peek(lexer, 0) == '\xef' &&
+        peek(lexer, 1) == '\xbb' && peek(lexer, 2) == '\xbf') {
+        lexer->pos = 3;
+    }
+
     skip_whitespace(lexer);
+    if (lexer->failed) {
+        return NULL;
+    }
+    lexer->keep = lexer->pos;
 
+    size_t startPos = lexer->pos;
     size_t startLine = lexer->line;
     size_t startColumn = lexer->column;
 
@@ -211,8 +296,8 @@ Token* get_next_token(Lexer* lexer) {
                 advance(lexer);
                 advance(lexer);
             } else {
-                fprintf(stderr, "Lexer Error [%zu:%zu]: Expected '&' got "\
-                    "'%c'\n", startLine, startColumn, peek(lexer, 1));
+                lexer_error(lexer, startLine, startColumn, "Expected '&'"\
+                    " got '%c'", peek(lexer, 1));
                 token = create_token(TOK_INVALID, NULL, startLine,
                     startColumn);
                 advance(lexer);
@@ -224,8 +309,8 @@ Token* get_next_token(Lexer* lexer) {
                 advance(lexer);
                 advance(lexer);
             } else {
-                fprintf(stderr, "Lexer Error [%zu:%zu]: Expected '|' after"\
-                    " '|' got '%c'\n", startLine, startColumn, peek(lexer, 1));
+                lexer_error(lexer, startLine, startColumn, "Expected '|'"\
+                    " after '|' got '%c'", peek(lexer, 1));
                 token = create_token(TOK_INVALID, NULL, startLine,
                     startColumn);
                 advance(lexer);
@@ -265,14 +350,14 @@ Token* get_next_token(Lexer* lexer) {
             char charLit = peek(lexer, 0);
 
             if (charLit == '\0') {
-                fprintf(stderr, "Lexer Error [%zu:%zu]: Unexpected EOF in"\
-                    " character literal\n", startLine, startColumn);
+                lexer_error(lexer, startLine, startColumn, "Unexpected EOF"\
+                    " in character literal");
                 token = create_token(TOK_INVALID, NULL, startLine,
                     startColumn);
                 break;
             } else if (charLit == '\'') {
-                fprintf(stderr, "Lexer Error [%zu:%zu]: Empty character"\
-                    " literal\n", startLine, startColumn);
+                lexer_error(lexer, startLine, startColumn, "Empty"\
+                    " character literal");
                 token = create_token(TOK_INVALID, NULL, startLine,
                     startColumn);
                 advance(lexer);
@@ -284,8 +369,8 @@ Token* get_next_token(Lexer* lexer) {
                 char escapeChar = peek(lexer, 0);
 
                 if (escapeChar == '\0') {
-                    fprintf(stderr, "Lexer Error [%zu:%zu]: Unexpected EOF in"\
-                        " escape sequence\n", startLine, startColumn);
+                    lexer_error(lexer, startLine, startColumn, "Unexpected"\
+                        " EOF in escape sequence");
                     token = create_token(TOK_INVALID, NULL, startLine,
                         startColumn);
                     break;
@@ -299,9 +384,8 @@ Token* get_next_token(Lexer* lexer) {
                     case '\\': charLit = '\\'; break;
                     case '\'': charLit = '\''; break;
                     default:
-                        fprintf(stderr, "Lexer Error [%zu:%zu]: Invalid"\
-                            " escape sequence '\\%c'\n", startLine,
-                            startColumn, escapeChar);
+                        lexer_error(lexer, startLine, startColumn,
+                            "Invalid escape sequence '\\%c'", escapeChar);
                         token = create_token(TOK_INVALID, NULL, startLine,
                             startColumn);
                         // Skip to closing quote or newline for error recovery
@@ -325,9 +409,8 @@ Token* get_next_token(Lexer* lexer) {
             }
 
             if (peek(lexer, 0) != '\'') {
-                fprintf(stderr, "Lexer Error [%zu:%zu]: Expected \"'\" after"\
-                    " character literal, got '%c'\n", startLine, startColumn,
-                    peek(lexer, 0));
+                lexer_error(lexer, startLine, startColumn, "Expected \"'\""\
+                    " after character literal, got '%c'", peek(lexer, 0));
                 token = create_token(TOK_INVALID, NULL, startLine,
                     startColumn);
 
@@ -359,7 +442,7 @@ Token* get_next_token(Lexer* lexer) {
         // Identifiers, keywords, and literals
         default:
             // Identifier
-            if (isalpha(curChar) || curChar == '_') {
+            if (is_alpha(curChar) || curChar == '_') {
                 char* ident = read_identifier(lexer);
                 if (ident == NULL) {
                     return NULL;
@@ -372,10 +455,9 @@ Token* get_next_token(Lexer* lexer) {
                 }
 
                 token = create_token(type, ident, startLine, startColumn);
-                return token;
             }
             // Numeric Literals
-            else if (isdigit(curChar)) {
+            else if (is_digit(curChar)) {
                 char* num = read_number(lexer, startLine, startColumn);
                 if (num == NULL) {
                     return NULL;
@@ -383,11 +465,23 @@ Token* get_next_token(Lexer* lexer) {
                 TokenType type = get_num_type(num, startLine, startColumn);
 
                 token = create_token(type, num, startLine, startColumn);
-                return token;
+            }
+            // A character beyond ASCII, known to be valid UTF-8
+            else if ((unsigned char)curChar >= 0x80) {
+                char seq[5] = { 0 };
+                size_t len = utf8_sequence_length((unsigned char)curChar);
+                for (size_t i = 0; i < len; i++) {
+                    seq[i] = peek(lexer, 0);
+                    advance(lexer);
+                }
+                lexer_error(lexer, startLine, startColumn, "Unexpected"\
+                    " character '%s' outside a comment", seq);
+                token = create_token(TOK_INVALID, NULL, startLine,
+                    startColumn);
             }
             else {
-                fprintf(stderr, "Lexer Error [%zu:%zu]: Unexpected token"\
-                    " '%c'\n", startLine, startColumn, curChar);
+                lexer_error(lexer, startLine, startColumn, "Unexpected"\
+                    " token '%c'", curChar);
                 token = create_token(TOK_INVALID, NULL, startLine,
                     startColumn);
                 advance(lexer);
@@ -395,20 +489,128 @@ Token* get_next_token(Lexer* lexer) {
             break;
     }
 
+    // A token cut short by a failed read would not be the one written
+    if (lexer->failed) {
+        free_token(token);
+        return NULL;
+    }
+
+    if (token != NULL) {
+        token->offset = startPos;
+        token->length = lexer->pos - startPos;
+    }
     return token;
 }
 
 /* --- Helper Functions --- */
 
 static inline char peek(Lexer* lexer, size_t offset) {
-    size_t newPos = lexer->pos + offset;
+    size_t newPos = lexer->pos + offset - lexer->base;
     if (newPos >= lexer->srcLen) {
-        return '\0';
+        if (lexer->input == NULL || !refill(lexer, offset)) {
+            return '\0';
+        }
+        newPos = lexer->pos + offset - lexer->base;
     }
 
     return lexer->src[newPos];
 }
 
+static bool refill(Lexer* lexer, size_t offset) {
+    while (lexer->pos + offset - lexer->base >= lexer->srcLen) {
+        if (lexer->eof) {
+            return false;
+        }
+
+        // Carry the unread part of the window over to its front
+        size_t drop = lexer->keep - lexer->base;
+        memmove(lexer->src, lexer->src + drop, lexer->srcLen - drop);
+        lexer->srcLen -= drop;
+        lexer->base = lexer->keep;
+
+        if (lexer->srcLen + lexer->chunkSize + 1 > lexer->cap) {
+            size_t newCap = lexer->cap * 2;
+            if (newCap < lexer->srcLen + lexer->chunkSize + 1) {
+                newCap = lexer->srcLen + lexer->chunkSize + 1;
+            }
+            char* grown = realloc(lexer->src, newCap);
+            if (grown == NULL) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                return fail_refill(lexer);
+            }
+            lexer->src = grown;
+            lexer->cap = newCap;
+        }
+
+        size_t read = fread(lexer->src + lexer->srcLen, 1, lexer->chunkSize,
+            lexer->input);
+        size_t invalid = utf8_validate(&lexer->utf8,
+            lexer->src + lexer->srcLen, read);
+        lexer->srcLen += read;
+        lexer->src[lexer->srcLen] = '\0';
+        if (read < lexer->chunkSize) {
+            lexer->eof = true;
+            if (ferror(lexer->input)) {
+                fprintf(stderr, "Error: Failed to read input\n");
+                return fail_refill(lexer);
+            }
+            if (invalid == UTF8_VALID) {
+                invalid = utf8_finish(&lexer->utf8);
+            }
+        }
+
+        if (invalid != UTF8_VALID) {
+            // A sequence the lexer is already inside started on the
+            // same line, otherwise the bytes up to it are in the window
+            if (invalid < lexer->pos) {
+                print_utf8_error(NULL, 0, lexer->line,
+                    lexer->column - (lexer->pos - invalid), invalid);
+            } else {
+                print_utf8_error(lexer->src + lexer->pos - lexer->base,
+                    invalid - lexer->pos, lexer->line, lexer->column,
+                    invalid);
+            }
+            return fail_refill(lexer);
+        }
+    }
+
+    return true;
+}
+
+static bool fail_refill(Lexer* lexer) {
+    lexer->srcLen = lexer->pos - lexer->base;
+    lexer->src[lexer->srcLen] = '\0';
+    lexer->eof = true;
+    lexer->failed = true;
+    return false;
+}
+
+static void lexer_error(const Lexer* lexer, size_t line, size_t column,
+    const char* format, ...) {
+    if (lexer->failed) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "Lexer Error [%zu:%zu]: ", line, column);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+static inline bool is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool is_alnum(char c) {
+    return is_alpha(c) || is_digit(c);
+}
+
 static void advance(Lexer* lexer) {
     char curChar = peek(lexer, 0);
     if (curChar == '\0') {
@@ -426,6 +628,8 @@ static void advance(Lexer* lexer) {
 
 static void skip_whitespace(Lexer* lexer) {
     while (true) {
+        // Nothing skipped needs to stay in the window
+        lexer->keep = lexer->pos;
         char curChar = peek(lexer, 0);
 
         // Whitespace characters
@@ -441,6 +645,7 @@ static void skip_whitespace(Lexer* lexer) {
 
             while (peek(lexer, 0) != '\n' && peek(lexer, 0) != '\0') {
                 advance(lexer);
+                lexer->keep = lexer->pos;
             }
 
             continue;
@@ -455,9 +660,8 @@ static void skip_whitespace(Lexer* lexer) {
 
             while (true) {
                 if (peek(lexer, 0) == '\0') {
-                    fprintf(stderr, "Lexer Error [%zu:%zu]: Unterminated"\
-                        " multiline comment\n", commentStartLine,
-                        commentStartCol);
+                    lexer_error(lexer, commentStartLine, commentStartCol,
+                        "Unterminated multiline comment");
                     break;
                 }
 
@@ -466,6 +670,7 @@ static void skip_whitespace(Lexer* lexer) {
                 }
 
                 advance(lexer);
+                lexer->keep = lexer->pos;
             }
 
             advance(lexer);
@@ -479,7 +684,7 @@ static void skip_whitespace(Lexer* lexer) {
 
 static char* read_identifier(Lexer* lexer) {
     size_t startPos = lexer->pos;
-    while (isalnum(peek(lexer, 0)) || peek(lexer, 0) == '_') {
+    while (is_alnum(peek(lexer, 0)) || peek(lexer, 0) == '_') {
         advance(lexer);
     }
 
@@ -489,7 +694,7 @@ static char* read_identifier(Lexer* lexer) {
         fprintf(stderr, "Error: Memory allocation failed\n");
         return NULL;
     }
-    memcpy(ident, lexer->src + startPos, len);
+    memcpy(ident, lexer->src + startPos - lexer->base, len);
     ident[len] = '\0';
 
     return ident;
@@ -500,7 +705,7 @@ static char* read_number(Lexer* lexer, size_t startLine, size_t startColumn) {
     bool hasDigitsAfterDot = false;
 
     // Read integer part
-    while (isdigit(peek(lexer, 0))) {
+    while (is_digit(peek(lexer, 0))) {
         advance(lexer);
     }
 
@@ -509,15 +714,15 @@ static char* read_number(Lexer* lexer, size_t startLine, size_t startColumn) {
         advance(lexer);
 
         // Read fractional part
-        while (isdigit(peek(lexer, 0))) {
+        while (is_digit(peek(lexer, 0))) {
             hasDigitsAfterDot = true;
             advance(lexer);
         }
 
         // Check for digits after dot
         if (!hasDigitsAfterDot) {
-            fprintf(stderr, "Lexer Error [%zu:%zu]: Float literal must have"\
-                " digits after decimal point\n", startLine, startColumn);
+            lexer_error(lexer, startLine, startColumn, "Float literal"\
+                " must have digits after decimal point");
             return NULL;
         }
     }
@@ -528,7 +733,7 @@ static char* read_number(Lexer* lexer, size_t startLine, size_t startColumn) {
         fprintf(stderr, "Error: Memory allocation failed\n");
         return NULL;
     }
-    memcpy(num, lexer->src + startPos, len);
+    memcpy(num, lexer->src + startPos - lexer->base, len);
     num[len] = '\0';
 
     return num;
@@ -572,7 +777,7 @@ static TokenType get_ident_type(const char* ident) {
 static TokenType get_num_type(const char* num, size_t startLine,
     size_t startColumn) {
     // Check for leading zero
-    if (num[0] == '0' && isdigit(num[1])) {
+    if (num[0] == '0' && is_digit(num[1])) {
         fprintf(stderr, "Lexer Error [%zu:%zu]: Leading zero in numeric"\
             " literal\n", startLine, startColumn);
         return TOK_INVALID;
@@ -1,13 +1,20 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include "token.h"
+#include "utf8.h"
+
+/// The number of bytes a streaming lexer reads at a time.
+#define LEXER_CHUNK_SIZE 65536
 
 typedef struct Lexer {
-    /// Null-terminated copy of source code being lexed.
+    /// Null-terminated copy of source code being lexed. For a streaming
+    /// lexer, the window of the input read so far and not yet dropped.
     char* src;
-    /// Length of the source code being lexed.
+    /// Length of the source code being lexed, or of the window.
     size_t srcLen;
     /// Lexer's current position in the source code.
     size_t pos;
@@ -15,19 +22,45 @@ typedef struct Lexer {
     size_t line;
     /// Current column number in the source file.
     size_t column;
+    /// The file a streaming lexer reads chunkSize bytes of at a time, or
+    /// NULL for a lexer given the whole source.
+    FILE* input;
+    size_t chunkSize;
+    /// The position in the input of the first byte of the window, and
+    /// the capacity of the window.
+    size_t base;
+    size_t cap;
+    /// The position of the first byte a refill must keep, the start of
+    /// the token being read.
+    size_t keep;
+    /// Whether the input was read to its end, and whether reading it
+    /// failed.
+    bool eof;
+    bool failed;
+    /// How far the input read by a streaming lexer has been validated.
+    Utf8State utf8;
 } Lexer;
 
 /// Creates a lexer from the given source code. Takes ownership of the
-/// src and expects it to be null-terminated. Returns a pointer to the
-/// newly created lexer, or NULL if src is not valid or memory
-/// allocation fails.
+/// src and expects it to be null-terminated. A leading byte order mark
+/// is skipped. Returns a pointer to the newly created lexer, or NULL if
+/// src is not valid UTF-8 or memory allocation fails, leaving src to the
+/// caller.
 Lexer* create_lexer(char* src);
+/// Creates a lexer reading input a chunk of chunkSize bytes at a time,
+/// so only the token being read and the chunk it ends in are held in
+/// memory however long the input is. The input stays open and owned by
+/// the caller, and can be a pipe. It gives the same tokens as lexing the
+/// whole input, each chunk being validated as UTF-8 as it is read, and
+/// getting a token fails once an invalid sequence is read. Returns NULL
+/// if input is NULL, chunkSize is 0 or memory allocation fails.
+Lexer* create_stream_lexer(FILE* input, size_t chunkSize);
 /// Frees the memory allocated for the lexer, including the owned source
 /// string. Safely handles NULL.
 void destroy_lexer(Lexer* lexer);
 /// Returns a pointer to the next token in the source code. This needs
-/// to be freed by the caller. Returns NULL if lexer is not valid or
-/// memory allocation fails.
+/// to be freed by the caller. Returns NULL if lexer is not valid,
+/// reading its input fails or memory allocation fails.
 Token* get_next_token(Lexer* lexer);
 
 #endif // LEXER_H
@@ -0,0 +1,782 @@
+#include "lower.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "constval.h"
+#include "scope.h"
+#include "types.h"
+
+/// State shared while lowering a single file.
+typedef struct Lowerer {
+    /// Variables visible at the current position. Each symbol value is
+    /// the SSA value currently bound to the variable.
+    Scope* scope;
+    /// The functions of the file, their order gives the callee indices.
+    FuncTable* funcs;
+    /// The function being built.
+    IRFunction* func;
+    /// False once a semantic error has been reported.
+    bool ok;
+} Lowerer;
+
+/// Lowers a function declaration into a new IR function. Returns NULL
+/// on failure.
+static IRFunction* lower_function(Lowerer* lowerer, ASTNode* decl);
+/// Lowers a statement into the current block. Statements after a
+/// return are unreachable and only checked with check_unreachable().
+static void lower_stmt(Lowerer* lowerer, ASTNode* stmt);
+/// Lowers an unreachable statement into blocks that are removed again,
+/// so it is checked like any other but emits nothing. The variables keep
+/// the values they had before it.
+static void check_unreachable(Lowerer* lowerer, ASTNode* stmt);
+/// Declares a variable or parameter in the innermost block scope,
+/// reporting a name the block already declares. Returns NULL on failure.
+static Symbol* declare(Lowerer* lowerer, const char* name, TokenType type,
+    bool mutable, ASTNode* decl);
+/// Lowers an if statement, merging the variables assigned in either
+/// branch with phis at the join block.
+static void lower_if(Lowerer* lowerer, ASTNode* stmt);
+/// Lowers an expression whose type is given by its context. A context of
+/// TOK_INVALID means the expression is evaluated in its own type and its
+/// value may be discarded.
+static uint32_t lower_root(Lowerer* lowerer, ASTNode* expr,
+    TokenType context);
+/// Lowers an expression evaluated in type. Returns its value id, or
+/// IR_NONE on error.
+static uint32_t lower_expr(Lowerer* lowerer, ASTNode* expr, TokenType type);
+/// Lowers a short-circuit && or || into blocks joined by a bool phi.
+static uint32_t lower_logical(Lowerer* lowerer, ASTNode* expr);
+/// Lowers an operand of a comparison evaluated in type, casting a signed
+/// operand compared with an unsigned one to it.
+static uint32_t lower_compare_operand(Lowerer* lowerer, ASTNode* operand,
+    TokenType type);
+/// Lowers a call expression. Its value is of the callee's return type.
+static uint32_t lower_call(Lowerer* lowerer, ASTNode* expr,
+    TokenType* resultType);
+/// Lowers an assignment, or an increment or decrement when op is
+/// TOK_INCREMENT or TOK_DECREMENT. Returns the value the expression
+/// produces in the variable's type.
+static uint32_t lower_update(Lowerer* lowerer, ASTNode* expr,
+    ASTNode* target, TokenType op, ASTNode* valueExpr, bool isPostfix,
+    TokenType* resultType);
+/// Converts a value between types. Implicit conversions must be
+/// lossless. Constants are converted at compile time.
+static uint32_t convert(Lowerer* lowerer, const ASTNode* node,
+    uint32_t value, TokenType from, TokenType to, bool isExplicit);
+/// Returns the type the operand of a cast expression is evaluated in.
+static TokenType cast_operand_type(Lowerer* lowerer, const ASTNode* operand);
+/// Returns the IR op of an arithmetic or comparison operator, or IR_NOP
+/// if the operator has none.
+static IROp binary_op(TokenType op);
+/// Returns a copy of the values bound to every visible symbol, or NULL
+/// on failure.
+static uint32_t* snapshot_values(Lowerer* lowerer);
+/// Prints a formatted semantic error at the node and marks the lowering
+/// failed.
+static void error_at(Lowerer* lowerer, const ASTNode* node,
+    const char* format, ...);
+
+IRModule* lower_program(ASTNode* file) {
+    if (file == NULL || file->type != NODE_FILE) {
+        fprintf(stderr, "Error: Lowering requires a file node\n");
+        return NULL;
+    }
+
+    Lowerer lowerer = { 0 };
+    lowerer.ok = true;
+    lowerer.scope = create_scope();
+    lowerer.funcs = create_func_table(file);
+    IRModule* module = create_ir_module();
+    if (lowerer.scope == NULL || lowerer.funcs == NULL || module == NULL) {
+        destroy_scope(lowerer.scope);
+        destroy_func_table(lowerer.funcs);
+        free_ir_module(module);
+        return NULL;
+    }
+
+    // The table keeps the first function of each name
+    for (size_t i = 0; i < file->data.file.stmtCount; i++) {
+        ASTNode* stmt = file->data.file.stmts[i];
+        if (stmt != NULL && stmt->type == NODE_FUNCTION_DECL &&
+            func_table_lookup(lowerer.funcs, stmt->data.functionDecl.name)
+            != stmt) {
+            error_at(&lowerer, stmt, "Function '%s' is already defined",
+                stmt->data.functionDecl.name);
+        }
+    }
+
+    for (size_t i = 0; lowerer.ok && i < lowerer.funcs->count; i++) {
+        IRFunction* func = lower_function(&lowerer, lowerer.funcs->funcs[i]);
+        if (func == NULL || !ir_module_add(module, func)) {
+            free_ir_function(func);
+            lowerer.ok = false;
+        }
+        if (!lowerer.ok) {
+            break;
+        }
+    }
+
+    if (lowerer.ok && !verify_ir_module(module)) {
+        lowerer.ok = false;
+    }
+
+    destroy_scope(lowerer.scope);
+    destroy_func_table(lowerer.funcs);
+    if (!lowerer.ok) {
+        free_ir_module(module);
+        return NULL;
+    }
+
+    return module;
+}
+
+IRFunction* lower_function_decl(ASTNode* decl, FuncTable* funcs) {
+    if (decl == NULL || decl->type != NODE_FUNCTION_DECL) {
+        fprintf(stderr, "Error: Lowering requires a function declaration\n");
+        return NULL;
+    }
+
+    Lowerer lowerer = { 0 };
+    lowerer.ok = true;
+    lowerer.scope = create_scope();
+    lowerer.funcs = funcs;
+    if (lowerer.scope == NULL) {
+        return NULL;
+    }
+
+    IRFunction* func = lower_function(&lowerer, decl);
+    destroy_scope(lowerer.scope);
+    if (!lowerer.ok) {
+        free_ir_function(func);
+        return NULL;
+    }
+
+    return func;
+}
+
+/* --- Helper Functions --- */
+
+static IRFunction* lower_function(Lowerer* lowerer, ASTNode* decl) {
+    FunctionDecl* fn = &decl->data.functionDecl;
+    TokenType* paramTypes = malloc((fn->paramCount + 1) * sizeof(TokenType));
+    if (paramTypes == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return NULL;
+    }
+    for (size_t i = 0; i < fn->paramCount; i++) {
+        paramTypes[i] = fn->params[i]->data.parameterDecl.type;
+    }
+
+    IRFunction* func = create_ir_function(fn->name, fn->returnType,
+        paramTypes, (uint32_t)fn->paramCount);
+    free(paramTypes);
+    if (func == NULL || !scope_enter(lowerer->scope)) {
+        free_ir_function(func);
+        return NULL;
+    }
+
+    lowerer->func = func;
+    ir_set_block(func, ir_add_block(func));
+    for (size_t i = 0; i < fn->paramCount; i++) {
+        ASTNode* param = fn->params[i];
+        Symbol* symbol = declare(lowerer, param->data.parameterDecl.name,
+            param->data.parameterDecl.type, false, param);
+        if (symbol != NULL) {
+            symbol->value = ir_emit(func, IR_PARAM,
+                param->data.parameterDecl.type, (uint32_t)i, 0);
+        }
+    }
+
+    lower_stmt(lowerer, fn->body);
+    scope_exit(lowerer->scope);
+    if (!lowerer->ok) {
+        return func;
+    }
+
+    if (func->curBlock != IR_NONE) {
+        if (fn->returnType == TOK_INVALID) {
+            ir_emit_ret(func, IR_NONE);
+        } else {
+            error_at(lowerer, decl, "Not all paths of '%s' return a"\
+                " value", fn->name);
+            return func;
+        }
+    }
+
+    if (!ir_compact(func)) {
+        free_ir_function(func);
+        return NULL;
+    }
+
+    return func;
+}
+
+static void lower_stmt(Lowerer* lowerer, ASTNode* stmt) {
+    if (stmt == NULL || !lowerer->ok) {
+        return;
+    }
+    if (lowerer->func->curBlock == IR_NONE) {
+        check_unreachable(lowerer, stmt);
+        return;
+    }
+
+    switch (stmt->type) {
+        case NODE_BLOCK_STMT:
+            if (!scope_enter(lowerer->scope)) {
+                lowerer->ok = false;
+                return;
+            }
+            for (size_t i = 0; i < stmt->data.blockStmt.stmtCount; i++) {
+                lower_stmt(lowerer, stmt->data.blockStmt.stmts[i]);
+            }
+            scope_exit(lowerer->scope);
+            break;
+        case NODE_VARIABLE_DECL: {
+            VariableDecl* decl = &stmt->data.variableDecl;
+            uint32_t value;
+            if (decl->initializer != NULL) {
+                value = lower_root(lowerer, decl->initializer, decl->type);
+            } else {
+                ConstValue zero = { { 0, 0 }, 0.0 };
+                value = ir_const(lowerer->func, decl->type, zero);
+            }
+
+            Symbol* symbol = declare(lowerer, decl->name, decl->type,
+                decl->mutable, stmt);
+            if (symbol == NULL) {
+                lowerer->ok = false;
+                return;
+            }
+            symbol->value = value;
+            break;
+        }
+        case NODE_RETURN_STMT: {
+            TokenType returnType = lowerer->func->returnType;
+            ASTNode* expr = stmt->data.returnStmt.expr;
+            if (returnType == TOK_INVALID && expr != NULL) {
+                error_at(lowerer, stmt, "Cannot return a value from void"\
+                    " function '%s'", lowerer->func->name);
+                return;
+            }
+            if (returnType != TOK_INVALID && expr == NULL) {
+                error_at(lowerer, stmt, "Missing return value in '%s'",
+                    lowerer->func->name);
+                return;
+            }
+
+            uint32_t value = expr == NULL ? IR_NONE :
+                lower_root(lowerer, expr, returnType);
+            if (lowerer->ok) {
+                ir_emit_ret(lowerer->func, value);
+            }
+            break;
+        }
+        case NODE_IF_STMT:
+            lower_if(lowerer, stmt);
+            break;
+        case NODE_EXPR_STMT:
+            lower_root(lowerer, stmt->data.exprStmt.expr, TOK_INVALID);
+            break;
+        default:
+            error_at(lowerer, stmt, "Unexpected statement");
+            break;
+    }
+}
+
+static void check_unreachable(Lowerer* lowerer, ASTNode* stmt) {
+    IRFunction* func = lowerer->func;
+    size_t symbolCount = lowerer->scope->symbolCount;
+    uint32_t* before = snapshot_values(lowerer);
+    uint32_t firstBlock = func->blockCount;
+    uint32_t block = ir_add_block(func);
+    if (before == NULL || block == IR_NONE) {
+        free(before);
+        lowerer->ok = false;
+        return;
+    }
+
+    ir_set_block(func, block);
+    lower_stmt(lowerer, stmt);
+
+    // Removed blocks are dropped with their instructions when the
+    // function is compacted
+    func->curBlock = IR_NONE;
+    for (uint32_t b = firstBlock; b < func->blockCount; b++) {
+        func->blocks[b].start = IR_NONE;
+    }
+    for (size_t i = 0; i < symbolCount; i++) {
+        lowerer->scope->symbols[i].value = before[i];
+    }
+    free(before);
+}
+
+static Symbol* declare(Lowerer* lowerer, const char* name, TokenType type,
+    bool mutable, ASTNode* decl) {
+    Symbol* previous = scope_lookup_local(lowerer->scope, name);
+    if (previous != NULL) {
+        error_at(lowerer, decl, "'%s' is already declared at %zu:%zu", name,
+            previous->decl->line, previous->decl->column);
+        return NULL;
+    }
+
+    return scope_declare(lowerer->scope, name, type, mutable, decl);
+}
+
+static void lower_if(Lowerer* lowerer, ASTNode* stmt) {
+    IRFunction* func = lowerer->func;
+    IfStmt* ifStmt = &stmt->data.ifStmt;
+    uint32_t cond = lower_root(lowerer, ifStmt->condition, TOK_BOOL);
+    if (cond == IR_NONE) {
+        return;
+    }
+
+    uint32_t condBlock = func->curBlock;
+    uint32_t thenBlock = ir_add_block(func);
+    uint32_t elseBlock = ifStmt->elseBranch != NULL ? ir_add_block(func) :
+        IR_NONE;
+    uint32_t joinBlock = ir_add_block(func);
+    ir_emit_br(func, cond, thenBlock,
+        elseBlock != IR_NONE ? elseBlock : joinBlock);
+
+    // Each path records the block it leaves from and the variable
+    // values at that point, IR_NONE if it does not reach the join
+    uint32_t* before = snapshot_values(lowerer);
+    if (before == NULL) {
+        lowerer->ok = false;
+        return;
+    }
+    uint32_t predBlocks[2] = { IR_NONE, IR_NONE };
+    uint32_t* predValues[2] = { NULL, NULL };
+    size_t symbolCount = lowerer->scope->symbolCount;
+
+    ir_set_block(func, thenBlock);
+    lower_stmt(lowerer, ifStmt->thenBranch);
+    // A failed branch can leave its block open, the else branch is not
+    // started after it
+    if (!lowerer->ok) {
+        free(before);
+        return;
+    }
+    if (func->curBlock != IR_NONE) {
+        predBlocks[0] = func->curBlock;
+        predValues[0] = snapshot_values(lowerer);
+        ir_emit_jmp(func, joinBlock);
+    }
+
+    for (size_t i = 0; i < symbolCount; i++) {
+        lowerer->scope->symbols[i].value = before[i];
+    }
+
+    if (elseBlock != IR_NONE) {
+        ir_set_block(func, elseBlock);
+        lower_stmt(lowerer, ifStmt->elseBranch);
+        if (lowerer->ok && func->curBlock != IR_NONE) {
+            predBlocks[1] = func->curBlock;
+            predValues[1] = snapshot_values(lowerer);
+            ir_emit_jmp(func, joinBlock);
+        }
+    } else {
+        predBlocks[1] = condBlock;
+        predValues[1] = before;
+    }
+
+    if ((predBlocks[0] != IR_NONE && predValues[0] == NULL) ||
+        (predBlocks[1] != IR_NONE && predValues[1] == NULL)) {
+        lowerer->ok = false;
+    }
+
+    if (lowerer->ok &&
+        (predBlocks[0] != IR_NONE || predBlocks[1] != IR_NONE)) {
+        ir_set_block(func, joinBlock);
+        for (size_t i = 0; i < symbolCount; i++) {
+            Symbol* symbol = &lowerer->scope->symbols[i];
+            if (predBlocks[0] == IR_NONE) {
+                symbol->value = predValues[1][i];
+            } else if (predBlocks[1] == IR_NONE ||
+                predValues[0][i] == predValues[1][i]) {
+                symbol->value = predValues[0][i];
+            } else {
+                uint32_t values[2] = { predValues[0][i], predValues[1][i] };
+                symbol->value = ir_emit_phi(func, symbol->type, predBlocks,
+                    values, 2);
+            }
+        }
+    }
+
+    free(predValues[0]);
+    if (predValues[1] != before) {
+        free(predValues[1]);
+    }
+    free(before);
+}
+
+static uint32_t lower_root(Lowerer* lowerer, ASTNode* expr,
+    TokenType context) {
+    if (expr == NULL) {
+        return IR_NONE;
+    }
+
+    if (context != TOK_INVALID) {
+        return lower_expr(lowerer, expr, context);
+    }
+
+    TokenType type = type_default(type_of_expr(expr, lowerer->scope,
+        lowerer->funcs));
+    return lower_expr(lowerer, expr, type);
+}
+
+static uint32_t lower_expr(Lowerer* lowerer, ASTNode* expr, TokenType type) {
+    IRFunction* func = lowerer->func;
+
+    switch (expr->type) {
+        case NODE_LITERAL: {
+            ConstValue value;
+            if (!const_from_literal(expr, type, &value)) {
+                error_at(lowerer, expr, "Literal '%s' cannot be used as"\
+                    " %s", expr->data.literal.value, type_name(type));
+                return IR_NONE;
+            }
+            return ir_const(func, type, value);
+        }
+        case NODE_IDENT: {
+            Symbol* symbol = scope_lookup(lowerer->scope,
+                expr->data.ident.name);
+            if (symbol == NULL) {
+                error_at(lowerer, expr, "Undeclared variable '%s'",
+                    expr->data.ident.name);
+                return IR_NONE;
+            }
+            return convert(lowerer, expr, symbol->value, symbol->type, type,
+                false);
+        }
+        case NODE_BINARY_EXPR: {
+            BinaryExpr* binary = &expr->data.binaryExpr;
+            if (binary->op == TOK_AND || binary->op == TOK_OR) {
+                uint32_t value = lower_logical(lowerer, expr);
+                return value == IR_NONE ? IR_NONE : convert(lowerer, expr,
+                    value, TOK_BOOL, type, false);
+            }
+
+            IROp op = binary_op(binary->op);
+            if (op >= IR_ADD && op <= IR_MOD) {
+                if (type == TOK_BOOL || type == TOK_INVALID) {
+                    error_at(lowerer, expr, "Arithmetic cannot produce %s",
+                        type_name(type));
+                    return IR_NONE;
+                }
+                uint32_t left = lower_expr(lowerer, binary->left, type);
+                uint32_t right = left == IR_NONE ? IR_NONE :
+                    lower_expr(lowerer, binary->right, type);
+                if (right == IR_NONE) {
+                    return IR_NONE;
+                }
+                return ir_emit(func, op, type, left, right);
+            }
+
+            // Comparisons evaluate their operands in the widest type of
+            // the two
+            TokenType operandType = type_default(type_common(
+                type_of_expr(binary->left, lowerer->scope, lowerer->funcs),
+                type_of_expr(binary->right, lowerer->scope,
+                lowerer->funcs)));
+            uint32_t left = lower_compare_operand(lowerer, binary->left,
+                operandType);
+            uint32_t right = left == IR_NONE ? IR_NONE :
+                lower_compare_operand(lowerer, binary->right, operandType);
+            if (right == IR_NONE) {
+                return IR_NONE;
+            }
+            uint32_t value = ir_emit(func, op, TOK_BOOL, left, right);
+            return convert(lowerer, expr, value, TOK_BOOL, type, false);
+        }
+        case NODE_UNARY_EXPR: {
+            UnaryExpr* unary = &expr->data.unaryExpr;
+            if (unary->op == TOK_INCREMENT || unary->op == TOK_DECREMENT) {
+                TokenType resultType;
+                uint32_t value = lower_update(lowerer, expr, unary->operand,
+                    unary->op, NULL, unary->isPostfix, &resultType);
+                return value == IR_NONE ? IR_NONE : convert(lowerer, expr,
+                    value, resultType, type, false);
+            }
+            if (unary->op == TOK_NOT) {
+                uint32_t operand = lower_expr(lowerer, unary->operand,
+                    TOK_BOOL);
+                if (operand == IR_NONE) {
+                    return IR_NONE;
+                }
+                uint32_t value = ir_emit(func, IR_NOT, TOK_BOOL, operand, 0);
+                return convert(lowerer, expr, value, TOK_BOOL, type, false);
+            }
+
+            if (type == TOK_BOOL || type == TOK_INVALID) {
+                error_at(lowerer, expr, "Negation cannot produce %s",
+                    type_name(type));
+                return IR_NONE;
+            }
+            uint32_t operand = lower_expr(lowerer, unary->operand, type);
+            return operand == IR_NONE ? IR_NONE :
+                ir_emit(func, IR_NEG, type, operand, 0);
+        }
+        case NODE_CAST_EXPR: {
+            ASTNode* operand = expr->data.castExpr.expr;
+            TokenType castType = expr->data.castExpr.type;
+            TokenType operandType = cast_operand_type(lowerer, operand);
+            uint32_t value = lower_expr(lowerer, operand, operandType);
+            if (value == IR_NONE) {
+                return IR_NONE;
+            }
+            value = convert(lowerer, expr, value, operandType, castType,
+                true);
+            return convert(lowerer, expr, value, castType, type, false);
+        }
+        case NODE_CALL_EXPR: {
+            TokenType resultType;
+            uint32_t value = lower_call(lowerer, expr, &resultType);
+            if (value == IR_NONE) {
+                return IR_NONE;
+            }
+            if (resultType == TOK_INVALID && type != TOK_INVALID) {
+                error_at(lowerer, expr, "Function '%s' does not return a"\
+                    " value", expr->data.callExpr.callee->data.ident.name);
+                return IR_NONE;
+            }
+            return convert(lowerer, expr, value, resultType, type, false);
+        }
+        case NODE_ASSIGN_EXPR: {
+            AssignExpr* assign = &expr->data.assignExpr;
+            TokenType resultType;
+            uint32_t value = lower_update(lowerer, expr, assign->target,
+                assign->op, assign->value, false, &resultType);
+            return value == IR_NONE ? IR_NONE : convert(lowerer, expr,
+                value, resultType, type, false);
+        }
+        default:
+            error_at(lowerer, expr, "Unexpected expression");
+            return IR_NONE;
+    }
+}
+
+static uint32_t lower_logical(Lowerer* lowerer, ASTNode* expr) {
+    IRFunction* func = lowerer->func;
+    BinaryExpr* binary = &expr->data.binaryExpr;
+    uint32_t left = lower_expr(lowerer, binary->left, TOK_BOOL);
+    if (left == IR_NONE) {
+        return IR_NONE;
+    }
+
+    // The right operand only runs when the left does not decide the
+    // result, which is then the left value itself
+    bool isAnd = binary->op == TOK_AND;
+    uint32_t leftBlock = func->curBlock;
+    uint32_t rightBlock = ir_add_block(func);
+    uint32_t joinBlock = ir_add_block(func);
+    if (isAnd) {
+        ir_emit_br(func, left, rightBlock, joinBlock);
+    } else {
+        ir_emit_br(func, left, joinBlock, rightBlock);
+    }
+
+    ir_set_block(func, rightBlock);
+    uint32_t right = lower_expr(lowerer, binary->right, TOK_BOOL);
+    if (right == IR_NONE) {
+        return IR_NONE;
+    }
+    uint32_t rightEnd = func->curBlock;
+    ir_emit_jmp(func, joinBlock);
+
+    ConstValue decided = { i128_from_u64(isAnd ? 0 : 1), 0.0 };
+    uint32_t blocks[2] = { leftBlock, rightEnd };
+    uint32_t values[2] = { ir_const(func, TOK_BOOL, decided), right };
+    ir_set_block(func, joinBlock);
+    return ir_emit_phi(func, TOK_BOOL, blocks, values, 2);
+}
+
+static uint32_t lower_compare_operand(Lowerer* lowerer, ASTNode* operand,
+    TokenType type) {
+    TokenType own = type_of_expr(operand, lowerer->scope, lowerer->funcs);
+    if (!type_compare_casts(own, type)) {
+        return lower_expr(lowerer, operand, type);
+    }
+
+    uint32_t value = lower_expr(lowerer, operand, own);
+    return value == IR_NONE ? IR_NONE :
+        convert(lowerer, operand, value, own, type, true);
+}
+
+static uint32_t lower_call(Lowerer* lowerer, ASTNode* expr,
+    TokenType* resultType) {
+    CallExpr* call = &expr->data.callExpr;
+    if (call->callee == NULL || call->callee->type != NODE_IDENT) {
+        error_at(lowerer, expr, "Callee must be a function name");
+        return IR_NONE;
+    }
+
+    const char* name = call->callee->data.ident.name;
+    size_t index = func_table_index(lowerer->funcs, name);
+    if (index == SIZE_MAX) {
+        error_at(lowerer, expr, "Undeclared function '%s'", name);
+        return IR_NONE;
+    }
+
+    FunctionDecl* callee = &lowerer->funcs->funcs[index]->data.functionDecl;
+    if (call->argCount != callee->paramCount) {
+        error_at(lowerer, expr, "Function '%s' expects %zu argument(s)"\
+            " but got %zu", name, callee->paramCount, call->argCount);
+        return IR_NONE;
+    }
+
+    uint32_t* args = malloc((call->argCount + 1) * sizeof(uint32_t));
+    if (args == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        lowerer->ok = false;
+        return IR_NONE;
+    }
+    for (size_t i = 0; i < call->argCount; i++) {
+        args[i] = lower_expr(lowerer, call->args[i],
+            callee->params[i]->data.parameterDecl.type);
+        if (args[i] == IR_NONE) {
+            free(args);
+            return IR_NONE;
+        }
+    }
+
+    *resultType = callee->returnType;
+    uint32_t value = ir_emit_call(lowerer->func, callee->returnType,
+        (uint32_t)index, args, (uint32_t)call->argCount);
+    free(args);
+    return value;
+}
+
+static uint32_t lower_update(Lowerer* lowerer, ASTNode* expr,
+    ASTNode* target, TokenType op, ASTNode* valueExpr, bool isPostfix,
+    TokenType* resultType) {
+    if (target == NULL || target->type != NODE_IDENT) {
+        error_at(lowerer, expr, "Assignment target must be a variable");
+        return IR_NONE;
+    }
+
+    Symbol* symbol = scope_lookup(lowerer->scope, target->data.ident.name);
+    if (symbol == NULL) {
+        error_at(lowerer, target, "Undeclared variable '%s'",
+            target->data.ident.name);
+        return IR_NONE;
+    }
+    if (!symbol->mutable) {
+        error_at(lowerer, target, "Cannot assign to immutable variable"\
+            " '%s'", symbol->name);
+        return IR_NONE;
+    }
+
+    TokenType type = symbol->type;
+    *resultType = type;
+    if (op == TOK_ASSIGN) {
+        uint32_t value = lower_expr(lowerer, valueExpr, type);
+        if (value != IR_NONE) {
+            symbol->value = value;
+        }
+        return value;
+    }
+
+    if (type == TOK_BOOL) {
+        error_at(lowerer, expr, "Arithmetic cannot produce %s",
+            type_name(type));
+        return IR_NONE;
+    }
+
+    uint32_t operand;
+    IROp irOp;
+    if (op == TOK_INCREMENT || op == TOK_DECREMENT) {
+        ConstValue one = { i128_from_u64(1), 1.0 };
+        operand = ir_const(lowerer->func, type, one);
+        irOp = op == TOK_INCREMENT ? IR_ADD : IR_SUB;
+    } else {
+        // The compound operators follow the arithmetic operators in
+        // declaration order
+        operand = lower_expr(lowerer, valueExpr, type);
+        irOp = binary_op((TokenType)(TOK_ADD + (op - TOK_PLUS_ASSIGN)));
+    }
+    if (operand == IR_NONE) {
+        return IR_NONE;
+    }
+
+    // Read after the operand, which may have reassigned the variable
+    uint32_t old = symbol->value;
+    uint32_t value = ir_emit(lowerer->func, irOp, type, old, operand);
+    symbol->value = value;
+    return isPostfix ? old : value;
+}
+
+static uint32_t convert(Lowerer* lowerer, const ASTNode* node,
+    uint32_t value, TokenType from, TokenType to, bool isExplicit) {
+    if (from == to || to == TOK_INVALID) {
+        return value;
+    }
+
+    if (!isExplicit && !type_is_lossless(from, to)) {
+        error_at(lowerer, node, "Cannot implicitly convert %s to %s",
+            type_name(from), type_name(to));
+        return IR_NONE;
+    }
+
+    ConstValue result;
+    if (ir_is_const(value) && const_convert(ir_const_value(lowerer->func,
+        value), from, to, isExplicit, &result)) {
+        return ir_const(lowerer->func, to, result);
+    }
+
+    return ir_emit(lowerer->func, IR_CAST, to, value, 0);
+}
+
+static TokenType cast_operand_type(Lowerer* lowerer, const ASTNode* operand) {
+    // Untyped literals are cast from their exact value, as when folding
+    TokenType type = type_of_expr(operand, lowerer->scope, lowerer->funcs);
+    if (type == TOK_INT_LIT) {
+        return TOK_I128;
+    }
+
+    return type_default(type);
+}
+
+static IROp binary_op(TokenType op) {
+    switch (op) {
+        case TOK_ADD: return IR_ADD;
+        case TOK_SUB: return IR_SUB;
+        case TOK_MUL: return IR_MUL;
+        case TOK_DIV: return IR_DIV;
+        case TOK_MOD: return IR_MOD;
+        case TOK_EQ: return IR_EQ;
+        case TOK_NEQ: return IR_NEQ;
+        case TOK_LT: return IR_LT;
+        case TOK_LTE: return IR_LTE;
+        case TOK_GT: return IR_GT;
+        case TOK_GTE: return IR_GTE;
+        default: return IR_NOP;
+    }
+}
+
+static uint32_t* snapshot_values(Lowerer* lowerer) {
+    size_t count = lowerer->scope->symbolCount;
+    uint32_t* values = malloc((count + 1) * sizeof(uint32_t));
+    if (values == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        values[i] = lowerer->scope->symbols[i].value;
+    }
+
+    return values;
+}
+
+static void error_at(Lowerer* lowerer, const ASTNode* node,
+    const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "Semantic Error [%zu:%zu]: ", node->line, node->column);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    lowerer->ok = false;
+}
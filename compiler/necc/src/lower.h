@@ -0,0 +1,19 @@
+#ifndef LOWER_H
+#define LOWER_H
+
+#include "ast.h"
+#include "ir.h"
+#include "scope.h"
+
+/// Lowers every function of a file node to SSA form. Expressions are
+/// typed as the spec describes and implicit conversions become explicit
+/// casts, so the result only contains operations on matching types.
+/// Prints each semantic error found and returns NULL if there are any.
+IRModule* lower_program(ASTNode* file);
+/// Lowers a single function declaration like lower_program(). funcs
+/// holds the functions of its file, whose declarations only need a
+/// signature, and their order gives the callee indices of calls.
+/// Prints each semantic error found and returns NULL if there are any.
+IRFunction* lower_function_decl(ASTNode* decl, FuncTable* funcs);
+
+#endif // LOWER_H
@@ -1,54 +1,1033 @@
+#include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ast.h"
+#include "bytecode.h"
+#include "cache.h"
+#include "callgraph.h"
+#include "consteval.h"
+#include "dce.h"
+#include "elf.h"
+#include "fold.h"
+#include "gvn.h"
+#include "inline.h"
+#include "intern.h"
+#include "ir.h"
+#include "jit.h"
+#include "lower.h"
+#include "parser.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "range.h"
+#include "server.h"
+#include "stats.h"
+#include "switch.h"
+#include "tailrec.h"
+#include "tier.h"
 #include "token.h"
+#include "vm.h"
+#include "watch.h"
+#include "x64.h"
 
-int main(void/*int argc, char* argv[]*/) {
-    /*
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <input_file>\n", argv[0]);
-        exit(EXIT_FAILURE);
+/// Options taken from the command line.
+typedef struct Options {
+    /// The source file to compile.
+    const char* path;
+    /// Runs the program instead of only checking it.
+    bool run;
+    /// Runs the program as native code instead of bytecode.
+    bool jit;
+    /// Interprets the program and compiles hot functions in the
+    /// background.
+    bool tiered;
+    uint32_t tierCalls;
+    uint32_t tierLoops;
+    /// Writes an x86-64 object file.
+    bool compile;
+    /// The object file path, NULL to derive it from the source file.
+    const char* output;
+    /// Keeps every value in memory instead of allocating registers.
+    bool noRegalloc;
+    /// Skips the peephole patterns of the x86-64 backend.
+    bool noPeephole;
+    /// The threads inlining and compiling native code.
+    uint32_t jobs;
+    /// The cost up to which calls are inlined, 0 to disable inlining.
+    uint32_t inlineThreshold;
+    /// The instructions compile time evaluation may run, 0 to disable it.
+    uint64_t constevalSteps;
+    /// The fewest cases an else-if chain needs to become a switch, 0 to
+    /// keep every chain.
+    uint32_t switchMinCases;
+    /// Skips global value numbering.
+    bool noGvn;
+    /// Skips value range analysis.
+    bool noRanges;
+    /// Skips dead code elimination.
+    bool noDce;
+    /// Shares one node among equal literals, names and pure expressions.
+    bool shareNodes;
+    /// The bytes the lexer reads of the file at a time, 0 to read all of
+    /// it before lexing. Left out of the usage, it is there to test the
+    /// chunk boundaries. Cached files are always read whole.
+    size_t lexerChunk;
+    bool dumpAst;
+    bool dumpIr;
+    /// Prints the call graph the bottom-up passes are scheduled over.
+    bool dumpCallGraph;
+    bool dumpBc;
+    /// Prints phase timings and IR size to stderr.
+    bool stats;
+    /// Serves compile requests instead of compiling a file, on stdin and
+    /// stdout or on the Unix domain socket at socketPath if it is set.
+    bool server;
+    const char* socketPath;
+    /// Compiles the file again each time it changes.
+    bool watch;
+    /// Compiles the file to an object one function at a time.
+    bool pipeline;
+} Options;
+
+/// What a rebuild of --watch needs.
+typedef struct WatchContext {
+    const Options* options;
+    /// Keeps the tokens, tree and IR of the file between rebuilds.
+    SourceCache* cache;
+} WatchContext;
+
+/// Compiles the file of the options and does what they ask with it.
+/// With a cache, the file is read through it and its tree and IR are
+/// kept there for later requests. Returns the exit code of the compiler.
+static int compile_program(const Options* options, SourceCache* cache);
+/// Parses the source read from input a chunk at a time, closing input,
+/// and folds constants. Returns NULL on failure.
+static ASTNode* parse_source(FILE* input, const Options* options,
+    size_t* folded);
+/// Reads input to its end and creates a parser lexing it as a whole.
+/// Returns NULL on failure.
+static Parser* create_buffered_parser(FILE* input);
+/// Returns a folded copy of the tree of a cached file, reparsing the
+/// tree from its tokens first if it is stale or missing. The caller
+/// owns the copy. Returns NULL on failure.
+static ASTNode* parse_entry(CacheEntry* entry, const Options* options);
+/// Lowers and optimizes a folded tree. Returns NULL on failure.
+static IRModule* build_module(ASTNode* file, const Options* options);
+/// Writes the options the optimized IR depends on to key, which holds
+/// size bytes.
+static void format_module_key(const Options* options, char* key,
+    size_t size);
+/// Compiles the file of the options to an object one function at a
+/// time. Returns the exit code of the compiler.
+static int pipeline_program(const Options* options);
+/// Runs a server request, the ServerHandler of --server. ctx is the
+/// SourceCache shared by the requests.
+static int handle_request(void* ctx, int argc, char* argv[]);
+/// Compiles the file of the options, then again each time it changes
+/// until interrupted. Returns the exit code of the watch.
+static int watch_program(const Options* options);
+/// Rebuilds after the file changed, the WatchHandler of --watch. ctx is
+/// the WatchContext.
+static void handle_change(void* ctx, const bool* changed);
+/// Parses the arguments into options. Returns false if they are not
+/// valid.
+static bool parse_args(int argc, char* argv[], Options* options);
+/// Parses the positive count following the option at argv[*i] and
+/// advances past it. Returns false if it is missing or not valid.
+static bool parse_count(int argc, char* argv[], int* i, uint32_t* out);
+/// Parses the number given to an -f option, what names it in errors.
+/// Returns false if it is not valid or above max.
+static bool parse_limit(const char* text, const char* what, uint64_t max,
+    uint64_t* out);
+/// Prints the usage message to stderr.
+static void print_usage(const char* program);
+/// Compiles the IR to x86-64 and writes the object file. Returns the
+/// exit code of the compiler.
+static int write_object(const IRModule* module, const Options* options);
+/// Writes obj to the object file named by the options. Returns false on
+/// failure.
+static bool save_object(const ElfObject* obj, const Options* options);
+/// Returns the default object path for a source file, the file name
+/// with its extension replaced by ".o". Returns NULL on allocation
+/// failure.
+static char* object_path(const char* path);
+/// Compiles the IR to bytecode and runs main. Returns the exit code of
+/// the program.
+static int run_program(const IRModule* module, const Options* options);
+/// Compiles the IR to native code in memory and runs main. start is when
+/// compilation began, for reporting the latency until main starts.
+/// Returns the exit code of the program.
+static int jit_program(const IRModule* module, const Options* options,
+    double start);
+/// Returns the index of the function main, checking that it can be run.
+/// Returns IR_NONE if it cannot.
+static uint32_t find_main(const IRModule* module);
+/// Prints the instruction count and memory use of the IR.
+static void print_ir_stats(const IRModule* module);
+/// Prints the shape of the call graph the bottom-up passes are scheduled
+/// over and the seconds it took to build.
+static void print_call_graph_stats(const CallGraph* graph, double seconds);
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse_args(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.watch) {
+        return watch_program(&options);
+    }
+    if (options.pipeline) {
+        return pipeline_program(&options);
+    }
+    if (!options.server) {
+        return compile_program(&options, NULL);
+    }
+
+    SourceCache* cache = create_source_cache();
+    if (cache == NULL) {
+        return EXIT_FAILURE;
+    }
+    int exitCode = options.socketPath != NULL ?
+        server_run_socket(options.socketPath, handle_request, cache) :
+        server_run_stdio(handle_request, cache);
+    free_source_cache(cache);
+    return exitCode;
+}
+
+/* --- Helper Functions --- */
+
+static int compile_program(const Options* options, SourceCache* cache) {
+    CacheEntry* entry = NULL;
+    FILE* input = NULL;
+    if (cache != NULL) {
+        entry = cache_load(cache, options->path);
+        if (entry == NULL) {
+            return EXIT_FAILURE;
+        }
+    } else {
+        input = fopen(options->path, "rb");
+        if (input == NULL) {
+            fprintf(stderr, "Error: Failed to open input file '%s'\n",
+                options->path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    double start = stats_now();
+    char key[128];
+    format_module_key(options, key, sizeof(key));
+    // The call graph is only there to dump while the module is built
+    bool reuseModule = entry != NULL && entry->module != NULL &&
+        strcmp(entry->moduleKey, key) == 0 && !options->dumpCallGraph;
+
+    // The folded tree is only needed to build the module or dump it
+    size_t folded;
+    ASTNode* file = NULL;
+    if (!reuseModule || options->dumpAst) {
+        file = entry != NULL ? parse_entry(entry, options) :
+            parse_source(input, options, &folded);
+        if (file == NULL) {
+            return EXIT_FAILURE;
+        }
+    }
+    if (options->dumpAst) {
+        print_ast_node(file, 0);
     }
 
-    FILE* input_file = fopen(argv[1], "r");
-    if (input_file == NULL) {
-        fprintf(stderr, "Error: Failed to open input file\n");
-        exit(EXIT_FAILURE);
+    IRModule* module = NULL;
+    if (reuseModule) {
+        module = entry->module;
+        if (options->stats) {
+            fprintf(stderr, "Lower: reused the IR of the unchanged file\n");
+        }
+    } else {
+        module = build_module(file, options);
+        if (module == NULL || (entry != NULL &&
+            !cache_set_module(entry, module, key))) {
+            free_ast_node(file);
+            return EXIT_FAILURE;
+        }
+    }
+    free_ast_node(file);
+    if (options->dumpIr) {
+        print_ir_module(module);
+    }
+    if (options->stats) {
+        print_ir_stats(module);
+        if (cache != NULL) {
+            fprintf(stderr, "Cache: %zu hit(s), %zu miss(es)\n",
+                cache->hits, cache->misses);
+        }
     }
 
-    fseek(input_file, 0, SEEK_END);
-    size_t file_size = ftell(input_file);
-    fseek(input_file, 0, SEEK_SET);
+    int exitCode = EXIT_SUCCESS;
+    if (options->compile) {
+        exitCode = write_object(module, options);
+    }
+    if (exitCode == EXIT_SUCCESS && options->jit) {
+        exitCode = jit_program(module, options, start);
+    } else if (exitCode == EXIT_SUCCESS && (options->run ||
+        options->dumpBc)) {
+        exitCode = run_program(module, options);
+    }
 
-    char* src = malloc(file_size + 1);
+    if (entry == NULL) {
+        free_ir_module(module);
+    }
+    return exitCode;
+}
+
+static ASTNode* parse_source(FILE* input, const Options* options,
+    size_t* folded) {
+    double start = stats_now();
+    Parser* parser = options->lexerChunk > 0 ?
+        create_stream_parser(input, options->lexerChunk) :
+        create_buffered_parser(input);
+    NodeTable* nodes = options->shareNodes ? create_node_table() : NULL;
+    if (parser == NULL || (options->shareNodes && nodes == NULL)) {
+        destroy_parser(parser);
+        fclose(input);
+        return NULL;
+    }
+    parser->nodes = nodes;
+    ASTNode* file = parse_program(parser);
+    destroy_parser(parser);
+    fclose(input);
+
+    // The table only finds nodes to share while parsing
+    size_t shared = nodes != NULL ? nodes->shared : 0;
+    size_t distinct = nodes != NULL ? nodes->count : 0;
+    destroy_node_table(nodes);
+    if (file == NULL) {
+        return NULL;
+    }
+    double parsed = stats_now();
+
+    *folded = fold_constants(file);
+    if (options->stats) {
+        fprintf(stderr, "Parse: %.3f ms\n", (parsed - start) * 1000.0);
+        if (options->shareNodes) {
+            fprintf(stderr, "Share: %zu expression(s) in %zu node(s)\n",
+                shared + distinct, distinct);
+        }
+        fprintf(stderr, "Fold: %.3f ms, %zu expression(s)\n",
+            (stats_now() - parsed) * 1000.0, *folded);
+    }
+    return file;
+}
+
+static Parser* create_buffered_parser(FILE* input) {
+    size_t len = 0;
+    size_t cap = LEXER_CHUNK_SIZE;
+    char* src = malloc(cap + 1);
+    while (src != NULL) {
+        len += fread(src + len, 1, cap - len, input);
+        if (len < cap) {
+            break;
+        }
+        cap *= 2;
+        char* grown = realloc(src, cap + 1);
+        if (grown == NULL) {
+            free(src);
+        }
+        src = grown;
+    }
     if (src == NULL) {
         fprintf(stderr, "Error: Memory allocation failed\n");
-        fclose(input_file);
-        exit(EXIT_FAILURE);
-    }
-    fread(src, 1, file_size, input_file);
-    src[file_size] = '\0';
-    fclose(input_file);
-    free(src);
-    */
-
-    // Create an example AST for testing
-    ASTNode* num1 = create_literal_node(10, 9, TOK_INT_LIT, "42");
-    ASTNode* num2 = create_literal_node(10, 9, TOK_INT_LIT, "20");
-    ASTNode* add_expr = create_binary_expr_node(10, 9, TOK_ADD, num1, num2);
-    ASTNode* var_decl = create_variable_decl_node(10, 10, "my_var", TOK_I32,
-        false, add_expr);
-    ASTNode* body = create_block_stmt_node(10, 10, &var_decl, 1);
-    ASTNode* argcDecl = create_parameter_decl_node(100, 200, "argc", TOK_I32);
-    ASTNode* func_decl = create_function_decl_node(10, 10, "main", &argcDecl,
-        1, TOK_I32, body);
-    ASTNode* file_node = create_file_node(&func_decl, 1);
-
-    print_ast_node(file_node, 0);
-
-    // This errors at runtime because the hardcoded identifier's are
-    // not on the heap, but its ok for testing purposes
-    free_ast_node(file_node);
-    return 0;
+        return NULL;
+    }
+    if (ferror(input)) {
+        fprintf(stderr, "Error: Failed to read the input\n");
+        free(src);
+        return NULL;
+    }
+
+    src[len] = '\0';
+    Parser* parser = create_parser(src);
+    if (parser == NULL) {
+        free(src);
+    }
+    return parser;
+}
+
+static ASTNode* parse_entry(CacheEntry* entry, const Options* options) {
+    double start = stats_now();
+    bool reparse = entry->ast == NULL || entry->stale;
+    bool stale = reparse && entry->ast != NULL;
+    if (reparse) {
+        if (entry->tokens == NULL) {
+            entry->tokens = lex_token_stream(entry->src, entry->srcLen);
+            if (entry->tokens == NULL) {
+                return NULL;
+            }
+        }
+
+        // A stale tree lends the functions and blocks the edit left alone
+        entry->ast = reparse_program(entry->ast, entry->tokens,
+            stale ? &entry->tokens->change : NULL);
+        entry->stale = false;
+
+        // The lexer prints its errors only as it makes invalid tokens, so
+        // a stream holding any is not kept, the next build lexing it again
+        // and printing them again instead of failing without a word
+        if (entry->tokens->invalid > 0) {
+            free_ast_node(entry->ast);
+            free_token_stream(entry->tokens);
+            entry->ast = NULL;
+            entry->tokens = NULL;
+        }
+        if (entry->ast == NULL) {
+            return NULL;
+        }
+    }
+    double parsed = stats_now();
+
+    // Folding rewrites blocks with the values of variables declared
+    // before them, so the cached tree is kept as parsed for the next
+    // reparse to lend from and a copy is folded
+    ASTNode* file = copy_ast_node(entry->ast);
+    if (file == NULL) {
+        return NULL;
+    }
+    size_t folded = fold_constants(file);
+    if (options->stats) {
+        if (!reparse) {
+            fprintf(stderr, "Parse: reused the tree of the unchanged"\
+                " file\n");
+        } else if (stale) {
+            fprintf(stderr, "Parse: %.3f ms, reparsed after relexing %zu"\
+                " of %zu token(s)\n", (parsed - start) * 1000.0,
+                entry->tokens->relexed, entry->tokens->count);
+        } else {
+            fprintf(stderr, "Parse: %.3f ms\n", (parsed - start) * 1000.0);
+        }
+        fprintf(stderr, "Fold: %.3f ms, %zu expression(s)\n",
+            (stats_now() - parsed) * 1000.0, folded);
+    }
+    return file;
+}
+
+static IRModule* build_module(ASTNode* file, const Options* options) {
+    double start = stats_now();
+    IRModule* module = lower_program(file);
+    double lowered = stats_now();
+    if (module == NULL) {
+        return NULL;
+    }
+
+    size_t tailCalls = eliminate_tail_recursion(module);
+    double tailEnd = stats_now();
+    uint64_t steps = 0;
+    size_t evaluated = evaluate_pure_calls(module, options->constevalSteps,
+        &steps);
+    double evalEnd = stats_now();
+    CallGraph* graph = create_call_graph(module);
+    double graphEnd = stats_now();
+    if (graph != NULL && options->dumpCallGraph) {
+        print_call_graph(graph, module);
+    }
+    size_t inlined = graph == NULL ? 0 : inline_functions(module, graph,
+        options->inlineThreshold, options->jobs);
+    double inlineEnd = stats_now();
+    size_t switches = form_switches(module, options->switchMinCases);
+    double switchEnd = stats_now();
+    ValueNumberStats numbered = { 0 };
+    if (!options->noGvn) {
+        number_values(module, &numbered);
+    }
+    double gvnEnd = stats_now();
+    size_t narrowed = options->noRanges ? 0 : narrow_ranges(module);
+    double rangeEnd = stats_now();
+    DeadCodeStats dead = { 0 };
+    if (!options->noDce) {
+        eliminate_dead_code(module, &dead);
+    }
+    double dceEnd = stats_now();
+    if (tailCalls + evaluated + inlined + switches + numbered.insts +
+        narrowed +
+        dead.branches + dead.blocks + dead.insts + dead.funcs > 0 &&
+        !verify_ir_module(module)) {
+        free_call_graph(graph);
+        free_ir_module(module);
+        return NULL;
+    }
+    if (options->stats) {
+        fprintf(stderr, "Lower: %.3f ms\n", (lowered - start) * 1000.0);
+        fprintf(stderr, "Tail recursion: %.3f ms, %zu call(s)\n",
+            (tailEnd - lowered) * 1000.0, tailCalls);
+        fprintf(stderr, "Consteval: %.3f ms, %zu call(s), %llu step(s)\n",
+            (evalEnd - tailEnd) * 1000.0, evaluated,
+            (unsigned long long)steps);
+        if (graph != NULL) {
+            print_call_graph_stats(graph, graphEnd - evalEnd);
+        }
+        fprintf(stderr, "Inline: %.3f ms, %zu call(s)\n",
+            (inlineEnd - graphEnd) * 1000.0, inlined);
+        fprintf(stderr, "Switch: %.3f ms, %zu chain(s)\n",
+            (switchEnd - inlineEnd) * 1000.0, switches);
+        fprintf(stderr, "GVN: %.3f ms, %zu instruction(s), %zu call(s)\n",
+            (gvnEnd - switchEnd) * 1000.0, numbered.insts, numbered.calls);
+        fprintf(stderr, "Range: %.3f ms, %zu instruction(s)\n",
+            (rangeEnd - gvnEnd) * 1000.0, narrowed);
+        fprintf(stderr, "DCE: %.3f ms, %zu branch(es), %zu block(s), %zu"\
+            " instruction(s), %zu function(s)\n",
+            (dceEnd - rangeEnd) * 1000.0, dead.branches, dead.blocks,
+            dead.insts, dead.funcs);
+    }
+    free_call_graph(graph);
+    return module;
+}
+
+static void format_module_key(const Options* options, char* key,
+    size_t size) {
+    snprintf(key, size, "%u %llu %u %d %d %d", options->inlineThreshold,
+        (unsigned long long)options->constevalSteps, options->switchMinCases,
+        options->noGvn, options->noRanges, options->noDce);
+}
+
+static int handle_request(void* ctx, int argc, char* argv[]) {
+    Options options;
+    if (!parse_args(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.server) {
+        fprintf(stderr, "Error: '--server' cannot be requested from a"\
+            " server\n");
+        return EXIT_FAILURE;
+    }
+    if (options.shareNodes) {
+        fprintf(stderr, "Error: '-fshare-nodes' cannot be requested from a"\
+            " server\n");
+        return EXIT_FAILURE;
+    }
+    // Native code running in the server would take it down with any
+    // crash, and a watch or pipeline never goes through the cache
+    const char* unserved = options.jit ? "--jit" :
+        options.tiered ? "--tiered" : options.watch ? "--watch" :
+        options.pipeline ? "--pipeline" : NULL;
+    if (unserved != NULL) {
+        fprintf(stderr, "Error: '%s' cannot be requested from a server\n",
+            unserved);
+        return EXIT_FAILURE;
+    }
+    return compile_program(&options, ctx);
+}
+
+static int pipeline_program(const Options* options) {
+    FILE* input = fopen(options->path, "rb");
+    if (input == NULL) {
+        fprintf(stderr, "Error: Failed to open input file '%s'\n",
+            options->path);
+        return EXIT_FAILURE;
+    }
+    ElfObject* obj = create_elf_object();
+    if (obj == NULL) {
+        fclose(input);
+        return EXIT_FAILURE;
+    }
+
+    double start = stats_now();
+    PipelineOptions pipeline = { options->switchMinCases, !options->noGvn,
+        !options->noRanges, !options->noDce, !options->noRegalloc,
+        !options->noPeephole, options->lexerChunk };
+    PipelineStats stats;
+    bool ok = compile_pipelined(input, obj, &pipeline, &stats);
+    fclose(input);
+    double compiled = stats_now();
+
+    ok = ok && save_object(obj, options);
+    if (ok && options->stats) {
+        fprintf(stderr, "Pipeline: %.3f ms, %zu function(s), at most %zu"\
+            " instruction(s) held\n", (compiled - start) * 1000.0,
+            stats.funcs, stats.maxInsts);
+        fprintf(stderr, "Passes: %zu folded, %zu tail call(s), %zu"\
+            " chain(s), %zu numbered, %zu narrowed, %zu dead"\
+            " instruction(s)\n", stats.folded, stats.tailCalls,
+            stats.switches, stats.numbered.insts, stats.narrowed,
+            stats.dead.insts);
+        fprintf(stderr, "Codegen: %zu byte(s)\n", obj->textSize);
+    }
+
+    free_elf_object(obj);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int watch_program(const Options* options) {
+    SourceCache* cache = create_source_cache();
+    if (cache == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    double start = stats_now();
+    int exitCode = compile_program(options, cache);
+    fprintf(stderr, "Watch: built '%s' in %.3f ms, exit code %d\n",
+        options->path, (stats_now() - start) * 1000.0, exitCode);
+
+    // Only the one input file can change until files depend on others
+    WatchContext context = { options, cache };
+    exitCode = watch_files(&options->path, 1, WATCH_DEBOUNCE_MS,
+        handle_change, &context);
+    free_source_cache(cache);
+    return exitCode;
+}
+
+static void handle_change(void* ctx, const bool* changed) {
+    const WatchContext* context = ctx;
+    if (!changed[0]) {
+        return;
+    }
+
+    double start = stats_now();
+    int exitCode = compile_program(context->options, context->cache);
+    fprintf(stderr, "Watch: rebuilt '%s' in %.3f ms, exit code %d\n",
+        context->options->path, (stats_now() - start) * 1000.0, exitCode);
+}
+
+static bool parse_args(int argc, char* argv[], Options* options) {
+    memset(options, 0, sizeof(Options));
+    options->tierCalls = TIER_CALL_THRESHOLD;
+    options->tierLoops = TIER_LOOP_THRESHOLD;
+    options->inlineThreshold = INLINE_THRESHOLD;
+    options->constevalSteps = CONSTEVAL_STEPS;
+    options->switchMinCases = SWITCH_MIN_CASES;
+    options->jobs = pool_default_threads();
+    options->lexerChunk = LEXER_CHUNK_SIZE;
+
+    int i = 1;
+    if (i < argc && strcmp(argv[i], "run") == 0) {
+        options->run = true;
+        i++;
+    }
+
+    for (; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--dump-ast") == 0) {
+            options->dumpAst = true;
+        } else if (strcmp(arg, "--dump-ir") == 0) {
+            options->dumpIr = true;
+        } else if (strcmp(arg, "--dump-callgraph") == 0) {
+            options->dumpCallGraph = true;
+        } else if (strcmp(arg, "--dump-bc") == 0) {
+            options->dumpBc = true;
+        } else if (strcmp(arg, "--stats") == 0) {
+            options->stats = true;
+        } else if (strcmp(arg, "-c") == 0) {
+            options->compile = true;
+        } else if (strcmp(arg, "-o") == 0) {
+            if (i + 1 == argc) {
+                fprintf(stderr, "Error: Missing file name after '-o'\n");
+                return false;
+            }
+            options->output = argv[++i];
+        } else if (strcmp(arg, "--jit") == 0) {
+            options->jit = true;
+        } else if (strcmp(arg, "--tiered") == 0) {
+            options->tiered = true;
+        } else if (strcmp(arg, "--tier-calls") == 0) {
+            if (!parse_count(argc, argv, &i, &options->tierCalls)) {
+                return false;
+            }
+        } else if (strcmp(arg, "--tier-loops") == 0) {
+            if (!parse_count(argc, argv, &i, &options->tierLoops)) {
+                return false;
+            }
+        } else if (strcmp(arg, "--jobs") == 0) {
+            if (!parse_count(argc, argv, &i, &options->jobs)) {
+                return false;
+            }
+        } else if (strcmp(arg, "--server") == 0) {
+            options->server = true;
+        } else if (strcmp(arg, "--socket") == 0) {
+            if (i + 1 == argc) {
+                fprintf(stderr, "Error: Missing path after '--socket'\n");
+                return false;
+            }
+            options->socketPath = argv[++i];
+        } else if (strcmp(arg, "--watch") == 0) {
+            options->watch = true;
+        } else if (strcmp(arg, "--pipeline") == 0) {
+            options->pipeline = true;
+        } else if (strcmp(arg, "--no-regalloc") == 0) {
+            options->noRegalloc = true;
+        } else if (strncmp(arg, "-finline-threshold=", 19) == 0) {
+            uint64_t value;
+            if (!parse_limit(arg + 19, "inline threshold", UINT32_MAX,
+                &value)) {
+                return false;
+            }
+            options->inlineThreshold = (uint32_t)value;
+        } else if (strncmp(arg, "-fswitch-min-cases=", 19) == 0) {
+            uint64_t value;
+            if (!parse_limit(arg + 19, "switch case count", UINT32_MAX,
+                &value)) {
+                return false;
+            }
+            options->switchMinCases = (uint32_t)value;
+        } else if (strcmp(arg, "-fno-gvn") == 0) {
+            options->noGvn = true;
+        } else if (strcmp(arg, "-fno-ranges") == 0) {
+            options->noRanges = true;
+        } else if (strcmp(arg, "-fno-dce") == 0) {
+            options->noDce = true;
+        } else if (strcmp(arg, "-fno-peephole") == 0) {
+            options->noPeephole = true;
+        } else if (strcmp(arg, "-fshare-nodes") == 0) {
+            options->shareNodes = true;
+        } else if (strncmp(arg, "-flexer-chunk=", 14) == 0) {
+            uint64_t value;
+            if (!parse_limit(arg + 14, "lexer chunk size", UINT32_MAX,
+                &value)) {
+                return false;
+            }
+            options->lexerChunk = (size_t)value;
+        } else if (strncmp(arg, "-fconsteval-steps=", 18) == 0) {
+            if (!parse_limit(arg + 18, "consteval step count", UINT64_MAX,
+                &options->constevalSteps)) {
+                return false;
+            }
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "Error: Unknown option '%s'\n", arg);
+            return false;
+        } else if (options->path != NULL) {
+            fprintf(stderr, "Error: Only one input file is supported\n");
+            return false;
+        } else {
+            options->path = arg;
+        }
+    }
+
+    if ((options->jit || options->tiered) && !options->run) {
+        fprintf(stderr, "Error: '%s' only applies to 'run'\n",
+            options->jit ? "--jit" : "--tiered");
+        return false;
+    }
+    if (options->jit && options->tiered) {
+        fprintf(stderr, "Error: '--jit' and '--tiered' cannot be combined\n");
+        return false;
+    }
+    if (options->socketPath != NULL && !options->server) {
+        fprintf(stderr, "Error: '--socket' only applies to '--server'\n");
+        return false;
+    }
+    if (options->watch && options->server) {
+        fprintf(stderr, "Error: '--watch' and '--server' cannot be"\
+            " combined\n");
+        return false;
+    }
+    if (options->pipeline && (!options->compile || options->run ||
+        options->server || options->watch || options->dumpAst ||
+        options->dumpIr || options->dumpCallGraph || options->dumpBc)) {
+        fprintf(stderr, "Error: '--pipeline' only applies to '-c' without"\
+            " 'run', '--server', '--watch' or dumps\n");
+        return false;
+    }
+    if (options->pipeline && options->lexerChunk == 0) {
+        fprintf(stderr, "Error: '--pipeline' reads the file a chunk at a"\
+            " time\n");
+        return false;
+    }
+    // Reparsing moves the nodes it reuses, and a pipeline would keep the
+    // nodes of every function alive
+    if (options->shareNodes && (options->server || options->watch ||
+        options->pipeline)) {
+        fprintf(stderr, "Error: '-fshare-nodes' cannot be combined with"\
+            " '--server', '--watch' or '--pipeline'\n");
+        return false;
+    }
+    if (options->server && options->path != NULL) {
+        fprintf(stderr, "Error: A server takes its files from requests\n");
+        return false;
+    }
+    return options->server || options->path != NULL;
+}
+
+static bool parse_count(int argc, char* argv[], int* i, uint32_t* out) {
+    const char* option = argv[*i];
+    if (*i + 1 == argc) {
+        fprintf(stderr, "Error: Missing count after '%s'\n", option);
+        return false;
+    }
+
+    const char* text = argv[++*i];
+    char* end;
+    unsigned long value = strtoul(text, &end, 10);
+    if (text[0] < '0' || text[0] > '9' || *end != '\0' || value == 0 ||
+        value > UINT32_MAX) {
+        fprintf(stderr, "Error: Invalid count '%s' after '%s'\n", text,
+            option);
+        return false;
+    }
+    *out = (uint32_t)value;
+    return true;
+}
+
+static bool parse_limit(const char* text, const char* what, uint64_t max,
+    uint64_t* out) {
+    char* end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (text[0] < '0' || text[0] > '9' || *end != '\0' || errno != 0 ||
+        value > max) {
+        fprintf(stderr, "Error: Invalid %s '%s'\n", what, text);
+        return false;
+    }
+    *out = (uint64_t)value;
+    return true;
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr, "Usage: %s [run] [options] <input_file>\n", program);
+    fprintf(stderr, "  run         Run main after compiling, its result"\
+        " is the exit code\n");
+    fprintf(stderr, "  --jit       Run main as native code compiled in"\
+        " memory\n");
+    fprintf(stderr, "  --tiered    Interpret main and compile hot functions"\
+        " in the background\n");
+    fprintf(stderr, "  --tier-calls <n>  Calls before a function is compiled,"\
+        " %u by default\n", TIER_CALL_THRESHOLD);
+    fprintf(stderr, "  --tier-loops <n>  Backward jumps before a function is"\
+        " compiled, %u by default\n", TIER_LOOP_THRESHOLD);
+    fprintf(stderr, "  -c          Write an x86-64 ELF object file\n");
+    fprintf(stderr, "  -o <file>   Name the object file\n");
+    fprintf(stderr, "  --no-regalloc  Keep every value on the stack in"\
+        " the object file\n");
+    fprintf(stderr, "  --jobs <n>  Threads inlining and compiling native code,"\
+        " one per processor by default\n");
+    fprintf(stderr, "  -finline-threshold=<n>  Inline calls costing at most"\
+        " n, 0 disables, %u by default\n", INLINE_THRESHOLD);
+    fprintf(stderr, "  -fconsteval-steps=<n>  Instructions compile time"\
+        " evaluation may run, 0 disables, %u by default\n",
+        CONSTEVAL_STEPS);
+    fprintf(stderr, "  -fswitch-min-cases=<n>  Turn else-if chains of at"\
+        " least n cases into switches, 0 disables, %u by default\n",
+        SWITCH_MIN_CASES);
+    fprintf(stderr, "  -fno-gvn    Skip global value numbering\n");
+    fprintf(stderr, "  -fno-ranges  Skip value range analysis\n");
+    fprintf(stderr, "  -fno-dce    Keep dead code and unused functions\n");
+    fprintf(stderr, "  -fno-peephole  Skip peephole rewrites of native"\
+        " code\n");
+    fprintf(stderr, "  -fshare-nodes  Share one syntax tree node among equal"\
+        " literals, names and pure expressions\n");
+    fprintf(stderr, "  --dump-ast  Print the syntax tree\n");
+    fprintf(stderr, "  --dump-ir   Print the SSA IR\n");
+    fprintf(stderr, "  --dump-callgraph  Print the call graph levels and"\
+        " edges inlining is scheduled over\n");
+    fprintf(stderr, "  --dump-bc   Print the bytecode\n");
+    fprintf(stderr, "  --stats     Print phase timings and IR size\n");
+    fprintf(stderr, "  --server    Serve compile requests, one line of"\
+        " arguments each, on stdin\n");
+    fprintf(stderr, "  --socket <path>  Serve requests on a Unix domain"\
+        " socket instead of stdin\n");
+    fprintf(stderr, "  --watch     Compile again each time the input file"\
+        " changes\n");
+    fprintf(stderr, "  --pipeline  With -c, compile one function at a time"\
+        " to bound memory\n");
+}
+
+static int write_object(const IRModule* module, const Options* options) {
+    double start = stats_now();
+    ElfObject* obj = create_elf_object();
+    if (obj == NULL) {
+        return EXIT_FAILURE;
+    }
+    if (!x64_compile(module, obj, !options->noRegalloc,
+        !options->noPeephole, options->jobs)) {
+        free_elf_object(obj);
+        return EXIT_FAILURE;
+    }
+    double compiled = stats_now();
+
+    bool ok = save_object(obj, options);
+    if (ok && options->stats) {
+        fprintf(stderr, "Codegen: %zu byte(s), built in %.3f ms on %u"\
+            " thread(s)\n", obj->textSize, (compiled - start) * 1000.0,
+            options->jobs);
+    }
+
+    free_elf_object(obj);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool save_object(const ElfObject* obj, const Options* options) {
+    char* path = options->output == NULL ? object_path(options->path) :
+        NULL;
+    bool ok = options->output != NULL || path != NULL;
+    if (ok) {
+        ok = write_elf_object(obj, options->output != NULL ?
+            options->output : path, options->path);
+    }
+    free(path);
+    return ok;
+}
+
+static char* object_path(const char* path) {
+    // Like other compilers, the object goes to the current directory
+    const char* name = path;
+    for (const char* c = path; *c != '\0'; c++) {
+        if (*c == '/' || *c == '\\') {
+            name = c + 1;
+        }
+    }
+    const char* dot = strrchr(name, '.');
+    size_t len = dot != NULL && dot != name ? (size_t)(dot - name) :
+        strlen(name);
+
+    char* result = malloc(len + 3);
+    if (result == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return NULL;
+    }
+    memcpy(result, name, len);
+    memcpy(result + len, ".o", 3);
+    return result;
+}
+
+static int run_program(const IRModule* module, const Options* options) {
+    double start = stats_now();
+    BCModule* bytecode = bc_compile(module);
+    if (bytecode == NULL) {
+        return EXIT_FAILURE;
+    }
+    double compiled = stats_now();
+
+    if (options->dumpBc) {
+        print_bc_module(bytecode);
+    }
+    if (options->stats) {
+        size_t insts = 0;
+        for (uint32_t i = 0; i < bytecode->funcCount; i++) {
+            insts += bytecode->funcs[i].codeCount;
+        }
+        fprintf(stderr, "Bytecode: %zu instruction(s), built in %.3f ms\n",
+            insts, (compiled - start) * 1000.0);
+    }
+    if (!options->run) {
+        free_bc_module(bytecode);
+        return EXIT_SUCCESS;
+    }
+
+    uint32_t entry = find_main(module);
+    if (entry == IR_NONE) {
+        free_bc_module(bytecode);
+        return EXIT_FAILURE;
+    }
+
+    VMValue result = { 0 };
+    TierOptions tierOptions = {
+        options->tierCalls, options->tierLoops, !options->noRegalloc,
+        !options->noPeephole, options->stats,
+    };
+    start = stats_now();
+    bool ok = options->tiered ?
+        tier_run(module, bytecode, entry, &tierOptions, &result) :
+        vm_run(bytecode, entry, NULL, &result);
+    double elapsed = stats_now() - start;
+    free_bc_module(bytecode);
+
+    if (options->stats) {
+        fprintf(stderr, "Run: %.3f ms\n", elapsed * 1000.0);
+    }
+    return ok ? (int)result.i : EXIT_FAILURE;
+}
+
+static int jit_program(const IRModule* module, const Options* options,
+    double start) {
+    if (find_main(module) == IR_NONE) {
+        return EXIT_FAILURE;
+    }
+
+    double codegenStart = stats_now();
+    ElfObject* obj = create_elf_object();
+    if (obj == NULL) {
+        return EXIT_FAILURE;
+    }
+    if (!x64_compile(module, obj, !options->noRegalloc,
+        !options->noPeephole, options->jobs)) {
+        free_elf_object(obj);
+        return EXIT_FAILURE;
+    }
+    JitModule* jit = jit_load(obj, NULL, NULL);
+    uint32_t symbol = elf_symbol(obj, "main");
+    size_t codeSize = obj->textSize;
+    free_elf_object(obj);
+    if (jit == NULL || symbol == UINT32_MAX) {
+        free_jit_module(jit);
+        return EXIT_FAILURE;
+    }
+
+    double entered = stats_now();
+    int32_t result = jit_call_i32(jit, symbol);
+    double finished = stats_now();
+    free_jit_module(jit);
+
+    if (options->stats) {
+        fprintf(stderr, "JIT: %zu byte(s), built in %.3f ms\n", codeSize,
+            (entered - codegenStart) * 1000.0);
+        fprintf(stderr, "First instruction: %.3f ms after parsing began\n",
+            (entered - start) * 1000.0);
+        fprintf(stderr, "Run: %.3f ms, %.3f ms in total\n",
+            (finished - entered) * 1000.0, (finished - start) * 1000.0);
+    }
+    return (int)result;
+}
+
+static uint32_t find_main(const IRModule* module) {
+    uint32_t entry = IR_NONE;
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        if (strcmp(module->funcs[i]->name, "main") == 0) {
+            entry = i;
+            break;
+        }
+    }
+    if (entry == IR_NONE) {
+        fprintf(stderr, "Error: No 'main' function to run\n");
+        return IR_NONE;
+    }
+    if (module->funcs[entry]->paramCount != 0 ||
+        module->funcs[entry]->returnType != TOK_I32) {
+        fprintf(stderr, "Error: 'main' must take no parameters and return"\
+            " i32 to be run\n");
+        return IR_NONE;
+    }
+    return entry;
+}
+
+static void print_ir_stats(const IRModule* module) {
+    size_t insts = 0;
+    size_t bytes = 0;
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        const IRFunction* func = module->funcs[i];
+        insts += func->instCount;
+        bytes += func->instCount * sizeof(IRInst) +
+            func->operandCount * sizeof(uint32_t) +
+            func->blockCount * sizeof(IRBlock) +
+            func->constCount * sizeof(IRConst);
+    }
+    fprintf(stderr, "IR: %zu instruction(s), %.1f bytes/inst\n", insts,
+        insts > 0 ? (double)bytes / (double)insts : 0.0);
+}
+
+static void print_call_graph_stats(const CallGraph* graph, double seconds) {
+    size_t recursive = 0;
+    for (uint32_t scc = 0; scc < graph->sccCount; scc++) {
+        recursive += graph->recursive[scc];
+    }
+    // The widest level bounds how many components run at once
+    uint32_t widest = 0;
+    for (uint32_t level = 0; level < graph->levelCount; level++) {
+        uint32_t width = graph->levelStart[level + 1] -
+            graph->levelStart[level];
+        if (width > widest) {
+            widest = width;
+        }
+    }
+
+    fprintf(stderr, "Call graph: %.3f ms, %u function(s), %u call edge(s),"\
+        " %u component(s), %zu recursive, %u level(s), at most %u in a"\
+        " level\n", seconds * 1000.0, graph->funcCount,
+        graph->calleeStart[graph->funcCount], graph->sccCount, recursive,
+        graph->levelCount, widest);
 }
@@ -1,22 +1,135 @@
 #include "parser.h"
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+// Parsing a function or block only looks at its own tokens, so one whose
+// tokens an edit left alone parses to the same tree it did before.
+// Reparsing keeps the functions of the old tree and the blocks of those
+// the edit reached, and when the parser comes to one of them it moves it
+// over and skips its tokens. Nodes after the edit are moved to where
+// their tokens are now.
+
+/// A function or block of the tree being reparsed.
+typedef struct ReuseSlot {
+    /// The bytes the node covered in the source before the edit.
+    size_t offset;
+    size_t end;
+    /// Where the old tree holds the node, set to NULL once it is moved.
+    ASTNode** slot;
+} ReuseSlot;
+
+/// The nodes a reparse can reuse, in the order of their offsets.
+struct ReuseTable {
+    ReuseSlot* slots;
+    size_t count;
+    size_t cap;
+    TokenChange change;
+};
+
+/// Moves to the next token, freeing the current one. Returns false if
+/// the lexer fails.
+static bool advance_token(Parser* parser);
+/// Returns true if the current token has the given type.
+static bool check(const Parser* parser, TokenType type);
+/// Consumes the current token if it has the given type. Otherwise
+/// prints an error naming what was expected and returns false.
+static bool expect(Parser* parser, TokenType type, const char* what);
+/// Prints an error at the current token.
+static void error_at_current(const Parser* parser, const char* what);
+/// Appends a node to a growing array. Returns false on failure.
+static bool push_node(ASTNode*** nodes, size_t* count, size_t* cap,
+    ASTNode* node);
+/// Frees an array of nodes and the nodes in it.
+static void free_nodes(ASTNode** nodes, size_t count);
+/// Returns the next token of the parser's stream, repeating its TOK_EOF
+/// at the end.
+static Token* stream_token(Parser* parser);
+/// Frees a token the parser read from its lexer. Tokens read from a
+/// stream belong to the stream.
+static void release_token(const Parser* parser, Token* token);
+/// Gives a node the span from offset to the end of the last token
+/// parsed. Returns node.
+static ASTNode* finish_node(const Parser* parser, ASTNode* node,
+    size_t offset);
+/// Returns the node of the parser's node table equal to node, which is
+/// freed, or node itself when it has none or nodes are not shared.
+static ASTNode* share_node(Parser* parser, ASTNode* node);
+
+/// Adds the functions of an old file to table, and the blocks of those
+/// the change reached. Returns false on failure.
+static bool collect_reusable(struct ReuseTable* table, ASTNode* file);
+/// Adds the blocks in the statement held by slot to table. Returns false
+/// on failure.
+static bool collect_blocks(struct ReuseTable* table, ASTNode** slot);
+/// Adds a node to table. Returns false on failure.
+static bool push_slot(struct ReuseTable* table, ASTNode** slot);
+/// Looks for a node of the given type the reparse can reuse at the
+/// current token, moving it to node and skipping its tokens if found,
+/// or setting node to NULL. Returns false on failure.
+static bool reuse_node(Parser* parser, NodeType type, ASTNode** node);
+/// Refills the token window from the first token of the stream at or
+/// after offset. Returns false on failure.
+static bool seek_stream(Parser* parser, size_t offset);
+
+/// Creates a parser reading the tokens of lexer, taking ownership of
+/// it. Returns NULL on allocation failure, leaving lexer to the caller.
+static Parser* create_lexer_parser(Lexer* lexer);
+/// Parses the declarations up to the end of the file.
+static ASTNode* parse_file(Parser* parser);
+/// Parses fn <name>(<params>) [type] <block>.
+static ASTNode* parse_function(Parser* parser);
+/// Parses a brace delimited block of statements.
+static ASTNode* parse_block(Parser* parser);
+/// Steps over a brace delimited block by matching its braces. Returns
+/// false if the block does not end or holds an invalid token.
+static bool skip_block(Parser* parser);
+/// Parses a single statement.
+static ASTNode* parse_stmt(Parser* parser);
+/// Parses an if statement with its else-if chain.
+static ASTNode* parse_if(Parser* parser);
+/// Parses [mut] <type> <name> = <expr>;.
+static ASTNode* parse_var_decl(Parser* parser);
+/// Parses an expression statement, which may be an assignment.
+static ASTNode* parse_expr_stmt(Parser* parser);
+/// Parses a binary expression whose operators bind at least as tightly
+/// as minPrec.
+static ASTNode* parse_expr(Parser* parser, int minPrec);
+/// Parses prefix operators and casts.
+static ASTNode* parse_unary(Parser* parser);
+/// Parses a primary expression and any postfix operators.
+static ASTNode* parse_postfix(Parser* parser);
+/// Parses the arguments of a call to callee.
+static ASTNode* parse_call(Parser* parser, ASTNode* callee);
+/// Returns the precedence of a binary operator, 0 if it is not one.
+/// Higher binds tighter.
+static int binary_precedence(TokenType type);
+
 Parser* create_parser(char* src) {
-    Parser* parser = malloc(sizeof(Parser));
-    if (parser == NULL) {
-        fprintf(stderr, "Error: Failed to allocate memory for parser\n");
+    Lexer* lexer = create_lexer(src);
+    if (lexer == NULL) {
         return NULL;
     }
 
-    Lexer* lexer = create_lexer(src);
+    // The caller keeps src when creating the parser fails
+    Parser* parser = create_lexer_parser(lexer);
+    if (parser == NULL) {
+        lexer->src = NULL;
+        destroy_lexer(lexer);
+    }
+    return parser;
+}
+
+Parser* create_stream_parser(FILE* input, size_t chunkSize) {
+    Lexer* lexer = create_stream_lexer(input, chunkSize);
     if (lexer == NULL) {
-        free(parser);
         return NULL;
     }
 
-    parser->lexer = lexer;
-
+    Parser* parser = create_lexer_parser(lexer);
+    if (parser == NULL) {
+        destroy_lexer(lexer);
+    }
     return parser;
 }
 
@@ -29,6 +142,8 @@ void destroy_parser(Parser* parser) {
         destroy_lexer(parser->lexer);
     }
 
+    release_token(parser, parser->current);
+    release_token(parser, parser->next);
     free(parser);
 }
 
@@ -43,7 +158,973 @@ ASTNode* parse_program(Parser* parser) {
         return NULL;
     }
 
-    // Parse program here
+    // Fill the two token window
+    if (!advance_token(parser) || !advance_token(parser)) {
+        return NULL;
+    }
+
+    return parse_file(parser);
+}
+
+ASTNode* parse_signatures(Parser* parser) {
+    if (parser == NULL || parser->lexer == NULL) {
+        fprintf(stderr, "Error: Parser is uninitialized\n");
+        return NULL;
+    }
+
+    parser->skipBodies = true;
+    ASTNode* file = NULL;
+    if (advance_token(parser) && advance_token(parser)) {
+        file = parse_file(parser);
+    }
+    parser->skipBodies = false;
+    return file;
+}
+
+bool parse_next_function(Parser* parser, ASTNode** decl) {
+    *decl = NULL;
+    if (parser == NULL || parser->lexer == NULL) {
+        fprintf(stderr, "Error: Parser is uninitialized\n");
+        return false;
+    }
+
+    // Fill the two token window before the first function
+    if (parser->current == NULL &&
+        (!advance_token(parser) || !advance_token(parser))) {
+        return false;
+    }
+    if (check(parser, TOK_EOF)) {
+        return true;
+    }
+
+    *decl = parse_function(parser);
+    return *decl != NULL;
+}
+
+ASTNode* reparse_program(ASTNode* old, const TokenStream* stream,
+    const TokenChange* change) {
+    if (stream == NULL || stream->count == 0) {
+        fprintf(stderr, "Error: Reparse received no tokens\n");
+        free_ast_node(old);
+        return NULL;
+    }
+    if (old != NULL && old->type != NODE_FILE) {
+        fprintf(stderr, "Error: Reparse received a tree that is not a"\
+            " file\n");
+        free_ast_node(old);
+        return NULL;
+    }
+
+    struct ReuseTable table = { NULL, 0, 0, { 0, 0, 0 } };
+    Parser parser = { NULL, stream, 0, NULL, NULL, 0, NULL, false, NULL };
+    if (old != NULL && change != NULL) {
+        table.change = *change;
+        parser.reuse = &table;
+        if (!collect_reusable(&table, old)) {
+            free(table.slots);
+            free_ast_node(old);
+            return NULL;
+        }
+    }
+
+    ASTNode* file = NULL;
+    if (advance_token(&parser) && advance_token(&parser)) {
+        file = parse_file(&parser);
+    }
+
+    free(table.slots);
+    free_ast_node(old);
+    release_token(&parser, parser.current);
+    release_token(&parser, parser.next);
+    return file;
+}
+
+/* --- Helper Functions --- */
+
+static Parser* create_lexer_parser(Lexer* lexer) {
+    Parser* parser = malloc(sizeof(Parser));
+    if (parser == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for parser\n");
+        return NULL;
+    }
+
+    parser->lexer = lexer;
+    parser->stream = NULL;
+    parser->streamPos = 0;
+    parser->current = NULL;
+    parser->next = NULL;
+    parser->lastEnd = 0;
+    parser->reuse = NULL;
+    parser->skipBodies = false;
+    parser->nodes = NULL;
+
+    return parser;
+}
+
+static ASTNode* parse_file(Parser* parser) {
+    ASTNode** decls = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+    while (!check(parser, TOK_EOF)) {
+        ASTNode* decl = parse_function(parser);
+        if (decl == NULL || !push_node(&decls, &count, &cap, decl)) {
+            free_ast_node(decl);
+            free_nodes(decls, count);
+            return NULL;
+        }
+    }
+
+    ASTNode* file = create_file_node(decls, count);
+    if (file == NULL) {
+        free_nodes(decls, count);
+    }
+
+    return file;
+}
+
+static bool advance_token(Parser* parser) {
+    if (parser->current != NULL) {
+        parser->lastEnd = parser->current->offset + parser->current->length;
+    }
+    release_token(parser, parser->current);
+    parser->current = parser->next;
+
+    // Keep returning EOF once the end is reached
+    if (parser->lexer == NULL) {
+        parser->next = stream_token(parser);
+    } else if (parser->current != NULL &&
+        parser->current->type == TOK_EOF) {
+        parser->next = create_token(TOK_EOF, NULL, parser->current->line,
+            parser->current->column);
+    } else {
+        parser->next = get_next_token(parser->lexer);
+    }
+
+    return parser->next != NULL;
+}
 
-    return NULL;
+static bool check(const Parser* parser, TokenType type) {
+    return parser->current != NULL && parser->current->type == type;
+}
+
+static bool expect(Parser* parser, TokenType type, const char* what) {
+    if (!check(parser, type)) {
+        error_at_current(parser, what);
+        return false;
+    }
+
+    return advance_token(parser);
+}
+
+static void error_at_current(const Parser* parser, const char* what) {
+    const Token* token = parser->current;
+
+    // The lexer has already reported invalid tokens
+    if (token->type == TOK_INVALID) {
+        return;
+    }
+
+    fprintf(stderr, "Parser Error [%zu:%zu]: Expected %s, got %s\n",
+        token->line, token->column, what, token_as_str(token->type));
+}
+
+static bool push_node(ASTNode*** nodes, size_t* count, size_t* cap,
+    ASTNode* node) {
+    if (*count == *cap) {
+        size_t newCap = *cap == 0 ? 4 : *cap * 2;
+        ASTNode** grown = realloc(*nodes, newCap * sizeof(ASTNode*));
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return false;
+        }
+        *nodes = grown;
+        *cap = newCap;
+    }
+
+    (*nodes)[(*count)++] = node;
+    return true;
+}
+
+static void free_nodes(ASTNode** nodes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free_ast_node(nodes[i]);
+    }
+    free(nodes);
+}
+
+static Token* stream_token(Parser* parser) {
+    const TokenStream* stream = parser->stream;
+    if (parser->streamPos < stream->count) {
+        return stream->tokens[parser->streamPos++];
+    }
+    return stream->tokens[stream->count - 1];
+}
+
+static void release_token(const Parser* parser, Token* token) {
+    if (parser->lexer != NULL) {
+        free_token(token);
+    }
+}
+
+static ASTNode* finish_node(const Parser* parser, ASTNode* node,
+    size_t offset) {
+    if (node != NULL) {
+        node->offset = offset;
+        node->length = parser->lastEnd - offset;
+    }
+    return node;
+}
+
+static ASTNode* share_node(Parser* parser, ASTNode* node) {
+    if (parser->nodes == NULL) {
+        return node;
+    }
+    return intern_ast_node(parser->nodes, node);
+}
+
+static bool collect_reusable(struct ReuseTable* table, ASTNode* file) {
+    const TokenChange* change = &table->change;
+    for (size_t i = 0; i < file->data.file.stmtCount; i++) {
+        ASTNode** slot = &file->data.file.stmts[i];
+        if (*slot == NULL) {
+            continue;
+        }
+        if (!push_slot(table, slot)) {
+            return false;
+        }
+
+        // Blocks are only looked for in the functions parsed again
+        const ASTNode* decl = *slot;
+        if (decl->offset + decl->length > change->start &&
+            decl->offset < change->oldEnd && decl->length > 0 &&
+            decl->type == NODE_FUNCTION_DECL &&
+            !collect_blocks(table, &(*slot)->data.functionDecl.body)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool collect_blocks(struct ReuseTable* table, ASTNode** slot) {
+    ASTNode* node = *slot;
+    if (node == NULL) {
+        return true;
+    }
+
+    switch (node->type) {
+        case NODE_BLOCK_STMT:
+            if (!push_slot(table, slot)) {
+                return false;
+            }
+            for (size_t i = 0; i < node->data.blockStmt.stmtCount; i++) {
+                if (!collect_blocks(table, &node->data.blockStmt.stmts[i])) {
+                    return false;
+                }
+            }
+            return true;
+        case NODE_IF_STMT:
+            return collect_blocks(table, &node->data.ifStmt.thenBranch) &&
+                collect_blocks(table, &node->data.ifStmt.elseBranch);
+        default:
+            return true;
+    }
+}
+
+static bool push_slot(struct ReuseTable* table, ASTNode** slot) {
+    // Nodes without a span were not made by the parser
+    if ((*slot)->length == 0) {
+        return true;
+    }
+
+    if (table->count == table->cap) {
+        size_t newCap = table->cap == 0 ? 64 : table->cap * 2;
+        ReuseSlot* grown = realloc(table->slots,
+            newCap * sizeof(ReuseSlot));
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return false;
+        }
+        table->slots = grown;
+        table->cap = newCap;
+    }
+
+    ReuseSlot* entry = &table->slots[table->count++];
+    entry->offset = (*slot)->offset;
+    entry->end = (*slot)->offset + (*slot)->length;
+    entry->slot = slot;
+    return true;
+}
+
+static bool reuse_node(Parser* parser, NodeType type, ASTNode** node) {
+    *node = NULL;
+    const struct ReuseTable* table = parser->reuse;
+    if (table == NULL) {
+        return true;
+    }
+
+    // Where the current token was before the edit, if the edit left it
+    const Token* token = parser->current;
+    const TokenChange* change = &table->change;
+    size_t offset;
+    if (token->offset < change->start) {
+        offset = token->offset;
+    } else if (token->offset >= change->newEnd) {
+        offset = token->offset - change->newEnd + change->oldEnd;
+    } else {
+        return true;
+    }
+
+    size_t low = 0;
+    size_t high = table->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (table->slots[mid].offset < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == table->count || table->slots[low].offset != offset) {
+        return true;
+    }
+    const ReuseSlot* entry = &table->slots[low];
+    ASTNode* found = *entry->slot;
+    if (found == NULL || found->type != type ||
+        (offset < change->start && entry->end > change->start)) {
+        return true;
+    }
+
+    size_t end = entry->end;
+    if (offset >= change->oldEnd) {
+        move_ast_node(found, token->offset, token->line, token->column);
+        end = entry->end - change->oldEnd + change->newEnd;
+    }
+    *entry->slot = NULL;
+    if (!seek_stream(parser, end)) {
+        free_ast_node(found);
+        return false;
+    }
+    *node = found;
+    return true;
+}
+
+static bool seek_stream(Parser* parser, size_t offset) {
+    // The token is usually a few ahead of the current one, so gallop
+    // towards it before searching
+    const TokenStream* stream = parser->stream;
+    size_t low = parser->streamPos >= 2 ? parser->streamPos - 2 : 0;
+    size_t high = stream->count - 1;
+    size_t step = 1;
+    while (low + step < high && stream->tokens[low + step]->offset < offset) {
+        low += step;
+        step *= 2;
+    }
+    if (low + step < high) {
+        high = low + step;
+    }
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (stream->tokens[mid]->offset < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    parser->current = NULL;
+    parser->next = NULL;
+    parser->streamPos = low;
+    if (!advance_token(parser) || !advance_token(parser)) {
+        return false;
+    }
+    parser->lastEnd = offset;
+    return true;
+}
+
+static ASTNode* parse_function(Parser* parser) {
+    ASTNode* reused;
+    if (!reuse_node(parser, NODE_FUNCTION_DECL, &reused)) {
+        return NULL;
+    }
+    if (reused != NULL) {
+        return reused;
+    }
+
+    size_t line = parser->current->line;
+    size_t column = parser->current->column;
+    size_t offset = parser->current->offset;
+    if (!expect(parser, TOK_FN, "function declaration")) {
+        return NULL;
+    }
+
+    if (!check(parser, TOK_IDENT)) {
+        error_at_current(parser, "function name");
+        return NULL;
+    }
+    Token* name = parser->current;
+    parser->current = NULL;
+    if (!advance_token(parser) || !expect(parser, TOK_LPAREN, "'('")) {
+        release_token(parser, name);
+        return NULL;
+    }
+
+    ASTNode** params = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+    bool ok = true;
+    while (!check(parser, TOK_RPAREN)) {
+        ok = false;
+        if (count > 0 && !expect(parser, TOK_COMMA, "',' or ')'")) {
+            break;
+        }
+
+        if (!token_is_type(parser->current->type)) {
+            error_at_current(parser, "parameter type");
+            break;
+        }
+        TokenType type = parser->current->type;
+        size_t paramOffset = parser->current->offset;
+        if (!advance_token(parser)) {
+            break;
+        }
+        if (!check(parser, TOK_IDENT)) {
+            error_at_current(parser, "parameter name");
+            break;
+        }
+
+        ASTNode* param = create_parameter_decl_node(parser->current->line,
+            parser->current->column, parser->current->ident, type);
+        if (param == NULL || !push_node(&params, &count, &cap, param)) {
+            free_ast_node(param);
+            break;
+        }
+        if (!advance_token(parser)) {
+            break;
+        }
+        finish_node(parser, param, paramOffset);
+        ok = true;
+    }
+    if (!ok || !advance_token(parser)) {
+        free_nodes(params, count);
+        release_token(parser, name);
+        return NULL;
+    }
+
+    // The return type is optional, void functions omit it
+    TokenType returnType = TOK_INVALID;
+    if (token_is_type(parser->current->type)) {
+        returnType = parser->current->type;
+        if (!advance_token(parser)) {
+            free_nodes(params, count);
+            release_token(parser, name);
+            return NULL;
+        }
+    }
+
+    // A signature pass steps over the body without building it
+    ASTNode* body = parser->skipBodies ? NULL : parse_block(parser);
+    if (parser->skipBodies ? !skip_block(parser) : body == NULL) {
+        free_nodes(params, count);
+        release_token(parser, name);
+        return NULL;
+    }
+
+    ASTNode* func = create_function_decl_node(line, column, name->ident,
+        params, count, returnType, body);
+    if (func == NULL) {
+        free_nodes(params, count);
+        free_ast_node(body);
+    }
+
+    release_token(parser, name);
+    return finish_node(parser, func, offset);
+}
+
+static bool skip_block(Parser* parser) {
+    if (!expect(parser, TOK_LBRACE, "'{'")) {
+        return false;
+    }
+
+    size_t depth = 1;
+    while (depth > 0) {
+        if (check(parser, TOK_EOF)) {
+            error_at_current(parser, "'}'");
+            return false;
+        }
+
+        // The lexer has already reported invalid tokens
+        if (check(parser, TOK_INVALID)) {
+            return false;
+        }
+
+        if (check(parser, TOK_LBRACE)) {
+            depth++;
+        } else if (check(parser, TOK_RBRACE)) {
+            depth--;
+        }
+        if (!advance_token(parser)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static ASTNode* parse_block(Parser* parser) {
+    ASTNode* reused;
+    if (!reuse_node(parser, NODE_BLOCK_STMT, &reused)) {
+        return NULL;
+    }
+    if (reused != NULL) {
+        return reused;
+    }
+
+    size_t line = parser->current->line;
+    size_t column = parser->current->column;
+    size_t offset = parser->current->offset;
+    if (!expect(parser, TOK_LBRACE, "'{'")) {
+        return NULL;
+    }
+
+    ASTNode** stmts = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+    while (!check(parser, TOK_RBRACE)) {
+        if (check(parser, TOK_EOF)) {
+            error_at_current(parser, "'}'");
+            free_nodes(stmts, count);
+            return NULL;
+        }
+
+        ASTNode* stmt = parse_stmt(parser);
+        if (stmt == NULL || !push_node(&stmts, &count, &cap, stmt)) {
+            free_ast_node(stmt);
+            free_nodes(stmts, count);
+            return NULL;
+        }
+    }
+
+    if (!advance_token(parser)) {
+        free_nodes(stmts, count);
+        return NULL;
+    }
+
+    ASTNode* block = create_block_stmt_node(line, column, stmts, count);
+    if (block == NULL) {
+        free_nodes(stmts, count);
+    }
+
+    return finish_node(parser, block, offset);
+}
+
+static ASTNode* parse_stmt(Parser* parser) {
+    TokenType type = parser->current->type;
+
+    if (type == TOK_LBRACE) {
+        return parse_block(parser);
+    }
+    if (type == TOK_IF) {
+        return parse_if(parser);
+    }
+    if (type == TOK_MUT || token_is_type(type)) {
+        return parse_var_decl(parser);
+    }
+
+    if (type == TOK_RETURN) {
+        size_t line = parser->current->line;
+        size_t column = parser->current->column;
+        size_t offset = parser->current->offset;
+        if (!advance_token(parser)) {
+            return NULL;
+        }
+
+        ASTNode* expr = NULL;
+        if (!check(parser, TOK_SEMICOLON)) {
+            expr = parse_expr(parser, 1);
+            if (expr == NULL) {
+                return NULL;
+            }
+        }
+        if (!expect(parser, TOK_SEMICOLON, "';'")) {
+            free_ast_node(expr);
+            return NULL;
+        }
+
+        ASTNode* stmt = create_return_stmt_node(line, column, expr);
+        if (stmt == NULL) {
+            free_ast_node(expr);
+        }
+        return finish_node(parser, stmt, offset);
+    }
+
+    return parse_expr_stmt(parser);
+}
+
+static ASTNode* parse_if(Parser* parser) {
+    size_t line = parser->current->line;
+    size_t column = parser->current->column;
+    size_t offset = parser->current->offset;
+    if (!advance_token(parser) || !expect(parser, TOK_LPAREN, "'('")) {
+        return NULL;
+    }
+
+    ASTNode* condition = parse_expr(parser, 1);
+    if (condition == NULL) {
+        return NULL;
+    }
+    if (!expect(parser, TOK_RPAREN, "')'")) {
+        free_ast_node(condition);
+        return NULL;
+    }
+
+    ASTNode* thenBranch = parse_block(parser);
+    if (thenBranch == NULL) {
+        free_ast_node(condition);
+        return NULL;
+    }
+
+    // An else if is an if statement in the else branch
+    ASTNode* elseBranch = NULL;
+    if (check(parser, TOK_ELSE)) {
+        if (!advance_token(parser)) {
+            free_ast_node(condition);
+            free_ast_node(thenBranch);
+            return NULL;
+        }
+        elseBranch = check(parser, TOK_IF) ? parse_if(parser) :
+            parse_block(parser);
+        if (elseBranch == NULL) {
+            free_ast_node(condition);
+            free_ast_node(thenBranch);
+            return NULL;
+        }
+    }
+
+    ASTNode* stmt = create_if_stmt_node(line, column, condition, thenBranch,
+        elseBranch);
+    if (stmt == NULL) {
+        free_ast_node(condition);
+        free_ast_node(thenBranch);
+        free_ast_node(elseBranch);
+    }
+
+    return finish_node(parser, stmt, offset);
+}
+
+static ASTNode* parse_var_decl(Parser* parser) {
+    size_t line = parser->current->line;
+    size_t column = parser->current->column;
+    size_t offset = parser->current->offset;
+
+    bool mutable = check(parser, TOK_MUT);
+    if (mutable && !advance_token(parser)) {
+        return NULL;
+    }
+
+    if (!token_is_type(parser->current->type)) {
+        error_at_current(parser, "variable type");
+        return NULL;
+    }
+    TokenType type = parser->current->type;
+    if (!advance_token(parser)) {
+        return NULL;
+    }
+
+    if (!check(parser, TOK_IDENT)) {
+        error_at_current(parser, "variable name");
+        return NULL;
+    }
+    Token* name = parser->current;
+    parser->current = NULL;
+    if (!advance_token(parser) || !expect(parser, TOK_ASSIGN, "'='")) {
+        release_token(parser, name);
+        return NULL;
+    }
+
+    ASTNode* initializer = parse_expr(parser, 1);
+    if (initializer == NULL || !expect(parser, TOK_SEMICOLON, "';'")) {
+        free_ast_node(initializer);
+        release_token(parser, name);
+        return NULL;
+    }
+
+    ASTNode* decl = create_variable_decl_node(line, column, name->ident,
+        type, mutable, initializer);
+    if (decl == NULL) {
+        free_ast_node(initializer);
+    }
+
+    release_token(parser, name);
+    return finish_node(parser, decl, offset);
+}
+
+static ASTNode* parse_expr_stmt(Parser* parser) {
+    size_t line = parser->current->line;
+    size_t column = parser->current->column;
+    size_t offset = parser->current->offset;
+
+    ASTNode* expr = parse_expr(parser, 1);
+    if (expr == NULL) {
+        return NULL;
+    }
+
+    // Assignments are statements, so they are only accepted here
+    if (token_is_assign_op(parser->current->type)) {
+        TokenType op = parser->current->type;
+        size_t opLine = parser->current->line;
+        size_t opColumn = parser->current->column;
+        if (!advance_token(parser)) {
+            free_ast_node(expr);
+            return NULL;
+        }
+
+        ASTNode* value = parse_expr(parser, 1);
+        if (value == NULL) {
+            free_ast_node(expr);
+            return NULL;
+        }
+
+        ASTNode* assign = create_assign_expr_node(opLine, opColumn, expr, op,
+            value);
+        if (assign == NULL) {
+            free_ast_node(expr);
+            free_ast_node(value);
+            return NULL;
+        }
+        expr = finish_node(parser, assign, offset);
+    }
+
+    if (!expect(parser, TOK_SEMICOLON, "';'")) {
+        free_ast_node(expr);
+        return NULL;
+    }
+
+    ASTNode* stmt = create_expr_stmt_node(line, column, expr);
+    if (stmt == NULL) {
+        free_ast_node(expr);
+    }
+
+    return finish_node(parser, stmt, offset);
+}
+
+static ASTNode* parse_expr(Parser* parser, int minPrec) {
+    // Taken from the token, as a shared operand may start elsewhere
+    size_t offset = parser->current->offset;
+    ASTNode* left = parse_unary(parser);
+
+    while (left != NULL) {
+        TokenType op = parser->current->type;
+        int prec = binary_precedence(op);
+        if (prec == 0 || prec < minPrec) {
+            break;
+        }
+
+        size_t line = parser->current->line;
+        size_t column = parser->current->column;
+        if (!advance_token(parser)) {
+            free_ast_node(left);
+            return NULL;
+        }
+
+        // All binary operators are left associative
+        ASTNode* right = parse_expr(parser, prec + 1);
+        if (right == NULL) {
+            free_ast_node(left);
+            return NULL;
+        }
+
+        ASTNode* binary = create_binary_expr_node(line, column, op, left,
+            right);
+        if (binary == NULL) {
+            free_ast_node(left);
+            free_ast_node(right);
+            return NULL;
+        }
+        left = share_node(parser, finish_node(parser, binary, offset));
+    }
+
+    return left;
+}
+
+static ASTNode* parse_unary(Parser* parser) {
+    Token* token = parser->current;
+    size_t line = token->line;
+    size_t column = token->column;
+    size_t offset = token->offset;
+
+    if (token->type == TOK_SUB || token->type == TOK_NOT ||
+        token->type == TOK_INCREMENT || token->type == TOK_DECREMENT) {
+        TokenType op = token->type;
+        if (!advance_token(parser)) {
+            return NULL;
+        }
+
+        ASTNode* operand = parse_unary(parser);
+        if (operand == NULL) {
+            return NULL;
+        }
+
+        ASTNode* unary = create_unary_expr_node(line, column, op, operand,
+            false);
+        if (unary == NULL) {
+            free_ast_node(operand);
+        }
+        return share_node(parser, finish_node(parser, unary, offset));
+    }
+
+    // A type after an opening parenthesis makes it a cast
+    if (token->type == TOK_LPAREN && parser->next != NULL &&
+        token_is_type(parser->next->type)) {
+        if (!advance_token(parser)) {
+            return NULL;
+        }
+        TokenType type = parser->current->type;
+        if (!advance_token(parser) || !expect(parser, TOK_RPAREN, "')'")) {
+            return NULL;
+        }
+
+        ASTNode* operand = parse_unary(parser);
+        if (operand == NULL) {
+            return NULL;
+        }
+
+        ASTNode* cast = create_cast_expr_node(line, column, type, operand);
+        if (cast == NULL) {
+            free_ast_node(operand);
+        }
+        return share_node(parser, finish_node(parser, cast, offset));
+    }
+
+    return parse_postfix(parser);
+}
+
+static ASTNode* parse_postfix(Parser* parser) {
+    Token* token = parser->current;
+    size_t line = token->line;
+    size_t column = token->column;
+    size_t offset = token->offset;
+    ASTNode* expr = NULL;
+
+    if (token_is_literal(token->type)) {
+        expr = create_literal_node(line, column, token->type,
+            token->ident != NULL ? token->ident : "");
+        if (expr == NULL || !advance_token(parser)) {
+            free_ast_node(expr);
+            return NULL;
+        }
+        expr = share_node(parser, finish_node(parser, expr, offset));
+    } else if (token->type == TOK_IDENT) {
+        expr = create_ident_node(line, column, token->ident);
+        if (expr == NULL || !advance_token(parser)) {
+            free_ast_node(expr);
+            return NULL;
+        }
+        finish_node(parser, expr, offset);
+        // A callee keeps its own node, its position being the call's
+        if (check(parser, TOK_LPAREN)) {
+            expr = parse_call(parser, expr);
+        } else {
+            expr = share_node(parser, expr);
+        }
+    } else if (token->type == TOK_LPAREN) {
+        if (!advance_token(parser)) {
+            return NULL;
+        }
+        expr = parse_expr(parser, 1);
+        if (expr == NULL) {
+            return NULL;
+        }
+        if (!expect(parser, TOK_RPAREN, "')'")) {
+            free_ast_node(expr);
+            return NULL;
+        }
+    } else {
+        error_at_current(parser, "expression");
+        return NULL;
+    }
+
+    while (expr != NULL && (check(parser, TOK_INCREMENT) ||
+        check(parser, TOK_DECREMENT))) {
+        TokenType op = parser->current->type;
+        if (!advance_token(parser)) {
+            free_ast_node(expr);
+            return NULL;
+        }
+
+        ASTNode* unary = create_unary_expr_node(line, column, op, expr,
+            true);
+        if (unary == NULL) {
+            free_ast_node(expr);
+        }
+        expr = finish_node(parser, unary, offset);
+    }
+
+    return expr;
+}
+
+static ASTNode* parse_call(Parser* parser, ASTNode* callee) {
+    if (!advance_token(parser)) {
+        free_ast_node(callee);
+        return NULL;
+    }
+
+    ASTNode** args = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+    bool ok = true;
+    while (ok && !check(parser, TOK_RPAREN)) {
+        if (count > 0 && !expect(parser, TOK_COMMA, "',' or ')'")) {
+            ok = false;
+            break;
+        }
+
+        ASTNode* arg = parse_expr(parser, 1);
+        if (arg == NULL || !push_node(&args, &count, &cap, arg)) {
+            free_ast_node(arg);
+            ok = false;
+        }
+    }
+
+    if (!ok || !advance_token(parser)) {
+        free_nodes(args, count);
+        free_ast_node(callee);
+        return NULL;
+    }
+
+    size_t offset = callee->offset;
+    ASTNode* call = create_call_expr_node(callee->line, callee->column,
+        callee, args, count);
+    if (call == NULL) {
+        free_nodes(args, count);
+        free_ast_node(callee);
+    }
+
+    return finish_node(parser, call, offset);
+}
+
+static int binary_precedence(TokenType type) {
+    switch (type) {
+        case TOK_OR:
+            return 1;
+        case TOK_AND:
+            return 2;
+        case TOK_EQ:
+        case TOK_NEQ:
+            return 3;
+        case TOK_LT:
+        case TOK_LTE:
+        case TOK_GT:
+        case TOK_GTE:
+            return 4;
+        case TOK_ADD:
+        case TOK_SUB:
+            return 5;
+        case TOK_MUL:
+        case TOK_DIV:
+        case TOK_MOD:
+            return 6;
+        default:
+            return 0;
+    }
 }
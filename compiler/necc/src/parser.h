@@ -2,11 +2,35 @@
 #define PARSER_H
 
 #include "lexer.h"
+#include "relex.h"
 #include "ast.h"
+#include "intern.h"
 
 typedef struct Parser {
     /// The lexer used by the parser.
     Lexer* lexer;
+    /// The token stream read instead of the lexer when lexer is NULL,
+    /// and the position in it of the token after next.
+    const TokenStream* stream;
+    size_t streamPos;
+    /// The token being parsed, NULL before parsing starts.
+    Token* current;
+    /// The token after current, used to tell casts from parenthesized
+    /// expressions.
+    Token* next;
+    /// The offset just past the last token parsed, where a node being
+    /// finished ends.
+    size_t lastEnd;
+    /// The functions and blocks of the tree being reparsed that can be
+    /// reused, NULL when parsing from scratch.
+    struct ReuseTable* reuse;
+    /// Whether function bodies are stepped over instead of parsed, while
+    /// gathering signatures.
+    bool skipBodies;
+    /// The table literals, names and pure expressions are interned in as
+    /// they are parsed, so equal ones share a node, or NULL to give each
+    /// its own. Set by the caller, who keeps ownership.
+    NodeTable* nodes;
 } Parser;
 
 /// Creates a parser from the given source code. Takes ownership of the
@@ -14,12 +38,39 @@ typedef struct Parser {
 /// newly created parser, or NULL if src is not valid or memory
 /// allocation fails.
 Parser* create_parser(char* src);
+/// Creates a parser reading its source from input in chunks of
+/// chunkSize bytes, as create_stream_lexer does. The input stays owned
+/// by the caller. Returns NULL if input is NULL, chunkSize is 0 or
+/// memory allocation fails.
+Parser* create_stream_parser(FILE* input, size_t chunkSize);
 /// Frees the memory allocated for the parser, including the owned
 /// lexer and its source string. Safely handles NULL.
 void destroy_parser(Parser* parser);
 
 /// Parses the source code owned by the parser. Returns a pointer to the
-/// root node of the abstract syntax tree, or NULL if parsing fails.
+/// root node of the abstract syntax tree, or NULL if parsing fails. The
+/// first syntax error found is printed.
 ASTNode* parse_program(Parser* parser);
+/// Parses only the signatures of the functions in the source owned by
+/// the parser, matching the braces of their bodies to step over them.
+/// Returns a file node of function declarations without bodies, which
+/// is what later code needs to call them, or NULL if parsing fails.
+ASTNode* parse_signatures(Parser* parser);
+/// Parses the next function of the source owned by the parser into
+/// decl, so a file can be compiled one function at a time without
+/// holding its whole tree. decl is set to NULL once the end of the file
+/// is reached. Returns false if parsing fails.
+bool parse_next_function(Parser* parser, ASTNode** decl);
+/// Parses the tokens of stream again after an edit, given old, the tree
+/// parsed before the edit by parse_program or an earlier reparse, and
+/// change, the bytes the edit lexed again. Functions and blocks lying
+/// wholly before or after the change are moved from old into the new
+/// tree instead of being parsed again, so an edit inside one function
+/// only parses that function. Takes ownership of old, freeing what is
+/// not reused even if parsing fails. A NULL old or change parses the
+/// whole stream. Returns the root of the new tree, or NULL if parsing
+/// fails. The first syntax error found is printed.
+ASTNode* reparse_program(ASTNode* old, const TokenStream* stream,
+    const TokenChange* change);
 
 #endif // PARSER_H
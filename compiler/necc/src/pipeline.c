@@ -0,0 +1,166 @@
+#include "pipeline.h"
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+#include "fold.h"
+#include "ir.h"
+#include "lower.h"
+#include "parser.h"
+#include "range.h"
+#include "scope.h"
+#include "switch.h"
+#include "tailrec.h"
+#include "x64.h"
+
+// The signatures read by the first pass are declarations without
+// bodies, so the same function table types and numbers calls as when
+// the whole tree is held. The module holds a bodiless IRFunction for
+// each of them, which is all verification and code generation look at
+// in a callee. The function being compiled is swapped in for its stub
+// and out again once emitted. Inlining, compile time evaluation and
+// removing functions main never calls need every body at once and are
+// left out.
+
+/// Creates a module with a function without instructions for each
+/// signature of funcs. Returns NULL on failure.
+static IRModule* create_stub_module(const FuncTable* funcs);
+/// Folds, lowers, optimizes and emits decl, function index of module.
+/// Returns false on failure.
+static bool compile_function(ASTNode* decl, FuncTable* funcs,
+    IRModule* module, uint32_t index, ElfObject* obj,
+    const PipelineOptions* options, PipelineStats* stats);
+
+bool compile_pipelined(FILE* input, ElfObject* obj,
+    const PipelineOptions* options, PipelineStats* stats) {
+    memset(stats, 0, sizeof(PipelineStats));
+    if (fseek(input, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "Error: Compiling one function at a time needs an"\
+            " input that can be read twice\n");
+        return false;
+    }
+
+    Parser* parser = create_stream_parser(input, options->lexerChunk);
+    if (parser == NULL) {
+        return false;
+    }
+    ASTNode* sigs = parse_signatures(parser);
+    destroy_parser(parser);
+    if (sigs == NULL) {
+        return false;
+    }
+
+    FuncTable* funcs = create_func_table(sigs);
+    IRModule* module = funcs != NULL ? create_stub_module(funcs) : NULL;
+    parser = NULL;
+    if (module != NULL && fseek(input, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "Error: Failed to read the input again\n");
+    } else if (module != NULL) {
+        parser = create_stream_parser(input, options->lexerChunk);
+    }
+
+    bool ok = parser != NULL;
+    for (size_t i = 0; ok; i++) {
+        ASTNode* decl;
+        ok = parse_next_function(parser, &decl);
+        if (!ok || decl == NULL) {
+            break;
+        }
+
+        // The table keeps the first function of each name, later ones
+        // are reported as when the whole file is compiled
+        size_t index = func_table_index(funcs, decl->data.functionDecl.name);
+        if (i >= sigs->data.file.stmtCount || index == SIZE_MAX) {
+            fprintf(stderr, "Error: The input changed while it was being"\
+                " compiled\n");
+            ok = false;
+        } else if (funcs->funcs[index] == sigs->data.file.stmts[i]) {
+            ok = compile_function(decl, funcs, module, (uint32_t)index, obj,
+                options, stats);
+        } else {
+            fprintf(stderr, "Semantic Error [%zu:%zu]: Function '%s' is"\
+                " already defined\n", decl->line, decl->column,
+                decl->data.functionDecl.name);
+            ok = false;
+        }
+        free_ast_node(decl);
+    }
+
+    destroy_parser(parser);
+    free_ir_module(module);
+    destroy_func_table(funcs);
+    free_ast_node(sigs);
+    return ok;
+}
+
+/* --- Helper Functions --- */
+
+static IRModule* create_stub_module(const FuncTable* funcs) {
+    IRModule* module = create_ir_module();
+    if (module == NULL) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < funcs->count; i++) {
+        const FunctionDecl* decl = &funcs->funcs[i]->data.functionDecl;
+        TokenType* paramTypes = malloc((decl->paramCount + 1) *
+            sizeof(TokenType));
+        if (paramTypes == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            free_ir_module(module);
+            return NULL;
+        }
+        for (size_t j = 0; j < decl->paramCount; j++) {
+            paramTypes[j] = decl->params[j]->data.parameterDecl.type;
+        }
+
+        IRFunction* stub = create_ir_function(decl->name, decl->returnType,
+            paramTypes, (uint32_t)decl->paramCount);
+        free(paramTypes);
+        if (stub == NULL || !ir_module_add(module, stub)) {
+            free_ir_function(stub);
+            free_ir_module(module);
+            return NULL;
+        }
+    }
+
+    return module;
+}
+
+static bool compile_function(ASTNode* decl, FuncTable* funcs,
+    IRModule* module, uint32_t index, ElfObject* obj,
+    const PipelineOptions* options, PipelineStats* stats) {
+    stats->folded += fold_function_constants(decl, funcs);
+    IRFunction* func = lower_function_decl(decl, funcs);
+    if (func == NULL) {
+        return false;
+    }
+    if (func->instCount > stats->maxInsts) {
+        stats->maxInsts = func->instCount;
+    }
+
+    // Tail recursion replaces the function in the module
+    IRFunction* stub = module->funcs[index];
+    module->funcs[index] = func;
+    stats->tailCalls += eliminate_function_tail_recursion(module, index);
+    func = module->funcs[index];
+    stats->switches += form_function_switches(func,
+        options->switchMinCases);
+    if (options->gvn) {
+        // Callees have no bodies yet, so no call is known to be pure
+        number_function_values(func, NULL, &stats->numbered);
+    }
+    if (options->ranges) {
+        stats->narrowed += narrow_function_ranges(func);
+    }
+    if (options->dce) {
+        eliminate_function_dead_code(func, &stats->dead);
+    }
+
+    bool ok = verify_ir_function(func, module) &&
+        x64_compile_function(module, index, obj, options->allocateRegs,
+            options->peephole);
+    module->funcs[index] = stub;
+    free_ir_function(func);
+    stats->funcs++;
+    return ok;
+}
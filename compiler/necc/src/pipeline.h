@@ -0,0 +1,58 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "dce.h"
+#include "elf.h"
+#include "gvn.h"
+
+/// The passes a pipelined compile runs on each function.
+typedef struct PipelineOptions {
+    /// The fewest cases an else-if chain needs to become a switch, 0 to
+    /// keep every chain.
+    uint32_t switchMinCases;
+    /// Whether global value numbering, value range analysis and dead
+    /// code elimination run.
+    bool gvn;
+    bool ranges;
+    bool dce;
+    /// Passed on to the backend as x64_compile() takes them.
+    bool allocateRegs;
+    bool peephole;
+    /// The bytes the lexer reads at a time, LEXER_CHUNK_SIZE unless
+    /// testing the chunk boundaries.
+    size_t lexerChunk;
+} PipelineOptions;
+
+/// What a pipelined compile did.
+typedef struct PipelineStats {
+    /// The functions compiled.
+    size_t funcs;
+    /// The most instructions a single function had after lowering, the
+    /// largest IR held at once.
+    size_t maxInsts;
+    /// What the passes did, summed over the functions.
+    size_t folded;
+    size_t tailCalls;
+    size_t switches;
+    ValueNumberStats numbered;
+    size_t narrowed;
+    DeadCodeStats dead;
+} PipelineStats;
+
+/// Compiles the source read from input to x86-64 code in obj one function at a
+/// time. A first pass reads the signature of every function, then each function
+/// is parsed, folded, lowered, optimized and emitted before the next one is
+/// read, so beyond the signatures and the object built the memory used grows
+/// with the largest function rather than the whole file. Only passes that work
+/// within a function run: tail recursion, switch forming, value numbering
+/// without reusing calls, value ranges and dead code elimination, every
+/// function staying in the object. input is read twice, so it must be seekable.
+/// Fills stats and returns false on failure, printing the errors found.
+bool compile_pipelined(FILE* input, ElfObject* obj,
+    const PipelineOptions* options, PipelineStats* stats);
+
+#endif // PIPELINE_H
@@ -0,0 +1,214 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#define POOL_THREADS 1
+#include <pthread.h>
+#include <unistd.h>
+#else
+#define POOL_THREADS 0
+#endif
+
+// Every worker owns a deque of tasks. The owner takes tasks from the
+// front and thieves take them from the back, so the expensive tasks
+// dealt out first stay with their owner while the cheap ones even out
+// the load. No task is ever added once the pool runs, so each deque is a
+// shrinking range of one shared array behind its own lock, and a worker
+// finding every deque empty is done.
+
+/// The tasks left to a worker.
+typedef struct PoolQueue {
+    /// The tasks left are tasks[head, tail) of the pool.
+    uint32_t head;
+    uint32_t tail;
+#if POOL_THREADS
+    pthread_mutex_t lock;
+#endif
+} PoolQueue;
+
+typedef struct Pool {
+    uint32_t* tasks;
+    PoolQueue* queues;
+    uint32_t workerCount;
+    PoolTask task;
+    void* ctx;
+    /// Set once a task fails, guarded by lock.
+    bool failed;
+#if POOL_THREADS
+    pthread_mutex_t lock;
+#endif
+} Pool;
+
+#if POOL_THREADS
+/// The argument of a worker thread.
+typedef struct PoolWorker {
+    Pool* pool;
+    uint32_t index;
+} PoolWorker;
+
+/// Runs tasks on a worker until none are left anywhere.
+static void run_worker(Pool* pool, uint32_t index);
+/// Takes the next task of a worker's own deque. Returns false if it is
+/// empty.
+static bool take_task(Pool* pool, uint32_t index, uint32_t* task);
+/// Takes the last task of the first other worker with tasks left.
+/// Returns false if every deque is empty.
+static bool steal_task(Pool* pool, uint32_t index, uint32_t* task);
+/// The entry point of a worker thread.
+static void* worker_thread(void* arg);
+#endif
+
+uint32_t pool_default_threads(void) {
+#if POOL_THREADS
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > 1) {
+        return (uint32_t)count;
+    }
+#endif
+    return 1;
+}
+
+bool pool_run(const uint32_t* order, uint32_t count, uint32_t threads,
+    PoolTask task, void* ctx) {
+    if (threads > count) {
+        threads = count;
+    }
+#if POOL_THREADS
+    if (threads > 1) {
+        Pool pool = { 0 };
+        pool.tasks = malloc(count * sizeof(uint32_t));
+        pool.queues = malloc(threads * sizeof(PoolQueue));
+        PoolWorker* workers = malloc(threads * sizeof(PoolWorker));
+        pthread_t* handles = malloc(threads * sizeof(pthread_t));
+        if (pool.tasks == NULL || pool.queues == NULL || workers == NULL ||
+            handles == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            free(pool.tasks);
+            free(pool.queues);
+            free(workers);
+            free(handles);
+            return false;
+        }
+        pool.task = task;
+        pool.ctx = ctx;
+
+        // Worker w is dealt the tasks at positions w, w + threads, ... of
+        // order, kept in that order
+        uint32_t next = 0;
+        uint32_t locks = 0;
+        bool poolLock = pthread_mutex_init(&pool.lock, NULL) == 0;
+        bool ok = poolLock;
+        for (uint32_t w = 0; ok && w < threads; w++) {
+            PoolQueue* queue = &pool.queues[w];
+            queue->head = next;
+            for (uint32_t k = w; k < count; k += threads) {
+                pool.tasks[next++] = order[k];
+            }
+            queue->tail = next;
+            ok = pthread_mutex_init(&queue->lock, NULL) == 0;
+            locks += ok;
+        }
+
+        // Deques of workers that do not start are stolen from
+        if (ok) {
+            uint32_t started = 1;
+            pool.workerCount = threads;
+            for (uint32_t w = 1; w < threads; w++) {
+                workers[w].pool = &pool;
+                workers[w].index = w;
+                if (pthread_create(&handles[started], NULL, worker_thread,
+                    &workers[w]) == 0) {
+                    started++;
+                }
+            }
+            run_worker(&pool, 0);
+            for (uint32_t w = 1; w < started; w++) {
+                pthread_join(handles[w], NULL);
+            }
+        }
+
+        for (uint32_t w = 0; w < locks; w++) {
+            pthread_mutex_destroy(&pool.queues[w].lock);
+        }
+        if (poolLock) {
+            pthread_mutex_destroy(&pool.lock);
+        }
+        free(pool.tasks);
+        free(pool.queues);
+        free(workers);
+        free(handles);
+        // Without locks the tasks run one after another below
+        if (ok) {
+            return !pool.failed;
+        }
+    }
+#endif
+
+    for (uint32_t k = 0; k < count; k++) {
+        if (!task(ctx, 0, order[k])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* --- Helper Functions --- */
+
+#if POOL_THREADS
+static void run_worker(Pool* pool, uint32_t index) {
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        bool failed = pool->failed;
+        pthread_mutex_unlock(&pool->lock);
+
+        uint32_t task;
+        if (failed || (!take_task(pool, index, &task) &&
+            !steal_task(pool, index, &task))) {
+            return;
+        }
+        if (!pool->task(pool->ctx, index, task)) {
+            pthread_mutex_lock(&pool->lock);
+            pool->failed = true;
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+}
+
+static bool take_task(Pool* pool, uint32_t index, uint32_t* task) {
+    PoolQueue* queue = &pool->queues[index];
+    pthread_mutex_lock(&queue->lock);
+    bool found = queue->head < queue->tail;
+    if (found) {
+        *task = pool->tasks[queue->head++];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static bool steal_task(Pool* pool, uint32_t index, uint32_t* task) {
+    for (uint32_t k = 1; k < pool->workerCount; k++) {
+        PoolQueue* queue = &pool->queues[(index + k) % pool->workerCount];
+        pthread_mutex_lock(&queue->lock);
+        bool found = queue->head < queue->tail;
+        if (found) {
+            *task = pool->tasks[--queue->tail];
+        }
+        pthread_mutex_unlock(&queue->lock);
+        if (found) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void* worker_thread(void* arg) {
+    PoolWorker* worker = arg;
+    run_worker(worker->pool, worker->index);
+    return NULL;
+}
+#endif
@@ -0,0 +1,23 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// Runs task on worker, a number below the thread count of the pool.
+/// Tasks on the same worker never run at the same time. Returns false on
+/// failure.
+typedef bool (*PoolTask)(void* ctx, uint32_t worker, uint32_t task);
+
+/// Returns the number of processors online, at least 1.
+uint32_t pool_default_threads(void);
+/// Runs the count tasks listed in order on up to threads workers, the
+/// calling thread being worker 0. The tasks are dealt out in turn, so
+/// listing the most expensive first spreads them out, and a worker
+/// without tasks left steals from the end of another worker's. Once a
+/// task fails no new ones are started. Returns false if a task failed
+/// or the pool could not be set up.
+bool pool_run(const uint32_t* order, uint32_t count, uint32_t threads,
+    PoolTask task, void* ctx);
+
+#endif // POOL_H
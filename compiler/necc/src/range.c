@@ -0,0 +1,811 @@
+#include "range.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+
+// Ranges are found by walking the dominator tree, so every block is
+// visited after the blocks its values come from and sees the facts the
+// branches leading to it established: a block entered only through the
+// then edge of x < 10 knows x is at most 9. The facts are undone when
+// the walk leaves the block. Phis can depend on values of later blocks,
+// so the walk repeats until no range changes, widening phis that keep
+// changing to their whole type so loops settle quickly. A last walk
+// recomputes the same ranges and rewrites the function with them.
+
+/// Walks after which a phi whose range still changes gets its whole type.
+#define RANGE_WIDEN_ROUNDS 3
+/// Walks after which a function whose ranges still change is left alone.
+#define RANGE_MAX_ROUNDS 8
+/// Marks a block on the walk stack whose subtree has been walked.
+#define RANGE_LEAVE UINT32_C(0x80000000)
+
+/// The values an integer can hold, lo to hi inclusive. Unsigned values
+/// above the signed maximum stay positive since ranges are 128 bits.
+typedef struct Range {
+    Int128 lo;
+    Int128 hi;
+} Range;
+
+/// A fact replaced on entering a block, put back on leaving it.
+typedef struct Fact {
+    uint32_t value;
+    Range saved;
+    bool hadFact;
+} Fact;
+
+typedef struct Analysis {
+    IRFunction* func;
+    IRCfg* cfg;
+    /// Blocks still to walk, or to leave when RANGE_LEAVE is set.
+    uint32_t* pending;
+
+    /// The range of each value, valid once known is set.
+    Range* ranges;
+    bool* known;
+    /// The narrower range of values the branches leading to the block
+    /// being walked established, valid where hasFact is set.
+    Range* facts;
+    bool* hasFact;
+    /// Replaced facts, and the size of the stack on entering each block.
+    Fact* saved;
+    uint32_t savedCount;
+    uint32_t* savedMark;
+
+    /// The number of uses of each instruction.
+    uint32_t* uses;
+    /// The position of each instruction in the last walk. Of two
+    /// instructions dominating a third, the later one is dominated by
+    /// the other.
+    uint32_t* order;
+    uint32_t visited;
+
+    /// True if phis whose range changes get their whole type.
+    bool widen;
+    /// True if a range changed during the walk.
+    bool changed;
+    /// The number of instructions removed or rewritten.
+    size_t simplified;
+} Analysis;
+
+/// Analyzes and rewrites a function. Returns the number of instructions
+/// removed or rewritten.
+static size_t narrow_function(IRFunction* func);
+/// Walks the dominator tree once, rewriting the function if rewrite is
+/// set.
+static void walk(Analysis* an, bool rewrite);
+/// Adds the facts known on entering a block from its only predecessor.
+static void enter_block(Analysis* an, uint32_t block);
+/// Adds the facts implied by the bool cond being equal to holds.
+static void constrain(Analysis* an, uint32_t cond, bool holds);
+/// Narrows the range of value to range until the current block is left.
+static void add_fact(Analysis* an, uint32_t value, Range range);
+/// Computes the range of an instruction and stores it, simplifying the
+/// instruction if rewrite is set.
+static void visit(Analysis* an, uint32_t index, bool rewrite);
+/// Computes the range of an instruction from its operands. Sets exact if
+/// the result is computed without wrapping. Returns false if the
+/// instruction has no integer result or nothing is known about it yet.
+static bool eval_range(const Analysis* an, uint32_t index, Range* out,
+    bool* exact);
+/// Computes the range of integer arithmetic on operands in a and b,
+/// without wrapping. Returns false if nothing useful is known.
+static bool arith_range(IROp op, Range a, Range b, Range* out);
+/// Returns 1 or 0 if the comparison of values in a and b is always true
+/// or false, -1 if it depends on the values.
+static int compare_outcome(IROp op, Range a, Range b);
+/// Stores the range of a value in out, using the facts of the current
+/// block. Returns false if it is not an integer value or unknown.
+static bool value_range(const Analysis* an, uint32_t value, Range* out);
+/// Stores the range of all values of type in out. Returns false if the
+/// type is not an integer up to 64 bits.
+static bool type_range(TokenType type, Range* out);
+/// Rewrites an instruction using its range.
+static void simplify(Analysis* an, uint32_t index, Range range);
+/// Rewrites arithmetic on values widened from a narrower type into the
+/// narrow arithmetic followed by a single widening.
+static void narrow_arith(Analysis* an, uint32_t index, Range range);
+/// Finds the narrow values two operands were widened from by exact
+/// casts, storing them and their type. A constant operand is converted
+/// to the narrow type if it fits. Returns false if there are none.
+static bool narrow_operands(Analysis* an, const uint32_t* args,
+    TokenType* type, uint32_t* narrow);
+/// Returns the value an exact cast operand was widened from, or IR_NONE.
+static uint32_t cast_source(const Analysis* an, uint32_t value);
+/// Replaces every use of an instruction with value and removes it.
+static void replace_value(Analysis* an, uint32_t index, uint32_t value);
+/// Drops a use of value, removing it if it was its last one and it has
+/// no side effects.
+static void release(Analysis* an, uint32_t value);
+/// Returns true if the range lies within the bounds.
+static bool range_within(Range range, Range bounds);
+/// Returns the smaller or larger of two signed values.
+static Int128 min_i128(Int128 a, Int128 b);
+static Int128 max_i128(Int128 a, Int128 b);
+
+size_t narrow_ranges(IRModule* module) {
+    size_t simplified = 0;
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        simplified += narrow_function_ranges(module->funcs[i]);
+    }
+    return simplified;
+}
+
+size_t narrow_function_ranges(IRFunction* func) {
+    return narrow_function(func);
+}
+
+/* --- Helper Functions --- */
+
+static size_t narrow_function(IRFunction* func) {
+    Analysis an;
+    memset(&an, 0, sizeof(an));
+    an.func = func;
+    an.cfg = create_ir_cfg(func);
+    if (an.cfg == NULL) {
+        return 0;
+    }
+
+    uint32_t values = func->instCount + 1;
+    uint32_t blocks = func->blockCount + 1;
+    an.pending = malloc(blocks * 2 * sizeof(uint32_t));
+    an.ranges = malloc(values * sizeof(Range));
+    an.known = calloc(values, sizeof(bool));
+    an.facts = malloc(values * sizeof(Range));
+    an.hasFact = calloc(values, sizeof(bool));
+    an.saved = malloc(blocks * 2 * sizeof(Fact));
+    an.savedMark = malloc(blocks * sizeof(uint32_t));
+    an.uses = calloc(values, sizeof(uint32_t));
+    an.order = malloc(values * sizeof(uint32_t));
+    bool ok = an.pending != NULL && an.ranges != NULL && an.known != NULL &&
+        an.facts != NULL && an.hasFact != NULL && an.saved != NULL &&
+        an.savedMark != NULL && an.uses != NULL && an.order != NULL;
+    if (!ok) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+
+    if (ok) {
+        for (uint32_t i = 0; i < func->instCount; i++) {
+            uint32_t* ops;
+            uint32_t count = ir_get_operands(func, &func->insts[i], &ops);
+            for (uint32_t j = 0; j < count; j++) {
+                if (!ir_is_const(ops[j])) {
+                    an.uses[ops[j]]++;
+                }
+            }
+        }
+
+        uint32_t round = 0;
+        do {
+            an.widen = round >= RANGE_WIDEN_ROUNDS;
+            an.changed = false;
+            walk(&an, false);
+            round++;
+        } while (an.changed && round < RANGE_MAX_ROUNDS);
+        if (!an.changed) {
+            walk(&an, true);
+        }
+    }
+
+    free_ir_cfg(an.cfg);
+    free(an.pending);
+    free(an.ranges);
+    free(an.known);
+    free(an.facts);
+    free(an.hasFact);
+    free(an.saved);
+    free(an.savedMark);
+    free(an.uses);
+    free(an.order);
+    if (an.simplified > 0 && !ir_compact(func)) {
+        return 0;
+    }
+    return an.simplified;
+}
+
+static void walk(Analysis* an, bool rewrite) {
+    const IRFunction* func = an->func;
+    uint32_t top = 0;
+    an->pending[top++] = an->cfg->rpo[0];
+    an->visited = 0;
+
+    while (top > 0) {
+        uint32_t block = an->pending[--top];
+        if (block & RANGE_LEAVE) {
+            block &= ~RANGE_LEAVE;
+            while (an->savedCount > an->savedMark[block]) {
+                const Fact* fact = &an->saved[--an->savedCount];
+                an->facts[fact->value] = fact->saved;
+                an->hasFact[fact->value] = fact->hadFact;
+            }
+            continue;
+        }
+
+        an->savedMark[block] = an->savedCount;
+        enter_block(an, block);
+        for (uint32_t i = func->blocks[block].start;
+            i < func->blocks[block].end; i++) {
+            if (func->insts[i].op != IR_NOP) {
+                an->order[i] = an->visited++;
+                visit(an, i, rewrite);
+            }
+        }
+
+        an->pending[top++] = block | RANGE_LEAVE;
+        for (uint32_t k = an->cfg->domStart[block + 1];
+            k > an->cfg->domStart[block]; k--) {
+            an->pending[top++] = an->cfg->domChildren[k - 1];
+        }
+    }
+}
+
+static void enter_block(Analysis* an, uint32_t block) {
+    const IRFunction* func = an->func;
+    const IRCfg* cfg = an->cfg;
+    if (block == cfg->rpo[0] ||
+        cfg->predStart[block + 1] - cfg->predStart[block] != 1) {
+        return;
+    }
+
+    uint32_t pred = cfg->preds[cfg->predStart[block]];
+    const IRInst* branch = &func->insts[func->blocks[pred].end - 1];
+    if (ir_is_const(branch->args[0])) {
+        return;
+    }
+    const uint32_t* pool = func->operands + branch->args[1];
+    if (branch->op == IR_BR && pool[0] != pool[1]) {
+        constrain(an, branch->args[0], block == pool[0]);
+    } else if (branch->op == IR_SWITCH) {
+        for (uint32_t k = 0; k < pool[0]; k++) {
+            if (pool[2 + k] == block) {
+                Int128 key = ir_get_const(func, pool[2 + pool[0] + k])->bits;
+                add_fact(an, branch->args[0], (Range){ key, key });
+            }
+        }
+    }
+}
+
+static void constrain(Analysis* an, uint32_t cond, bool holds) {
+    const IRFunction* func = an->func;
+    while (!ir_is_const(cond) && func->insts[cond].op == IR_NOT) {
+        cond = func->insts[cond].args[0];
+        holds = !holds;
+    }
+    if (ir_is_const(cond)) {
+        return;
+    }
+
+    const IRInst* compare = &func->insts[cond];
+    IROp op = (IROp)compare->op;
+    uint32_t left = compare->args[0];
+    uint32_t right = compare->args[1];
+    Range a;
+    Range b;
+    if (op < IR_EQ || op > IR_GTE || !value_range(an, left, &a) ||
+        !value_range(an, right, &b)) {
+        return;
+    }
+
+    if (!holds) {
+        static const IROp negated[] = {
+            [IR_EQ] = IR_NEQ, [IR_NEQ] = IR_EQ, [IR_LT] = IR_GTE,
+            [IR_LTE] = IR_GT, [IR_GT] = IR_LTE, [IR_GTE] = IR_LT,
+        };
+        op = negated[op];
+    }
+    // Only less than is handled, greater than swaps the sides
+    if (op == IR_GT || op == IR_GTE) {
+        uint32_t value = left;
+        left = right;
+        right = value;
+        Range range = a;
+        a = b;
+        b = range;
+        op = op == IR_GT ? IR_LT : IR_LTE;
+    }
+
+    Int128 one = i128_from_u64(1);
+    Range newA = a;
+    Range newB = b;
+    switch (op) {
+        case IR_EQ:
+            newA.lo = max_i128(a.lo, b.lo);
+            newA.hi = min_i128(a.hi, b.hi);
+            newB = newA;
+            break;
+        case IR_NEQ:
+            // Only an excluded bound narrows a range
+            if (i128_eq(b.lo, b.hi) && i128_eq(a.lo, b.lo)) {
+                newA.lo = i128_add(a.lo, one);
+            } else if (i128_eq(b.lo, b.hi) && i128_eq(a.hi, b.lo)) {
+                newA.hi = i128_sub(a.hi, one);
+            }
+            if (i128_eq(a.lo, a.hi) && i128_eq(b.lo, a.lo)) {
+                newB.lo = i128_add(b.lo, one);
+            } else if (i128_eq(a.lo, a.hi) && i128_eq(b.hi, a.lo)) {
+                newB.hi = i128_sub(b.hi, one);
+            }
+            break;
+        case IR_LT:
+            newA.hi = min_i128(a.hi, i128_sub(b.hi, one));
+            newB.lo = max_i128(b.lo, i128_add(a.lo, one));
+            break;
+        default:
+            newA.hi = min_i128(a.hi, b.hi);
+            newB.lo = max_i128(b.lo, a.lo);
+            break;
+    }
+    add_fact(an, left, newA);
+    add_fact(an, right, newB);
+}
+
+static void add_fact(Analysis* an, uint32_t value, Range range) {
+    Range current;
+    // An empty range means the block cannot be reached, which is left to
+    // other passes
+    if (ir_is_const(value) || i128_slt(range.hi, range.lo) ||
+        !value_range(an, value, &current) ||
+        (i128_eq(range.lo, current.lo) && i128_eq(range.hi, current.hi))) {
+        return;
+    }
+
+    Fact* fact = &an->saved[an->savedCount++];
+    fact->value = value;
+    fact->saved = an->facts[value];
+    fact->hadFact = an->hasFact[value];
+    an->facts[value] = range;
+    an->hasFact[value] = true;
+}
+
+static void visit(Analysis* an, uint32_t index, bool rewrite) {
+    IRInst* inst = &an->func->insts[index];
+    Range range;
+    bool exact;
+    if (!eval_range(an, index, &range, &exact)) {
+        return;
+    }
+
+    bool same = an->known[index] &&
+        i128_eq(range.lo, an->ranges[index].lo) &&
+        i128_eq(range.hi, an->ranges[index].hi);
+    if (!same && an->widen && an->known[index] && inst->op == IR_PHI) {
+        type_range((TokenType)inst->type, &range);
+        same = i128_eq(range.lo, an->ranges[index].lo) &&
+            i128_eq(range.hi, an->ranges[index].hi);
+    }
+    an->changed |= !same;
+    an->ranges[index] = range;
+    an->known[index] = true;
+
+    if (rewrite) {
+        if (exact) {
+            inst->flags |= IR_FLAG_EXACT;
+        } else {
+            inst->flags &= (uint16_t)~IR_FLAG_EXACT;
+        }
+        simplify(an, index, range);
+    }
+}
+
+static bool eval_range(const Analysis* an, uint32_t index, Range* out,
+    bool* exact) {
+    const IRFunction* func = an->func;
+    const IRInst* inst = &func->insts[index];
+    TokenType type = (TokenType)inst->type;
+    IROp op = (IROp)inst->op;
+    Range full;
+    *exact = false;
+    if (!type_range(type, &full)) {
+        return false;
+    }
+    *out = full;
+
+    Range a;
+    Range b;
+    switch (op) {
+        case IR_PHI: {
+            const uint32_t* values = func->operands + inst->args[0] +
+                inst->args[1];
+            bool any = false;
+            for (uint32_t k = 0; k < inst->args[1]; k++) {
+                // Inputs not reached yet add nothing
+                if (!value_range(an, values[k], &a)) {
+                    continue;
+                }
+                out->lo = any ? min_i128(out->lo, a.lo) : a.lo;
+                out->hi = any ? max_i128(out->hi, a.hi) : a.hi;
+                any = true;
+            }
+            return any;
+        }
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_MOD:
+            if (type != TOK_BOOL && value_range(an, inst->args[0], &a) &&
+                value_range(an, inst->args[1], &b) &&
+                arith_range(op, a, b, out)) {
+                *exact = range_within(*out, full);
+                if (!*exact) {
+                    *out = full;
+                }
+            }
+            return true;
+        case IR_NEG:
+            if (type != TOK_BOOL && value_range(an, inst->args[0], &a)) {
+                out->lo = i128_neg(a.hi);
+                out->hi = i128_neg(a.lo);
+                *exact = range_within(*out, full);
+                if (!*exact) {
+                    *out = full;
+                }
+            }
+            return true;
+        case IR_NOT:
+            if (value_range(an, inst->args[0], &a)) {
+                out->lo = i128_sub(i128_from_u64(1), a.hi);
+                out->hi = i128_sub(i128_from_u64(1), a.lo);
+            }
+            return true;
+        case IR_EQ:
+        case IR_NEQ:
+        case IR_LT:
+        case IR_LTE:
+        case IR_GT:
+        case IR_GTE:
+            if (value_range(an, inst->args[0], &a) &&
+                value_range(an, inst->args[1], &b)) {
+                int outcome = compare_outcome(op, a, b);
+                if (outcome >= 0) {
+                    out->lo = i128_from_u64((uint64_t)outcome);
+                    out->hi = out->lo;
+                }
+            }
+            return true;
+        case IR_CAST:
+            if (!value_range(an, inst->args[0], &a)) {
+                return true;
+            }
+            if (type == TOK_BOOL) {
+                bool hasZero = !i128_slt(i128_from_u64(0), a.lo) &&
+                    !i128_slt(a.hi, i128_from_u64(0));
+                bool onlyZero = i128_is_zero(a.lo) && i128_is_zero(a.hi);
+                out->lo = i128_from_u64(hasZero ? 0 : 1);
+                out->hi = i128_from_u64(onlyZero ? 0 : 1);
+            } else if (range_within(a, full)) {
+                *out = a;
+                *exact = ir_value_type(func, inst->args[0]) != TOK_BOOL;
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+static bool arith_range(IROp op, Range a, Range b, Range* out) {
+    Int128 corners[4];
+    Int128 zero = i128_from_u64(0);
+    bool hasZero = !i128_slt(zero, b.lo) && !i128_slt(b.hi, zero);
+    switch (op) {
+        case IR_ADD:
+            out->lo = i128_add(a.lo, b.lo);
+            out->hi = i128_add(a.hi, b.hi);
+            return true;
+        case IR_SUB:
+            out->lo = i128_sub(a.lo, b.hi);
+            out->hi = i128_sub(a.hi, b.lo);
+            return true;
+        case IR_MUL: {
+            // Products of values below 2^63 in magnitude cannot overflow
+            Int128 limit = i128_from_u64(UINT64_C(1) << 63);
+            Int128 bounds[4] = { a.lo, a.hi, b.lo, b.hi };
+            for (int k = 0; k < 4; k++) {
+                if (!i128_slt(bounds[k], limit) ||
+                    !i128_slt(i128_neg(limit), bounds[k])) {
+                    return false;
+                }
+            }
+            corners[0] = i128_mul(a.lo, b.lo);
+            corners[1] = i128_mul(a.lo, b.hi);
+            corners[2] = i128_mul(a.hi, b.lo);
+            corners[3] = i128_mul(a.hi, b.hi);
+            break;
+        }
+        case IR_DIV:
+            // With the sign of the divisor fixed the quotient is monotonic
+            // in both operands
+            if (hasZero) {
+                return false;
+            }
+            corners[0] = i128_sdivmod(a.lo, b.lo, NULL);
+            corners[1] = i128_sdivmod(a.lo, b.hi, NULL);
+            corners[2] = i128_sdivmod(a.hi, b.lo, NULL);
+            corners[3] = i128_sdivmod(a.hi, b.hi, NULL);
+            break;
+        default: {
+            // The remainder is smaller than the divisor and takes the
+            // sign of the dividend
+            if (hasZero) {
+                return false;
+            }
+            Int128 lo = i128_is_neg(b.lo) ? i128_neg(b.lo) : b.lo;
+            Int128 hi = i128_is_neg(b.hi) ? i128_neg(b.hi) : b.hi;
+            Int128 limit = i128_sub(max_i128(lo, hi), i128_from_u64(1));
+            out->lo = i128_is_neg(a.lo) ?
+                max_i128(a.lo, i128_neg(limit)) : zero;
+            out->hi = i128_slt(zero, a.hi) ? min_i128(a.hi, limit) : zero;
+            return true;
+        }
+    }
+
+    out->lo = corners[0];
+    out->hi = corners[0];
+    for (int k = 1; k < 4; k++) {
+        out->lo = min_i128(out->lo, corners[k]);
+        out->hi = max_i128(out->hi, corners[k]);
+    }
+    return true;
+}
+
+static int compare_outcome(IROp op, Range a, Range b) {
+    switch (op) {
+        case IR_EQ:
+        case IR_NEQ: {
+            int equal = -1;
+            if (i128_slt(a.hi, b.lo) || i128_slt(b.hi, a.lo)) {
+                equal = 0;
+            } else if (i128_eq(a.lo, a.hi) && i128_eq(b.lo, b.hi)) {
+                equal = 1;
+            }
+            return op == IR_EQ || equal < 0 ? equal : !equal;
+        }
+        case IR_LT:
+        case IR_GTE: {
+            int less = -1;
+            if (i128_slt(a.hi, b.lo)) {
+                less = 1;
+            } else if (!i128_slt(a.lo, b.hi)) {
+                less = 0;
+            }
+            return op == IR_LT || less < 0 ? less : !less;
+        }
+        default:
+            // a > b is b < a and a <= b is its negation
+            return compare_outcome(op == IR_GT ? IR_LT : IR_GTE, b, a);
+    }
+}
+
+static bool value_range(const Analysis* an, uint32_t value, Range* out) {
+    if (!type_range(ir_value_type(an->func, value), out)) {
+        return false;
+    }
+    if (ir_is_const(value)) {
+        out->lo = ir_get_const(an->func, value)->bits;
+        out->hi = out->lo;
+        return true;
+    }
+    if (an->hasFact[value]) {
+        *out = an->facts[value];
+        return true;
+    }
+    if (!an->known[value]) {
+        return false;
+    }
+    *out = an->ranges[value];
+    return true;
+}
+
+static bool type_range(TokenType type, Range* out) {
+    if (type == TOK_BOOL) {
+        out->lo = i128_from_u64(0);
+        out->hi = i128_from_u64(1);
+        return true;
+    }
+    if (!type_is_integer(type) || type_bit_width(type) > 64) {
+        return false;
+    }
+    out->lo = i128_type_limit(type, false);
+    out->hi = i128_type_limit(type, true);
+    return true;
+}
+
+static void simplify(Analysis* an, uint32_t index, Range range) {
+    IRFunction* func = an->func;
+    IRInst* inst = &func->insts[index];
+    IROp op = (IROp)inst->op;
+
+    // Division only gets a single value when the divisor cannot be zero
+    bool removable = op != IR_PARAM &&
+        (ir_is_pure(op) || op == IR_DIV || op == IR_MOD);
+    if (removable && i128_eq(range.lo, range.hi)) {
+        ConstValue value = { .i = range.lo };
+        uint32_t id = ir_const(func, (TokenType)inst->type, value);
+        if (id != IR_NONE) {
+            replace_value(an, index, id);
+        }
+        return;
+    }
+
+    if (op == IR_CAST) {
+        // The exact cast kept the value, so converting the value it was
+        // widened from gives the same result
+        uint32_t source = cast_source(an, inst->args[0]);
+        if (source == IR_NONE) {
+            return;
+        }
+        if (ir_value_type(func, source) == inst->type) {
+            replace_value(an, index, source);
+            return;
+        }
+        uint32_t widened = inst->args[0];
+        inst->args[0] = source;
+        an->uses[source]++;
+        release(an, widened);
+        an->simplified++;
+    } else if (op >= IR_EQ && op <= IR_GTE) {
+        TokenType type;
+        uint32_t narrow[2];
+        if (!narrow_operands(an, inst->args, &type, narrow)) {
+            return;
+        }
+        uint32_t old[2] = { inst->args[0], inst->args[1] };
+        for (int k = 0; k < 2; k++) {
+            inst->args[k] = narrow[k];
+            if (!ir_is_const(narrow[k])) {
+                an->uses[narrow[k]]++;
+            }
+        }
+        release(an, old[0]);
+        release(an, old[1]);
+        an->simplified++;
+    } else if (op == IR_ADD || op == IR_SUB || op == IR_MUL) {
+        narrow_arith(an, index, range);
+    }
+}
+
+static void narrow_arith(Analysis* an, uint32_t index, Range range) {
+    IRFunction* func = an->func;
+    IRInst* inst = &func->insts[index];
+    TokenType type;
+    uint32_t narrow[2];
+    Range bounds;
+    if (!narrow_operands(an, inst->args, &type, narrow) ||
+        type_bit_width(type) >= type_bit_width((TokenType)inst->type) ||
+        !type_range(type, &bounds) || !range_within(range, bounds)) {
+        return;
+    }
+
+    // The narrow operation takes the place of the later widening, where
+    // both narrow values are available. Each widening must have no other
+    // use for that to save anything.
+    uint32_t place = IR_NONE;
+    uint32_t other = IR_NONE;
+    for (int k = 0; k < 2; k++) {
+        uint32_t cast = inst->args[k];
+        if (ir_is_const(cast)) {
+            continue;
+        }
+        if (an->uses[cast] != 1) {
+            return;
+        }
+        if (place == IR_NONE || an->order[cast] > an->order[place]) {
+            other = place;
+            place = cast;
+        } else {
+            other = cast;
+        }
+    }
+
+    // The narrow values move from the widenings to the narrow operation,
+    // so no use count changes
+    func->insts[place] = (IRInst){
+        .op = inst->op, .type = (uint8_t)type, .flags = IR_FLAG_EXACT,
+        .args = { narrow[0], narrow[1] },
+    };
+    if (other != IR_NONE) {
+        func->insts[other].op = IR_NOP;
+    }
+    an->ranges[place] = range;
+    an->known[place] = true;
+    inst->op = IR_CAST;
+    inst->flags = IR_FLAG_EXACT;
+    inst->args[0] = place;
+    inst->args[1] = 0;
+    an->simplified++;
+}
+
+static bool narrow_operands(Analysis* an, const uint32_t* args,
+    TokenType* type, uint32_t* narrow) {
+    IRFunction* func = an->func;
+    *type = TOK_INVALID;
+    for (int k = 0; k < 2; k++) {
+        narrow[k] = cast_source(an, args[k]);
+        if (narrow[k] == IR_NONE) {
+            continue;
+        }
+        TokenType from = ir_value_type(func, narrow[k]);
+        if (*type != TOK_INVALID && *type != from) {
+            return false;
+        }
+        *type = from;
+    }
+    if (*type == TOK_INVALID) {
+        return false;
+    }
+
+    Range bounds;
+    type_range(*type, &bounds);
+    for (int k = 0; k < 2; k++) {
+        if (narrow[k] != IR_NONE) {
+            continue;
+        }
+        if (!ir_is_const(args[k])) {
+            return false;
+        }
+        Int128 bits = ir_get_const(func, args[k])->bits;
+        if (!range_within((Range){ bits, bits }, bounds)) {
+            return false;
+        }
+        narrow[k] = ir_const(func, *type, (ConstValue){ .i = bits });
+        if (narrow[k] == IR_NONE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t cast_source(const Analysis* an, uint32_t value) {
+    if (ir_is_const(value)) {
+        return IR_NONE;
+    }
+    const IRInst* inst = &an->func->insts[value];
+    if (inst->op != IR_CAST || !(inst->flags & IR_FLAG_EXACT) ||
+        ir_is_const(inst->args[0])) {
+        return IR_NONE;
+    }
+    return inst->args[0];
+}
+
+static void replace_value(Analysis* an, uint32_t index, uint32_t value) {
+    IRFunction* func = an->func;
+    ir_replace_uses(func, index, value);
+    if (!ir_is_const(value)) {
+        an->uses[value] += an->uses[index];
+    }
+    an->uses[index] = 0;
+
+    uint32_t* ops;
+    uint32_t count = ir_get_operands(func, &func->insts[index], &ops);
+    func->insts[index].op = IR_NOP;
+    for (uint32_t j = 0; j < count; j++) {
+        release(an, ops[j]);
+    }
+    an->simplified++;
+}
+
+static void release(Analysis* an, uint32_t value) {
+    if (value == IR_NONE || ir_is_const(value) || --an->uses[value] > 0) {
+        return;
+    }
+
+    // Only the value itself is removed, its operands are left to a later
+    // pass
+    IRInst* inst = &an->func->insts[value];
+    if (ir_is_pure((IROp)inst->op) && inst->op != IR_PARAM) {
+        inst->op = IR_NOP;
+        an->simplified++;
+    }
+}
+
+static bool range_within(Range range, Range bounds) {
+    return !i128_slt(range.lo, bounds.lo) && !i128_slt(bounds.hi, range.hi);
+}
+
+static Int128 min_i128(Int128 a, Int128 b) {
+    return i128_slt(b, a) ? b : a;
+}
+
+static Int128 max_i128(Int128 a, Int128 b) {
+    return i128_slt(a, b) ? b : a;
+}
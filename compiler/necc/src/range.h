@@ -0,0 +1,22 @@
+#ifndef RANGE_H
+#define RANGE_H
+
+#include <stddef.h>
+#include "ir.h"
+
+/// Computes the interval of values every integer value up to 64 bits can
+/// hold, using the branches that dominate a block to narrow the values
+/// they compare, and simplifies the module with the result. Values with
+/// a single possible value become constants, which folds comparisons
+/// decided by an earlier check. Casts of exact casts skip the middle
+/// type, comparisons and arithmetic on values widened from a narrower
+/// type use the narrow values when the result fits it, and instructions
+/// whose result provably fits their type get IR_FLAG_EXACT so the
+/// backends leave out the extension wrapping it. Returns the number of
+/// instructions removed or rewritten.
+size_t narrow_ranges(IRModule* module);
+/// Narrows the values of a single function like narrow_ranges(). Returns
+/// the number of instructions removed or rewritten.
+size_t narrow_function_ranges(IRFunction* func);
+
+#endif // RANGE_H
@@ -0,0 +1,270 @@
+#include "regalloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+
+// Live intervals are ranges of instruction indices. Along forward
+// branches the range from a definition to its last use covers every
+// path between them. A loop, which only tail recursion elimination
+// creates, runs from its header to the block jumping back to it, and a
+// value live on entry to the header has to survive every iteration, so
+// its interval is stretched to the backward jump. Intervals are never
+// split, a spilled value stays in its stack slot for its whole life.
+
+/// The live range of a value, both ends inclusive.
+typedef struct Interval {
+    uint32_t value;
+    uint32_t start;
+    uint32_t end;
+    /// True if a call lies strictly inside the interval.
+    bool crossesCall;
+    bool isFloat;
+} Interval;
+
+/// Stretches the end of every value live into a loop header to the last
+/// backward jump to it.
+static void extend_loops(IRFunction* func, const uint32_t* starts,
+    uint32_t* ends);
+/// Computes the interval of every value that can live in a register.
+/// Returns the number of intervals, or UINT32_MAX on allocation failure.
+static uint32_t build_intervals(IRFunction* func, const RAConfig* config,
+    Interval* intervals);
+/// Orders intervals by start, then by value.
+static int compare_intervals(const void* a, const void* b);
+/// Returns a register of the class of the interval that is free in the
+/// mask and survives the calls inside the interval, or RA_SPILLED if
+/// there is none.
+static uint8_t pick_register(const RAConfig* config, const Interval* interval,
+    uint32_t freeMask);
+/// Returns true if the register of its class survives calls.
+static bool is_callee_saved(const RAConfig* config, bool isFloat,
+    uint8_t reg);
+
+bool regalloc_linear_scan(IRFunction* func, const RAConfig* config,
+    uint8_t* regs) {
+    memset(regs, RA_SPILLED, func->instCount);
+    if (func->instCount == 0) {
+        return false;
+    }
+
+    Interval* intervals = malloc(func->instCount * sizeof(Interval));
+    uint32_t* active = malloc(func->instCount * sizeof(uint32_t));
+    if (intervals == NULL || active == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(intervals);
+        free(active);
+        return false;
+    }
+    uint32_t count = build_intervals(func, config, intervals);
+    if (count == UINT32_MAX) {
+        free(intervals);
+        free(active);
+        return false;
+    }
+    qsort(intervals, count, sizeof(Interval), compare_intervals);
+
+    // Register numbers index the free masks of their class
+    uint32_t freeGprs = 0;
+    uint32_t freeFprs = 0;
+    for (uint32_t i = 0; i < config->gprCount; i++) {
+        freeGprs |= UINT32_C(1) << config->gprs[i];
+    }
+    for (uint32_t i = 0; i < config->fprCount; i++) {
+        freeFprs |= UINT32_C(1) << config->fprs[i];
+    }
+
+    uint32_t activeCount = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const Interval* cur = &intervals[i];
+
+        // Release the registers of intervals that ended before this one
+        for (uint32_t j = 0; j < activeCount;) {
+            const Interval* old = &intervals[active[j]];
+            if (old->end >= cur->start) {
+                j++;
+                continue;
+            }
+            uint32_t bit = UINT32_C(1) << regs[old->value];
+            if (old->isFloat) {
+                freeFprs |= bit;
+            } else {
+                freeGprs |= bit;
+            }
+            active[j] = active[--activeCount];
+        }
+
+        uint32_t* freeMask = cur->isFloat ? &freeFprs : &freeGprs;
+        uint8_t reg = pick_register(config, cur, *freeMask);
+        if (reg != RA_SPILLED) {
+            regs[cur->value] = reg;
+            *freeMask &= ~(UINT32_C(1) << reg);
+            active[activeCount++] = i;
+            continue;
+        }
+
+        // Out of registers, spill whichever usable interval ends last
+        uint32_t victim = UINT32_MAX;
+        for (uint32_t j = 0; j < activeCount; j++) {
+            const Interval* other = &intervals[active[j]];
+            if (other->isFloat != cur->isFloat || other->end <= cur->end ||
+                (cur->crossesCall && !is_callee_saved(config, cur->isFloat,
+                regs[other->value]))) {
+                continue;
+            }
+            if (victim == UINT32_MAX ||
+                other->end > intervals[active[victim]].end) {
+                victim = j;
+            }
+        }
+        if (victim != UINT32_MAX) {
+            uint32_t value = intervals[active[victim]].value;
+            regs[cur->value] = regs[value];
+            regs[value] = RA_SPILLED;
+            active[victim] = i;
+        }
+    }
+
+    free(intervals);
+    free(active);
+    return true;
+}
+
+/* --- Helper Functions --- */
+
+static void extend_loops(IRFunction* func, const uint32_t* starts,
+    uint32_t* ends) {
+    // Nested loops can stretch a value into an outer loop, so this runs
+    // until nothing changes
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t b = 0; b < func->blockCount; b++) {
+            uint32_t jump = func->blocks[b].end - 1;
+            uint32_t* succs;
+            uint32_t count = ir_get_successors(func, &func->insts[jump],
+                &succs);
+            for (uint32_t s = 0; s < count; s++) {
+                if (succs[s] > b) {
+                    continue;
+                }
+                uint32_t header = func->blocks[succs[s]].start;
+                for (uint32_t v = 0; v < func->instCount; v++) {
+                    if (starts[v] < header && ends[v] >= header &&
+                        ends[v] < jump) {
+                        ends[v] = jump;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static uint32_t build_intervals(IRFunction* func, const RAConfig* config,
+    Interval* intervals) {
+    uint32_t n = func->instCount;
+    uint32_t* starts = malloc(n * sizeof(uint32_t));
+    uint32_t* ends = malloc(n * sizeof(uint32_t));
+    // The number of calls before each position
+    uint32_t* calls = malloc((n + 1) * sizeof(uint32_t));
+    if (starts == NULL || ends == NULL || calls == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(starts);
+        free(ends);
+        free(calls);
+        return UINT32_MAX;
+    }
+
+    calls[0] = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        starts[i] = i;
+        ends[i] = i;
+        calls[i + 1] = calls[i] + (config->isCall(func, i) ? 1 : 0);
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        IRInst* inst = &func->insts[i];
+        if (inst->op == IR_PHI) {
+            // Each input is copied in at the end of its predecessor
+            const uint32_t* pool = func->operands + inst->args[0];
+            for (uint32_t j = 0; j < inst->args[1]; j++) {
+                uint32_t copy = func->blocks[pool[j]].end - 1;
+                uint32_t value = pool[inst->args[1] + j];
+                if (copy < starts[i]) {
+                    starts[i] = copy;
+                }
+                if (!ir_is_const(value) && ends[value] < copy) {
+                    ends[value] = copy;
+                }
+            }
+            continue;
+        }
+
+        uint32_t* ops;
+        uint32_t count = ir_get_operands(func, inst, &ops);
+        for (uint32_t j = 0; j < count; j++) {
+            if (!ir_is_const(ops[j]) && ends[ops[j]] < i) {
+                ends[ops[j]] = i;
+            }
+        }
+    }
+
+    extend_loops(func, starts, ends);
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        TokenType type = (TokenType)func->insts[i].type;
+        if (type == TOK_INVALID || type == TOK_I128 || type == TOK_U128) {
+            continue;
+        }
+        Interval* interval = &intervals[count++];
+        interval->value = i;
+        interval->start = starts[i];
+        interval->end = ends[i];
+        interval->crossesCall = ends[i] > starts[i] + 1 &&
+            calls[ends[i]] > calls[starts[i] + 1];
+        interval->isFloat = type_is_float(type);
+    }
+
+    free(starts);
+    free(ends);
+    free(calls);
+    return count;
+}
+
+static int compare_intervals(const void* a, const void* b) {
+    const Interval* left = a;
+    const Interval* right = b;
+    if (left->start != right->start) {
+        return left->start < right->start ? -1 : 1;
+    }
+    return left->value < right->value ? -1 : left->value > right->value;
+}
+
+static uint8_t pick_register(const RAConfig* config, const Interval* interval,
+    uint32_t freeMask) {
+    const uint8_t* candidates = interval->isFloat ? config->fprs :
+        config->gprs;
+    uint32_t count = interval->isFloat ? config->fprCount : config->gprCount;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t reg = candidates[i];
+        if (!(freeMask & (UINT32_C(1) << reg))) {
+            continue;
+        }
+        if (interval->crossesCall &&
+            !is_callee_saved(config, interval->isFloat, reg)) {
+            continue;
+        }
+        return reg;
+    }
+    return RA_SPILLED;
+}
+
+static bool is_callee_saved(const RAConfig* config, bool isFloat,
+    uint8_t reg) {
+    uint32_t mask = isFloat ? config->calleeSavedFprs :
+        config->calleeSavedGprs;
+    return (mask & (UINT32_C(1) << reg)) != 0;
+}
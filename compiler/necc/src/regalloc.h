@@ -0,0 +1,42 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ir.h"
+
+/// Marks a value that was not given a register.
+#define RA_SPILLED UINT8_MAX
+
+/// The registers a target offers to the allocator.
+typedef struct RAConfig {
+    /// Registers for integer, bool and char values, in order of
+    /// preference.
+    const uint8_t* gprs;
+    uint32_t gprCount;
+    /// Registers for float values, in order of preference.
+    const uint8_t* fprs;
+    uint32_t fprCount;
+    /// Bit r is set if integer register r keeps its value across calls.
+    uint32_t calleeSavedGprs;
+    /// Bit r is set if float register r keeps its value across calls.
+    uint32_t calleeSavedFprs;
+    /// Returns true if the instruction calls out of the function and so
+    /// clobbers every register that is not callee saved.
+    bool (*isCall)(const IRFunction* func, uint32_t inst);
+} RAConfig;
+
+/// Assigns registers to the values of a compacted function by linear
+/// scan over live intervals in instruction order. Values live across a
+/// call only get callee saved registers, and when registers run out the
+/// interval ending last is spilled. i128 and u128 values are always
+/// spilled. Phi inputs count as uses at the end of their predecessor,
+/// where the copies into the phi are made, and a phi is live from its
+/// first predecessor's terminator. Values live into a loop stay live up
+/// to its backward jump. regs receives one entry per instruction, a
+/// register or RA_SPILLED. Returns false on allocation failure, leaving
+/// every value spilled.
+bool regalloc_linear_scan(IRFunction* func, const RAConfig* config,
+    uint8_t* regs);
+
+#endif // REGALLOC_H
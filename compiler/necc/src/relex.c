@@ -0,0 +1,250 @@
+#include "relex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+
+// The lexer carries nothing from one token to the next, whitespace and
+// comments being skipped as part of the token after them, so lexing
+// from the start of any token gives the tokens that followed it. A
+// token can only change when the edit touches it or the character after
+// it, which the lexer looks at to see where the token ends, so lexing
+// starts again at the token before the first one reaching the edit.
+// That also catches an edit opening or closing a comment or character
+// literal between or inside tokens. Once a new token past the edit
+// starts where an old one did, the rest of the text is the same and so
+// are the rest of its tokens.
+
+/// Appends a token to a growable array. Returns false on allocation
+/// failure, leaving the token to the caller.
+static bool push_token(Token*** tokens, size_t* count, size_t* cap,
+    Token* token);
+/// Frees count tokens and the array holding them.
+static void free_tokens(Token** tokens, size_t count);
+/// Returns the index of the first token ending at or after offset.
+static size_t find_token(const TokenStream* stream, size_t offset);
+
+TokenStream* lex_token_stream(const char* src, size_t len) {
+    TokenStream* stream = calloc(1, sizeof(TokenStream));
+    char* copy = malloc(len + 1);
+    if (stream == NULL || copy == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(stream);
+        free(copy);
+        return NULL;
+    }
+    memcpy(copy, src, len);
+    copy[len] = '\0';
+    stream->src = copy;
+    stream->srcLen = len;
+
+    Lexer lexer = { copy, len, 0, 1, 1, NULL, 0, 0, 0, 0, true, false,
+        { 0, 0, 0 } };
+    for (;;) {
+        Token* token = get_next_token(&lexer);
+        if (token == NULL ||
+            !push_token(&stream->tokens, &stream->count, &stream->cap,
+                token)) {
+            free_token(token);
+            free_token_stream(stream);
+            return NULL;
+        }
+        if (token->type == TOK_INVALID) {
+            stream->invalid++;
+        }
+        if (token->type == TOK_EOF) {
+            break;
+        }
+    }
+    stream->relexed = stream->count;
+    stream->change.start = 0;
+    stream->change.oldEnd = len + 1;
+    stream->change.newEnd = len + 1;
+    return stream;
+}
+
+void free_token_stream(TokenStream* stream) {
+    if (stream == NULL) {
+        return;
+    }
+    free_tokens(stream->tokens, stream->count);
+    free(stream->src);
+    free(stream);
+}
+
+bool relex_token_stream(TokenStream* stream, size_t offset, size_t removed,
+    const char* inserted, size_t insertedLen) {
+    if (offset > stream->srcLen || removed > stream->srcLen - offset) {
+        fprintf(stderr, "Error: Edit of %zu byte(s) at %zu is outside the"\
+            " %zu byte source\n", removed, offset, stream->srcLen);
+        return false;
+    }
+
+    size_t newLen = stream->srcLen - removed + insertedLen;
+    char* src = malloc(newLen + 1);
+    if (src == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+    memcpy(src, stream->src, offset);
+    memcpy(src + offset, inserted, insertedLen);
+    memcpy(src + offset + insertedLen, stream->src + offset + removed,
+        stream->srcLen - offset - removed);
+    src[newLen] = '\0';
+
+    // Tokens before first are kept as they were
+    size_t first = find_token(stream, offset);
+    Lexer lexer = { src, newLen, 0, 1, 1, NULL, 0, 0, 0, 0, true, false,
+        { 0, 0, 0 } };
+    if (first > 0) {
+        first--;
+        lexer.pos = stream->tokens[first]->offset;
+        lexer.line = stream->tokens[first]->line;
+        lexer.column = stream->tokens[first]->column;
+    }
+    size_t restart = lexer.pos;
+
+    // Lex until a token past the edit starts where an old one did, old
+    // tokens from first up to match being replaced
+    Token** fresh = NULL;
+    size_t freshCount = 0;
+    size_t freshCap = 0;
+    size_t editEnd = offset + insertedLen;
+    size_t match = first;
+    Token* anchor = NULL;
+    for (;;) {
+        Token* token = get_next_token(&lexer);
+        if (token == NULL) {
+            free_tokens(fresh, freshCount);
+            free(src);
+            return false;
+        }
+        if (token->offset >= editEnd) {
+            size_t oldOffset = token->offset - insertedLen + removed;
+            while (match < stream->count &&
+                stream->tokens[match]->offset < oldOffset) {
+                match++;
+            }
+            if (match < stream->count &&
+                stream->tokens[match]->offset == oldOffset) {
+                anchor = token;
+                break;
+            }
+        }
+        if (!push_token(&fresh, &freshCount, &freshCap, token)) {
+            free_token(token);
+            free_tokens(fresh, freshCount);
+            free(src);
+            return false;
+        }
+        if (token->type == TOK_EOF) {
+            match = stream->count;
+            break;
+        }
+    }
+
+    TokenChange change = { restart, stream->srcLen + 1, newLen + 1 };
+    size_t kept = stream->count - match;
+    size_t newCount = first + freshCount + kept;
+    if (newCount > stream->cap) {
+        size_t newCap = stream->cap * 2 > newCount ? stream->cap * 2 :
+            newCount;
+        Token** grown = realloc(stream->tokens, newCap * sizeof(Token*));
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            free_token(anchor);
+            free_tokens(fresh, freshCount);
+            free(src);
+            return false;
+        }
+        stream->tokens = grown;
+        stream->cap = newCap;
+    }
+
+    // Tokens after the edit move by its size. Only those on the line of
+    // the first of them change column, the newlines before the others
+    // being untouched.
+    if (anchor != NULL) {
+        Token* old = stream->tokens[match];
+        change.oldEnd = old->offset;
+        change.newEnd = anchor->offset;
+        size_t anchorLine = old->line;
+        size_t anchorColumn = old->column;
+        for (size_t i = match; i < stream->count; i++) {
+            Token* token = stream->tokens[i];
+            if (token->line == anchorLine) {
+                token->column = token->column - anchorColumn +
+                    anchor->column;
+            }
+            token->line = token->line - anchorLine + anchor->line;
+            token->offset = token->offset - removed + insertedLen;
+        }
+        free_token(anchor);
+    }
+
+    for (size_t i = first; i < match; i++) {
+        if (stream->tokens[i]->type == TOK_INVALID) {
+            stream->invalid--;
+        }
+        free_token(stream->tokens[i]);
+    }
+    for (size_t i = 0; i < freshCount; i++) {
+        if (fresh[i]->type == TOK_INVALID) {
+            stream->invalid++;
+        }
+    }
+    memmove(stream->tokens + first + freshCount, stream->tokens + match,
+        kept * sizeof(Token*));
+    if (freshCount > 0) {
+        memcpy(stream->tokens + first, fresh, freshCount * sizeof(Token*));
+    }
+    free(fresh);
+    free(stream->src);
+    stream->src = src;
+    stream->srcLen = newLen;
+    stream->count = newCount;
+    stream->relexed = freshCount;
+    stream->reused = first + kept;
+    stream->change = change;
+    return true;
+}
+
+/* --- Helper Functions --- */
+
+static bool push_token(Token*** tokens, size_t* count, size_t* cap,
+    Token* token) {
+    if (*count == *cap) {
+        size_t newCap = *cap == 0 ? 64 : *cap * 2;
+        Token** grown = realloc(*tokens, newCap * sizeof(Token*));
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return false;
+        }
+        *tokens = grown;
+        *cap = newCap;
+    }
+    (*tokens)[(*count)++] = token;
+    return true;
+}
+
+static void free_tokens(Token** tokens, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free_token(tokens[i]);
+    }
+    free(tokens);
+}
+
+static size_t find_token(const TokenStream* stream, size_t offset) {
+    size_t low = 0;
+    size_t high = stream->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const Token* token = stream->tokens[mid];
+        if (token->offset + token->length < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
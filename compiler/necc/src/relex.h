@@ -0,0 +1,53 @@
+#ifndef RELEX_H
+#define RELEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "token.h"
+
+/// The bytes of a source an edit lexed again. Tokens ending at or
+/// before start were kept as they were, and tokens that started at or
+/// after oldEnd were kept, now starting as far after newEnd. Both ends
+/// are one past the end of the source when lexing went on to its end.
+typedef struct TokenChange {
+    size_t start;
+    size_t oldEnd;
+    size_t newEnd;
+} TokenChange;
+
+/// The tokens of a source text, kept up to date as the text is edited.
+typedef struct TokenStream {
+    /// Null-terminated copy of the source the tokens were lexed from.
+    char* src;
+    size_t srcLen;
+    /// The tokens of src in order, the last one being TOK_EOF.
+    Token** tokens;
+    size_t count;
+    size_t cap;
+    /// The number of TOK_INVALID tokens, whose errors the lexer printed
+    /// when it made them.
+    size_t invalid;
+    /// The number of tokens the last edit lexed again and the number it
+    /// kept, shifting them if they came after it.
+    size_t relexed;
+    size_t reused;
+    /// The bytes the last edit lexed again, all of them for a new
+    /// stream.
+    TokenChange change;
+} TokenStream;
+
+/// Lexes the len bytes of src into a new stream, copying src. Returns
+/// NULL if lexing or memory allocation fails.
+TokenStream* lex_token_stream(const char* src, size_t len);
+/// Frees a stream with its tokens and source. Safely handles NULL.
+void free_token_stream(TokenStream* stream);
+/// Replaces the removed bytes at offset in the source of a stream with
+/// the insertedLen bytes of inserted, then lexes again from the last
+/// token the edit cannot have changed until the new tokens line up with
+/// the old ones, moving the tokens after that by the size of the edit.
+/// Returns false, leaving the stream as it was, if the edit lies outside
+/// the source or lexing or memory allocation fails.
+bool relex_token_stream(TokenStream* stream, size_t offset, size_t removed,
+    const char* inserted, size_t insertedLen);
+
+#endif // RELEX_H
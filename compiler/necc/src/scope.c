@@ -0,0 +1,178 @@
+#include "scope.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+
+Scope* create_scope(void) {
+    Scope* scope = calloc(1, sizeof(Scope));
+    if (scope == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for scope\n");
+        return NULL;
+    }
+
+    return scope;
+}
+
+void destroy_scope(Scope* scope) {
+    if (scope == NULL) {
+        return;
+    }
+
+    free(scope->symbols);
+    free(scope->frames);
+    free(scope);
+}
+
+bool scope_enter(Scope* scope) {
+    if (scope->frameCount == scope->frameCap) {
+        size_t newCap = scope->frameCap == 0 ? 8 : scope->frameCap * 2;
+        size_t* frames = realloc(scope->frames, newCap * sizeof(size_t));
+        if (frames == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return false;
+        }
+        scope->frames = frames;
+        scope->frameCap = newCap;
+    }
+
+    scope->frames[scope->frameCount++] = scope->symbolCount;
+    return true;
+}
+
+void scope_exit(Scope* scope) {
+    if (scope->frameCount == 0) {
+        return;
+    }
+
+    scope->symbolCount = scope->frames[--scope->frameCount];
+}
+
+Symbol* scope_declare(Scope* scope, const char* name, TokenType type,
+    bool mutable, ASTNode* decl) {
+    if (scope->symbolCount == scope->symbolCap) {
+        size_t newCap = scope->symbolCap == 0 ? 16 : scope->symbolCap * 2;
+        Symbol* symbols = realloc(scope->symbols, newCap * sizeof(Symbol));
+        if (symbols == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return NULL;
+        }
+        scope->symbols = symbols;
+        scope->symbolCap = newCap;
+    }
+
+    Symbol* symbol = &scope->symbols[scope->symbolCount++];
+    symbol->name = name;
+    symbol->type = type;
+    symbol->mutable = mutable;
+    symbol->decl = decl;
+    symbol->value = 0;
+    return symbol;
+}
+
+Symbol* scope_lookup(const Scope* scope, const char* name) {
+    for (size_t i = scope->symbolCount; i > 0; i--) {
+        if (!strcmp(scope->symbols[i - 1].name, name)) {
+            return &scope->symbols[i - 1];
+        }
+    }
+
+    return NULL;
+}
+
+Symbol* scope_lookup_local(const Scope* scope, const char* name) {
+    size_t start = scope->frameCount > 0 ?
+        scope->frames[scope->frameCount - 1] : 0;
+    for (size_t i = scope->symbolCount; i > start; i--) {
+        if (!strcmp(scope->symbols[i - 1].name, name)) {
+            return &scope->symbols[i - 1];
+        }
+    }
+
+    return NULL;
+}
+
+FuncTable* create_func_table(ASTNode* file) {
+    if (file == NULL || file->type != NODE_FILE) {
+        fprintf(stderr, "Error: Function table requires a file node\n");
+        return NULL;
+    }
+
+    FuncTable* table = calloc(1, sizeof(FuncTable));
+    if (table == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for function"\
+            " table\n");
+        return NULL;
+    }
+
+    size_t stmtCount = file->data.file.stmtCount;
+    table->slotCount = 16;
+    while (table->slotCount < stmtCount * 2) {
+        table->slotCount *= 2;
+    }
+
+    table->funcs = malloc((stmtCount + 1) * sizeof(ASTNode*));
+    table->slots = calloc(table->slotCount, sizeof(size_t));
+    if (table->funcs == NULL || table->slots == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        destroy_func_table(table);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < stmtCount; i++) {
+        ASTNode* stmt = file->data.file.stmts[i];
+        if (stmt == NULL || stmt->type != NODE_FUNCTION_DECL ||
+            func_table_index(table, stmt->data.functionDecl.name)
+            != SIZE_MAX) {
+            continue;
+        }
+
+        size_t slot = (size_t)hash_string(HASH_SEED,
+            stmt->data.functionDecl.name) & (table->slotCount - 1);
+        while (table->slots[slot] != 0) {
+            slot = (slot + 1) & (table->slotCount - 1);
+        }
+
+        table->funcs[table->count] = stmt;
+        table->slots[slot] = ++table->count;
+    }
+
+    return table;
+}
+
+void destroy_func_table(FuncTable* table) {
+    if (table == NULL) {
+        return;
+    }
+
+    free(table->funcs);
+    free(table->slots);
+    free(table);
+}
+
+size_t func_table_index(const FuncTable* table, const char* name) {
+    if (table == NULL || name == NULL) {
+        return SIZE_MAX;
+    }
+
+    size_t slot = (size_t)hash_string(HASH_SEED, name) &
+        (table->slotCount - 1);
+    while (table->slots[slot] != 0) {
+        size_t index = table->slots[slot] - 1;
+        if (!strcmp(table->funcs[index]->data.functionDecl.name, name)) {
+            return index;
+        }
+        slot = (slot + 1) & (table->slotCount - 1);
+    }
+
+    return SIZE_MAX;
+}
+
+ASTNode* func_table_lookup(const FuncTable* table, const char* name) {
+    size_t index = func_table_index(table, name);
+    if (index == SIZE_MAX) {
+        return NULL;
+    }
+
+    return table->funcs[index];
+}
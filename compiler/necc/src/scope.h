@@ -0,0 +1,88 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+#include "token.h"
+
+/// A variable or parameter visible in the current scope.
+typedef struct Symbol {
+    /// The name of the symbol, borrowed from its declaration node.
+    const char* name;
+    /// The declared type of the symbol.
+    TokenType type;
+    /// Whether the symbol was declared with mut.
+    bool mutable;
+    /// The declaration node of the symbol.
+    ASTNode* decl;
+    /// Pass specific value attached to the symbol, such as the SSA value
+    /// currently bound to it.
+    uint32_t value;
+} Symbol;
+
+/// A stack of nested block scopes. Lookups search from the innermost
+/// scope outward so inner declarations shadow outer ones.
+typedef struct Scope {
+    /// The declared symbols, innermost last.
+    Symbol* symbols;
+    /// The number of visible symbols.
+    size_t symbolCount;
+    /// The capacity of the symbols array.
+    size_t symbolCap;
+    /// The symbol count at the start of each open block.
+    size_t* frames;
+    /// The number of open blocks.
+    size_t frameCount;
+    /// The capacity of the frames array.
+    size_t frameCap;
+} Scope;
+
+/// Maps function names to their declarations in a file.
+typedef struct FuncTable {
+    /// The function declaration nodes, in file order.
+    ASTNode** funcs;
+    /// The number of functions.
+    size_t count;
+    /// Open addressing hash table of indices into funcs plus one, zero
+    /// marks an empty slot.
+    size_t* slots;
+    /// The number of slots, always a power of two.
+    size_t slotCount;
+} FuncTable;
+
+/// Creates an empty scope stack. Returns NULL on failure.
+Scope* create_scope(void);
+/// Frees the scope stack. Safely handles NULL.
+void destroy_scope(Scope* scope);
+/// Opens a new block scope. Returns false on failure.
+bool scope_enter(Scope* scope);
+/// Closes the innermost block scope, dropping its symbols.
+void scope_exit(Scope* scope);
+/// Declares a symbol in the innermost block scope. The name is borrowed
+/// and must outlive the symbol. Returns the new symbol, which is only
+/// valid until the next declaration, or NULL on failure.
+Symbol* scope_declare(Scope* scope, const char* name, TokenType type,
+    bool mutable, ASTNode* decl);
+/// Returns the innermost visible symbol with the given name, or NULL if
+/// there is none.
+Symbol* scope_lookup(const Scope* scope, const char* name);
+/// Returns the symbol with the given name declared in the innermost block
+/// scope, or NULL if there is none.
+Symbol* scope_lookup_local(const Scope* scope, const char* name);
+
+/// Creates a function table from the function declarations of a file
+/// node. The nodes are borrowed. Duplicate names keep the first
+/// declaration, lowering reports the others. Returns NULL on failure.
+FuncTable* create_func_table(ASTNode* file);
+/// Frees the function table. Safely handles NULL.
+void destroy_func_table(FuncTable* table);
+/// Returns the index of the named function in the table, or SIZE_MAX if
+/// it does not exist.
+size_t func_table_index(const FuncTable* table, const char* name);
+/// Returns the declaration of the named function, or NULL if it does
+/// not exist.
+ASTNode* func_table_lookup(const FuncTable* table, const char* name);
+
+#endif // SCOPE_H
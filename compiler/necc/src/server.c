@@ -0,0 +1,311 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "server.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#define SERVER_SOCKETS 1
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#else
+#define SERVER_SOCKETS 0
+#endif
+
+// Requests run one at a time on the thread reading them, so a handler
+// can keep caches between requests without locking. While a socket
+// request runs, stdout and stderr point at its connection, which sends
+// the client every diagnostic the request prints.
+
+/// The most arguments a request can have, the program name included.
+#define SERVER_MAX_ARGS 256
+/// The longest request line accepted, in bytes.
+#define SERVER_MAX_LINE (1 << 20)
+
+/// Reads a line from input without its newline. Returns NULL at the end
+/// of input or on failure.
+static char* read_line(FILE* input);
+/// Splits a request line into arguments in place and passes them to the
+/// handler. Returns the exit code of the request.
+static int run_request(char* line, ServerHandler handler, void* ctx);
+/// Returns true if a line holds nothing but blanks.
+static bool is_blank(const char* line);
+#if SERVER_SOCKETS
+/// Reads the request line of a connection. Returns NULL on failure.
+static char* read_request(int fd);
+/// Writes all of text to fd. Returns false on failure.
+static bool write_all(int fd, const char* text, size_t len);
+/// Runs the request of a connection, setting stop for "shutdown".
+static void serve_connection(int conn, ServerHandler handler, void* ctx,
+    bool* stop);
+#endif
+
+int server_run_stdio(ServerHandler handler, void* ctx) {
+    FILE* answers = stdout;
+#if SERVER_SOCKETS
+    // Answers keep the original stdout, what requests print goes to
+    // stderr
+    fflush(stdout);
+    int fd = dup(STDOUT_FILENO);
+    answers = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (answers == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        fprintf(stderr, "Error: Failed to set up the server output\n");
+        if (answers != NULL) {
+            fclose(answers);
+        } else if (fd >= 0) {
+            close(fd);
+        }
+        return EXIT_FAILURE;
+    }
+#endif
+
+    char* line;
+    while ((line = read_line(stdin)) != NULL) {
+        if (!is_blank(line)) {
+            int code = run_request(line, handler, ctx);
+            fflush(stdout);
+            fflush(stderr);
+            fprintf(answers, "%d\n", code);
+            fflush(answers);
+        }
+        free(line);
+    }
+
+    if (answers != stdout) {
+        fclose(answers);
+    }
+    return EXIT_SUCCESS;
+}
+
+int server_run_socket(const char* path, ServerHandler handler, void* ctx) {
+#if SERVER_SOCKETS
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path '%s' is too long\n", path);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, path);
+
+    // A socket left behind by a server that did not stop cleanly is
+    // replaced, anything else at the path is an error from bind
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 ||
+        bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(listener, 16) != 0) {
+        fprintf(stderr, "Error: Failed to listen on '%s': %s\n", path,
+            strerror(errno));
+        if (listener >= 0) {
+            close(listener);
+        }
+        return EXIT_FAILURE;
+    }
+
+    // A client going away must not end the server
+    signal(SIGPIPE, SIG_IGN);
+    bool stop = false;
+    int exitCode = EXIT_SUCCESS;
+    while (!stop) {
+        int conn = accept(listener, NULL, NULL);
+        if (conn < 0 && errno == EINTR) {
+            continue;
+        }
+        if (conn < 0) {
+            fprintf(stderr, "Error: Failed to accept a connection: %s\n",
+                strerror(errno));
+            exitCode = EXIT_FAILURE;
+            break;
+        }
+        serve_connection(conn, handler, ctx, &stop);
+        close(conn);
+    }
+
+    close(listener);
+    unlink(path);
+    return exitCode;
+#else
+    (void)path;
+    (void)handler;
+    (void)ctx;
+    fprintf(stderr, "Error: Unix domain sockets are not supported on this"\
+        " platform\n");
+    return EXIT_FAILURE;
+#endif
+}
+
+/* --- Helper Functions --- */
+
+static char* read_line(FILE* input) {
+    size_t len = 0;
+    size_t cap = 256;
+    char* line = malloc(cap);
+    if (line == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return NULL;
+    }
+
+    int c;
+    while ((c = fgetc(input)) != EOF && c != '\n') {
+        if (len + 1 == cap) {
+            char* grown = cap < SERVER_MAX_LINE ? realloc(line, cap * 2) :
+                NULL;
+            if (grown == NULL) {
+                fprintf(stderr, "Error: Request line is too long\n");
+                free(line);
+                return NULL;
+            }
+            line = grown;
+            cap *= 2;
+        }
+        line[len++] = (char)c;
+    }
+    if (c == EOF && len == 0) {
+        free(line);
+        return NULL;
+    }
+    line[len] = '\0';
+    return line;
+}
+
+static int run_request(char* line, ServerHandler handler, void* ctx) {
+    static char program[] = "necc";
+    char* argv[SERVER_MAX_ARGS + 1];
+    int argc = 0;
+    argv[argc++] = program;
+
+    char* c = line;
+    while (*c != '\0') {
+        while (*c == ' ' || *c == '\t' || *c == '\r') {
+            *c++ = '\0';
+        }
+        if (*c == '\0') {
+            break;
+        }
+        if (argc == SERVER_MAX_ARGS) {
+            fprintf(stderr, "Error: Too many arguments in request\n");
+            return EXIT_FAILURE;
+        }
+        argv[argc++] = c;
+        while (*c != '\0' && *c != ' ' && *c != '\t' && *c != '\r') {
+            c++;
+        }
+    }
+    argv[argc] = NULL;
+    return handler(ctx, argc, argv);
+}
+
+static bool is_blank(const char* line) {
+    for (const char* c = line; *c != '\0'; c++) {
+        if (*c != ' ' && *c != '\t' && *c != '\r') {
+            return false;
+        }
+    }
+    return true;
+}
+
+#if SERVER_SOCKETS
+static char* read_request(int fd) {
+    size_t len = 0;
+    size_t cap = 256;
+    char* line = malloc(cap);
+    if (line == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return NULL;
+    }
+
+    for (;;) {
+        if (len + 1 == cap) {
+            char* grown = cap < SERVER_MAX_LINE ? realloc(line, cap * 2) :
+                NULL;
+            if (grown == NULL) {
+                fprintf(stderr, "Error: Request line is too long\n");
+                free(line);
+                return NULL;
+            }
+            line = grown;
+            cap *= 2;
+        }
+        ssize_t got = read(fd, line + len, 1);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0 || line[len] == '\n') {
+            break;
+        }
+        len++;
+    }
+    line[len] = '\0';
+    return line;
+}
+
+static bool write_all(int fd, const char* text, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, text, len);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        text += written;
+        len -= (size_t)written;
+    }
+    return true;
+}
+
+static void serve_connection(int conn, ServerHandler handler, void* ctx,
+    bool* stop) {
+    char* line = read_request(conn);
+    if (line == NULL) {
+        return;
+    }
+
+    int code;
+    char* request = line + strspn(line, " \t");
+    if (strncmp(request, "shutdown", 8) == 0 && is_blank(request + 8)) {
+        *stop = true;
+        code = EXIT_SUCCESS;
+    } else {
+        fflush(stdout);
+        fflush(stderr);
+        int savedOut = dup(STDOUT_FILENO);
+        int savedErr = dup(STDERR_FILENO);
+        bool redirected = savedOut >= 0 && savedErr >= 0 &&
+            dup2(conn, STDOUT_FILENO) >= 0 && dup2(conn, STDERR_FILENO) >= 0;
+
+        code = run_request(line, handler, ctx);
+
+        fflush(stdout);
+        fflush(stderr);
+        if (savedOut >= 0) {
+            dup2(savedOut, STDOUT_FILENO);
+            close(savedOut);
+        }
+        if (savedErr >= 0) {
+            dup2(savedErr, STDERR_FILENO);
+            close(savedErr);
+        }
+        if (!redirected) {
+            fprintf(stderr, "Error: Failed to redirect request output\n");
+        }
+    }
+    free(line);
+
+    char answer[32];
+    int len = snprintf(answer, sizeof(answer), "exit %d\n", code);
+    write_all(conn, answer, (size_t)len);
+}
+#endif
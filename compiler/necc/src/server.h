@@ -0,0 +1,22 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/// Handles a request given as the arguments of a command line, argv[0]
+/// being the program name. Returns the exit code the command would have
+/// had.
+typedef int (*ServerHandler)(void* ctx, int argc, char* argv[]);
+
+/// Serves requests read from stdin until it is closed, one per line of
+/// arguments separated by blanks, answering each with a line holding its
+/// exit code on stdout. What requests print to stdout goes to stderr
+/// instead so it cannot be taken for an answer. Returns the exit code of
+/// the server.
+int server_run_stdio(ServerHandler handler, void* ctx);
+/// Serves requests on a Unix domain socket created at path, one per
+/// connection. A client writes a line of arguments and reads back what
+/// the request printed followed by a line "exit <code>". The request
+/// "shutdown" stops the server and removes the socket. Returns the exit
+/// code of the server.
+int server_run_socket(const char* path, ServerHandler handler, void* ctx);
+
+#endif // SERVER_H
@@ -0,0 +1,8 @@
+#ifndef STATS_H
+#define STATS_H
+
+/// Returns the current time in seconds from a monotonic clock, for
+/// measuring how long compiler phases take.
+double stats_now(void);
+
+#endif // STATS_H
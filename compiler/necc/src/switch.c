@@ -0,0 +1,300 @@
+#include "switch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+
+// Lowering gives every else-if its own block that only compares and
+// branches, so a chain is a path of such blocks along the else edges.
+// The first block of a chain keeps its other instructions and ends in
+// the switch instead of its branch, the rest of the chain is removed
+// and the phis of the case and default blocks take their inputs from
+// the first block.
+
+/// One comparison of a chain.
+typedef struct Case {
+    /// The constant compared against.
+    uint32_t key;
+    /// The block taken when the value equals key.
+    uint32_t target;
+    /// The block making the comparison.
+    uint32_t block;
+} Case;
+
+/// A key and the position of its case, for sorting.
+typedef struct SortKey {
+    Int128 bits;
+    uint32_t index;
+} SortKey;
+
+/// Replaces the chains of a function. Returns the number replaced.
+static size_t form_function(IRFunction* func, uint32_t minCases);
+/// Returns true if a block ends in a branch on value == key or
+/// value != key, describing it in link and the other successor in next.
+static bool match_case(const IRFunction* func, uint32_t block,
+    uint32_t* value, Case* link, uint32_t* next);
+/// Collects the chain starting at head into cases. Blocks of the chain
+/// and case targets are marked while it is collected. Returns the
+/// number of cases, storing the compared value and the block reached
+/// when no case matches.
+static uint32_t collect_chain(const IRFunction* func, const IRCfg* cfg,
+    const uint32_t* uses, bool* marks, uint32_t head, Case* cases,
+    uint32_t* value, uint32_t* defaultBlock);
+/// Shortens a chain so its keys are distinct and the default block is
+/// no case target, a case after a repeated key can never be taken.
+/// Leaves the remaining keys sorted in sorted. Returns the new count.
+static uint32_t trim_chain(const IRFunction* func, const Case* cases,
+    uint32_t count, uint32_t* defaultBlock, SortKey* sorted);
+/// Replaces a trimmed chain with a switch at the end of its first block.
+/// Returns false on allocation failure.
+static bool rewrite_chain(IRFunction* func, const uint32_t* uses,
+    uint32_t value, const Case* cases, uint32_t count,
+    uint32_t defaultBlock, const SortKey* sorted);
+/// Makes the phis of block take the inputs coming from one block from
+/// another one.
+static void retarget_phis(IRFunction* func, uint32_t block, uint32_t from,
+    uint32_t to);
+/// Orders sort keys by signed value, the order of canonical keys up to
+/// 64 bits, then by case position.
+static int compare_keys(const void* a, const void* b);
+
+size_t form_switches(IRModule* module, uint32_t minCases) {
+    size_t formed = 0;
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        formed += form_function_switches(module->funcs[i], minCases);
+    }
+    return formed;
+}
+
+size_t form_function_switches(IRFunction* func, uint32_t minCases) {
+    if (minCases == 0) {
+        return 0;
+    }
+
+    return form_function(func, minCases);
+}
+
+/* --- Helper Functions --- */
+
+static size_t form_function(IRFunction* func, uint32_t minCases) {
+    IRCfg* cfg = create_ir_cfg(func);
+    uint32_t* uses = calloc(func->instCount + 1, sizeof(uint32_t));
+    bool* marks = calloc(func->blockCount + 1, sizeof(bool));
+    Case* cases = malloc((func->blockCount + 1) * sizeof(Case));
+    SortKey* sorted = malloc((func->blockCount + 1) * sizeof(SortKey));
+    bool ok = cfg != NULL && uses != NULL && marks != NULL &&
+        cases != NULL && sorted != NULL;
+    if (!ok && cfg != NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+
+    for (uint32_t i = 0; ok && i < func->instCount; i++) {
+        uint32_t* ops;
+        uint32_t count = ir_get_operands(func, &func->insts[i], &ops);
+        for (uint32_t j = 0; j < count; j++) {
+            if (!ir_is_const(ops[j])) {
+                uses[ops[j]]++;
+            }
+        }
+    }
+
+    size_t formed = 0;
+    for (uint32_t b = 0; ok && b < func->blockCount; b++) {
+        uint32_t value;
+        uint32_t defaultBlock;
+        uint32_t count = collect_chain(func, cfg, uses, marks, b, cases,
+            &value, &defaultBlock);
+        for (uint32_t k = 0; k < count; k++) {
+            marks[cases[k].block] = false;
+            marks[cases[k].target] = false;
+        }
+        if (count == 0 || defaultBlock == b) {
+            continue;
+        }
+
+        count = trim_chain(func, cases, count, &defaultBlock, sorted);
+        if (count >= minCases) {
+            ok = rewrite_chain(func, uses, value, cases, count, defaultBlock,
+                sorted);
+            formed += ok ? 1 : 0;
+        }
+    }
+
+    free_ir_cfg(cfg);
+    free(uses);
+    free(marks);
+    free(cases);
+    free(sorted);
+    if (formed > 0 && !ir_compact(func)) {
+        return 0;
+    }
+    return formed;
+}
+
+static bool match_case(const IRFunction* func, uint32_t block,
+    uint32_t* value, Case* link, uint32_t* next) {
+    const IRBlock* range = &func->blocks[block];
+    if (range->start == IR_NONE || range->start == range->end) {
+        return false;
+    }
+    const IRInst* branch = &func->insts[range->end - 1];
+    if (branch->op != IR_BR || ir_is_const(branch->args[0])) {
+        return false;
+    }
+    const IRInst* compare = &func->insts[branch->args[0]];
+    if (compare->op != IR_EQ && compare->op != IR_NEQ) {
+        return false;
+    }
+
+    uint32_t operand = compare->args[0];
+    uint32_t key = compare->args[1];
+    if (ir_is_const(operand)) {
+        operand = compare->args[1];
+        key = compare->args[0];
+    }
+    TokenType type = ir_value_type(func, operand);
+    if (ir_is_const(operand) || !ir_is_const(key) ||
+        !type_is_integer(type) || type_bit_width(type) > 64) {
+        return false;
+    }
+
+    const uint32_t* targets = func->operands + branch->args[1];
+    bool isEq = compare->op == IR_EQ;
+    *value = operand;
+    link->key = key;
+    link->target = targets[isEq ? 0 : 1];
+    link->block = block;
+    *next = targets[isEq ? 1 : 0];
+    return link->target != *next;
+}
+
+static uint32_t collect_chain(const IRFunction* func, const IRCfg* cfg,
+    const uint32_t* uses, bool* marks, uint32_t head, Case* cases,
+    uint32_t* value, uint32_t* defaultBlock) {
+    uint32_t next;
+    if (!match_case(func, head, value, &cases[0], &next)) {
+        return 0;
+    }
+    marks[head] = true;
+    marks[cases[0].target] = true;
+
+    // Every later block must hold only the comparison feeding its branch,
+    // so removing it loses nothing
+    uint32_t count = 1;
+    for (;;) {
+        const IRBlock* range = &func->blocks[next];
+        uint32_t other;
+        uint32_t after;
+        if (marks[next] || cfg->predStart[next + 1] -
+            cfg->predStart[next] != 1 || range->start == IR_NONE ||
+            range->end - range->start != 2 ||
+            !match_case(func, next, &other, &cases[count], &after) ||
+            other != *value || uses[range->start] != 1 ||
+            func->insts[range->start + 1].args[0] != range->start ||
+            marks[cases[count].target]) {
+            break;
+        }
+        marks[next] = true;
+        marks[cases[count].target] = true;
+        count++;
+        next = after;
+    }
+    *defaultBlock = next;
+    return count;
+}
+
+static uint32_t trim_chain(const IRFunction* func, const Case* cases,
+    uint32_t count, uint32_t* defaultBlock, SortKey* sorted) {
+    // The last comparison can fall through to an earlier case
+    uint32_t cut = count;
+    for (uint32_t k = 0; k < count; k++) {
+        if (cases[k].target == *defaultBlock) {
+            cut = k;
+        }
+        sorted[k].bits = ir_get_const(func, cases[k].key)->bits;
+        sorted[k].index = k;
+    }
+
+    qsort(sorted, count, sizeof(SortKey), compare_keys);
+    for (uint32_t k = 1; k < count; k++) {
+        if (i128_eq(sorted[k].bits, sorted[k - 1].bits) &&
+            sorted[k].index < cut) {
+            cut = sorted[k].index;
+        }
+    }
+    if (cut == count) {
+        return count;
+    }
+
+    // The block testing the first dropped key becomes the default
+    *defaultBlock = cases[cut].block;
+    uint32_t kept = 0;
+    for (uint32_t k = 0; k < count; k++) {
+        if (sorted[k].index < cut) {
+            sorted[kept++] = sorted[k];
+        }
+    }
+    return kept;
+}
+
+static bool rewrite_chain(IRFunction* func, const uint32_t* uses,
+    uint32_t value, const Case* cases, uint32_t count,
+    uint32_t defaultBlock, const SortKey* sorted) {
+    uint32_t* words = malloc((count * 2 + 2) * sizeof(uint32_t));
+    if (words == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+    words[0] = count;
+    words[1] = defaultBlock;
+    for (uint32_t k = 0; k < count; k++) {
+        words[2 + k] = cases[sorted[k].index].target;
+        words[2 + count + k] = cases[sorted[k].index].key;
+    }
+    uint32_t start = ir_add_operands(func, words, count * 2 + 2);
+    free(words);
+    if (start == IR_NONE) {
+        return false;
+    }
+
+    uint32_t head = cases[0].block;
+    for (uint32_t k = 1; k < count; k++) {
+        retarget_phis(func, cases[k].target, cases[k].block, head);
+        func->blocks[cases[k].block].start = IR_NONE;
+    }
+    retarget_phis(func, defaultBlock, cases[count - 1].block, head);
+
+    IRInst* branch = &func->insts[func->blocks[head].end - 1];
+    if (uses[branch->args[0]] == 1) {
+        func->insts[branch->args[0]].op = IR_NOP;
+    }
+    branch->op = IR_SWITCH;
+    branch->args[0] = value;
+    branch->args[1] = start;
+    return true;
+}
+
+static void retarget_phis(IRFunction* func, uint32_t block, uint32_t from,
+    uint32_t to) {
+    for (uint32_t i = func->blocks[block].start; i < func->blocks[block].end &&
+        func->insts[i].op == IR_PHI; i++) {
+        uint32_t* blocks = func->operands + func->insts[i].args[0];
+        for (uint32_t k = 0; k < func->insts[i].args[1]; k++) {
+            if (blocks[k] == from) {
+                blocks[k] = to;
+            }
+        }
+    }
+}
+
+static int compare_keys(const void* a, const void* b) {
+    const SortKey* left = a;
+    const SortKey* right = b;
+    if (i128_slt(left->bits, right->bits)) {
+        return -1;
+    }
+    if (i128_slt(right->bits, left->bits)) {
+        return 1;
+    }
+    return left->index < right->index ? -1 : left->index > right->index;
+}
@@ -0,0 +1,24 @@
+#ifndef SWITCH_H
+#define SWITCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ir.h"
+
+/// The fewest cases an else-if chain needs to become a switch.
+#define SWITCH_MIN_CASES 4
+
+/// Turns else-if chains comparing one integer value against distinct
+/// constants into switches. A chain starts at any branch on value == key
+/// or value != key and continues through blocks holding nothing but the
+/// next such comparison of the same value, reached only from the block
+/// before them. Chains of at least minCases keys become a single
+/// IR_SWITCH, which the backends dispatch through a jump table when the
+/// keys are dense and a binary search otherwise. A minCases of 0
+/// disables the pass. Returns the number of chains replaced.
+size_t form_switches(IRModule* module, uint32_t minCases);
+/// Turns the else-if chains of a single function into switches like
+/// form_switches(). Returns the number of chains replaced.
+size_t form_function_switches(IRFunction* func, uint32_t minCases);
+
+#endif // SWITCH_H
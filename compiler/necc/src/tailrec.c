@@ -0,0 +1,349 @@
+#include "tailrec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+
+// A rewritten function gets a new entry block holding its parameters,
+// and the old entry block becomes the loop header. Every parameter is
+// replaced with a phi there, fed by the real parameter from the entry
+// and by the arguments of each removed call, and the accumulator is one
+// more phi starting at the identity of its op. Each removed call ends
+// its block with an unconditional jump back to the header, the backends
+// rely on backward branches never being conditional.
+
+/// The calls of a function that can become jumps.
+typedef struct Sites {
+    /// The recursive call ending each block, IR_NONE for blocks without
+    /// one.
+    uint32_t* calls;
+    uint32_t count;
+    /// IR_ADD or IR_MUL if some call is combined into an accumulator,
+    /// IR_NOP otherwise.
+    IROp accOp;
+} Sites;
+
+/// Rewrites the recursion at the end of a function into a loop. Returns
+/// the number of calls replaced, 0 if there are none or on failure,
+/// which leaves the function unchanged.
+static size_t rewrite_function(IRModule* module, uint32_t index);
+/// Finds the recursive calls of a function that can become jumps.
+/// Returns false on allocation failure.
+static bool find_sites(const IRFunction* func, uint32_t index,
+    Sites* sites);
+/// Builds the looping form of a function. Returns NULL on failure.
+static IRFunction* build_loop(const IRFunction* func, const Sites* sites);
+/// Returns the value of the new function standing for a value of the old
+/// one.
+static uint32_t map_value(IRFunction* out, const IRFunction* func,
+    const uint32_t* map, uint32_t value);
+
+size_t eliminate_tail_recursion(IRModule* module) {
+    size_t replaced = 0;
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        replaced += eliminate_function_tail_recursion(module, i);
+    }
+    return replaced;
+}
+
+size_t eliminate_function_tail_recursion(IRModule* module, uint32_t index) {
+    return rewrite_function(module, index);
+}
+
+/* --- Helper Functions --- */
+
+static size_t rewrite_function(IRModule* module, uint32_t index) {
+    IRFunction* func = module->funcs[index];
+    Sites sites;
+    if (!find_sites(func, index, &sites)) {
+        return 0;
+    }
+    if (sites.count == 0) {
+        free(sites.calls);
+        return 0;
+    }
+
+    IRFunction* loop = build_loop(func, &sites);
+    size_t count = sites.count;
+    free(sites.calls);
+    if (loop == NULL) {
+        return 0;
+    }
+
+    free_ir_function(func);
+    module->funcs[index] = loop;
+    return count;
+}
+
+static bool find_sites(const IRFunction* func, uint32_t index,
+    Sites* sites) {
+    sites->calls = malloc((func->blockCount + 1) * sizeof(uint32_t));
+    sites->count = 0;
+    sites->accOp = IR_NOP;
+    if (sites->calls == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    // A value defined in a block ending in a return cannot be used in
+    // any other block, so the return is the only use the shapes below
+    // need to rule out
+    for (uint32_t b = 0; b < func->blockCount; b++) {
+        const IRBlock* block = &func->blocks[b];
+        const IRInst* ret = &func->insts[block->end - 1];
+        uint32_t value = ret->args[0];
+        uint32_t call = block->end - 2;
+        sites->calls[b] = IR_NONE;
+        if (ret->op != IR_RET || block->end - block->start < 2) {
+            continue;
+        }
+
+        // return f(...), or f(...) followed by a bare return
+        const IRInst* inst = &func->insts[call];
+        if (inst->op == IR_CALL && func->operands[inst->args[0]] == index &&
+            (value == call || (value == IR_NONE &&
+            func->returnType == TOK_INVALID))) {
+            sites->calls[b] = call;
+            sites->count++;
+            continue;
+        }
+
+        // return x op f(...) or f(...) op x, for a single op per function
+        call = block->end - 3;
+        if (value != block->end - 2 || block->end - block->start < 3 ||
+            !type_is_integer(func->returnType)) {
+            continue;
+        }
+        const IRInst* combine = &func->insts[value];
+        inst = &func->insts[call];
+        bool isAcc = (combine->op == IR_ADD || combine->op == IR_MUL) &&
+            (sites->accOp == IR_NOP || combine->op == sites->accOp) &&
+            inst->op == IR_CALL && func->operands[inst->args[0]] == index &&
+            (combine->args[0] == call) != (combine->args[1] == call);
+        if (isAcc) {
+            sites->accOp = (IROp)combine->op;
+            sites->calls[b] = call;
+            sites->count++;
+        }
+    }
+    return true;
+}
+
+static IRFunction* build_loop(const IRFunction* func, const Sites* sites) {
+    uint32_t paramCount = func->paramCount;
+    uint32_t phiCount = paramCount + (sites->accOp != IR_NOP ? 1 : 0);
+    uint32_t inputs = sites->count + 1;
+    IRFunction* out = create_ir_function(func->name, func->returnType,
+        func->paramTypes, paramCount);
+    uint32_t* map = malloc((func->instCount + 1) * sizeof(uint32_t));
+    uint32_t* blocks = malloc((func->blockCount + 1) * sizeof(uint32_t));
+    // The incoming blocks of the header phis, then the incoming values
+    // of each phi
+    uint32_t* fromBlocks = malloc(inputs * sizeof(uint32_t));
+    uint32_t* fromValues = malloc(inputs * (phiCount + 1) *
+        sizeof(uint32_t));
+    uint32_t* phis = malloc((phiCount + 1) * sizeof(uint32_t));
+    bool ok = out != NULL && map != NULL && blocks != NULL &&
+        fromBlocks != NULL && fromValues != NULL && phis != NULL;
+    if (!ok && out != NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+
+    uint32_t entry = ok ? ir_add_block(out) : IR_NONE;
+    ok = ok && entry != IR_NONE;
+    for (uint32_t b = 0; ok && b < func->blockCount; b++) {
+        blocks[b] = ir_add_block(out);
+        ok = blocks[b] != IR_NONE;
+    }
+
+    if (ok) {
+        ir_set_block(out, entry);
+        fromBlocks[0] = entry;
+        for (uint32_t k = 0; ok && k < paramCount; k++) {
+            fromValues[k * inputs] = ir_emit(out, IR_PARAM,
+                func->paramTypes[k], k, 0);
+            ok = fromValues[k * inputs] != IR_NONE;
+        }
+        if (ok && sites->accOp != IR_NOP) {
+            ConstValue identity = {
+                i128_from_u64(sites->accOp == IR_MUL ? 1 : 0), 0.0,
+            };
+            fromValues[paramCount * inputs] = ir_const(out,
+                func->returnType, identity);
+            ok = fromValues[paramCount * inputs] != IR_NONE;
+        }
+        ir_emit_jmp(out, blocks[0]);
+    }
+
+    // The header phis start out with only their entry input, the rest is
+    // filled in below
+    if (ok) {
+        ir_set_block(out, blocks[0]);
+        for (uint32_t k = 0; ok && k < phiCount; k++) {
+            for (uint32_t s = 1; s < inputs; s++) {
+                fromBlocks[s] = entry;
+                fromValues[k * inputs + s] = fromValues[k * inputs];
+            }
+            TokenType type = k < paramCount ? func->paramTypes[k] :
+                func->returnType;
+            phis[k] = ir_emit_phi(out, type, fromBlocks,
+                &fromValues[k * inputs], inputs);
+            ok = phis[k] != IR_NONE;
+        }
+    }
+    uint32_t acc = ok && sites->accOp != IR_NOP ? phis[paramCount] :
+        IR_NONE;
+
+    uint32_t site = 1;
+    for (uint32_t b = 0; ok && b < func->blockCount; b++) {
+        if (b > 0) {
+            ir_set_block(out, blocks[b]);
+        }
+        for (uint32_t i = func->blocks[b].start; ok &&
+            i < func->blocks[b].end; i++) {
+            const IRInst* inst = &func->insts[i];
+            TokenType type = (TokenType)inst->type;
+            uint32_t value = IR_NONE;
+
+            if (i == sites->calls[b]) {
+                const uint32_t* args = func->operands + inst->args[0] + 1;
+                for (uint32_t k = 0; k < paramCount; k++) {
+                    fromValues[k * inputs + site] = map_value(out, func, map,
+                        args[k]);
+                }
+                if (acc != IR_NONE) {
+                    // The op of a combined call follows it, the other
+                    // operand is folded into the accumulator
+                    const IRInst* combine = &func->insts[i + 1];
+                    uint32_t next = acc;
+                    if (combine->op != IR_RET) {
+                        uint32_t x = combine->args[0] == i ?
+                            combine->args[1] : combine->args[0];
+                        next = ir_emit(out, sites->accOp, func->returnType,
+                            acc, map_value(out, func, map, x));
+                        ok = next != IR_NONE;
+                    }
+                    fromValues[paramCount * inputs + site] = next;
+                }
+                fromBlocks[site++] = out->curBlock;
+                ir_emit_jmp(out, blocks[0]);
+                break;
+            }
+
+            switch ((IROp)inst->op) {
+                case IR_PARAM:
+                    value = phis[inst->args[0]];
+                    break;
+                case IR_PHI:
+                    // Patched below
+                    value = ir_emit_phi(out, type,
+                        &func->operands[inst->args[0]],
+                        &func->operands[inst->args[0] + inst->args[1]],
+                        inst->args[1]);
+                    ok = value != IR_NONE;
+                    break;
+                case IR_CALL: {
+                    uint32_t count = inst->args[1];
+                    uint32_t* args = malloc((count + 1) * sizeof(uint32_t));
+                    ok = args != NULL;
+                    for (uint32_t k = 0; ok && k < count; k++) {
+                        args[k] = map_value(out, func, map,
+                            func->operands[inst->args[0] + 1 + k]);
+                    }
+                    if (ok) {
+                        value = ir_emit_call(out, type,
+                            func->operands[inst->args[0]], args, count);
+                        ok = value != IR_NONE;
+                    } else {
+                        fprintf(stderr, "Error: Memory allocation failed\n");
+                    }
+                    free(args);
+                    break;
+                }
+                case IR_JMP:
+                    ir_emit_jmp(out, blocks[inst->args[0]]);
+                    break;
+                case IR_BR:
+                    ir_emit_br(out, map_value(out, func, map, inst->args[0]),
+                        blocks[func->operands[inst->args[1]]],
+                        blocks[func->operands[inst->args[1] + 1]]);
+                    break;
+                case IR_SWITCH:
+                    ok = ir_copy_switch(out, func, inst,
+                        map_value(out, func, map, inst->args[0]), blocks);
+                    break;
+                case IR_RET:
+                    value = map_value(out, func, map, inst->args[0]);
+                    if (acc != IR_NONE) {
+                        value = ir_emit(out, sites->accOp, func->returnType,
+                            acc, value);
+                        ok = value != IR_NONE;
+                    }
+                    ir_emit_ret(out, value);
+                    value = IR_NONE;
+                    break;
+                default: {
+                    // Arithmetic, comparisons and casts keep their
+                    // operands in args
+                    IRInst copy = *inst;
+                    uint32_t* ops;
+                    uint32_t count = ir_get_operands(out, &copy, &ops);
+                    for (uint32_t k = 0; k < count; k++) {
+                        ops[k] = map_value(out, func, map, ops[k]);
+                    }
+                    value = ir_emit(out, (IROp)inst->op, type, copy.args[0],
+                        copy.args[1]);
+                    ok = value != IR_NONE;
+                    break;
+                }
+            }
+            map[i] = value;
+        }
+    }
+
+    for (uint32_t i = 0; ok && i < func->instCount; i++) {
+        const IRInst* inst = &func->insts[i];
+        if (inst->op != IR_PHI) {
+            continue;
+        }
+        uint32_t start = out->insts[map[i]].args[0];
+        uint32_t count = inst->args[1];
+        for (uint32_t k = 0; k < count; k++) {
+            uint32_t value = map_value(out, func, map,
+                func->operands[inst->args[0] + count + k]);
+            out->operands[start + k] =
+                blocks[func->operands[inst->args[0] + k]];
+            out->operands[start + count + k] = value;
+        }
+    }
+    for (uint32_t k = 0; ok && k < phiCount; k++) {
+        uint32_t start = out->insts[phis[k]].args[0];
+        memcpy(&out->operands[start], fromBlocks, inputs * sizeof(uint32_t));
+        memcpy(&out->operands[start + inputs], &fromValues[k * inputs],
+            inputs * sizeof(uint32_t));
+    }
+
+    ok = ok && ir_compact(out);
+    free(map);
+    free(blocks);
+    free(fromBlocks);
+    free(fromValues);
+    free(phis);
+    if (!ok) {
+        free_ir_function(out);
+        return NULL;
+    }
+    return out;
+}
+
+static uint32_t map_value(IRFunction* out, const IRFunction* func,
+    const uint32_t* map, uint32_t value) {
+    if (value == IR_NONE) {
+        return IR_NONE;
+    }
+    if (ir_is_const(value)) {
+        return ir_const(out, ir_get_const(func, value)->type,
+            ir_const_value(func, value));
+    }
+    return map[value];
+}
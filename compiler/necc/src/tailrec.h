@@ -0,0 +1,23 @@
+#ifndef TAILREC_H
+#define TAILREC_H
+
+#include <stddef.h>
+#include "ir.h"
+
+/// Turns self recursion at the end of functions into loops. A call of
+/// the function itself whose result is returned right away becomes a
+/// jump back to the start with the arguments as the new parameters. A
+/// call whose result is added to or multiplied by another integer right
+/// before being returned, such as `return n * f(n - 1)`, is rewritten
+/// the same way with an accumulator that every other return of the
+/// function is combined with, which is correct because integer addition
+/// and multiplication wrap and are associative. A function whose
+/// recursive calls all go away runs in constant stack space. Returns the
+/// number of calls that were replaced with jumps.
+size_t eliminate_tail_recursion(IRModule* module);
+/// Rewrites the self recursion of function index of the module like
+/// eliminate_tail_recursion(), replacing the function in the module.
+/// Returns the number of calls that were replaced with jumps.
+size_t eliminate_function_tail_recursion(IRModule* module, uint32_t index);
+
+#endif // TAILREC_H
@@ -0,0 +1,341 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "tier.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "elf.h"
+#include "jit.h"
+#include "stats.h"
+#include "vm.h"
+#include "x64.h"
+
+#ifndef _WIN32
+#define TIER_THREADS 1
+#include <pthread.h>
+#else
+#define TIER_THREADS 0
+#endif
+
+// The interpreter thread only counts and queues hot functions, the
+// compiler thread builds their native code and publishes each entry
+// with a release store the interpreter's calls pair with an acquire
+// load. Native code never calls back into the interpreter, so a hot
+// function is compiled together with every interpreted function it can
+// reach, and functions that already have native code are linked to it.
+// All native code stays mapped until the program has finished.
+
+/// A function getting hot and moving to native code.
+typedef struct TierEvent {
+    uint32_t func;
+    /// True if backward jumps triggered it rather than calls.
+    bool fromLoops;
+    /// Set by the compiler thread once it is done with the function.
+    bool done;
+    bool failed;
+    /// The number of functions compiled with it, 0 if another hot
+    /// function already brought it to native code.
+    uint32_t compiled;
+    /// When it got hot and when its code was published, in seconds from
+    /// the start of the run.
+    double queued;
+    double published;
+} TierEvent;
+
+typedef struct Tier {
+    const IRModule* ir;
+    const TierOptions* options;
+    VMTier vm;
+    double start;
+    /// The native code of each function, only used by the compiler
+    /// thread.
+    void** natives;
+    JitModule** jits;
+    uint32_t jitCount;
+
+    /// One event per hot function, appended by the interpreter.
+    TierEvent* events;
+    uint32_t eventCount;
+    /// Events waiting for the compiler thread. Every function is queued
+    /// at most once, so funcCount entries are enough.
+    uint32_t* queue;
+    uint32_t queueHead;
+    uint32_t queueTail;
+    bool* queued;
+    bool stop;
+#if TIER_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+#endif
+} Tier;
+
+/// Queues a function that crossed a threshold. Runs on the interpreter
+/// thread.
+static void on_hot(void* ctx, uint32_t func);
+/// Builds and publishes the native code of the function of an event and
+/// the interpreted functions it reaches.
+static void compile_hot(Tier* tier, TierEvent* event);
+/// Returns the native code of a function by name, the JitResolver used
+/// to link new code to older code.
+static void* resolve_native(void* ctx, const char* name);
+/// Prints the tier-up events.
+static void print_events(const Tier* tier);
+/// Publishes the native entry of a function to the interpreter.
+static void publish_entry(void** entry, void* address);
+#if TIER_THREADS
+/// The compiler thread, working through the queue until stopped.
+static void* compile_thread(void* arg);
+#endif
+
+bool tier_run(const IRModule* ir, const BCModule* bytecode, uint32_t entry,
+    const TierOptions* options, VMValue* result) {
+    uint32_t n = ir->funcCount + 1;
+    Tier tier;
+    memset(&tier, 0, sizeof(Tier));
+    tier.ir = ir;
+    tier.options = options;
+    tier.vm.entries = calloc(n, sizeof(void*));
+    tier.vm.calls = calloc(n, sizeof(uint32_t));
+    tier.vm.loops = calloc(n, sizeof(uint32_t));
+    tier.vm.callThreshold = options->callThreshold;
+    tier.vm.loopThreshold = options->loopThreshold;
+    tier.vm.hot = on_hot;
+    tier.vm.ctx = &tier;
+    tier.natives = calloc(n, sizeof(void*));
+    tier.jits = calloc(n, sizeof(JitModule*));
+    tier.events = calloc(n, sizeof(TierEvent));
+    tier.queue = calloc(n, sizeof(uint32_t));
+    tier.queued = calloc(n, sizeof(bool));
+
+    bool ok = tier.vm.entries != NULL && tier.vm.calls != NULL &&
+        tier.vm.loops != NULL && tier.natives != NULL && tier.jits != NULL &&
+        tier.events != NULL && tier.queue != NULL && tier.queued != NULL;
+    if (!ok) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+
+    // Without a compiler thread the program is only interpreted
+    bool threaded = false;
+#if TIER_THREADS
+    if (ok && jit_is_supported()) {
+        threaded = pthread_mutex_init(&tier.lock, NULL) == 0;
+        if (threaded && pthread_cond_init(&tier.wake, NULL) != 0) {
+            pthread_mutex_destroy(&tier.lock);
+            threaded = false;
+        }
+        if (threaded && pthread_create(&tier.thread, NULL, compile_thread,
+            &tier) != 0) {
+            pthread_cond_destroy(&tier.wake);
+            pthread_mutex_destroy(&tier.lock);
+            threaded = false;
+        }
+    }
+#endif
+
+    if (ok) {
+        tier.start = stats_now();
+        ok = vm_run_tiered(bytecode, entry, NULL, result,
+            threaded ? &tier.vm : NULL);
+    }
+
+#if TIER_THREADS
+    if (threaded) {
+        // A compilation in progress finishes, queued ones are dropped
+        pthread_mutex_lock(&tier.lock);
+        tier.stop = true;
+        pthread_cond_signal(&tier.wake);
+        pthread_mutex_unlock(&tier.lock);
+        pthread_join(tier.thread, NULL);
+        pthread_cond_destroy(&tier.wake);
+        pthread_mutex_destroy(&tier.lock);
+    }
+#endif
+
+    if (options->stats && tier.events != NULL) {
+        print_events(&tier);
+    }
+
+    for (uint32_t i = 0; i < tier.jitCount; i++) {
+        free_jit_module(tier.jits[i]);
+    }
+    free(tier.vm.entries);
+    free(tier.vm.calls);
+    free(tier.vm.loops);
+    free(tier.natives);
+    free(tier.jits);
+    free(tier.events);
+    free(tier.queue);
+    free(tier.queued);
+    return ok;
+}
+
+/* --- Helper Functions --- */
+
+static void on_hot(void* ctx, uint32_t func) {
+#if TIER_THREADS
+    Tier* tier = ctx;
+    pthread_mutex_lock(&tier->lock);
+    if (!tier->queued[func]) {
+        tier->queued[func] = true;
+        TierEvent* event = &tier->events[tier->eventCount];
+        event->func = func;
+        event->fromLoops = tier->vm.loops[func] >= tier->vm.loopThreshold;
+        event->queued = stats_now() - tier->start;
+        tier->queue[tier->queueTail++] = tier->eventCount++;
+        pthread_cond_signal(&tier->wake);
+    }
+    pthread_mutex_unlock(&tier->lock);
+#else
+    (void)ctx;
+    (void)func;
+#endif
+}
+
+static void compile_hot(Tier* tier, TierEvent* event) {
+    const IRModule* ir = tier->ir;
+    uint32_t n = ir->funcCount;
+    bool* include = calloc(n + 1, sizeof(bool));
+    uint32_t* members = malloc((n + 1) * sizeof(uint32_t));
+    ElfObject* obj = create_elf_object();
+    if (include == NULL || members == NULL || obj == NULL) {
+        if (obj != NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+        }
+        free(include);
+        free(members);
+        free_elf_object(obj);
+        event->failed = true;
+        event->done = true;
+        return;
+    }
+
+    // Collect the interpreted functions reachable from the hot one,
+    // members doubles as the work list
+    uint32_t count = 0;
+    if (tier->natives[event->func] == NULL) {
+        include[event->func] = true;
+        members[count++] = event->func;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        IRFunction* func = ir->funcs[members[i]];
+        for (uint32_t j = 0; j < func->instCount; j++) {
+            const IRInst* inst = &func->insts[j];
+            if (inst->op != IR_CALL) {
+                continue;
+            }
+            uint32_t callee = func->operands[inst->args[0]];
+            if (!include[callee] && tier->natives[callee] == NULL) {
+                include[callee] = true;
+                members[count++] = callee;
+            }
+        }
+    }
+
+    char** names = calloc(count + 1, sizeof(char*));
+    bool ok = names != NULL;
+    for (uint32_t i = 0; ok && i < count; i++) {
+        // Entry names are not valid NeoC identifiers, so they never clash
+        const char* name = ir->funcs[members[i]]->name;
+        size_t len = strlen(name);
+        names[i] = malloc(len + 7);
+        ok = names[i] != NULL;
+        if (ok) {
+            memcpy(names[i], name, len);
+            memcpy(names[i] + len, ".entry", 7);
+            ok = x64_compile_function(ir, members[i], obj,
+                tier->options->allocateRegs, tier->options->peephole) &&
+                x64_compile_entry(ir, members[i], names[i], obj);
+        }
+    }
+
+    JitModule* jit = ok && count > 0 ?
+        jit_load(obj, resolve_native, tier) : NULL;
+    if (jit != NULL) {
+        tier->jits[tier->jitCount++] = jit;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t func = members[i];
+            uint32_t symbol = elf_symbol(obj, ir->funcs[func]->name);
+            uint32_t entry = elf_symbol(obj, names[i]);
+            tier->natives[func] = jit->addresses[symbol];
+            publish_entry(&tier->vm.entries[func], jit->addresses[entry]);
+        }
+    }
+
+    event->failed = count > 0 && jit == NULL;
+    event->compiled = jit != NULL ? count : 0;
+    event->published = stats_now() - tier->start;
+    event->done = true;
+
+    for (uint32_t i = 0; names != NULL && i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    free(include);
+    free(members);
+    free_elf_object(obj);
+}
+
+static void* resolve_native(void* ctx, const char* name) {
+    const Tier* tier = ctx;
+    for (uint32_t i = 0; i < tier->ir->funcCount; i++) {
+        if (strcmp(tier->ir->funcs[i]->name, name) == 0) {
+            return tier->natives[i];
+        }
+    }
+    return NULL;
+}
+
+static void print_events(const Tier* tier) {
+    for (uint32_t i = 0; i < tier->eventCount; i++) {
+        const TierEvent* event = &tier->events[i];
+        fprintf(stderr, "Tier-up: '%s' after %u %s at %.3f ms",
+            tier->ir->funcs[event->func]->name,
+            event->fromLoops ? tier->vm.loopThreshold :
+            tier->vm.callThreshold,
+            event->fromLoops ? "backward jump(s)" : "call(s)",
+            event->queued * 1000.0);
+        if (!event->done) {
+            fprintf(stderr, ", still queued at exit\n");
+        } else if (event->failed) {
+            fprintf(stderr, ", compilation failed\n");
+        } else if (event->compiled == 0) {
+            fprintf(stderr, ", already native\n");
+        } else {
+            fprintf(stderr, ", native at %.3f ms with %u function(s)\n",
+                event->published * 1000.0, event->compiled);
+        }
+    }
+}
+
+static void publish_entry(void** entry, void* address) {
+#ifdef __GNUC__
+    __atomic_store_n(entry, address, __ATOMIC_RELEASE);
+#else
+    *(void* volatile*)entry = address;
+#endif
+}
+
+#if TIER_THREADS
+static void* compile_thread(void* arg) {
+    Tier* tier = arg;
+    pthread_mutex_lock(&tier->lock);
+    for (;;) {
+        while (!tier->stop && tier->queueHead == tier->queueTail) {
+            pthread_cond_wait(&tier->wake, &tier->lock);
+        }
+        if (tier->stop) {
+            break;
+        }
+
+        TierEvent* event = &tier->events[tier->queue[tier->queueHead++]];
+        pthread_mutex_unlock(&tier->lock);
+        compile_hot(tier, event);
+        pthread_mutex_lock(&tier->lock);
+    }
+    pthread_mutex_unlock(&tier->lock);
+    return NULL;
+}
+#endif
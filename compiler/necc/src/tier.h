@@ -0,0 +1,36 @@
+#ifndef TIER_H
+#define TIER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bytecode.h"
+#include "ir.h"
+
+/// The default number of calls before a function is compiled.
+#define TIER_CALL_THRESHOLD 1000
+/// The default number of backward jumps before a function is compiled.
+#define TIER_LOOP_THRESHOLD 10000
+
+typedef struct TierOptions {
+    /// Calls and backward jumps after which a function is compiled.
+    uint32_t callThreshold;
+    uint32_t loopThreshold;
+    /// Passed on to the x86-64 backend.
+    bool allocateRegs;
+    bool peephole;
+    /// Prints every tier-up to stderr once the program has finished.
+    bool stats;
+} TierOptions;
+
+/// Runs function entry of the bytecode in the interpreter while a
+/// background thread compiles functions that get hot to native code.
+/// A hot function is compiled together with every function it can reach
+/// that is still interpreted, and calls from the interpreter switch to
+/// the native code as soon as it is published. Functions whose native
+/// code cannot be built stay interpreted. Without threads or JIT support
+/// everything is interpreted. The IR must outlive the run. Returns false
+/// if the program panics.
+bool tier_run(const IRModule* ir, const BCModule* bytecode, uint32_t entry,
+    const TierOptions* options, VMValue* result);
+
+#endif // TIER_H
@@ -13,6 +13,8 @@ Token* create_token(TokenType type, char* ident, size_t line, size_t column) {
     token->ident = ident;
     token->line = line;
     token->column = column;
+    token->offset = 0;
+    token->length = 0;
 
     return token;
 }
@@ -94,6 +94,10 @@ typedef struct Token {
     size_t line;
     /// Column number where the token started.
     size_t column;
+    /// Byte offset of the token in the source and its length in bytes,
+    /// set by the lexer.
+    size_t offset;
+    size_t length;
 } Token;
 
 /// Creates a new token, identifier can be NULL but if not, it is
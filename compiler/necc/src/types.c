@@ -0,0 +1,259 @@
+#include "types.h"
+
+/// Returns true if the type is one of the pseudo literal types.
+static bool is_literal_type(TokenType type);
+
+size_t type_bit_width(TokenType type) {
+    switch (type) {
+        case TOK_BOOL:
+        case TOK_CHAR:
+        case TOK_I8:
+        case TOK_U8:
+            return 8;
+        case TOK_I16:
+        case TOK_U16:
+            return 16;
+        case TOK_I32:
+        case TOK_U32:
+        case TOK_F32:
+            return 32;
+        case TOK_I64:
+        case TOK_U64:
+        case TOK_F64:
+            return 64;
+        case TOK_I128:
+        case TOK_U128:
+            return 128;
+        default:
+            return 0;
+    }
+}
+
+bool type_is_integer(TokenType type) {
+    switch (type) {
+        case TOK_I8:
+        case TOK_I16:
+        case TOK_I32:
+        case TOK_I64:
+        case TOK_I128:
+        case TOK_U8:
+        case TOK_U16:
+        case TOK_U32:
+        case TOK_U64:
+        case TOK_U128:
+        case TOK_BOOL:
+        case TOK_CHAR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool type_is_signed(TokenType type) {
+    switch (type) {
+        case TOK_I8:
+        case TOK_I16:
+        case TOK_I32:
+        case TOK_I64:
+        case TOK_I128:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool type_is_float(TokenType type) {
+    return type == TOK_F32 || type == TOK_F64;
+}
+
+bool type_is_lossless(TokenType from, TokenType to) {
+    if (from == to) {
+        return true;
+    }
+
+    if (from == TOK_INT_LIT) {
+        return type_is_integer(to) || type_is_float(to);
+    }
+    if (from == TOK_FLOAT_LIT) {
+        return type_is_float(to);
+    }
+
+    if (type_is_float(from)) {
+        return type_is_float(to) &&
+            type_bit_width(from) <= type_bit_width(to);
+    }
+
+    // bool is a 1-bit integer and fits anywhere an integer does
+    size_t fromBits = from == TOK_BOOL ? 1 : type_bit_width(from);
+    size_t toBits = type_bit_width(to);
+
+    if (type_is_float(to)) {
+        // Only integers that fit in the mantissa convert exactly
+        return type_is_integer(from) && fromBits <= (to == TOK_F32 ? 16 : 32);
+    }
+
+    if (!type_is_integer(from) || !type_is_integer(to) || to == TOK_BOOL) {
+        return false;
+    }
+
+    if (from == TOK_BOOL || type_is_signed(from) == type_is_signed(to)) {
+        return fromBits <= toBits;
+    }
+
+    // Unsigned to signed needs a strictly wider target
+    return !type_is_signed(from) && fromBits < toBits;
+}
+
+TokenType type_common(TokenType a, TokenType b) {
+    if (a == b) {
+        return a;
+    }
+    if (a == TOK_INVALID) {
+        return b;
+    }
+    if (b == TOK_INVALID) {
+        return a;
+    }
+
+    if (is_literal_type(a) && is_literal_type(b)) {
+        return TOK_FLOAT_LIT;
+    }
+    if (is_literal_type(b)) {
+        TokenType tmp = a;
+        a = b;
+        b = tmp;
+    }
+    if (a == TOK_INT_LIT) {
+        // bool and char only take part in arithmetic as small integers
+        return b == TOK_BOOL || b == TOK_CHAR ? TOK_I32 : b;
+    }
+    if (a == TOK_FLOAT_LIT) {
+        return type_is_float(b) ? b : TOK_F64;
+    }
+
+    if (type_is_float(a) || type_is_float(b)) {
+        if (type_is_float(a) && type_is_float(b)) {
+            return TOK_F64;
+        }
+        TokenType floatType = type_is_float(a) ? a : b;
+        TokenType intType = type_is_float(a) ? b : a;
+        return type_is_lossless(intType, floatType) ? floatType : TOK_F64;
+    }
+
+    if (type_is_lossless(a, b)) {
+        return b;
+    }
+    if (type_is_lossless(b, a)) {
+        return a;
+    }
+
+    // Mixed signedness where neither holds the other, the signed value
+    // is converted to the unsigned type of the wider width, as the spec
+    // has it for comparisons
+    size_t bits = type_bit_width(a) > type_bit_width(b) ?
+        type_bit_width(a) : type_bit_width(b);
+    switch (bits) {
+        case 8: return TOK_U8;
+        case 16: return TOK_U16;
+        case 32: return TOK_U32;
+        case 64: return TOK_U64;
+        default: return TOK_U128;
+    }
+}
+
+bool type_compare_casts(TokenType from, TokenType to) {
+    return type_is_signed(from) && type_is_integer(to) &&
+        !type_is_signed(to) && !type_is_lossless(from, to);
+}
+
+TokenType type_default(TokenType type) {
+    if (type == TOK_INT_LIT) {
+        return TOK_I32;
+    }
+    if (type == TOK_FLOAT_LIT) {
+        return TOK_F64;
+    }
+
+    return type;
+}
+
+const char* type_name(TokenType type) {
+    switch (type) {
+        case TOK_I8: return "i8";
+        case TOK_I16: return "i16";
+        case TOK_I32: return "i32";
+        case TOK_I64: return "i64";
+        case TOK_I128: return "i128";
+        case TOK_U8: return "u8";
+        case TOK_U16: return "u16";
+        case TOK_U32: return "u32";
+        case TOK_U64: return "u64";
+        case TOK_U128: return "u128";
+        case TOK_F32: return "f32";
+        case TOK_F64: return "f64";
+        case TOK_BOOL: return "bool";
+        case TOK_CHAR: return "char";
+        case TOK_INVALID: return "void";
+        default: return token_as_str(type);
+    }
+}
+
+TokenType type_of_expr(const ASTNode* expr, const Scope* scope,
+    const FuncTable* funcs) {
+    if (expr == NULL) {
+        return TOK_INVALID;
+    }
+
+    switch (expr->type) {
+        case NODE_LITERAL:
+            switch (expr->data.literal.type) {
+                case TOK_BOOL_LIT: return TOK_BOOL;
+                case TOK_CHAR_LIT: return TOK_CHAR;
+                default: return expr->data.literal.type;
+            }
+        case NODE_IDENT: {
+            Symbol* symbol = scope == NULL ? NULL :
+                scope_lookup(scope, expr->data.ident.name);
+            return symbol == NULL ? TOK_INVALID : symbol->type;
+        }
+        case NODE_BINARY_EXPR:
+            switch (expr->data.binaryExpr.op) {
+                case TOK_ADD:
+                case TOK_SUB:
+                case TOK_MUL:
+                case TOK_DIV:
+                case TOK_MOD:
+                    return type_common(
+                        type_of_expr(expr->data.binaryExpr.left, scope,
+                            funcs),
+                        type_of_expr(expr->data.binaryExpr.right, scope,
+                            funcs));
+                default:
+                    return TOK_BOOL;
+            }
+        case NODE_UNARY_EXPR:
+            if (expr->data.unaryExpr.op == TOK_NOT) {
+                return TOK_BOOL;
+            }
+            return type_of_expr(expr->data.unaryExpr.operand, scope, funcs);
+        case NODE_CAST_EXPR:
+            return expr->data.castExpr.type;
+        case NODE_CALL_EXPR: {
+            const ASTNode* callee = expr->data.callExpr.callee;
+            if (callee == NULL || callee->type != NODE_IDENT) {
+                return TOK_INVALID;
+            }
+            ASTNode* func = func_table_lookup(funcs, callee->data.ident.name);
+            return func == NULL ? TOK_INVALID :
+                func->data.functionDecl.returnType;
+        }
+        default:
+            return TOK_INVALID;
+    }
+}
+
+/* --- Helper Functions --- */
+
+static bool is_literal_type(TokenType type) {
+    return type == TOK_INT_LIT || type == TOK_FLOAT_LIT;
+}
@@ -0,0 +1,54 @@
+#ifndef TYPES_H
+#define TYPES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "ast.h"
+#include "scope.h"
+#include "token.h"
+
+// Types are represented by their type keyword TokenType (TOK_I32,
+// TOK_F64, ...). Untyped literals that adapt to their context use the
+// literal token types TOK_INT_LIT and TOK_FLOAT_LIT as pseudo types
+// until a concrete type is chosen. TOK_INVALID means no type (void).
+
+/// Returns the width in bits of the given type. bool and char are
+/// stored as 8 bits. Returns 0 if the type is not a concrete type.
+size_t type_bit_width(TokenType type);
+/// Returns true if the type is one of the integer types, char or bool.
+bool type_is_integer(TokenType type);
+/// Returns true if the type is a signed integer type.
+bool type_is_signed(TokenType type);
+/// Returns true if the type is f32 or f64.
+bool type_is_float(TokenType type);
+/// Returns true if a value of type from can be implicitly converted to
+/// type to without loss, following the spec's lossless conversion
+/// rules.
+bool type_is_lossless(TokenType from, TokenType to);
+/// Returns the type an expression with operands of types a and b is
+/// evaluated in when there is no context, which is the widest of the
+/// two, or the unsigned type of that width when their signedness differs
+/// and neither holds the other. Either may be a pseudo literal type.
+TokenType type_common(TokenType a, TokenType b);
+/// Returns true if an operand of type from of a comparison evaluated in
+/// type to is converted to it as by a cast, though the conversion is not
+/// lossless. That is a signed integer compared with an unsigned one it
+/// does not fit, which the spec converts to the unsigned type.
+bool type_compare_casts(TokenType from, TokenType to);
+/// Resolves pseudo literal types to their default concrete type, i32
+/// for integer literals and f64 for float literals. Other types are
+/// returned unchanged.
+TokenType type_default(TokenType type);
+
+/// Returns the NeoC spelling of a type, such as "i32", for use in
+/// diagnostics and dumps. Returns "void" for TOK_INVALID.
+const char* type_name(TokenType type);
+
+/// Returns the type an expression has on its own, without any context.
+/// Untyped literals produce pseudo literal types. Identifiers are looked
+/// up in scope and calls in funcs, either may be NULL. Returns
+/// TOK_INVALID for void calls and unknown names.
+TokenType type_of_expr(const ASTNode* expr, const Scope* scope,
+    const FuncTable* funcs);
+
+#endif // TYPES_H
@@ -0,0 +1,232 @@
+#include "utf8.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define UTF8_SSE2 1
+#include <emmintrin.h>
+#else
+#define UTF8_SSE2 0
+#endif
+
+// Source text is nearly all ASCII, so the text is taken a block at a
+// time and a block with no byte of 0x80 or above is passed over after
+// looking only at the top bit of each byte, 16 at once with SSE2 or 8 at
+// once in a 64 bit word elsewhere. A block with any other byte runs
+// through an automaton whose states are the ranges table 3-7 of the
+// Unicode standard allows the next byte of a sequence to be in, which
+// rules out overlong forms, surrogates and code points past U+10FFFF
+// with nothing decoded. Each byte is a class lookup and a transition
+// without a branch, and only a block found to be invalid is walked
+// again to find where its invalid sequence starts.
+
+/// The number of bytes looked at together by is_ascii_block(), and
+/// run through the automaton before checking for a rejection.
+#define UTF8_BLOCK 64
+/// The number of classes bytes are sorted into.
+#define UTF8_CLASS_COUNT 12
+
+/// The states of the automaton.
+enum {
+    STATE_ACCEPT,
+    // One, two or three more continuation bytes of any value
+    STATE_NEED1,
+    STATE_NEED2,
+    STATE_NEED3,
+    // The narrower ranges after E0, ED, F0 and F4
+    STATE_E0,
+    STATE_ED,
+    STATE_F0,
+    STATE_F4,
+    STATE_REJECT,
+    STATE_COUNT,
+};
+
+/// The class of each byte: ASCII, continuation bytes 80-8F, 90-9F and
+/// A0-BF, bytes never in UTF-8, lead bytes C2-DF, E0, E1-EC and EE-EF,
+/// ED, F0, F1-F3 and F4.
+static const uint8_t classes[256] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+     2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+     3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,
+     3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,
+     4,  4,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,
+     5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,
+     6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  7,
+     9, 10, 10, 10, 11,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+};
+
+/// The state after a byte of each class in each state.
+static const uint8_t transitions[STATE_COUNT][UTF8_CLASS_COUNT] = {
+    { STATE_ACCEPT, STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT,
+        STATE_NEED1, STATE_E0, STATE_NEED2, STATE_ED, STATE_F0, STATE_NEED3,
+        STATE_F4 },
+    { STATE_REJECT, STATE_ACCEPT, STATE_ACCEPT, STATE_ACCEPT, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT },
+    { STATE_REJECT, STATE_NEED1, STATE_NEED1, STATE_NEED1, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT },
+    { STATE_REJECT, STATE_NEED2, STATE_NEED2, STATE_NEED2, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT },
+    { STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_NEED1, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT },
+    { STATE_REJECT, STATE_NEED1, STATE_NEED1, STATE_REJECT, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT },
+    { STATE_REJECT, STATE_REJECT, STATE_NEED2, STATE_NEED2, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT },
+    { STATE_REJECT, STATE_NEED2, STATE_REJECT, STATE_REJECT, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT },
+    { STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT, STATE_REJECT,
+        STATE_REJECT, STATE_REJECT },
+};
+
+/// Returns whether every one of the UTF8_BLOCK bytes at bytes is below
+/// 0x80.
+static inline bool is_ascii_block(const unsigned char* bytes);
+/// Walks the len bytes at bytes, which the automaton rejects from the
+/// state in state, one at a time. Returns the offset of the first byte
+/// of the invalid sequence.
+static size_t find_invalid(const Utf8State* state,
+    const unsigned char* bytes, size_t len);
+
+size_t utf8_validate(Utf8State* state, const char* bytes, size_t len) {
+    const unsigned char* in = (const unsigned char*)bytes;
+    size_t i = 0;
+    while (i < len) {
+        if (state->state == STATE_ACCEPT) {
+            while (len - i >= UTF8_BLOCK && is_ascii_block(in + i)) {
+                i += UTF8_BLOCK;
+            }
+            if (i == len) {
+                break;
+            }
+        }
+
+        size_t end = len - i > UTF8_BLOCK ? i + UTF8_BLOCK : len;
+        uint8_t current = state->state;
+        for (size_t j = i; j < end; j++) {
+            current = transitions[current][classes[in[j]]];
+        }
+        if (current == STATE_REJECT) {
+            Utf8State block = *state;
+            block.offset += i;
+            return find_invalid(&block, in + i, end - i);
+        }
+
+        // A sequence left open started at its last lead byte, unless it
+        // started before this block
+        if (current != STATE_ACCEPT) {
+            for (size_t j = end; j > i && end - j < 3; j--) {
+                if (in[j - 1] >= 0xc0) {
+                    state->seqStart = state->offset + j - 1;
+                    break;
+                }
+            }
+        }
+        state->state = current;
+        i = end;
+    }
+
+    state->offset += len;
+    return UTF8_VALID;
+}
+
+size_t utf8_finish(const Utf8State* state) {
+    return state->state != STATE_ACCEPT ? state->seqStart : UTF8_VALID;
+}
+
+bool utf8_check(const char* text, size_t len) {
+    Utf8State state;
+    memset(&state, 0, sizeof(Utf8State));
+    size_t invalid = utf8_validate(&state, text, len);
+    if (invalid == UTF8_VALID) {
+        invalid = utf8_finish(&state);
+    }
+    if (invalid == UTF8_VALID) {
+        return true;
+    }
+
+    print_utf8_error(text, invalid, 1, 1, invalid);
+    return false;
+}
+
+void print_utf8_error(const char* text, size_t len, size_t line,
+    size_t column, size_t offset) {
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '\n') {
+            line++;
+            column = 1;
+        } else {
+            column++;
+        }
+    }
+
+    fprintf(stderr, "Lexer Error [%zu:%zu]: Invalid UTF-8 at byte %zu\n",
+        line, column, offset);
+}
+
+size_t utf8_sequence_length(unsigned char lead) {
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        return 2;
+    }
+    if (lead >= 0xe0 && lead <= 0xef) {
+        return 3;
+    }
+    if (lead >= 0xf0 && lead <= 0xf4) {
+        return 4;
+    }
+    return 1;
+}
+
+/* --- Helper Functions --- */
+
+static inline bool is_ascii_block(const unsigned char* bytes) {
+#if UTF8_SSE2
+    __m128i any = _mm_loadu_si128((const __m128i*)bytes);
+    for (size_t i = 16; i < UTF8_BLOCK; i += 16) {
+        any = _mm_or_si128(any,
+            _mm_loadu_si128((const __m128i*)(bytes + i)));
+    }
+    return _mm_movemask_epi8(any) == 0;
+#else
+    uint64_t any = 0;
+    for (size_t i = 0; i < UTF8_BLOCK; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        any |= word;
+    }
+    return (any & 0x8080808080808080u) == 0;
+#endif
+}
+
+static size_t find_invalid(const Utf8State* state,
+    const unsigned char* bytes, size_t len) {
+    uint8_t current = state->state;
+    size_t seqStart = state->seqStart;
+    for (size_t i = 0; i < len; i++) {
+        if (current == STATE_ACCEPT) {
+            seqStart = state->offset + i;
+        }
+        current = transitions[current][classes[bytes[i]]];
+        if (current == STATE_REJECT) {
+            break;
+        }
+    }
+
+    return seqStart;
+}
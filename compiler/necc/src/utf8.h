@@ -0,0 +1,44 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Returned by utf8_validate() and utf8_finish() when no invalid
+/// sequence was found.
+#define UTF8_VALID SIZE_MAX
+
+/// Where validating a text given a piece at a time has got to. Zeroed,
+/// it is at the start of the text.
+typedef struct Utf8State {
+    /// The number of bytes validated so far.
+    size_t offset;
+    /// The offset of the lead byte of the sequence being read.
+    size_t seqStart;
+    /// Where the sequence being read has got to, a state of the automaton
+    /// in utf8.c, 0 between sequences.
+    uint8_t state;
+} Utf8State;
+
+/// Validates the next len bytes of a text as UTF-8, a sequence being
+/// allowed to continue into the next call. Returns the offset in the
+/// whole text of the first byte of the first invalid sequence, or
+/// UTF8_VALID.
+size_t utf8_validate(Utf8State* state, const char* bytes, size_t len);
+/// Returns the offset of the sequence the text ends in the middle of,
+/// or UTF8_VALID if it ends between sequences.
+size_t utf8_finish(const Utf8State* state);
+/// Validates a whole text of len bytes, printing the line and column
+/// of the first invalid sequence if there is one. Returns whether the
+/// text is valid UTF-8.
+bool utf8_check(const char* text, size_t len);
+/// Prints an error for the invalid sequence at offset, text holding the
+/// len bytes before it starting at line and column.
+void print_utf8_error(const char* text, size_t len, size_t line,
+    size_t column, size_t offset);
+/// Returns the number of bytes in the sequence starting with lead, 1
+/// for a byte that cannot start one.
+size_t utf8_sequence_length(unsigned char lead);
+
+#endif // UTF8_H
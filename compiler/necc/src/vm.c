@@ -0,0 +1,534 @@
+#include "vm.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "int128.h"
+#include "types.h"
+
+// Handlers jump straight to the next one through a table of label
+// addresses where the compiler supports it, which gives every handler
+// its own indirect branch. Other compilers get a plain switch.
+#if defined(__GNUC__) && !defined(NECC_VM_SWITCH)
+#define VM_COMPUTED_GOTO
+#endif
+
+/// A suspended caller.
+typedef struct VMFrame {
+    const BCFunction* func;
+    /// The instruction after the call.
+    const BCInst* pc;
+    VMValue* base;
+    /// The slot of the caller receiving the result.
+    uint16_t dst;
+} VMFrame;
+
+/// Runs the interpreter loop until entry returns. tier may be NULL.
+static bool execute(const BCModule* module, const BCFunction* entry,
+    VMValue* stack, VMFrame* frames, VMValue* result, VMTier* tier);
+/// Counts a backward jump in func.
+static void count_loop(VMTier* tier, uint32_t func);
+/// Finds value among count ascending keys. Returns its position plus
+/// one, or 0 if it is missing.
+static uint32_t find_key(const VMValue* keys, uint32_t count,
+    VMValue value, bool isSigned);
+/// Reads the native entry of a function, published by another thread.
+static VMNativeEntry load_entry(void* const* entry);
+/// Converts src from one type to another with cast semantics. Floats
+/// saturate when converted to integers, NaN becomes zero.
+static void convert(VMValue* dst, const VMValue* src, TokenType from,
+    TokenType to);
+/// Reads a two slot value.
+static Int128 load_wide(const VMValue* slots);
+/// Writes a two slot value.
+static void store_wide(VMValue* slots, Int128 value);
+/// Returns true if values of the type take two slots.
+static bool is_wide(TokenType type);
+
+bool vm_run(const BCModule* module, uint32_t entry, const VMValue* args,
+    VMValue* result) {
+    return vm_run_tiered(module, entry, args, result, NULL);
+}
+
+bool vm_run_tiered(const BCModule* module, uint32_t entry,
+    const VMValue* args, VMValue* result, VMTier* tier) {
+    VMValue* stack = calloc(VM_STACK_SLOTS, sizeof(VMValue));
+    VMFrame* frames = malloc(VM_MAX_FRAMES * sizeof(VMFrame));
+    if (stack == NULL || frames == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for the VM\n");
+        free(stack);
+        free(frames);
+        return false;
+    }
+
+    const BCFunction* func = &module->funcs[entry];
+    bool ok = false;
+    if (func->stackSize > VM_STACK_SLOTS) {
+        fprintf(stderr, "Runtime Error: Stack overflow in '%s'\n",
+            func->name);
+    } else {
+        if (func->paramSlots > 0) {
+            memcpy(stack, args, func->paramSlots * sizeof(VMValue));
+        }
+        ok = execute(module, func, stack, frames, result, tier);
+    }
+
+    free(stack);
+    free(frames);
+    return ok;
+}
+
+/* --- Helper Functions --- */
+
+// Slot operands of the current instruction
+#define REG_A (base[inst->a])
+#define REG_B (base[inst->b])
+#define REG_C (base[inst->c])
+// Immediate operands
+#define IMM_B ((int64_t)(int16_t)inst->b)
+#define IMM_C ((int64_t)(int16_t)inst->c)
+// Backward jumps are counted while tiering
+#define JUMP() \
+    do { \
+        pc = code + inst->c; \
+        if (pc <= inst && tier != NULL) { \
+            count_loop(tier, (uint32_t)(func - module->funcs)); \
+        } \
+    } while (0)
+
+// Bring a 64-bit result back to the canonical form of a width
+#define WRAP_64(x) (x)
+#define WRAP_I32(x) ((uint64_t)(int64_t)(int32_t)(uint32_t)(x))
+#define WRAP_U32(x) ((uint64_t)(uint32_t)(x))
+#define WRAP_I16(x) ((uint64_t)(int64_t)(int16_t)(uint16_t)(x))
+#define WRAP_U16(x) ((uint64_t)(uint16_t)(x))
+#define WRAP_I8(x) ((uint64_t)(int64_t)(int8_t)(uint8_t)(x))
+#define WRAP_U8(x) ((uint64_t)(uint8_t)(x))
+
+#ifdef VM_COMPUTED_GOTO
+#define VM_CASE(name) op_##name:
+#define VM_NEXT() do { inst = pc++; goto *dispatch[inst->op]; } while (0)
+#else
+#define VM_CASE(name) case BC_##name:
+#define VM_NEXT() continue
+#endif
+
+/// Defines a handler for an integer op at every width up to 64 bits.
+#define VM_INT_OPS(name, expr) \
+    VM_CASE(name##_64) REG_A.u = WRAP_64(expr); VM_NEXT(); \
+    VM_CASE(name##_I32) REG_A.u = WRAP_I32(expr); VM_NEXT(); \
+    VM_CASE(name##_U32) REG_A.u = WRAP_U32(expr); VM_NEXT(); \
+    VM_CASE(name##_I16) REG_A.u = WRAP_I16(expr); VM_NEXT(); \
+    VM_CASE(name##_U16) REG_A.u = WRAP_U16(expr); VM_NEXT(); \
+    VM_CASE(name##_I8) REG_A.u = WRAP_I8(expr); VM_NEXT(); \
+    VM_CASE(name##_U8) REG_A.u = WRAP_U8(expr); VM_NEXT();
+
+/// Defines a handler for a float op at both widths.
+#define VM_FLOAT_OPS(name, expr) \
+    VM_CASE(name##_F64) REG_A.f = (expr); VM_NEXT(); \
+    VM_CASE(name##_F32) REG_A.f = (double)(float)(expr); VM_NEXT();
+
+/// Defines a signed division handler, which wraps the quotient of the
+/// most negative value by -1.
+#define VM_SDIV(name, wrap) \
+    VM_CASE(name) \
+        if (REG_C.i == 0) { \
+            goto div_zero; \
+        } \
+        REG_A.u = wrap(REG_C.i == -1 ? 0 - REG_B.u : \
+            (uint64_t)(REG_B.i / REG_C.i)); \
+        VM_NEXT();
+
+/// Defines a conditional jump handler.
+#define VM_JUMP_IF(name, cond) \
+    VM_CASE(name) \
+        if (cond) { \
+            JUMP(); \
+        } \
+        VM_NEXT();
+
+/// Resumes the suspended caller, or finishes when entry returns.
+#define VM_RETURN(store) \
+    { \
+        if (frame == frames) { \
+            store(result); \
+            return true; \
+        } \
+        frame--; \
+        func = frame->func; \
+        base = frame->base; \
+        code = func->code; \
+        consts = func->consts; \
+        pc = frame->pc; \
+        store(&base[frame->dst]); \
+        VM_NEXT(); \
+    }
+
+#define VM_STORE_ONE(dst) ((dst)[0] = value[0])
+#define VM_STORE_TWO(dst) ((dst)[0] = value[0], (dst)[1] = value[1])
+#define VM_STORE_NONE(dst) ((void)(dst))
+
+#ifdef VM_COMPUTED_GOTO
+// Label addresses and computed gotos are GNU extensions
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+static bool execute(const BCModule* module, const BCFunction* entry,
+    VMValue* stack, VMFrame* frames, VMValue* result, VMTier* tier) {
+    const VMValue* stackEnd = stack + VM_STACK_SLOTS;
+    const VMFrame* framesEnd = frames + VM_MAX_FRAMES;
+    VMFrame* frame = frames;
+    const BCFunction* func = entry;
+    VMValue* base = stack;
+    const BCInst* code = func->code;
+    const VMValue* consts = func->consts;
+    const BCInst* pc = code;
+    const BCInst* inst;
+
+#ifdef VM_COMPUTED_GOTO
+    static const void* const dispatch[BC_OP_COUNT] = {
+#define VM_LABEL(name) &&op_##name,
+        BC_OP_LIST(VM_LABEL)
+#undef VM_LABEL
+    };
+    VM_NEXT();
+    {
+#else
+    for (;;) {
+        inst = pc++;
+        switch (inst->op) {
+#endif
+        VM_CASE(MOV) REG_A = REG_B; VM_NEXT();
+        VM_CASE(MOV2)
+            (&REG_A)[0] = (&REG_B)[0];
+            (&REG_A)[1] = (&REG_B)[1];
+            VM_NEXT();
+        VM_CASE(LOADK) REG_A = consts[inst->b]; VM_NEXT();
+        VM_CASE(LOADK2)
+            (&REG_A)[0] = consts[inst->b];
+            (&REG_A)[1] = consts[inst->b + 1];
+            VM_NEXT();
+        VM_CASE(LOADI) REG_A.i = IMM_B; VM_NEXT();
+
+        VM_INT_OPS(ADD, REG_B.u + REG_C.u)
+        VM_FLOAT_OPS(ADD, REG_B.f + REG_C.f)
+        VM_CASE(ADD_128)
+            store_wide(&REG_A, i128_add(load_wide(&REG_B),
+                load_wide(&REG_C)));
+            VM_NEXT();
+        VM_INT_OPS(SUB, REG_B.u - REG_C.u)
+        VM_FLOAT_OPS(SUB, REG_B.f - REG_C.f)
+        VM_CASE(SUB_128)
+            store_wide(&REG_A, i128_sub(load_wide(&REG_B),
+                load_wide(&REG_C)));
+            VM_NEXT();
+        VM_INT_OPS(MUL, REG_B.u * REG_C.u)
+        VM_FLOAT_OPS(MUL, REG_B.f * REG_C.f)
+        VM_CASE(MUL_128)
+            store_wide(&REG_A, i128_mul(load_wide(&REG_B),
+                load_wide(&REG_C)));
+            VM_NEXT();
+
+        VM_SDIV(DIV_I64, WRAP_64)
+        VM_SDIV(DIV_I32, WRAP_I32)
+        VM_SDIV(DIV_I16, WRAP_I16)
+        VM_SDIV(DIV_I8, WRAP_I8)
+        VM_CASE(DIV_U64)
+            if (REG_C.u == 0) {
+                goto div_zero;
+            }
+            REG_A.u = REG_B.u / REG_C.u;
+            VM_NEXT();
+        VM_FLOAT_OPS(DIV, REG_B.f / REG_C.f)
+        VM_CASE(DIV_I128)
+        VM_CASE(DIV_U128) {
+            Int128 divisor = load_wide(&REG_C);
+            if (i128_is_zero(divisor)) {
+                goto div_zero;
+            }
+            store_wide(&REG_A, inst->op == BC_DIV_I128 ?
+                i128_sdivmod(load_wide(&REG_B), divisor, NULL) :
+                i128_udivmod(load_wide(&REG_B), divisor, NULL));
+            VM_NEXT();
+        }
+        VM_CASE(MOD_I64)
+            if (REG_C.i == 0) {
+                goto div_zero;
+            }
+            REG_A.i = REG_C.i == -1 ? 0 : REG_B.i % REG_C.i;
+            VM_NEXT();
+        VM_CASE(MOD_U64)
+            if (REG_C.u == 0) {
+                goto div_zero;
+            }
+            REG_A.u = REG_B.u % REG_C.u;
+            VM_NEXT();
+        VM_FLOAT_OPS(MOD, fmod(REG_B.f, REG_C.f))
+        VM_CASE(MOD_I128)
+        VM_CASE(MOD_U128) {
+            Int128 divisor = load_wide(&REG_C);
+            Int128 remainder;
+            if (i128_is_zero(divisor)) {
+                goto div_zero;
+            }
+            if (inst->op == BC_MOD_I128) {
+                i128_sdivmod(load_wide(&REG_B), divisor, &remainder);
+            } else {
+                i128_udivmod(load_wide(&REG_B), divisor, &remainder);
+            }
+            store_wide(&REG_A, remainder);
+            VM_NEXT();
+        }
+
+        VM_CASE(ADDI_64) REG_A.u = REG_B.u + (uint64_t)IMM_C; VM_NEXT();
+        VM_CASE(ADDI_I32)
+            REG_A.u = WRAP_I32(REG_B.u + (uint64_t)IMM_C);
+            VM_NEXT();
+        VM_CASE(ADDI_U32)
+            REG_A.u = WRAP_U32(REG_B.u + (uint64_t)IMM_C);
+            VM_NEXT();
+        VM_CASE(ADDI_I16)
+            REG_A.u = WRAP_I16(REG_B.u + (uint64_t)IMM_C);
+            VM_NEXT();
+        VM_CASE(ADDI_U16)
+            REG_A.u = WRAP_U16(REG_B.u + (uint64_t)IMM_C);
+            VM_NEXT();
+        VM_CASE(ADDI_I8)
+            REG_A.u = WRAP_I8(REG_B.u + (uint64_t)IMM_C);
+            VM_NEXT();
+        VM_CASE(ADDI_U8)
+            REG_A.u = WRAP_U8(REG_B.u + (uint64_t)IMM_C);
+            VM_NEXT();
+
+        VM_INT_OPS(NEG, 0 - REG_B.u)
+        VM_CASE(NEG_F) REG_A.f = -REG_B.f; VM_NEXT();
+        VM_CASE(NEG_128) store_wide(&REG_A, i128_neg(load_wide(&REG_B)));
+            VM_NEXT();
+        VM_CASE(NOT) REG_A.u = REG_B.u ^ 1; VM_NEXT();
+
+        VM_CASE(EQ) REG_A.u = REG_B.u == REG_C.u; VM_NEXT();
+        VM_CASE(NE) REG_A.u = REG_B.u != REG_C.u; VM_NEXT();
+        VM_CASE(EQ_F) REG_A.u = REG_B.f == REG_C.f; VM_NEXT();
+        VM_CASE(NE_F) REG_A.u = REG_B.f != REG_C.f; VM_NEXT();
+        VM_CASE(LT_S) REG_A.u = REG_B.i < REG_C.i; VM_NEXT();
+        VM_CASE(LE_S) REG_A.u = REG_B.i <= REG_C.i; VM_NEXT();
+        VM_CASE(LT_U) REG_A.u = REG_B.u < REG_C.u; VM_NEXT();
+        VM_CASE(LE_U) REG_A.u = REG_B.u <= REG_C.u; VM_NEXT();
+        VM_CASE(LT_F) REG_A.u = REG_B.f < REG_C.f; VM_NEXT();
+        VM_CASE(LE_F) REG_A.u = REG_B.f <= REG_C.f; VM_NEXT();
+        VM_CASE(EQ_128)
+            REG_A.u = i128_eq(load_wide(&REG_B), load_wide(&REG_C));
+            VM_NEXT();
+        VM_CASE(NE_128)
+            REG_A.u = !i128_eq(load_wide(&REG_B), load_wide(&REG_C));
+            VM_NEXT();
+        VM_CASE(LT_S128)
+            REG_A.u = i128_slt(load_wide(&REG_B), load_wide(&REG_C));
+            VM_NEXT();
+        VM_CASE(LE_S128)
+            REG_A.u = !i128_slt(load_wide(&REG_C), load_wide(&REG_B));
+            VM_NEXT();
+        VM_CASE(LT_U128)
+            REG_A.u = i128_ult(load_wide(&REG_B), load_wide(&REG_C));
+            VM_NEXT();
+        VM_CASE(LE_U128)
+            REG_A.u = !i128_ult(load_wide(&REG_C), load_wide(&REG_B));
+            VM_NEXT();
+        VM_CASE(EQ_I) REG_A.u = REG_B.i == IMM_C; VM_NEXT();
+        VM_CASE(NE_I) REG_A.u = REG_B.i != IMM_C; VM_NEXT();
+        VM_CASE(LT_I) REG_A.u = REG_B.i < IMM_C; VM_NEXT();
+        VM_CASE(LE_I) REG_A.u = REG_B.i <= IMM_C; VM_NEXT();
+        VM_CASE(GT_I) REG_A.u = REG_B.i > IMM_C; VM_NEXT();
+        VM_CASE(GE_I) REG_A.u = REG_B.i >= IMM_C; VM_NEXT();
+
+        VM_CASE(CONV)
+            convert(&REG_A, &REG_B, (TokenType)(inst->c & 0xff),
+                (TokenType)(inst->c >> 8));
+            VM_NEXT();
+
+        VM_CASE(JMP) JUMP(); VM_NEXT();
+        VM_JUMP_IF(JT, REG_A.u != 0)
+        VM_JUMP_IF(JF, REG_A.u == 0)
+        VM_JUMP_IF(JEQ, REG_A.u == REG_B.u)
+        VM_JUMP_IF(JNE, REG_A.u != REG_B.u)
+        VM_JUMP_IF(JLT_S, REG_A.i < REG_B.i)
+        VM_JUMP_IF(JLE_S, REG_A.i <= REG_B.i)
+        VM_JUMP_IF(JLT_U, REG_A.u < REG_B.u)
+        VM_JUMP_IF(JLE_U, REG_A.u <= REG_B.u)
+        VM_JUMP_IF(JEQ_I, REG_A.i == IMM_B)
+        VM_JUMP_IF(JNE_I, REG_A.i != IMM_B)
+        VM_JUMP_IF(JLT_I, REG_A.i < IMM_B)
+        VM_JUMP_IF(JLE_I, REG_A.i <= IMM_B)
+        VM_JUMP_IF(JGT_I, REG_A.i > IMM_B)
+        VM_JUMP_IF(JGE_I, REG_A.i >= IMM_B)
+
+        // The selected JMP of the table runs next
+        VM_CASE(JTAB) {
+            uint64_t entry = REG_A.u - consts[inst->b].u;
+            pc += entry < inst->c ? entry + 1 : 0;
+            VM_NEXT();
+        }
+        VM_CASE(JSEARCH_S)
+            pc += find_key(consts + inst->b, inst->c, REG_A, true);
+            VM_NEXT();
+        VM_CASE(JSEARCH_U)
+            pc += find_key(consts + inst->b, inst->c, REG_A, false);
+            VM_NEXT();
+
+        VM_CASE(CALL) {
+            const BCFunction* callee = &module->funcs[inst->b];
+            VMValue* calleeBase = base + inst->c;
+            if (tier != NULL) {
+                VMNativeEntry native = load_entry(&tier->entries[inst->b]);
+                if (native != NULL) {
+                    native(calleeBase, &REG_A);
+                    VM_NEXT();
+                }
+                if (++tier->calls[inst->b] == tier->callThreshold &&
+                    tier->loops[inst->b] < tier->loopThreshold) {
+                    tier->hot(tier->ctx, inst->b);
+                }
+            }
+            if (frame == framesEnd ||
+                callee->stackSize > (size_t)(stackEnd - calleeBase)) {
+                fprintf(stderr, "Runtime Error: Stack overflow in '%s'\n",
+                    callee->name);
+                return false;
+            }
+
+            frame->func = func;
+            frame->pc = pc;
+            frame->base = base;
+            frame->dst = inst->a;
+            frame++;
+
+            func = callee;
+            base = calleeBase;
+            code = func->code;
+            consts = func->consts;
+            pc = code;
+            VM_NEXT();
+        }
+        VM_CASE(RET) {
+            VMValue value[1] = { REG_A };
+            VM_RETURN(VM_STORE_ONE)
+        }
+        VM_CASE(RET2) {
+            VMValue value[2] = { (&REG_A)[0], (&REG_A)[1] };
+            VM_RETURN(VM_STORE_TWO)
+        }
+        VM_CASE(RETV)
+            VM_RETURN(VM_STORE_NONE)
+#ifdef VM_COMPUTED_GOTO
+    }
+#else
+        default:
+            fprintf(stderr, "Runtime Error: Invalid op %u in '%s'\n",
+                (unsigned)inst->op, func->name);
+            return false;
+        }
+    }
+#endif
+
+div_zero:
+    fprintf(stderr, "Runtime Error: Division by zero in '%s'\n", func->name);
+    return false;
+}
+
+#ifdef VM_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+static void count_loop(VMTier* tier, uint32_t func) {
+    if (++tier->loops[func] == tier->loopThreshold &&
+        tier->calls[func] < tier->callThreshold) {
+        tier->hot(tier->ctx, func);
+    }
+}
+
+static uint32_t find_key(const VMValue* keys, uint32_t count,
+    VMValue value, bool isSigned) {
+    uint32_t lo = 0;
+    uint32_t hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (keys[mid].u == value.u) {
+            return mid + 1;
+        }
+        bool below = isSigned ? keys[mid].i < value.i :
+            keys[mid].u < value.u;
+        if (below) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+static VMNativeEntry load_entry(void* const* entry) {
+#ifdef __GNUC__
+    void* address = __atomic_load_n(entry, __ATOMIC_ACQUIRE);
+#else
+    void* address = *(void* const volatile*)entry;
+#endif
+    // ISO C has no conversion from data to function pointers
+    VMNativeEntry native;
+    memcpy(&native, &address, sizeof(native));
+    return native;
+}
+
+static void convert(VMValue* dst, const VMValue* src, TokenType from,
+    TokenType to) {
+    if (type_is_float(from) && type_is_float(to)) {
+        dst->f = to == TOK_F32 ? (double)(float)src->f : src->f;
+        return;
+    }
+
+    Int128 value;
+    if (type_is_float(from)) {
+        if (to == TOK_BOOL) {
+            value = i128_from_u64(src->f != 0.0 ? 1 : 0);
+        } else if (isnan(src->f)) {
+            value = i128_from_u64(0);
+        } else if (!i128_from_double(src->f, to, &value)) {
+            value = i128_type_limit(to, src->f > 0.0);
+        }
+    } else {
+        if (is_wide(from)) {
+            value = load_wide(src);
+        } else if (type_is_signed(from)) {
+            value = i128_from_i64(src->i);
+        } else {
+            value = i128_from_u64(src->u);
+        }
+
+        if (type_is_float(to)) {
+            double result = i128_to_double(value, type_is_signed(from));
+            dst->f = to == TOK_F32 ? (double)(float)result : result;
+            return;
+        }
+        value = i128_wrap(value, to);
+    }
+
+    if (is_wide(to)) {
+        store_wide(dst, value);
+    } else {
+        dst->u = value.lo;
+    }
+}
+
+static Int128 load_wide(const VMValue* slots) {
+    Int128 value = { slots[0].u, slots[1].u };
+    return value;
+}
+
+static void store_wide(VMValue* slots, Int128 value) {
+    slots[0].u = value.lo;
+    slots[1].u = value.hi;
+}
+
+static bool is_wide(TokenType type) {
+    return type == TOK_I128 || type == TOK_U128;
+}
@@ -0,0 +1,48 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bytecode.h"
+
+/// The number of register slots available to all active calls.
+#define VM_STACK_SLOTS (1u << 20)
+/// The maximum call depth.
+#define VM_MAX_FRAMES (1u << 16)
+
+/// Native code for a function, called with the argument slots in the
+/// layout of its window and writing the result slots.
+typedef void (*VMNativeEntry)(const VMValue* args, VMValue* result);
+
+/// Lets a tiered engine watch the interpreter and replace functions with
+/// native code while the program runs.
+typedef struct VMTier {
+    /// The VMNativeEntry of each function as a data pointer, NULL while
+    /// it is interpreted. Set by another thread and read atomically by
+    /// every call.
+    void** entries;
+    /// How often each function was called and jumped backward.
+    uint32_t* calls;
+    uint32_t* loops;
+    uint32_t callThreshold;
+    uint32_t loopThreshold;
+    /// Called on the interpreter thread the first time a function
+    /// reaches either threshold.
+    void (*hot)(void* ctx, uint32_t func);
+    void* ctx;
+} VMTier;
+
+/// Runs function entry of the module. args holds the argument slots in
+/// the layout of its window and result receives the returned slots, one
+/// or two depending on the return type. Both stacks are allocated once
+/// up front, so calls inside the program never allocate. Prints the
+/// error and returns false if the program panics.
+bool vm_run(const BCModule* module, uint32_t entry, const VMValue* args,
+    VMValue* result);
+/// Runs function entry like vm_run(), counting calls and backward jumps
+/// in tier and calling the native entries it provides instead of
+/// interpreting those functions. Native code runs on the machine stack.
+bool vm_run_tiered(const BCModule* module, uint32_t entry,
+    const VMValue* args, VMValue* result, VMTier* tier);
+
+#endif // VM_H
@@ -0,0 +1,207 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "watch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#define WATCH_INOTIFY 1
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#define WATCH_INOTIFY 0
+#endif
+
+// Every event naming a watched file marks it changed and restarts the
+// quiet period, so a burst of writes, renames and deletes ends in one
+// rebuild. The directories are watched rather than the files, since an
+// editor saving by writing a new file and renaming it over the old one
+// leaves a watch on the old file watching nothing.
+
+#if WATCH_INOTIFY
+/// The events on a directory that can change a file in it.
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE | \
+    IN_MOVED_FROM | IN_MOVED_TO)
+
+/// A file being watched.
+typedef struct WatchedFile {
+    /// The watch descriptor of its directory.
+    int dir;
+    /// The null-terminated name of the file within its directory.
+    char* name;
+} WatchedFile;
+
+/// Set by the signal handler to end the watch.
+static volatile sig_atomic_t stopRequested = 0;
+
+/// Asks the watch to stop, the handler of SIGINT and SIGTERM.
+static void request_stop(int sig);
+/// Adds a watch on the directory of path to the inotify instance fd,
+/// filling file. Returns false on failure.
+static bool watch_file(int fd, const char* path, WatchedFile* file);
+/// Reads the pending events of fd, marking the files they name in
+/// changed. Returns the number of files marked, or -1 on failure.
+static int read_events(int fd, const WatchedFile* files, size_t count,
+    bool* changed);
+#endif
+
+int watch_files(const char* const* paths, size_t count, uint32_t debounceMs,
+    WatchHandler handler, void* ctx) {
+#if WATCH_INOTIFY
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to start watching files: %s\n",
+            strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    WatchedFile* files = calloc(count, sizeof(WatchedFile));
+    bool* changed = calloc(count, sizeof(bool));
+    bool ok = files != NULL && changed != NULL;
+    if (!ok) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+    for (size_t i = 0; ok && i < count; i++) {
+        ok = watch_file(fd, paths[i], &files[i]);
+    }
+
+    struct sigaction action;
+    struct sigaction oldInt;
+    struct sigaction oldTerm;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    stopRequested = 0;
+    sigaction(SIGINT, &action, &oldInt);
+    sigaction(SIGTERM, &action, &oldTerm);
+
+    bool pending = false;
+    int exitCode = ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    while (ok && !stopRequested) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, pending ? (int)debounceMs : -1);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready < 0) {
+            fprintf(stderr, "Error: Failed to wait for changes: %s\n",
+                strerror(errno));
+            exitCode = EXIT_FAILURE;
+            break;
+        }
+
+        if (ready == 0) {
+            handler(ctx, changed);
+            memset(changed, 0, count * sizeof(bool));
+            pending = false;
+            continue;
+        }
+
+        int marked = read_events(fd, files, count, changed);
+        if (marked < 0) {
+            exitCode = EXIT_FAILURE;
+            break;
+        }
+        pending = pending || marked > 0;
+    }
+
+    sigaction(SIGINT, &oldInt, NULL);
+    sigaction(SIGTERM, &oldTerm, NULL);
+    for (size_t i = 0; files != NULL && i < count; i++) {
+        free(files[i].name);
+    }
+    free(files);
+    free(changed);
+    close(fd);
+    return exitCode;
+#else
+    (void)paths;
+    (void)count;
+    (void)debounceMs;
+    (void)handler;
+    (void)ctx;
+    fprintf(stderr, "Error: Watching files is not supported on this"\
+        " platform\n");
+    return EXIT_FAILURE;
+#endif
+}
+
+/* --- Helper Functions --- */
+
+#if WATCH_INOTIFY
+static void request_stop(int sig) {
+    (void)sig;
+    stopRequested = 1;
+}
+
+static bool watch_file(int fd, const char* path, WatchedFile* file) {
+    const char* slash = strrchr(path, '/');
+    const char* name = slash != NULL ? slash + 1 : path;
+    size_t dirLen = slash == NULL ? 1 : slash == path ? 1 :
+        (size_t)(slash - path);
+    char* dir = malloc(dirLen + 1);
+    file->name = malloc(strlen(name) + 1);
+    if (dir == NULL || file->name == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(dir);
+        return false;
+    }
+    memcpy(dir, slash == NULL ? "." : path, dirLen);
+    dir[dirLen] = '\0';
+    strcpy(file->name, name);
+
+    // Adding the same directory again returns its existing descriptor
+    file->dir = inotify_add_watch(fd, dir, WATCH_EVENTS);
+    if (file->dir < 0) {
+        fprintf(stderr, "Error: Failed to watch directory '%s': %s\n", dir,
+            strerror(errno));
+        free(dir);
+        return false;
+    }
+    free(dir);
+    return true;
+}
+
+static int read_events(int fd, const WatchedFile* files, size_t count,
+    bool* changed) {
+    // Aligned for the events read into it
+    union {
+        struct inotify_event event;
+        char bytes[4096];
+    } buffer;
+
+    ssize_t len = read(fd, buffer.bytes, sizeof(buffer.bytes));
+    if (len < 0 && errno == EINTR) {
+        return 0;
+    }
+    if (len <= 0) {
+        fprintf(stderr, "Error: Failed to read file changes: %s\n",
+            len < 0 ? strerror(errno) : "end of events");
+        return -1;
+    }
+
+    int marked = 0;
+    for (ssize_t pos = 0; pos < len;) {
+        const struct inotify_event* event =
+            (const struct inotify_event*)(buffer.bytes + pos);
+        pos += (ssize_t)(sizeof(struct inotify_event) + event->len);
+
+        // Events were lost, so any file may have changed
+        bool overflow = (event->mask & IN_Q_OVERFLOW) != 0;
+        for (size_t i = 0; i < count; i++) {
+            if (overflow || (event->wd == files[i].dir && event->len > 0 &&
+                strcmp(event->name, files[i].name) == 0)) {
+                changed[i] = true;
+                marked++;
+            }
+        }
+    }
+    return marked;
+}
+#endif
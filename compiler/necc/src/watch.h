@@ -0,0 +1,25 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// How long the watched files must stay unchanged after a change before
+/// a rebuild, in milliseconds. Editors and build tools often write a
+/// file several times in a row when saving.
+#define WATCH_DEBOUNCE_MS 50
+
+/// Rebuilds after the watched files changed, changed[i] telling whether
+/// paths[i] was among them.
+typedef void (*WatchHandler)(void* ctx, const bool* changed);
+
+/// Watches the count files at paths, calling handler once a burst of
+/// changes to them has been quiet for debounceMs milliseconds. Files are
+/// watched through their directories, so a file an editor replaces or
+/// deletes and writes again is still seen. Runs until interrupted by
+/// SIGINT or SIGTERM. Returns the exit code of the watch.
+int watch_files(const char* const* paths, size_t count, uint32_t debounceMs,
+    WatchHandler handler, void* ctx);
+
+#endif // WATCH_H
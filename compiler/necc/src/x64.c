@@ -0,0 +1,2122 @@
+#include "x64.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "int128.h"
+#include "pool.h"
+#include "regalloc.h"
+#include "types.h"
+
+// Values get a register from the linear scan allocator or their own
+// stack slot, 8 bytes or 16 for i128 and u128. Integers are kept sign or
+// zero extended to 64 bits by their own signedness like in the
+// bytecode, f32 is kept as single precision in the low half of its
+// register or slot and f64 as double. Instructions load their operands
+// into fixed scratch registers, rax, rcx, rdx, rsi, rdi, xmm0 and xmm1,
+// compute the result and store it back. The allocator only hands out
+// registers the scratch code and argument setup never touch.
+//
+// Functions that call nothing, including the libgcc and libm helpers,
+// run without a frame pointer and keep their spill slots in the red
+// zone below rsp if they fit. Other functions address their slots from
+// rbp, below the callee saved registers they use.
+//
+// Instructions are encoded as they are emitted, and the last few are
+// also kept in the form they were emitted from so peephole patterns can
+// match them and re-emit a replacement in their place. Labels, calls and
+// raw bytes end the window, so a rewrite never moves code a label,
+// relocation or later immediate refers to. Scratch registers never hold
+// a value from one IR instruction to the next, which patterns rely on to
+// drop writes to them before a branch.
+//
+// Functions compile independently, so a module can be spread over a
+// thread pool with every worker emitting into an object of its own. The
+// code is position independent apart from calls, which go through
+// relocations, so the functions are then copied into the output in
+// module order, giving the same bytes as compiling them one by one.
+
+typedef enum Reg {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+} Reg;
+
+// XMM registers are numbered like their names
+#define XMM0 0
+#define XMM1 1
+
+/// Condition codes, the low nibble of the jcc and setcc opcodes.
+typedef enum Cond {
+    CC_B = 0x2,
+    CC_AE = 0x3,
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_BE = 0x6,
+    CC_A = 0x7,
+    CC_S = 0x8,
+    CC_P = 0xa,
+    CC_NP = 0xb,
+    CC_L = 0xc,
+    CC_GE = 0xd,
+    CC_LE = 0xe,
+    CC_G = 0xf,
+    /// An unconditional jump.
+    CC_ALWAYS = 0x10,
+} Cond;
+
+/// Sets REX.W for a 64-bit operand size.
+#define OP_W 1
+/// The register operand of ModRM is a byte register, which needs a REX
+/// prefix to address sil and dil instead of dh and bh.
+#define OP_BYTE 2
+
+/// A register, or the memory operand [reg + disp].
+typedef struct Operand {
+    bool isMem;
+    uint8_t reg;
+    int32_t disp;
+} Operand;
+
+/// Where the System V ABI passes an argument.
+typedef struct ArgLoc {
+    bool inReg;
+    /// The index into argRegs, or the XMM register for floats.
+    uint8_t reg;
+    /// The offset from the first stack argument.
+    uint32_t offset;
+} ArgLoc;
+
+/// A rel32 field waiting for the position of its label.
+typedef struct Fixup {
+    size_t offset;
+    uint32_t label;
+    /// The position the field is relative to, the end of the field for
+    /// jumps and the start of the table for jump table entries.
+    size_t base;
+} Fixup;
+
+/// The number of emitted instructions peephole patterns can span.
+#define PEEP_WINDOW 4
+
+/// Kinds of instructions the peephole window keeps.
+typedef enum MachKind {
+    /// An instruction with a ModRM operand, from emit_op().
+    MACH_OP,
+    /// A register loaded with an immediate, from emit_mov_imm().
+    MACH_IMM,
+    /// A jump to a label, from emit_jump().
+    MACH_JUMP,
+} MachKind;
+
+/// An emitted instruction, described by the arguments it was emitted
+/// with.
+typedef struct MachInst {
+    MachKind kind;
+    /// The position of its first byte in .text.
+    size_t offset;
+    uint8_t prefix;
+    uint32_t opcode;
+    int flags;
+    /// The ModRM reg field, or the register a MACH_IMM loads.
+    uint8_t reg;
+    Operand rm;
+    uint64_t imm;
+    /// The condition and target of a MACH_JUMP.
+    Cond cond;
+    uint32_t label;
+} MachInst;
+
+/// A module being compiled by a thread pool.
+typedef struct ParallelCodegen {
+    const IRModule* module;
+    bool allocateRegs;
+    bool peephole;
+    /// The object each worker compiles its functions into.
+    ElfObject** arenas;
+    /// For each function, the worker that compiled it, its symbol in
+    /// that worker's object and the range of relocations it added.
+    uint32_t* workers;
+    uint32_t* symbols;
+    uint32_t* relocStart;
+    uint32_t* relocEnd;
+} ParallelCodegen;
+
+/// A function and the number of its instructions, which the time to
+/// compile it grows with.
+typedef struct FuncCost {
+    uint32_t func;
+    uint32_t cost;
+} FuncCost;
+
+/// State used while compiling one module.
+typedef struct Codegen {
+    const IRModule* module;
+    IRFunction* ir;
+    ElfObject* obj;
+    /// False to keep every value in its slot.
+    bool allocate;
+    /// The register of each value of the current function, RA_SPILLED
+    /// for values in a slot.
+    uint8_t* regs;
+    /// The offset of the slot of each spilled value from base.
+    int32_t* slots;
+    /// The register slots and stack arguments are addressed from, rbp,
+    /// or rsp in functions without a frame.
+    uint8_t base;
+    /// The offset of the first stack argument from base.
+    int32_t paramOffset;
+    bool hasFrame;
+    /// The callee saved registers the function uses, in push order.
+    uint8_t saved[5];
+    uint32_t savedCount;
+    /// The position of each label in .text. Labels of the current
+    /// function, the first ones are its blocks.
+    size_t* labels;
+    uint32_t labelCount;
+    uint32_t labelCap;
+    Fixup* fixups;
+    uint32_t fixupCount;
+    uint32_t fixupCap;
+    /// The number of uses of each value of the current function.
+    uint32_t* uses;
+    /// True to apply the peephole patterns.
+    bool peephole;
+    /// The instructions emitted since the last label, call or raw bytes,
+    /// at most PEEP_WINDOW of them, oldest first.
+    MachInst window[PEEP_WINDOW];
+    uint32_t windowCount;
+    bool ok;
+} Codegen;
+
+/// A peephole pattern over the last length instructions of the window.
+typedef struct Peephole {
+    uint32_t length;
+    /// Returns true if the instructions match the pattern.
+    bool (*match)(const MachInst* insts);
+    /// Emits the replacement for the matched instructions, which have
+    /// already been removed from .text.
+    void (*rewrite)(Codegen* cg, const MachInst* insts);
+} Peephole;
+
+/// The integer argument registers in order.
+static const uint8_t argRegs[6] = { RDI, RSI, RDX, RCX, R8, R9 };
+/// The callee saved registers the allocator may use.
+static const uint8_t calleeSavedRegs[5] = { RBX, R12, R13, R14, R15 };
+/// Allocatable registers, caller saved ones first so values that do not
+/// live across a call avoid saving registers in the prologue. The
+/// argument registers are left out so call setup never overwrites a
+/// value it still has to pass.
+static const uint8_t allocGprs[] = { R10, R11, RBX, R12, R13, R14, R15 };
+static const uint8_t allocFprs[] = { 8, 9, 10, 11, 12, 13, 14, 15 };
+/// The largest spill area a function without a frame keeps in the red
+/// zone.
+#define RED_ZONE_SIZE 128
+
+/// Compiles the module on a pool of threads workers.
+static bool compile_parallel(const IRModule* module, ElfObject* obj,
+    bool allocateRegs, bool peephole, uint32_t threads);
+/// Compiles a function into the object of a worker, the PoolTask of
+/// compile_parallel().
+static bool compile_task(void* ctx, uint32_t worker, uint32_t task);
+/// Orders FuncCosts by decreasing cost, then by function.
+static int compare_costs(const void* a, const void* b);
+/// Copies function index, compiled in parallel, into obj as if it had
+/// been compiled there.
+static bool merge_function(const ParallelCodegen* pc, uint32_t index,
+    ElfObject* obj);
+/// Compiles a single function.
+static void compile_function(Codegen* cg, uint32_t index);
+/// Lays out the frame of the current function from the register
+/// assignment. Returns the bytes to reserve below the saved registers.
+static uint32_t layout_frame(Codegen* cg);
+/// Emits the frame setup and moves the parameters to their registers or
+/// slots.
+static void compile_prologue(Codegen* cg, uint32_t frameSize);
+/// Emits the frame teardown and return.
+static void emit_epilogue(Codegen* cg);
+/// Returns true if the instruction calls a function, either a NeoC one
+/// or a runtime helper.
+static bool is_call(const IRFunction* func, uint32_t index);
+/// Compiles one instruction.
+static void compile_inst(Codegen* cg, uint32_t index);
+/// Compiles an arithmetic instruction.
+static void compile_arith(Codegen* cg, uint32_t index);
+/// Compiles a comparison.
+static void compile_compare(Codegen* cg, uint32_t index);
+/// Returns true if the instruction is a comparison whose only use is the
+/// branch right after it, with no phi copies in between. Its result is
+/// then left in rax for the branch instead of being stored.
+static bool feeds_branch(const Codegen* cg, uint32_t index);
+/// Compiles a cast.
+static void compile_cast(Codegen* cg, uint32_t index);
+/// Compiles a call.
+static void compile_call(Codegen* cg, uint32_t index);
+/// Converts the double in xmm0 to an integer type in rax, and rdx for
+/// 128-bit types. Saturates out of range values, NaN becomes zero.
+static void emit_float_to_int(Codegen* cg, TokenType to);
+/// Converts an integer value to a double in xmm0.
+static void emit_int_to_float(Codegen* cg, TokenType from, uint32_t value);
+/// Sets eax to the flag condition as a bool.
+static void emit_setcc(Codegen* cg, Cond cond);
+/// Compiles a switch into a jump table or a binary search.
+static void compile_switch(Codegen* cg, uint32_t index);
+/// Emits a binary search of rax among count ascending keys, jumping to
+/// the block of the key found or to defaultBlock.
+static void emit_search(Codegen* cg, const uint64_t* keys,
+    const uint32_t* blocks, uint32_t count, uint32_t defaultBlock,
+    bool isSigned);
+/// Emits the copies into the phis of a successor for the edge from
+/// block.
+static void emit_phi_copies(Codegen* cg, uint32_t block, uint32_t succ);
+/// Assigns argument locations to the given types. Returns the number of
+/// bytes of stack arguments, a multiple of 16.
+static uint32_t classify_args(const TokenType* types, uint32_t count,
+    ArgLoc* locs);
+
+/// Loads the low word of a value into a general register. Float values
+/// are loaded as their bits.
+static void load_value(Codegen* cg, uint8_t reg, uint32_t value);
+/// Loads the high word of a 128-bit value into a general register.
+static void load_high(Codegen* cg, uint8_t reg, uint32_t value);
+/// Loads a float value into an XMM register.
+static void load_float(Codegen* cg, uint8_t xmm, uint32_t value);
+/// Stores a general register to a word of a value. Float values are
+/// stored as their bits.
+static void store_value(Codegen* cg, uint8_t reg, uint32_t value,
+    int32_t word);
+/// Stores an XMM register to a float value.
+static void store_float(Codegen* cg, uint8_t xmm, uint32_t value);
+/// Sign or zero extends the low bits of a register to 64 bits as values
+/// of the type are kept.
+static void canonicalize(Codegen* cg, uint8_t reg, TokenType type);
+/// Returns a word of the bits of a constant.
+static uint64_t const_bits(const IRFunction* ir, uint32_t value, bool high);
+/// Returns the memory operand of a word of the slot of a value.
+static Operand slot_op(const Codegen* cg, uint32_t value, int32_t word);
+/// Returns a register operand.
+static Operand reg_op(uint8_t reg);
+
+/// Emits an instruction with a ModRM operand. opcode holds up to three
+/// bytes, the first one most significant, and prefix is a mandatory
+/// prefix or 0.
+static void emit_op(Codegen* cg, uint8_t prefix, uint32_t opcode, int flags,
+    uint8_t reg, Operand rm);
+/// Loads a 64-bit immediate into a register with the shortest encoding.
+static void emit_mov_imm(Codegen* cg, uint8_t reg, uint64_t imm);
+/// Emits push or pop, given as opcode 0x50 or 0x58, of a register.
+static void emit_stack_op(Codegen* cg, uint8_t opcode, uint8_t reg);
+/// Emits a call to a symbol, resolved by the linker.
+static void emit_call(Codegen* cg, const char* name);
+/// Emits a jump to a label, unconditional for CC_ALWAYS.
+static void emit_jump(Codegen* cg, Cond cond, uint32_t label);
+/// Emits a rel32 field holding the distance of a label from base.
+static void emit_rel32(Codegen* cg, uint32_t label, size_t base);
+/// Creates a label. Returns its id.
+static uint32_t new_label(Codegen* cg);
+/// Places a label at the current position.
+static void bind_label(Codegen* cg, uint32_t label);
+/// Appends raw bytes to .text.
+static void emit_bytes(Codegen* cg, const uint8_t* bytes, size_t count);
+static void emit_u8(Codegen* cg, uint8_t value);
+static void emit_u32(Codegen* cg, uint32_t value);
+/// Returns true if values of the type take two words.
+static bool is_wide(TokenType type);
+/// Appends bytes to .text without ending the peephole window.
+static void append_text(Codegen* cg, const uint8_t* bytes, size_t count);
+/// Registers a rel32 field at the current position.
+static void add_fixup(Codegen* cg, uint32_t label, size_t base);
+
+/// Adds an emitted instruction to the peephole window and applies the
+/// first pattern matching the end of the window.
+static void record_inst(Codegen* cg, const MachInst* inst);
+/// Emits an instruction of the window again.
+static void reemit(Codegen* cg, const MachInst* inst);
+/// Returns true if the instruction is a 64-bit move of the given opcode,
+/// 0x8b to load its reg field or 0x89 to store it.
+static bool is_move(const MachInst* inst, uint32_t opcode);
+/// Returns true if the instruction reads the flags.
+static bool reads_flags(const MachInst* inst);
+/// mov [m], a, mov b, [m] reads back the register just stored.
+static bool match_store_load(const MachInst* insts);
+/// mov a, b, mov b, a copies a register back where it came from.
+static bool match_move_back(const MachInst* insts);
+/// mov r, 0, add or sub x, r, then an instruction that does not read
+/// the flags leaves x unchanged.
+static bool match_zero_arith(const MachInst* insts);
+/// setcc al, movzx eax, al, test eax, eax, jne or je branches on flags
+/// the comparison already set.
+static bool match_setcc_branch(const MachInst* insts);
+/// Emits the first instruction of the match.
+static void rewrite_keep_first(Codegen* cg, const MachInst* insts);
+/// Emits the store and copies the stored register if the load was into
+/// another one.
+static void rewrite_store_load(Codegen* cg, const MachInst* insts);
+/// Emits the first and the last instruction, dropping the arithmetic.
+static void rewrite_zero_arith(Codegen* cg, const MachInst* insts);
+/// Emits a jump on the condition of the setcc.
+static void rewrite_setcc_branch(Codegen* cg, const MachInst* insts);
+
+/// The peephole patterns, tried in order whenever an instruction is
+/// emitted. A pattern can match windows of up to PEEP_WINDOW
+/// instructions.
+static const Peephole peepholes[] = {
+    { 2, match_store_load, rewrite_store_load },
+    { 2, match_move_back, rewrite_keep_first },
+    { 3, match_zero_arith, rewrite_zero_arith },
+    { 4, match_setcc_branch, rewrite_setcc_branch },
+};
+
+bool x64_compile(const IRModule* module, ElfObject* obj,
+    bool allocateRegs, bool peephole, uint32_t threads) {
+    if (threads > 1 && module->funcCount > 1) {
+        return compile_parallel(module, obj, allocateRegs, peephole,
+            threads);
+    }
+    for (uint32_t i = 0; i < module->funcCount; i++) {
+        if (!x64_compile_function(module, i, obj, allocateRegs,
+            peephole)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool x64_compile_function(const IRModule* module, uint32_t index,
+    ElfObject* obj, bool allocateRegs, bool peephole) {
+    Codegen cg = { 0 };
+    cg.module = module;
+    cg.obj = obj;
+    cg.allocate = allocateRegs;
+    cg.peephole = peephole;
+    cg.ok = true;
+
+    compile_function(&cg, index);
+
+    free(cg.labels);
+    free(cg.fixups);
+    return cg.ok;
+}
+
+bool x64_compile_entry(const IRModule* module, uint32_t index,
+    const char* name, ElfObject* obj) {
+    const IRFunction* func = module->funcs[index];
+    Codegen cg = { 0 };
+    cg.module = module;
+    cg.obj = obj;
+    cg.ok = true;
+
+    while (cg.ok && obj->textSize % 16 != 0) {
+        emit_u8(&cg, 0xcc);
+    }
+    size_t start = obj->textSize;
+
+    ArgLoc* locs = malloc((func->paramCount + 1) * sizeof(ArgLoc));
+    if (locs == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+    uint32_t stackBytes = classify_args(func->paramTypes, func->paramCount,
+        locs);
+
+    // push rbp, mov rbp, rsp, push rbx, push r12, which keeps rsp 16 byte
+    // aligned, then keep the result pointer in rbx and the slots in r12
+    static const uint8_t enter[] = { 0x55, 0x48, 0x89, 0xe5 };
+    emit_bytes(&cg, enter, sizeof(enter));
+    emit_stack_op(&cg, 0x50, RBX);
+    emit_stack_op(&cg, 0x50, R12);
+    emit_op(&cg, 0, 0x8b, OP_W, RBX, reg_op(RSI));
+    emit_op(&cg, 0, 0x8b, OP_W, R12, reg_op(RDI));
+    if (stackBytes > 0) {
+        emit_op(&cg, 0, 0x81, OP_W, 5, reg_op(RSP));
+        emit_u32(&cg, stackBytes);
+    }
+
+    // Bytecode keeps f32 as a double, the native code as single precision
+    Operand slot = { true, R12, 0 };
+    for (uint32_t i = 0; i < func->paramCount; i++) {
+        TokenType type = func->paramTypes[i];
+        const ArgLoc* loc = &locs[i];
+        Operand stack = { true, RSP, (int32_t)loc->offset };
+        if (type_is_float(type)) {
+            uint8_t xmm = loc->inReg ? loc->reg : XMM0;
+            emit_op(&cg, 0xf2, 0x0f10, 0, xmm, slot);
+            if (type == TOK_F32) {
+                emit_op(&cg, 0xf2, 0x0f5a, 0, xmm, reg_op(xmm));
+            }
+            if (!loc->inReg) {
+                emit_op(&cg, 0xf2, 0x0f11, 0, XMM0, stack);
+            }
+        } else {
+            int32_t words = is_wide(type) ? 2 : 1;
+            for (int32_t word = 0; word < words; word++) {
+                uint8_t reg = loc->inReg ? argRegs[loc->reg + word] : RAX;
+                emit_op(&cg, 0, 0x8b, OP_W, reg, slot);
+                if (!loc->inReg) {
+                    emit_op(&cg, 0, 0x89, OP_W, RAX, stack);
+                    stack.disp += 8;
+                }
+                slot.disp += 8;
+            }
+            continue;
+        }
+        slot.disp += 8;
+    }
+    free(locs);
+    emit_call(&cg, func->name);
+
+    Operand result = { true, RBX, 0 };
+    if (type_is_float(func->returnType)) {
+        if (func->returnType == TOK_F32) {
+            emit_op(&cg, 0xf3, 0x0f5a, 0, XMM0, reg_op(XMM0));
+        }
+        emit_op(&cg, 0xf2, 0x0f11, 0, XMM0, result);
+    } else if (func->returnType != TOK_INVALID) {
+        emit_op(&cg, 0, 0x89, OP_W, RAX, result);
+        if (is_wide(func->returnType)) {
+            result.disp = 8;
+            emit_op(&cg, 0, 0x89, OP_W, RDX, result);
+        }
+    }
+
+    // lea rsp, [rbp - 16], pop r12, pop rbx, pop rbp, ret
+    Operand saved = { true, RBP, -16 };
+    emit_op(&cg, 0, 0x8d, OP_W, RSP, saved);
+    emit_stack_op(&cg, 0x58, R12);
+    emit_stack_op(&cg, 0x58, RBX);
+    static const uint8_t leave[] = { 0x5d, 0xc3 };
+    emit_bytes(&cg, leave, sizeof(leave));
+
+    uint32_t symbol = cg.ok ? elf_symbol(obj, name) : UINT32_MAX;
+    if (symbol == UINT32_MAX) {
+        return false;
+    }
+    elf_define_symbol(obj, symbol, start, obj->textSize - start);
+    return true;
+}
+
+/* --- Helper Functions --- */
+
+static bool compile_parallel(const IRModule* module, ElfObject* obj,
+    bool allocateRegs, bool peephole, uint32_t threads) {
+    uint32_t n = module->funcCount;
+    if (threads > n) {
+        threads = n;
+    }
+    ParallelCodegen pc = { 0 };
+    pc.module = module;
+    pc.allocateRegs = allocateRegs;
+    pc.peephole = peephole;
+    pc.arenas = calloc(threads, sizeof(ElfObject*));
+    pc.workers = malloc(n * sizeof(uint32_t));
+    pc.symbols = malloc(n * sizeof(uint32_t));
+    pc.relocStart = malloc(n * sizeof(uint32_t));
+    pc.relocEnd = malloc(n * sizeof(uint32_t));
+    FuncCost* costs = malloc(n * sizeof(FuncCost));
+    uint32_t* order = malloc(n * sizeof(uint32_t));
+    bool ok = pc.arenas != NULL && pc.workers != NULL &&
+        pc.symbols != NULL && pc.relocStart != NULL && pc.relocEnd != NULL &&
+        costs != NULL && order != NULL;
+    if (!ok) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+    for (uint32_t w = 0; ok && w < threads; w++) {
+        pc.arenas[w] = create_elf_object();
+        ok = pc.arenas[w] != NULL;
+    }
+
+    // The largest functions go first so no worker is left with a big one
+    // at the end
+    if (ok) {
+        for (uint32_t i = 0; i < n; i++) {
+            costs[i].func = i;
+            costs[i].cost = module->funcs[i]->instCount;
+        }
+        qsort(costs, n, sizeof(FuncCost), compare_costs);
+        for (uint32_t i = 0; i < n; i++) {
+            order[i] = costs[i].func;
+        }
+        ok = pool_run(order, n, threads, compile_task, &pc);
+    }
+    for (uint32_t i = 0; ok && i < n; i++) {
+        ok = merge_function(&pc, i, obj);
+    }
+
+    for (uint32_t w = 0; pc.arenas != NULL && w < threads; w++) {
+        free_elf_object(pc.arenas[w]);
+    }
+    free(pc.arenas);
+    free(pc.workers);
+    free(pc.symbols);
+    free(pc.relocStart);
+    free(pc.relocEnd);
+    free(costs);
+    free(order);
+    return ok;
+}
+
+static bool compile_task(void* ctx, uint32_t worker, uint32_t task) {
+    ParallelCodegen* pc = ctx;
+    ElfObject* arena = pc->arenas[worker];
+    pc->workers[task] = worker;
+    pc->relocStart[task] = arena->relocCount;
+    if (!x64_compile_function(pc->module, task, arena, pc->allocateRegs,
+        pc->peephole)) {
+        return false;
+    }
+    pc->relocEnd[task] = arena->relocCount;
+    // The function defined its symbol, so this only looks it up
+    pc->symbols[task] = elf_symbol(arena, pc->module->funcs[task]->name);
+    return true;
+}
+
+static int compare_costs(const void* a, const void* b) {
+    const FuncCost* left = a;
+    const FuncCost* right = b;
+    if (left->cost != right->cost) {
+        return left->cost > right->cost ? -1 : 1;
+    }
+    return left->func < right->func ? -1 : left->func > right->func;
+}
+
+static bool merge_function(const ParallelCodegen* pc, uint32_t index,
+    ElfObject* obj) {
+    const ElfObject* arena = pc->arenas[pc->workers[index]];
+    const ElfSymbol* symbol = &arena->symbols[pc->symbols[index]];
+    static const uint8_t int3 = 0xcc;
+    while (obj->textSize % 16 != 0) {
+        if (!elf_append(obj, &int3, 1)) {
+            return false;
+        }
+    }
+    uint64_t start = obj->textSize;
+
+    // Symbols are looked up in the order compiling here would have added
+    // them, the callees first and the function itself last
+    for (uint32_t i = pc->relocStart[index]; i < pc->relocEnd[index]; i++) {
+        const ElfReloc* reloc = &arena->relocs[i];
+        uint32_t target = elf_symbol(obj, arena->symbols[reloc->symbol].name);
+        if (target == UINT32_MAX || !elf_add_reloc(obj,
+            start + reloc->offset - symbol->offset, target, reloc->type,
+            reloc->addend)) {
+            return false;
+        }
+    }
+    if (!elf_append(obj, arena->text + symbol->offset, symbol->size)) {
+        return false;
+    }
+    uint32_t defined = elf_symbol(obj, symbol->name);
+    if (defined == UINT32_MAX) {
+        return false;
+    }
+    elf_define_symbol(obj, defined, start, symbol->size);
+    return true;
+}
+
+static void compile_function(Codegen* cg, uint32_t index) {
+    IRFunction* ir = cg->module->funcs[index];
+    cg->ir = ir;
+    cg->labelCount = 0;
+    cg->fixupCount = 0;
+
+    // Functions start 16 byte aligned, padded with int3
+    while (cg->ok && cg->obj->textSize % 16 != 0) {
+        emit_u8(cg, 0xcc);
+    }
+    size_t start = cg->obj->textSize;
+
+    cg->slots = malloc((ir->instCount + 1) * sizeof(int32_t));
+    cg->regs = malloc(ir->instCount + 1);
+    cg->uses = calloc(ir->instCount + 1, sizeof(uint32_t));
+    if (cg->slots == NULL || cg->regs == NULL || cg->uses == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(cg->slots);
+        free(cg->regs);
+        free(cg->uses);
+        cg->slots = NULL;
+        cg->regs = NULL;
+        cg->uses = NULL;
+        cg->ok = false;
+        return;
+    }
+    for (uint32_t i = 0; i < ir->instCount; i++) {
+        uint32_t* ops;
+        uint32_t count = ir_get_operands(ir, &ir->insts[i], &ops);
+        for (uint32_t j = 0; j < count; j++) {
+            if (!ir_is_const(ops[j])) {
+                cg->uses[ops[j]]++;
+            }
+        }
+    }
+
+    // Functions the allocator cannot handle keep every value in memory
+    RAConfig config = {
+        allocGprs, sizeof(allocGprs), allocFprs, sizeof(allocFprs),
+        1u << RBX | 1u << R12 | 1u << R13 | 1u << R14 | 1u << R15, 0,
+        is_call,
+    };
+    if (!cg->allocate || !regalloc_linear_scan(ir, &config, cg->regs)) {
+        memset(cg->regs, RA_SPILLED, ir->instCount);
+    }
+
+    uint32_t frameSize = layout_frame(cg);
+    for (uint32_t b = 0; cg->ok && b < ir->blockCount; b++) {
+        new_label(cg);
+    }
+    if (cg->ok) {
+        compile_prologue(cg, frameSize);
+    }
+    for (uint32_t b = 0; cg->ok && b < ir->blockCount; b++) {
+        bind_label(cg, b);
+        for (uint32_t i = ir->blocks[b].start; i < ir->blocks[b].end; i++) {
+            compile_inst(cg, i);
+        }
+    }
+    free(cg->slots);
+    free(cg->regs);
+    free(cg->uses);
+    cg->slots = NULL;
+    cg->regs = NULL;
+    cg->uses = NULL;
+    if (!cg->ok) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < cg->fixupCount; i++) {
+        const Fixup* fixup = &cg->fixups[i];
+        int64_t rel = (int64_t)cg->labels[fixup->label] -
+            (int64_t)fixup->base;
+        uint32_t bits = (uint32_t)rel;
+        for (int j = 0; j < 4; j++) {
+            cg->obj->text[fixup->offset + j] = (uint8_t)(bits >> (8 * j));
+        }
+    }
+
+    uint32_t symbol = elf_symbol(cg->obj, ir->name);
+    if (symbol == UINT32_MAX) {
+        cg->ok = false;
+        return;
+    }
+    elf_define_symbol(cg->obj, symbol, start, cg->obj->textSize - start);
+}
+
+static uint32_t layout_frame(Codegen* cg) {
+    IRFunction* ir = cg->ir;
+    bool leaf = cg->allocate;
+    uint32_t usedRegs = 0;
+    uint64_t spillSize = 0;
+    for (uint32_t i = 0; i < ir->instCount; i++) {
+        TokenType type = (TokenType)ir->insts[i].type;
+        leaf = leaf && !is_call(ir, i);
+        if (type == TOK_INVALID) {
+            continue;
+        }
+        if (cg->regs[i] == RA_SPILLED) {
+            spillSize += is_wide(type) ? 16 : 8;
+        } else if (!type_is_float(type)) {
+            usedRegs |= 1u << cg->regs[i];
+        }
+    }
+
+    cg->savedCount = 0;
+    for (uint32_t i = 0; i < sizeof(calleeSavedRegs); i++) {
+        if (usedRegs & (1u << calleeSavedRegs[i])) {
+            cg->saved[cg->savedCount++] = calleeSavedRegs[i];
+        }
+    }
+    int32_t pushed = 8 * (int32_t)cg->savedCount;
+
+    // Slots go below the saved registers, and rsp stays 16 byte aligned
+    // at calls
+    cg->hasFrame = !leaf || spillSize > RED_ZONE_SIZE;
+    uint64_t frameSize = 0;
+    int32_t slot = 0;
+    if (cg->hasFrame) {
+        frameSize = ((spillSize + (uint64_t)pushed + 15) & ~(uint64_t)15) -
+            (uint64_t)pushed;
+        cg->base = RBP;
+        cg->paramOffset = 16;
+        slot = -pushed;
+    } else {
+        cg->base = RSP;
+        cg->paramOffset = 8 + pushed;
+    }
+    if (frameSize > INT32_MAX / 2) {
+        fprintf(stderr, "Error: Function '%s' has too many values\n",
+            ir->name);
+        cg->ok = false;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < ir->instCount; i++) {
+        TokenType type = (TokenType)ir->insts[i].type;
+        cg->slots[i] = 0;
+        if (type != TOK_INVALID && cg->regs[i] == RA_SPILLED) {
+            slot -= is_wide(type) ? 16 : 8;
+            cg->slots[i] = slot;
+        }
+    }
+    return (uint32_t)frameSize;
+}
+
+static void compile_prologue(Codegen* cg, uint32_t frameSize) {
+    IRFunction* ir = cg->ir;
+
+    // push rbp, mov rbp, rsp, push the saved registers, sub rsp, frameSize
+    if (cg->hasFrame) {
+        static const uint8_t enter[] = { 0x55, 0x48, 0x89, 0xe5 };
+        emit_bytes(cg, enter, sizeof(enter));
+    }
+    for (uint32_t i = 0; i < cg->savedCount; i++) {
+        emit_stack_op(cg, 0x50, cg->saved[i]);
+    }
+    if (frameSize > 0) {
+        emit_op(cg, 0, 0x81, OP_W, 5, reg_op(RSP));
+        emit_u32(cg, frameSize);
+    }
+
+    ArgLoc* locs = malloc((ir->paramCount + 1) * sizeof(ArgLoc));
+    if (locs == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        cg->ok = false;
+        return;
+    }
+    classify_args(ir->paramTypes, ir->paramCount, locs);
+
+    for (uint32_t i = 0; i < ir->instCount; i++) {
+        const IRInst* inst = &ir->insts[i];
+        if (inst->op != IR_PARAM) {
+            continue;
+        }
+
+        TokenType type = (TokenType)inst->type;
+        const ArgLoc* loc = &locs[inst->args[0]];
+        Operand stack = {
+            true, cg->base, cg->paramOffset + (int32_t)loc->offset,
+        };
+
+        if (type_is_float(type) && loc->inReg) {
+            store_float(cg, loc->reg, i);
+        } else if (is_wide(type)) {
+            for (int32_t word = 0; word < 2; word++) {
+                uint8_t reg = RAX;
+                if (loc->inReg) {
+                    reg = argRegs[loc->reg + word];
+                } else {
+                    emit_op(cg, 0, 0x8b, OP_W, RAX, stack);
+                    stack.disp += 8;
+                }
+                store_value(cg, reg, i, word);
+            }
+        } else {
+            uint8_t reg = RAX;
+            if (loc->inReg) {
+                reg = argRegs[loc->reg];
+            } else {
+                emit_op(cg, 0, 0x8b, OP_W, RAX, stack);
+            }
+            // The ABI leaves the upper bits of narrow arguments undefined
+            if (!type_is_float(type)) {
+                canonicalize(cg, reg, type);
+            }
+            store_value(cg, reg, i, 0);
+        }
+    }
+
+    free(locs);
+}
+
+static void compile_inst(Codegen* cg, uint32_t index) {
+    IRFunction* ir = cg->ir;
+    const IRInst* inst = &ir->insts[index];
+    TokenType type = (TokenType)inst->type;
+    uint32_t block = ir_block_of(ir, index);
+    uint32_t nextBlock = block + 1;
+
+    switch ((IROp)inst->op) {
+        case IR_NOP:
+        case IR_PARAM:
+        case IR_PHI:
+            // Parameters are stored by the prologue, phis by their
+            // predecessors
+            break;
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_MOD:
+            compile_arith(cg, index);
+            break;
+        case IR_NEG:
+            load_value(cg, RAX, inst->args[0]);
+            if (type == TOK_F64) {
+                // btc rax, 63
+                emit_op(cg, 0, 0x0fba, OP_W, 7, reg_op(RAX));
+                emit_u8(cg, 63);
+            } else if (type == TOK_F32) {
+                // btc eax, 31
+                emit_op(cg, 0, 0x0fba, 0, 7, reg_op(RAX));
+                emit_u8(cg, 31);
+            } else if (is_wide(type)) {
+                // neg rax, adc rdx, 0, neg rdx
+                load_high(cg, RDX, inst->args[0]);
+                emit_op(cg, 0, 0xf7, OP_W, 3, reg_op(RAX));
+                emit_op(cg, 0, 0x83, OP_W, 2, reg_op(RDX));
+                emit_u8(cg, 0);
+                emit_op(cg, 0, 0xf7, OP_W, 3, reg_op(RDX));
+                store_value(cg, RDX, index, 1);
+            } else {
+                emit_op(cg, 0, 0xf7, OP_W, 3, reg_op(RAX));
+                if (!(inst->flags & IR_FLAG_EXACT)) {
+                    canonicalize(cg, RAX, type);
+                }
+            }
+            store_value(cg, RAX, index, 0);
+            break;
+        case IR_NOT:
+            // xor eax, 1
+            load_value(cg, RAX, inst->args[0]);
+            emit_op(cg, 0, 0x83, 0, 6, reg_op(RAX));
+            emit_u8(cg, 1);
+            store_value(cg, RAX, index, 0);
+            break;
+        case IR_EQ:
+        case IR_NEQ:
+        case IR_LT:
+        case IR_LTE:
+        case IR_GT:
+        case IR_GTE:
+            compile_compare(cg, index);
+            break;
+        case IR_CAST:
+            compile_cast(cg, index);
+            break;
+        case IR_CALL:
+            compile_call(cg, index);
+            break;
+        case IR_JMP:
+            emit_phi_copies(cg, block, inst->args[0]);
+            if (inst->args[0] != nextBlock) {
+                emit_jump(cg, CC_ALWAYS, inst->args[0]);
+            }
+            break;
+        case IR_BR: {
+            const uint32_t* targets = ir->operands + inst->args[1];
+            emit_phi_copies(cg, block, targets[0]);
+            emit_phi_copies(cg, block, targets[1]);
+
+            // test eax, eax
+            if (index == 0 || !feeds_branch(cg, index - 1)) {
+                load_value(cg, RAX, inst->args[0]);
+            }
+            emit_op(cg, 0, 0x85, 0, RAX, reg_op(RAX));
+            if (targets[0] == nextBlock) {
+                emit_jump(cg, CC_E, targets[1]);
+            } else {
+                emit_jump(cg, CC_NE, targets[0]);
+                if (targets[1] != nextBlock) {
+                    emit_jump(cg, CC_ALWAYS, targets[1]);
+                }
+            }
+            break;
+        }
+        case IR_SWITCH:
+            compile_switch(cg, index);
+            break;
+        case IR_RET: {
+            uint32_t value = inst->args[0];
+            if (value != IR_NONE && type_is_float(ir->returnType)) {
+                load_float(cg, XMM0, value);
+            } else if (value != IR_NONE) {
+                load_value(cg, RAX, value);
+                if (is_wide(ir->returnType)) {
+                    load_high(cg, RDX, value);
+                }
+            }
+            emit_epilogue(cg);
+            break;
+        }
+        default:
+            fprintf(stderr, "Error: Unsupported IR op '%s' in x86-64"\
+                " backend\n", ir_op_name((IROp)inst->op));
+            cg->ok = false;
+            break;
+    }
+}
+
+static void emit_epilogue(Codegen* cg) {
+    if (cg->hasFrame && cg->savedCount > 0) {
+        // lea rsp, [rbp - 8 * savedCount]
+        Operand saved = { true, RBP, -8 * (int32_t)cg->savedCount };
+        emit_op(cg, 0, 0x8d, OP_W, RSP, saved);
+    }
+    for (uint32_t i = cg->savedCount; i-- > 0;) {
+        emit_stack_op(cg, 0x58, cg->saved[i]);
+    }
+    if (cg->hasFrame) {
+        // pop rbp, or leave if rsp still has to be restored
+        emit_u8(cg, cg->savedCount > 0 ? 0x5d : 0xc9);
+    }
+    emit_u8(cg, 0xc3);
+}
+
+static bool is_call(const IRFunction* func, uint32_t index) {
+    const IRInst* inst = &func->insts[index];
+    TokenType type = (TokenType)inst->type;
+    switch ((IROp)inst->op) {
+        case IR_CALL:
+            return true;
+        case IR_DIV:
+            return is_wide(type);
+        case IR_MOD:
+            return is_wide(type) || type_is_float(type);
+        case IR_CAST: {
+            TokenType from = ir_value_type(func, inst->args[0]);
+            return (is_wide(from) && type_is_float(type)) ||
+                (type_is_float(from) && is_wide(type));
+        }
+        default:
+            return false;
+    }
+}
+
+static void compile_arith(Codegen* cg, uint32_t index) {
+    const IRInst* inst = &cg->ir->insts[index];
+    TokenType type = (TokenType)inst->type;
+    IROp op = (IROp)inst->op;
+    uint32_t left = inst->args[0];
+    uint32_t right = inst->args[1];
+
+    if (type_is_float(type)) {
+        load_float(cg, XMM0, left);
+        load_float(cg, XMM1, right);
+        bool isF32 = type == TOK_F32;
+        if (op == IR_MOD) {
+            emit_call(cg, isF32 ? "fmodf" : "fmod");
+        } else {
+            static const uint32_t floatOps[] = {
+                [IR_ADD] = 0x0f58, [IR_SUB] = 0x0f5c, [IR_MUL] = 0x0f59,
+                [IR_DIV] = 0x0f5e,
+            };
+            emit_op(cg, isF32 ? 0xf3 : 0xf2, floatOps[op], 0, XMM0,
+                reg_op(XMM1));
+        }
+        store_float(cg, XMM0, index);
+        return;
+    }
+
+    bool isSigned = type_is_signed(type);
+    if (is_wide(type)) {
+        if (op == IR_DIV || op == IR_MOD) {
+            load_value(cg, RDI, left);
+            load_high(cg, RSI, left);
+            load_value(cg, RDX, right);
+            load_high(cg, RCX, right);
+
+            // mov rax, rdx, or rax, rcx, then trap on a zero divisor
+            uint32_t nonZero = new_label(cg);
+            emit_op(cg, 0, 0x8b, OP_W, RAX, reg_op(RDX));
+            emit_op(cg, 0, 0x0b, OP_W, RAX, reg_op(RCX));
+            emit_jump(cg, CC_NE, nonZero);
+            static const uint8_t ud2[] = { 0x0f, 0x0b };
+            emit_bytes(cg, ud2, sizeof(ud2));
+            bind_label(cg, nonZero);
+
+            if (op == IR_DIV) {
+                emit_call(cg, isSigned ? "__divti3" : "__udivti3");
+            } else {
+                emit_call(cg, isSigned ? "__modti3" : "__umodti3");
+            }
+        } else {
+            load_value(cg, RAX, left);
+            load_high(cg, RDX, left);
+            load_value(cg, RCX, right);
+            load_high(cg, RSI, right);
+            if (op == IR_ADD) {
+                // add rax, rcx, adc rdx, rsi
+                emit_op(cg, 0, 0x03, OP_W, RAX, reg_op(RCX));
+                emit_op(cg, 0, 0x13, OP_W, RDX, reg_op(RSI));
+            } else if (op == IR_SUB) {
+                // sub rax, rcx, sbb rdx, rsi
+                emit_op(cg, 0, 0x2b, OP_W, RAX, reg_op(RCX));
+                emit_op(cg, 0, 0x1b, OP_W, RDX, reg_op(RSI));
+            } else {
+                // The high word is hi(a.lo * b.lo) + a.lo * b.hi + a.hi * b.lo
+                emit_op(cg, 0, 0x0faf, OP_W, RSI, reg_op(RAX));
+                emit_op(cg, 0, 0x0faf, OP_W, RDX, reg_op(RCX));
+                emit_op(cg, 0, 0x03, OP_W, RSI, reg_op(RDX));
+                emit_op(cg, 0, 0xf7, OP_W, 4, reg_op(RCX));
+                emit_op(cg, 0, 0x03, OP_W, RDX, reg_op(RSI));
+            }
+        }
+        store_value(cg, RAX, index, 0);
+        store_value(cg, RDX, index, 1);
+        return;
+    }
+
+    load_value(cg, RAX, left);
+    load_value(cg, RCX, right);
+    switch (op) {
+        case IR_ADD:
+            emit_op(cg, 0, 0x03, OP_W, RAX, reg_op(RCX));
+            break;
+        case IR_SUB:
+            emit_op(cg, 0, 0x2b, OP_W, RAX, reg_op(RCX));
+            break;
+        case IR_MUL:
+            emit_op(cg, 0, 0x0faf, OP_W, RAX, reg_op(RCX));
+            break;
+        default: {
+            // Narrower values never overflow a 64-bit division, only the
+            // most negative i64 divided by -1 needs to wrap instead
+            uint32_t done = new_label(cg);
+            if (isSigned && type_bit_width(type) == 64) {
+                uint32_t divide = new_label(cg);
+                emit_op(cg, 0, 0x83, OP_W, 7, reg_op(RCX));
+                emit_u8(cg, 0xff);
+                emit_jump(cg, CC_NE, divide);
+                if (op == IR_DIV) {
+                    emit_op(cg, 0, 0xf7, OP_W, 3, reg_op(RAX));
+                } else {
+                    emit_op(cg, 0, 0x33, 0, RAX, reg_op(RAX));
+                }
+                emit_jump(cg, CC_ALWAYS, done);
+                bind_label(cg, divide);
+            }
+
+            if (isSigned) {
+                // cqo, idiv rcx
+                static const uint8_t cqo[] = { 0x48, 0x99 };
+                emit_bytes(cg, cqo, sizeof(cqo));
+                emit_op(cg, 0, 0xf7, OP_W, 7, reg_op(RCX));
+            } else {
+                // xor edx, edx, div rcx
+                emit_op(cg, 0, 0x33, 0, RDX, reg_op(RDX));
+                emit_op(cg, 0, 0xf7, OP_W, 6, reg_op(RCX));
+            }
+            if (op == IR_MOD) {
+                emit_op(cg, 0, 0x8b, OP_W, RAX, reg_op(RDX));
+            }
+            bind_label(cg, done);
+            break;
+        }
+    }
+
+    // Exact results already are the canonical value
+    if (!(inst->flags & IR_FLAG_EXACT)) {
+        canonicalize(cg, RAX, type);
+    }
+    store_value(cg, RAX, index, 0);
+}
+
+static void compile_compare(Codegen* cg, uint32_t index) {
+    const IRInst* inst = &cg->ir->insts[index];
+    TokenType type = ir_value_type(cg->ir, inst->args[0]);
+    IROp op = (IROp)inst->op;
+    uint32_t left = inst->args[0];
+    uint32_t right = inst->args[1];
+    // A branch right after uses the result in rax
+    bool fused = feeds_branch(cg, index);
+
+    if (type_is_float(type)) {
+        // ucomisd or ucomiss sets the flags like an unsigned compare,
+        // unordered sets all of ZF, PF and CF
+        uint8_t prefix = type == TOK_F32 ? 0 : 0x66;
+        load_float(cg, XMM0, left);
+        load_float(cg, XMM1, right);
+        bool swap = op == IR_LT || op == IR_LTE;
+        emit_op(cg, prefix, 0x0f2e, 0, swap ? XMM1 : XMM0,
+            reg_op(swap ? XMM0 : XMM1));
+
+        if (op == IR_EQ || op == IR_NEQ) {
+            // sete al, setnp cl, and al, cl or setne al, setp cl, or al, cl
+            bool isEq = op == IR_EQ;
+            emit_op(cg, 0, 0x0f90 | (isEq ? CC_E : CC_NE), OP_BYTE, 0,
+                reg_op(RAX));
+            emit_op(cg, 0, 0x0f90 | (isEq ? CC_NP : CC_P), OP_BYTE, 0,
+                reg_op(RCX));
+            emit_op(cg, 0, isEq ? 0x20 : 0x08, OP_BYTE, RCX, reg_op(RAX));
+            emit_op(cg, 0, 0x0fb6, OP_BYTE, RAX, reg_op(RAX));
+        } else {
+            emit_setcc(cg, op == IR_LT || op == IR_GT ? CC_A : CC_AE);
+        }
+        if (!fused) {
+            store_value(cg, RAX, index, 0);
+        }
+        return;
+    }
+
+    bool isSigned = type_is_signed(type);
+    if (is_wide(type)) {
+        load_value(cg, RAX, left);
+        load_high(cg, RDX, left);
+        load_value(cg, RCX, right);
+        load_high(cg, RSI, right);
+
+        if (op == IR_EQ || op == IR_NEQ) {
+            // xor rax, rcx, xor rdx, rsi, or rax, rdx
+            emit_op(cg, 0, 0x33, OP_W, RAX, reg_op(RCX));
+            emit_op(cg, 0, 0x33, OP_W, RDX, reg_op(RSI));
+            emit_op(cg, 0, 0x0b, OP_W, RAX, reg_op(RDX));
+            emit_setcc(cg, op == IR_EQ ? CC_E : CC_NE);
+        } else {
+            // cmp and sbb compute the flags of the 128-bit subtraction,
+            // greater than is less than with the operands swapped
+            bool swap = op == IR_GT || op == IR_LTE;
+            emit_op(cg, 0, 0x3b, OP_W, swap ? RCX : RAX,
+                reg_op(swap ? RAX : RCX));
+            emit_op(cg, 0, 0x1b, OP_W, swap ? RSI : RDX,
+                reg_op(swap ? RDX : RSI));
+            bool isLess = op == IR_LT || op == IR_GT;
+            if (isSigned) {
+                emit_setcc(cg, isLess ? CC_L : CC_GE);
+            } else {
+                emit_setcc(cg, isLess ? CC_B : CC_AE);
+            }
+        }
+        if (!fused) {
+            store_value(cg, RAX, index, 0);
+        }
+        return;
+    }
+
+    static const uint8_t signedConds[] = {
+        [IR_EQ] = CC_E, [IR_NEQ] = CC_NE, [IR_LT] = CC_L, [IR_LTE] = CC_LE,
+        [IR_GT] = CC_G, [IR_GTE] = CC_GE,
+    };
+    static const uint8_t unsignedConds[] = {
+        [IR_EQ] = CC_E, [IR_NEQ] = CC_NE, [IR_LT] = CC_B, [IR_LTE] = CC_BE,
+        [IR_GT] = CC_A, [IR_GTE] = CC_AE,
+    };
+    load_value(cg, RAX, left);
+    load_value(cg, RCX, right);
+    emit_op(cg, 0, 0x3b, OP_W, RAX, reg_op(RCX));
+    emit_setcc(cg, (Cond)(isSigned ? signedConds[op] : unsignedConds[op]));
+    if (!fused) {
+        store_value(cg, RAX, index, 0);
+    }
+}
+
+static bool feeds_branch(const Codegen* cg, uint32_t index) {
+    const IRFunction* ir = cg->ir;
+    const IRInst* inst = &ir->insts[index];
+    if (inst->op < IR_EQ || inst->op > IR_GTE || index + 1 >= ir->instCount ||
+        cg->uses[index] != 1) {
+        return false;
+    }
+    const IRInst* next = &ir->insts[index + 1];
+    if (next->op != IR_BR || next->args[0] != index) {
+        return false;
+    }
+    // Phi copies on the edges go through the scratch registers
+    const uint32_t* targets = ir->operands + next->args[1];
+    for (int i = 0; i < 2; i++) {
+        const IRBlock* block = &ir->blocks[targets[i]];
+        if (block->start < block->end && ir->insts[block->start].op == IR_PHI) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void compile_cast(Codegen* cg, uint32_t index) {
+    const IRInst* inst = &cg->ir->insts[index];
+    uint32_t value = inst->args[0];
+    TokenType from = ir_value_type(cg->ir, value);
+    TokenType to = (TokenType)inst->type;
+
+    if (type_is_float(to)) {
+        if (type_is_float(from)) {
+            load_float(cg, XMM0, value);
+            if (from != to) {
+                // cvtss2sd or cvtsd2ss
+                emit_op(cg, from == TOK_F32 ? 0xf3 : 0xf2, 0x0f5a, 0, XMM0,
+                    reg_op(XMM0));
+            }
+        } else {
+            emit_int_to_float(cg, from, value);
+            if (to == TOK_F32) {
+                emit_op(cg, 0xf2, 0x0f5a, 0, XMM0, reg_op(XMM0));
+            }
+        }
+        store_float(cg, XMM0, index);
+        return;
+    }
+
+    if (type_is_float(from)) {
+        load_float(cg, XMM0, value);
+        if (from == TOK_F32) {
+            emit_op(cg, 0xf3, 0x0f5a, 0, XMM0, reg_op(XMM0));
+        }
+
+        if (to == TOK_BOOL) {
+            // xorps xmm1, xmm1, ucomisd xmm0, xmm1, then true unless
+            // equal and ordered
+            emit_op(cg, 0, 0x0f57, 0, XMM1, reg_op(XMM1));
+            emit_op(cg, 0x66, 0x0f2e, 0, XMM0, reg_op(XMM1));
+            emit_op(cg, 0, 0x0f90 | CC_NE, OP_BYTE, 0, reg_op(RAX));
+            emit_op(cg, 0, 0x0f90 | CC_P, OP_BYTE, 0, reg_op(RCX));
+            emit_op(cg, 0, 0x08, OP_BYTE, RCX, reg_op(RAX));
+            emit_op(cg, 0, 0x0fb6, OP_BYTE, RAX, reg_op(RAX));
+        } else {
+            emit_float_to_int(cg, to);
+        }
+    } else {
+        load_value(cg, RAX, value);
+        if (is_wide(from)) {
+            load_high(cg, RDX, value);
+        }
+
+        if (is_wide(to)) {
+            if (!is_wide(from) && type_is_signed(from)) {
+                // cqo
+                static const uint8_t cqo[] = { 0x48, 0x99 };
+                emit_bytes(cg, cqo, sizeof(cqo));
+            } else if (!is_wide(from)) {
+                emit_op(cg, 0, 0x33, 0, RDX, reg_op(RDX));
+            }
+        } else if (to == TOK_BOOL) {
+            if (is_wide(from)) {
+                emit_op(cg, 0, 0x0b, OP_W, RAX, reg_op(RDX));
+            } else {
+                emit_op(cg, 0, 0x85, OP_W, RAX, reg_op(RAX));
+            }
+            emit_setcc(cg, CC_NE);
+        } else if (!(inst->flags & IR_FLAG_EXACT)) {
+            canonicalize(cg, RAX, to);
+        }
+    }
+
+    store_value(cg, RAX, index, 0);
+    if (is_wide(to)) {
+        store_value(cg, RDX, index, 1);
+    }
+}
+
+static void compile_call(Codegen* cg, uint32_t index) {
+    IRFunction* ir = cg->ir;
+    const IRInst* inst = &ir->insts[index];
+    const uint32_t* pool = ir->operands + inst->args[0];
+    const IRFunction* callee = cg->module->funcs[pool[0]];
+    const uint32_t* args = pool + 1;
+    uint32_t count = inst->args[1];
+    TokenType type = (TokenType)inst->type;
+
+    ArgLoc* locs = malloc((count + 1) * sizeof(ArgLoc));
+    if (locs == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        cg->ok = false;
+        return;
+    }
+    uint32_t stackBytes = classify_args(callee->paramTypes, count, locs);
+
+    // sub rsp, stackBytes, then store the stack arguments through rax
+    if (stackBytes > 0) {
+        emit_op(cg, 0, 0x81, OP_W, 5, reg_op(RSP));
+        emit_u32(cg, stackBytes);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (locs[i].inReg) {
+            continue;
+        }
+        Operand stack = { true, RSP, (int32_t)locs[i].offset };
+        load_value(cg, RAX, args[i]);
+        emit_op(cg, 0, 0x89, OP_W, RAX, stack);
+        if (is_wide(callee->paramTypes[i])) {
+            stack.disp += 8;
+            load_high(cg, RAX, args[i]);
+            emit_op(cg, 0, 0x89, OP_W, RAX, stack);
+        }
+    }
+
+    // Register arguments are loaded last, loading a float constant only
+    // clobbers rax
+    for (uint32_t i = 0; i < count; i++) {
+        TokenType paramType = callee->paramTypes[i];
+        if (!locs[i].inReg) {
+            continue;
+        }
+        if (type_is_float(paramType)) {
+            load_float(cg, locs[i].reg, args[i]);
+        } else {
+            load_value(cg, argRegs[locs[i].reg], args[i]);
+            if (is_wide(paramType)) {
+                load_high(cg, argRegs[locs[i].reg + 1], args[i]);
+            }
+        }
+    }
+    free(locs);
+
+    emit_call(cg, callee->name);
+    if (stackBytes > 0) {
+        emit_op(cg, 0, 0x81, OP_W, 0, reg_op(RSP));
+        emit_u32(cg, stackBytes);
+    }
+
+    if (type == TOK_INVALID) {
+        return;
+    }
+    if (type_is_float(type)) {
+        store_float(cg, XMM0, index);
+    } else if (is_wide(type)) {
+        store_value(cg, RAX, index, 0);
+        store_value(cg, RDX, index, 1);
+    } else {
+        canonicalize(cg, RAX, type);
+        store_value(cg, RAX, index, 0);
+    }
+}
+
+static void emit_float_to_int(Codegen* cg, TokenType to) {
+    uint32_t zero = new_label(cg);
+    uint32_t max = new_label(cg);
+    uint32_t min = new_label(cg);
+    uint32_t done = new_label(cg);
+    size_t bits = type_bit_width(to);
+    bool isSigned = type_is_signed(to);
+
+    // ucomisd xmm0, xmm0 is unordered only for NaN
+    emit_op(cg, 0x66, 0x0f2e, 0, XMM0, reg_op(XMM0));
+    emit_jump(cg, CC_P, zero);
+
+    // Values at or above 2^bits, 2^(bits - 1) if signed, saturate to the
+    // maximum and values below the minimum to the minimum
+    double upper = ldexp(1.0, (int)(isSigned ? bits - 1 : bits));
+    double lower = isSigned ? -upper : 0.0;
+    uint64_t upperBits;
+    uint64_t lowerBits;
+    memcpy(&upperBits, &upper, sizeof(double));
+    memcpy(&lowerBits, &lower, sizeof(double));
+
+    emit_mov_imm(cg, RAX, upperBits);
+    emit_op(cg, 0x66, 0x0f6e, OP_W, XMM1, reg_op(RAX));
+    emit_op(cg, 0x66, 0x0f2e, 0, XMM0, reg_op(XMM1));
+    emit_jump(cg, CC_AE, max);
+    emit_mov_imm(cg, RAX, lowerBits);
+    emit_op(cg, 0x66, 0x0f6e, OP_W, XMM1, reg_op(RAX));
+    emit_op(cg, 0x66, 0x0f2e, 0, XMM0, reg_op(XMM1));
+    emit_jump(cg, CC_B, min);
+
+    if (is_wide(to)) {
+        emit_call(cg, isSigned ? "__fixdfti" : "__fixunsdfti");
+    } else if (to == TOK_U64) {
+        // Values from 2^63 are converted with 2^63 subtracted first
+        uint32_t large = new_label(cg);
+        double half = ldexp(1.0, 63);
+        uint64_t halfBits;
+        memcpy(&halfBits, &half, sizeof(double));
+        emit_mov_imm(cg, RAX, halfBits);
+        emit_op(cg, 0x66, 0x0f6e, OP_W, XMM1, reg_op(RAX));
+        emit_op(cg, 0x66, 0x0f2e, 0, XMM0, reg_op(XMM1));
+        emit_jump(cg, CC_AE, large);
+        emit_op(cg, 0xf2, 0x0f2c, OP_W, RAX, reg_op(XMM0));
+        emit_jump(cg, CC_ALWAYS, done);
+        bind_label(cg, large);
+        emit_op(cg, 0xf2, 0x0f5c, 0, XMM0, reg_op(XMM1));
+        emit_op(cg, 0xf2, 0x0f2c, OP_W, RAX, reg_op(XMM0));
+        emit_op(cg, 0, 0x0fba, OP_W, 7, reg_op(RAX));
+        emit_u8(cg, 63);
+    } else {
+        // cvttsd2si rax, xmm0, the value is in range so already extended
+        emit_op(cg, 0xf2, 0x0f2c, OP_W, RAX, reg_op(XMM0));
+    }
+    emit_jump(cg, CC_ALWAYS, done);
+
+    bind_label(cg, zero);
+    emit_op(cg, 0, 0x33, 0, RAX, reg_op(RAX));
+    emit_op(cg, 0, 0x33, 0, RDX, reg_op(RDX));
+    emit_jump(cg, CC_ALWAYS, done);
+
+    Int128 maxValue = i128_type_limit(to, true);
+    Int128 minValue = i128_type_limit(to, false);
+    bind_label(cg, max);
+    emit_mov_imm(cg, RAX, maxValue.lo);
+    emit_mov_imm(cg, RDX, maxValue.hi);
+    emit_jump(cg, CC_ALWAYS, done);
+    bind_label(cg, min);
+    emit_mov_imm(cg, RAX, minValue.lo);
+    emit_mov_imm(cg, RDX, minValue.hi);
+    bind_label(cg, done);
+}
+
+static void emit_int_to_float(Codegen* cg, TokenType from, uint32_t value) {
+    if (is_wide(from)) {
+        load_value(cg, RDI, value);
+        load_high(cg, RSI, value);
+        emit_call(cg, type_is_signed(from) ? "__floattidf" :
+            "__floatuntidf");
+        return;
+    }
+
+    // xorps xmm0, xmm0 breaks the dependency on its old value
+    load_value(cg, RAX, value);
+    emit_op(cg, 0, 0x0f57, 0, XMM0, reg_op(XMM0));
+    if (from != TOK_U64) {
+        // cvtsi2sd xmm0, rax, every narrower value fits an i64
+        emit_op(cg, 0xf2, 0x0f2a, OP_W, XMM0, reg_op(RAX));
+        return;
+    }
+
+    // Values from 2^63 are halved keeping the lowest bit for rounding,
+    // converted and doubled
+    uint32_t large = new_label(cg);
+    uint32_t done = new_label(cg);
+    emit_op(cg, 0, 0x85, OP_W, RAX, reg_op(RAX));
+    emit_jump(cg, CC_S, large);
+    emit_op(cg, 0xf2, 0x0f2a, OP_W, XMM0, reg_op(RAX));
+    emit_jump(cg, CC_ALWAYS, done);
+    bind_label(cg, large);
+    emit_op(cg, 0, 0x8b, OP_W, RCX, reg_op(RAX));
+    emit_op(cg, 0, 0xd1, OP_W, 5, reg_op(RCX));
+    emit_op(cg, 0, 0x83, 0, 4, reg_op(RAX));
+    emit_u8(cg, 1);
+    emit_op(cg, 0, 0x0b, OP_W, RCX, reg_op(RAX));
+    emit_op(cg, 0xf2, 0x0f2a, OP_W, XMM0, reg_op(RCX));
+    emit_op(cg, 0xf2, 0x0f58, 0, XMM0, reg_op(XMM0));
+    bind_label(cg, done);
+}
+
+static void emit_setcc(Codegen* cg, Cond cond) {
+    // setcc al, movzx eax, al
+    emit_op(cg, 0, 0x0f90 | cond, OP_BYTE, 0, reg_op(RAX));
+    emit_op(cg, 0, 0x0fb6, OP_BYTE, RAX, reg_op(RAX));
+}
+
+static void compile_switch(Codegen* cg, uint32_t index) {
+    IRFunction* ir = cg->ir;
+    const IRInst* inst = &ir->insts[index];
+    uint32_t block = ir_block_of(ir, index);
+    const uint32_t* cases = ir->operands + inst->args[1];
+    uint32_t count = cases[0];
+    uint32_t defaultBlock = cases[1];
+    const uint32_t* targets = cases + 2;
+    for (uint32_t k = 0; k <= count; k++) {
+        emit_phi_copies(cg, block, cases[1 + k]);
+    }
+
+    uint64_t* keys = malloc((count + 1) * sizeof(uint64_t));
+    if (keys == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        cg->ok = false;
+        return;
+    }
+    for (uint32_t k = 0; k < count; k++) {
+        keys[k] = const_bits(ir, cases[2 + count + k], false);
+    }
+
+    load_value(cg, RAX, inst->args[0]);
+    if (!ir_switch_is_dense(ir, inst)) {
+        // Narrower unsigned values are zero extended, so only u64 needs
+        // unsigned compares
+        emit_search(cg, keys, targets, count, defaultBlock,
+            ir_value_type(ir, inst->args[0]) != TOK_U64);
+        free(keys);
+        return;
+    }
+
+    // Values below the first key wrap around and fail the bounds check
+    uint32_t span = (uint32_t)(keys[count - 1] - keys[0]) + 1;
+    if (keys[0] != 0) {
+        // sub rax, rcx
+        emit_mov_imm(cg, RCX, keys[0]);
+        emit_op(cg, 0, 0x29, OP_W, RCX, reg_op(RAX));
+    }
+    // cmp rax, span - 1
+    emit_op(cg, 0, 0x81, OP_W, 7, reg_op(RAX));
+    emit_u32(cg, span - 1);
+    emit_jump(cg, CC_A, defaultBlock);
+
+    // lea rcx, [rip + table], movsxd rax, [rcx + rax * 4], add rax, rcx,
+    // jmp rax, with the table of offsets from its start right after
+    uint32_t table = new_label(cg);
+    static const uint8_t lea[] = { 0x48, 0x8d, 0x0d };
+    static const uint8_t dispatch[] = {
+        0x48, 0x63, 0x04, 0x81, 0x48, 0x01, 0xc8, 0xff, 0xe0,
+    };
+    emit_bytes(cg, lea, sizeof(lea));
+    emit_rel32(cg, table, cg->obj->textSize + 4);
+    emit_bytes(cg, dispatch, sizeof(dispatch));
+    while (cg->ok && cg->obj->textSize % 4 != 0) {
+        emit_u8(cg, 0xcc);
+    }
+    bind_label(cg, table);
+    size_t start = cg->obj->textSize;
+    uint32_t next = 0;
+    for (uint32_t k = 0; k < span; k++) {
+        bool hit = keys[next] - keys[0] == k;
+        emit_rel32(cg, hit ? targets[next] : defaultBlock, start);
+        next += hit ? 1 : 0;
+    }
+    free(keys);
+}
+
+static void emit_search(Codegen* cg, const uint64_t* keys,
+    const uint32_t* blocks, uint32_t count, uint32_t defaultBlock,
+    bool isSigned) {
+    // Short ranges are cheaper to test one by one
+    uint32_t mid = count <= 3 ? 0 : count / 2;
+    for (uint32_t k = mid; k < count; k++) {
+        int64_t key = (int64_t)keys[k];
+        if (key >= INT32_MIN && key <= INT32_MAX) {
+            // cmp rax, imm32
+            emit_op(cg, 0, 0x81, OP_W, 7, reg_op(RAX));
+            emit_u32(cg, (uint32_t)key);
+        } else {
+            // cmp rax, rcx
+            emit_mov_imm(cg, RCX, keys[k]);
+            emit_op(cg, 0, 0x39, OP_W, RCX, reg_op(RAX));
+        }
+        emit_jump(cg, CC_E, blocks[k]);
+        if (mid > 0) {
+            break;
+        }
+    }
+    if (mid == 0) {
+        emit_jump(cg, CC_ALWAYS, defaultBlock);
+        return;
+    }
+
+    uint32_t upper = new_label(cg);
+    emit_jump(cg, isSigned ? CC_G : CC_A, upper);
+    emit_search(cg, keys, blocks, mid, defaultBlock, isSigned);
+    bind_label(cg, upper);
+    emit_search(cg, keys + mid + 1, blocks + mid + 1, count - mid - 1,
+        defaultBlock, isSigned);
+}
+
+static void emit_phi_copies(Codegen* cg, uint32_t block, uint32_t succ) {
+    IRFunction* ir = cg->ir;
+    uint32_t count;
+    IRMove* moves = ir_phi_moves(ir, block, succ, NULL, &count);
+    if (moves == NULL) {
+        cg->ok = false;
+        return;
+    }
+
+    // rcx and rdx hold a phi saved to break a cycle
+    for (uint32_t i = 0; i < count; i++) {
+        const IRMove* move = &moves[i];
+        uint32_t phi = move->dst != IR_NONE ? move->dst : move->src;
+        bool wide = is_wide((TokenType)ir->insts[phi].type);
+        if (move->dst == IR_NONE) {
+            load_value(cg, RCX, move->src);
+            if (wide) {
+                load_high(cg, RDX, move->src);
+            }
+        } else if (move->src == IR_NONE) {
+            store_value(cg, RCX, move->dst, 0);
+            if (wide) {
+                store_value(cg, RDX, move->dst, 1);
+            }
+        } else {
+            load_value(cg, RAX, move->src);
+            store_value(cg, RAX, move->dst, 0);
+            if (wide) {
+                load_high(cg, RAX, move->src);
+                store_value(cg, RAX, move->dst, 1);
+            }
+        }
+    }
+    free(moves);
+}
+
+static uint32_t classify_args(const TokenType* types, uint32_t count,
+    ArgLoc* locs) {
+    uint32_t gprs = 0;
+    uint32_t xmms = 0;
+    uint32_t stack = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        ArgLoc* loc = &locs[i];
+        loc->inReg = false;
+        loc->reg = 0;
+        loc->offset = 0;
+
+        if (type_is_float(types[i]) && xmms < 8) {
+            loc->inReg = true;
+            loc->reg = (uint8_t)xmms++;
+        } else if (is_wide(types[i]) && gprs + 2 <= 6) {
+            loc->inReg = true;
+            loc->reg = (uint8_t)gprs;
+            gprs += 2;
+        } else if (!type_is_float(types[i]) && !is_wide(types[i]) &&
+            gprs < 6) {
+            loc->inReg = true;
+            loc->reg = (uint8_t)gprs++;
+        } else {
+            // 128-bit values on the stack are 16 byte aligned
+            if (is_wide(types[i])) {
+                stack = (stack + 15) & ~UINT32_C(15);
+            }
+            loc->offset = stack;
+            stack += is_wide(types[i]) ? 16 : 8;
+        }
+    }
+
+    return (stack + 15) & ~UINT32_C(15);
+}
+
+static void load_value(Codegen* cg, uint8_t reg, uint32_t value) {
+    if (ir_is_const(value)) {
+        emit_mov_imm(cg, reg, const_bits(cg->ir, value, false));
+    } else if (cg->regs[value] != RA_SPILLED &&
+        type_is_float(ir_value_type(cg->ir, value))) {
+        // movq reg, xmm
+        emit_op(cg, 0x66, 0x0f7e, OP_W, cg->regs[value], reg_op(reg));
+    } else if (cg->regs[value] != RA_SPILLED) {
+        emit_op(cg, 0, 0x8b, OP_W, reg, reg_op(cg->regs[value]));
+    } else {
+        emit_op(cg, 0, 0x8b, OP_W, reg, slot_op(cg, value, 0));
+    }
+}
+
+static void load_high(Codegen* cg, uint8_t reg, uint32_t value) {
+    if (ir_is_const(value)) {
+        emit_mov_imm(cg, reg, const_bits(cg->ir, value, true));
+    } else {
+        emit_op(cg, 0, 0x8b, OP_W, reg, slot_op(cg, value, 1));
+    }
+}
+
+static void load_float(Codegen* cg, uint8_t xmm, uint32_t value) {
+    if (ir_is_const(value)) {
+        // mov rax, bits, movq xmm, rax
+        emit_mov_imm(cg, RAX, const_bits(cg->ir, value, false));
+        emit_op(cg, 0x66, 0x0f6e, OP_W, xmm, reg_op(RAX));
+        return;
+    }
+    if (cg->regs[value] != RA_SPILLED) {
+        // movaps copies either width
+        emit_op(cg, 0, 0x0f28, 0, xmm, reg_op(cg->regs[value]));
+        return;
+    }
+
+    // movss or movsd
+    bool isF32 = ir_value_type(cg->ir, value) == TOK_F32;
+    emit_op(cg, isF32 ? 0xf3 : 0xf2, 0x0f10, 0, xmm,
+        slot_op(cg, value, 0));
+}
+
+static void store_value(Codegen* cg, uint8_t reg, uint32_t value,
+    int32_t word) {
+    uint8_t target = cg->regs[value];
+    if (target != RA_SPILLED &&
+        type_is_float(ir_value_type(cg->ir, value))) {
+        // movq xmm, reg
+        emit_op(cg, 0x66, 0x0f6e, OP_W, target, reg_op(reg));
+    } else if (target != RA_SPILLED) {
+        emit_op(cg, 0, 0x8b, OP_W, target, reg_op(reg));
+    } else {
+        emit_op(cg, 0, 0x89, OP_W, reg, slot_op(cg, value, word));
+    }
+}
+
+static void store_float(Codegen* cg, uint8_t xmm, uint32_t value) {
+    if (cg->regs[value] != RA_SPILLED) {
+        emit_op(cg, 0, 0x0f28, 0, cg->regs[value], reg_op(xmm));
+        return;
+    }
+    bool isF32 = ir_value_type(cg->ir, value) == TOK_F32;
+    emit_op(cg, isF32 ? 0xf3 : 0xf2, 0x0f11, 0, xmm,
+        slot_op(cg, value, 0));
+}
+
+static void canonicalize(Codegen* cg, uint8_t reg, TokenType type) {
+    switch (type) {
+        case TOK_I32:
+            // movsxd reg, reg32
+            emit_op(cg, 0, 0x63, OP_W, reg, reg_op(reg));
+            break;
+        case TOK_U32:
+            // mov reg32, reg32
+            emit_op(cg, 0, 0x8b, 0, reg, reg_op(reg));
+            break;
+        case TOK_I16:
+            emit_op(cg, 0, 0x0fbf, OP_W, reg, reg_op(reg));
+            break;
+        case TOK_U16:
+            emit_op(cg, 0, 0x0fb7, 0, reg, reg_op(reg));
+            break;
+        case TOK_I8:
+            emit_op(cg, 0, 0x0fbe, OP_W | OP_BYTE, reg, reg_op(reg));
+            break;
+        case TOK_U8:
+        case TOK_CHAR:
+        case TOK_BOOL:
+            emit_op(cg, 0, 0x0fb6, OP_BYTE, reg, reg_op(reg));
+            break;
+        default:
+            break;
+    }
+}
+
+static uint64_t const_bits(const IRFunction* ir, uint32_t value, bool high) {
+    ConstValue constValue = ir_const_value(ir, value);
+    TokenType type = ir_value_type(ir, value);
+
+    if (type == TOK_F64) {
+        uint64_t bits;
+        memcpy(&bits, &constValue.f, sizeof(double));
+        return high ? 0 : bits;
+    }
+    if (type == TOK_F32) {
+        float single = (float)constValue.f;
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(float));
+        return high ? 0 : bits;
+    }
+
+    // Constants are stored wrapped to their type, so the low word is
+    // already sign or zero extended
+    return high ? constValue.i.hi : constValue.i.lo;
+}
+
+static Operand slot_op(const Codegen* cg, uint32_t value, int32_t word) {
+    Operand op = { true, cg->base, cg->slots[value] + word * 8 };
+    return op;
+}
+
+static Operand reg_op(uint8_t reg) {
+    Operand op = { false, reg, 0 };
+    return op;
+}
+
+static void emit_op(Codegen* cg, uint8_t prefix, uint32_t opcode, int flags,
+    uint8_t reg, Operand rm) {
+    uint8_t buf[16];
+    size_t len = 0;
+
+    if (prefix != 0) {
+        buf[len++] = prefix;
+    }
+    uint8_t rex = 0x40;
+    rex |= (flags & OP_W) ? 0x08 : 0;
+    rex |= (reg & 8) ? 0x04 : 0;
+    rex |= (rm.reg & 8) ? 0x01 : 0;
+    if (rex != 0x40 || ((flags & OP_BYTE) && !rm.isMem && rm.reg >= 4)) {
+        buf[len++] = rex;
+    }
+    if (opcode > 0xffff) {
+        buf[len++] = (uint8_t)(opcode >> 16);
+    }
+    if (opcode > 0xff) {
+        buf[len++] = (uint8_t)(opcode >> 8);
+    }
+    buf[len++] = (uint8_t)opcode;
+
+    if (!rm.isMem) {
+        buf[len++] = (uint8_t)(0xc0 | (reg & 7) << 3 | (rm.reg & 7));
+    } else {
+        // rbp and r13 as a base always need a displacement, rsp and r12
+        // need a SIB byte
+        uint8_t base = rm.reg & 7;
+        uint8_t mod = 2;
+        if (rm.disp == 0 && base != RBP) {
+            mod = 0;
+        } else if (rm.disp >= INT8_MIN && rm.disp <= INT8_MAX) {
+            mod = 1;
+        }
+        buf[len++] = (uint8_t)(mod << 6 | (reg & 7) << 3 | base);
+        if (base == RSP) {
+            buf[len++] = 0x24;
+        }
+        if (mod == 1) {
+            buf[len++] = (uint8_t)rm.disp;
+        } else if (mod == 2) {
+            for (int i = 0; i < 4; i++) {
+                buf[len++] = (uint8_t)((uint32_t)rm.disp >> (8 * i));
+            }
+        }
+    }
+
+    MachInst inst = { MACH_OP, cg->obj->textSize, prefix, opcode, flags,
+        reg, rm, 0, CC_ALWAYS, 0 };
+    append_text(cg, buf, len);
+    record_inst(cg, &inst);
+}
+
+static void emit_mov_imm(Codegen* cg, uint8_t reg, uint64_t imm) {
+    uint8_t buf[10];
+    size_t len = 0;
+    uint8_t rex = (reg & 8) ? 0x41 : 0;
+    size_t immBytes = 4;
+
+    if (imm <= UINT32_MAX) {
+        // mov reg32, imm32 zero extends
+        if (rex != 0) {
+            buf[len++] = rex;
+        }
+        buf[len++] = (uint8_t)(0xb8 | (reg & 7));
+    } else if ((int64_t)imm >= INT32_MIN && (int64_t)imm <= INT32_MAX) {
+        // mov reg, simm32 sign extends
+        buf[len++] = (uint8_t)(0x48 | rex);
+        buf[len++] = 0xc7;
+        buf[len++] = (uint8_t)(0xc0 | (reg & 7));
+    } else {
+        buf[len++] = (uint8_t)(0x48 | rex);
+        buf[len++] = (uint8_t)(0xb8 | (reg & 7));
+        immBytes = 8;
+    }
+    for (size_t i = 0; i < immBytes; i++) {
+        buf[len++] = (uint8_t)(imm >> (8 * i));
+    }
+
+    MachInst inst = { MACH_IMM, cg->obj->textSize, 0, 0, 0, reg,
+        reg_op(reg), imm, CC_ALWAYS, 0 };
+    append_text(cg, buf, len);
+    record_inst(cg, &inst);
+}
+
+static void emit_stack_op(Codegen* cg, uint8_t opcode, uint8_t reg) {
+    if (reg & 8) {
+        emit_u8(cg, 0x41);
+    }
+    emit_u8(cg, (uint8_t)(opcode | (reg & 7)));
+}
+
+static void emit_call(Codegen* cg, const char* name) {
+    uint32_t symbol = elf_symbol(cg->obj, name);
+    if (symbol == UINT32_MAX) {
+        cg->ok = false;
+        return;
+    }
+
+    emit_u8(cg, 0xe8);
+    if (cg->ok && !elf_add_reloc(cg->obj, cg->obj->textSize, symbol,
+        ELF_R_X86_64_PLT32, -4)) {
+        cg->ok = false;
+    }
+    emit_u32(cg, 0);
+}
+
+static void emit_jump(Codegen* cg, Cond cond, uint32_t label) {
+    MachInst inst = { MACH_JUMP, cg->obj->textSize, 0, 0, 0, 0,
+        reg_op(RAX), 0, cond, label };
+    uint8_t opcode[2] = { 0x0f, (uint8_t)(0x80 | cond) };
+    static const uint8_t rel32[4] = { 0 };
+
+    if (cond == CC_ALWAYS) {
+        opcode[0] = 0xe9;
+        append_text(cg, opcode, 1);
+    } else {
+        append_text(cg, opcode, 2);
+    }
+    add_fixup(cg, label, cg->obj->textSize + 4);
+    append_text(cg, rel32, sizeof(rel32));
+    record_inst(cg, &inst);
+}
+
+static void emit_rel32(Codegen* cg, uint32_t label, size_t base) {
+    add_fixup(cg, label, base);
+    emit_u32(cg, 0);
+}
+
+static void add_fixup(Codegen* cg, uint32_t label, size_t base) {
+    if (cg->ok && cg->fixupCount == cg->fixupCap) {
+        uint32_t newCap = cg->fixupCap == 0 ? 64 : cg->fixupCap * 2;
+        Fixup* grown = realloc(cg->fixups, newCap * sizeof(Fixup));
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            cg->ok = false;
+            return;
+        }
+        cg->fixups = grown;
+        cg->fixupCap = newCap;
+    }
+    if (cg->ok) {
+        cg->fixups[cg->fixupCount].offset = cg->obj->textSize;
+        cg->fixups[cg->fixupCount].label = label;
+        cg->fixups[cg->fixupCount].base = base;
+        cg->fixupCount++;
+    }
+}
+
+static uint32_t new_label(Codegen* cg) {
+    if (cg->labelCount == cg->labelCap) {
+        uint32_t newCap = cg->labelCap == 0 ? 64 : cg->labelCap * 2;
+        size_t* grown = realloc(cg->labels, newCap * sizeof(size_t));
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            cg->ok = false;
+            return 0;
+        }
+        cg->labels = grown;
+        cg->labelCap = newCap;
+    }
+
+    cg->labels[cg->labelCount] = 0;
+    return cg->labelCount++;
+}
+
+static void bind_label(Codegen* cg, uint32_t label) {
+    // Code a label points to is never rewritten
+    cg->windowCount = 0;
+    if (cg->ok) {
+        cg->labels[label] = cg->obj->textSize;
+    }
+}
+
+static void emit_bytes(Codegen* cg, const uint8_t* bytes, size_t count) {
+    cg->windowCount = 0;
+    append_text(cg, bytes, count);
+}
+
+static void append_text(Codegen* cg, const uint8_t* bytes, size_t count) {
+    if (cg->ok && !elf_append(cg->obj, bytes, count)) {
+        cg->ok = false;
+    }
+}
+
+static void emit_u8(Codegen* cg, uint8_t value) {
+    emit_bytes(cg, &value, 1);
+}
+
+static void emit_u32(Codegen* cg, uint32_t value) {
+    uint8_t bytes[4] = {
+        (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16),
+        (uint8_t)(value >> 24),
+    };
+    emit_bytes(cg, bytes, sizeof(bytes));
+}
+
+static bool is_wide(TokenType type) {
+    return type == TOK_I128 || type == TOK_U128;
+}
+
+static void record_inst(Codegen* cg, const MachInst* inst) {
+    if (!cg->ok) {
+        return;
+    }
+    if (cg->windowCount == PEEP_WINDOW) {
+        memmove(cg->window, cg->window + 1,
+            (PEEP_WINDOW - 1) * sizeof(MachInst));
+        cg->windowCount--;
+    }
+    cg->window[cg->windowCount++] = *inst;
+    if (!cg->peephole) {
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(peepholes) / sizeof(peepholes[0]); i++) {
+        const Peephole* rule = &peepholes[i];
+        uint32_t first = cg->windowCount - rule->length;
+        if (rule->length > cg->windowCount ||
+            !rule->match(cg->window + first)) {
+            continue;
+        }
+
+        // Take the match off the end of .text, dropping the jumps it
+        // holds, and emit the replacement in its place. The replacement
+        // is recorded again, so patterns can apply to it as well.
+        MachInst matched[PEEP_WINDOW];
+        memcpy(matched, cg->window + first, rule->length * sizeof(MachInst));
+        cg->windowCount = first;
+        cg->obj->textSize = matched[0].offset;
+        while (cg->fixupCount > 0 &&
+            cg->fixups[cg->fixupCount - 1].offset >= matched[0].offset) {
+            cg->fixupCount--;
+        }
+        rule->rewrite(cg, matched);
+        return;
+    }
+}
+
+static void reemit(Codegen* cg, const MachInst* inst) {
+    switch (inst->kind) {
+        case MACH_OP:
+            emit_op(cg, inst->prefix, inst->opcode, inst->flags, inst->reg,
+                inst->rm);
+            break;
+        case MACH_IMM:
+            emit_mov_imm(cg, inst->reg, inst->imm);
+            break;
+        case MACH_JUMP:
+            emit_jump(cg, inst->cond, inst->label);
+            break;
+    }
+}
+
+static bool is_move(const MachInst* inst, uint32_t opcode) {
+    return inst->kind == MACH_OP && inst->prefix == 0 &&
+        inst->opcode == opcode && inst->flags == OP_W;
+}
+
+static bool reads_flags(const MachInst* inst) {
+    if (inst->kind == MACH_JUMP) {
+        return inst->cond != CC_ALWAYS;
+    }
+    if (inst->kind != MACH_OP || inst->prefix != 0) {
+        return false;
+    }
+    // adc and sbb, in their register and immediate forms, setcc and cmovcc
+    uint32_t op = inst->opcode;
+    return op == 0x11 || op == 0x13 || op == 0x19 || op == 0x1b ||
+        ((op == 0x81 || op == 0x83) && (inst->reg == 2 || inst->reg == 3)) ||
+        (op & ~0xfu) == 0x0f90 || (op & ~0xfu) == 0x0f40;
+}
+
+static bool match_store_load(const MachInst* insts) {
+    const Operand* store = &insts[0].rm;
+    const Operand* load = &insts[1].rm;
+    return is_move(&insts[0], 0x89) && is_move(&insts[1], 0x8b) &&
+        store->isMem && load->isMem && store->reg == load->reg &&
+        store->disp == load->disp;
+}
+
+static bool match_move_back(const MachInst* insts) {
+    return is_move(&insts[0], 0x8b) && is_move(&insts[1], 0x8b) &&
+        !insts[0].rm.isMem && !insts[1].rm.isMem &&
+        insts[0].reg == insts[1].rm.reg && insts[0].rm.reg == insts[1].reg;
+}
+
+static bool match_zero_arith(const MachInst* insts) {
+    // Only 64-bit forms leave the register as it was, and flags are only
+    // ever read by the instruction right after the one setting them
+    const MachInst* arith = &insts[1];
+    return insts[0].kind == MACH_IMM && insts[0].imm == 0 &&
+        arith->kind == MACH_OP && arith->prefix == 0 &&
+        (arith->opcode == 0x03 || arith->opcode == 0x2b) &&
+        arith->flags == OP_W && !arith->rm.isMem &&
+        arith->rm.reg == insts[0].reg && !reads_flags(&insts[2]);
+}
+
+static bool match_setcc_branch(const MachInst* insts) {
+    const MachInst* set = &insts[0];
+    const MachInst* test = &insts[2];
+    const MachInst* jump = &insts[3];
+    return set->kind == MACH_OP && set->prefix == 0 &&
+        (set->opcode & ~0xfu) == 0x0f90 && set->flags == OP_BYTE &&
+        !set->rm.isMem && set->rm.reg == RAX &&
+        insts[1].kind == MACH_OP && insts[1].prefix == 0 &&
+        insts[1].opcode == 0x0fb6 && insts[1].reg == RAX &&
+        !insts[1].rm.isMem && insts[1].rm.reg == RAX &&
+        test->kind == MACH_OP && test->prefix == 0 && test->opcode == 0x85 &&
+        test->reg == RAX && !test->rm.isMem && test->rm.reg == RAX &&
+        jump->kind == MACH_JUMP && (jump->cond == CC_NE || jump->cond == CC_E);
+}
+
+static void rewrite_keep_first(Codegen* cg, const MachInst* insts) {
+    reemit(cg, &insts[0]);
+}
+
+static void rewrite_store_load(Codegen* cg, const MachInst* insts) {
+    reemit(cg, &insts[0]);
+    if (insts[1].reg != insts[0].reg) {
+        emit_op(cg, 0, 0x8b, OP_W, insts[1].reg, reg_op(insts[0].reg));
+    }
+}
+
+static void rewrite_zero_arith(Codegen* cg, const MachInst* insts) {
+    reemit(cg, &insts[0]);
+    reemit(cg, &insts[2]);
+}
+
+static void rewrite_setcc_branch(Codegen* cg, const MachInst* insts) {
+    // Conditions come in pairs differing in the lowest bit. rax only
+    // ever holds a value within one IR instruction, so the jump can
+    // leave it unset.
+    Cond cond = (Cond)(insts[0].opcode & 0xf);
+    if (insts[3].cond == CC_E) {
+        cond = (Cond)(cond ^ 1);
+    }
+    emit_jump(cg, cond, insts[3].label);
+}
@@ -0,0 +1,33 @@
+#ifndef X64_H
+#define X64_H
+
+#include <stdbool.h>
+#include "elf.h"
+#include "ir.h"
+
+/// Compiles every function of a verified IR module to x86-64 machine code
+/// following the System V ABI and adds it to obj as global functions.
+/// Integer division by zero traps. Float remainders call fmod and fmodf,
+/// and 128-bit division and float conversions call the libgcc helpers,
+/// so objects are linked with libm and libgcc. Values get registers from
+/// the linear scan allocator unless allocateRegs is false, which keeps
+/// every value in a stack slot. peephole applies the patterns rewriting
+/// short instruction sequences into cheaper ones. With more than one
+/// thread, functions are compiled on a pool of that many threads, giving
+/// the same object as a single one. Returns false on failure.
+bool x64_compile(const IRModule* module, ElfObject* obj,
+    bool allocateRegs, bool peephole, uint32_t threads);
+/// Compiles function index of the module into obj like x64_compile().
+/// Calls to functions not compiled into the same object are left as
+/// relocations against their names.
+bool x64_compile_function(const IRModule* module, uint32_t index,
+    ElfObject* obj, bool allocateRegs, bool peephole);
+/// Adds a function called name to obj that calls function index with
+/// arguments in bytecode register slots, as the interpreter lays them
+/// out, and stores its result in result slots. Its C signature is
+/// void (const VMValue* args, VMValue* result). Returns false on
+/// failure.
+bool x64_compile_entry(const IRModule* module, uint32_t index,
+    const char* name, ElfObject* obj);
+
+#endif // X64_H
@@ -0,0 +1,149 @@
+#!/bin/sh
+# Compares the .text size and native run time of a few benchmark programs
+# built with two sets of flags. Each program loops for long enough that
+# its run time, not the start of the process, is what is measured, and
+# the fastest of the runs is reported. Compile time evaluation is off so
+# the programs are not folded to their result. The flags of a set are
+# split on spaces and an empty set builds with the defaults.
+#
+# Usage: bench_flags.sh <path to necc> <name A> <flags A> <name B>
+#     <flags B> [runs]
+
+set -eu
+
+if [ $# -lt 5 ]; then
+    echo "Usage: $0 <path to necc> <name A> <flags A> <name B> <flags B>"\
+        "[runs]" >&2
+    exit 1
+fi
+NECC=$1
+NAME_A=$2
+FLAGS_A=$3
+NAME_B=$4
+FLAGS_B=$5
+RUNS=${6:-3}
+CC=${CC:-cc}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+FLAGS=-fconsteval-steps=0
+
+# Small functions called from the loop, which inlining removes
+cat >"$WORK/calls.nc" <<'EOF'
+fn main() i32 {
+    return run(100000000, 1) % 256;
+}
+
+fn run(i32 n, i32 acc) i32 {
+    if (n == 0) {
+        return acc;
+    }
+    return run(n - 1, mix(acc, n));
+}
+
+fn mix(i32 a, i32 b) i32 {
+    return clamp(a * 3 + b, -1000000, 1000000) + next(b);
+}
+
+fn clamp(i32 x, i32 lo, i32 hi) i32 {
+    if (x < lo) {
+        return x - lo;
+    }
+    if (x > hi) {
+        return x - hi;
+    }
+    return x;
+}
+
+fn next(i32 x) i32 {
+    return x + 1;
+}
+EOF
+
+# Six values live across the loop, few enough for the register
+# allocator to keep them all out of memory
+cat >"$WORK/live.nc" <<'EOF'
+fn main() i32 {
+    return run(100000000, 1, 2, 3, 4, 5) % 256;
+}
+
+fn run(i32 n, i32 a, i32 b, i32 c, i32 d, i32 e) i32 {
+    if (n == 0) {
+        return a + b + c + d + e;
+    }
+    i32 x = a * 7 + b * 3 + c;
+    i32 y = d * 5 + e - x;
+    return run(n - 1, b, c, x, e, y);
+}
+EOF
+
+# Comparisons branched on in the loop, which the peephole patterns turn
+# into conditional jumps
+cat >"$WORK/branch.nc" <<'EOF'
+fn main() i32 {
+    return run(100000000, 0, 0) % 256;
+}
+
+fn run(i32 n, i32 acc, i32 x) i32 {
+    if (n == 0) {
+        return acc;
+    }
+    mut i32 y = x + n;
+    if (y > 1000) {
+        y = y - 1999;
+    } else if (y < -1000) {
+        y = y + 1777;
+    }
+    if (y > acc && y < acc + 500) {
+        return run(n - 1, acc + 1, y);
+    }
+    if (acc > 100000 || acc < -100000) {
+        return run(n - 1, 0, y);
+    }
+    return run(n - 1, acc - 1, y);
+}
+EOF
+
+# Prints the size in bytes of the .text section of an object file
+text_size() {
+    hex=$(objdump -h "$1" | awk '$2 == ".text" { print $3 }')
+    printf "%d" "0x$hex"
+}
+
+# Prints the milliseconds of the fastest of RUNS runs of a program
+time_runs() {
+    best=
+    i=0
+    while [ "$i" -lt "$RUNS" ]; do
+        start=$(date +%s%N)
+        "$1" >/dev/null || true
+        end=$(date +%s%N)
+        ms=$(((end - start) / 1000000))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then
+            best=$ms
+        fi
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+# build <program> <name> <flags>, building <program>.<name>
+build() {
+    "$NECC" -c $FLAGS $3 "$WORK/$1.nc" -o "$WORK/$1.$2.o"
+    "$CC" "$WORK/$1.$2.o" -o "$WORK/$1.$2" -lm
+}
+
+printf "%-10s %12s %12s %12s %12s %8s\n" "program" "$NAME_A (B)" \
+    "$NAME_B (B)" "$NAME_A (ms)" "$NAME_B (ms)" "speedup"
+for name in calls live branch; do
+    build "$name" a "$FLAGS_A"
+    build "$name" b "$FLAGS_B"
+
+    sizeA=$(text_size "$WORK/$name.a.o")
+    sizeB=$(text_size "$WORK/$name.b.o")
+    msA=$(time_runs "$WORK/$name.a")
+    msB=$(time_runs "$WORK/$name.b")
+    speedup=$(awk -v a="$msA" -v b="$msB" \
+        'BEGIN { if (b > 0) printf "%.2fx", a / b; else print "-" }')
+    printf "%-10s %12s %12s %12s %12s %8s\n" "$name" "$sizeA" "$sizeB" \
+        "$msA" "$msB" "$speedup"
+done
@@ -0,0 +1,15 @@
+#!/bin/sh
+# Compares the native run time of the benchmark programs of
+# bench_flags.sh with inlining against the same programs built with
+# -finline-threshold=0.
+#
+# Usage: bench_inline.sh <path to necc> [runs]
+
+set -eu
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <path to necc> [runs]" >&2
+    exit 1
+fi
+exec "$(dirname "$0")/bench_flags.sh" "$1" "no inline" \
+    -finline-threshold=0 inline "" ${2:+"$2"}
@@ -0,0 +1,79 @@
+#!/bin/sh
+# Compiles a generated file of a few thousand functions to an object on
+# one thread and on more, comparing the codegen time --stats reports and
+# checking every object is byte for byte the one built on one thread.
+#
+# Usage: bench_jobs.sh <path to necc> [functions] [thread counts...]
+
+set -eu
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <path to necc> [functions] [thread counts...]" >&2
+    exit 1
+fi
+NECC=$1
+FUNCS=${2:-3000}
+if [ $# -ge 2 ]; then
+    shift 2
+else
+    shift 1
+fi
+JOBS=${*:-"2 4 8 $(nproc)"}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+# Keeps the functions from being evaluated at compile time
+FLAGS=-fconsteval-steps=0
+
+# Writes a program of $2 functions calling each other in a chain
+write_program() {
+    {
+        echo "fn main() i32 {"
+        echo "    return g0(7, 3) % 256;"
+        echo "}"
+        i=0
+        while [ "$i" -lt "$2" ]; do
+            echo
+            echo "fn g$i(i32 a, i32 b) i32 {"
+            echo "    mut i32 x = a * 3 + b;"
+            k=0
+            while [ "$k" -lt 12 ]; do
+                echo "    if (x > $((k * 17 + i % 13))) {"
+                echo "        x = x - $((k + 1));"
+                echo "    } else {"
+                echo "        x = x + b * $((k + 2));"
+                echo "    }"
+                k=$((k + 1))
+            done
+            if [ "$((i + 1))" -lt "$2" ]; then
+                echo "    return g$((i + 1))(a + 1, b) + x % 7;"
+            else
+                echo "    return x;"
+            fi
+            echo "}"
+            i=$((i + 1))
+        done
+    } > "$1"
+}
+
+# Prints the codegen milliseconds of compiling the program on $1 threads
+codegen_ms() {
+    "$NECC" -c $FLAGS --stats --jobs "$1" "$WORK/big.nc" \
+        -o "$WORK/big.$1.o" 2>&1 |
+        awk '/^Codegen:/ { for (i = 1; i < NF; i++) if ($(i + 1) == "ms") \
+            print $i }'
+}
+
+write_program "$WORK/big.nc" "$FUNCS"
+base=$(codegen_ms 1)
+printf "%-8s %12s %8s %10s\n" "threads" "codegen (ms)" "speedup" "identical"
+printf "%-8s %12s %8s %10s\n" 1 "$base" "1.00x" "-"
+for jobs in $JOBS; do
+    ms=$(codegen_ms "$jobs")
+    speedup=$(awk -v a="$base" -v b="$ms" \
+        'BEGIN { if (b > 0) printf "%.2fx", a / b; else print "-" }')
+    same=no
+    if cmp -s "$WORK/big.1.o" "$WORK/big.$jobs.o"; then
+        same=yes
+    fi
+    printf "%-8s %12s %8s %10s\n" "$jobs" "$ms" "$speedup" "$same"
+done
@@ -0,0 +1,14 @@
+#!/bin/sh
+# Compares the .text size and native run time of the benchmark programs
+# of bench_flags.sh with the peephole patterns against -fno-peephole.
+#
+# Usage: bench_peephole.sh <path to necc> [runs]
+
+set -eu
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <path to necc> [runs]" >&2
+    exit 1
+fi
+exec "$(dirname "$0")/bench_flags.sh" "$1" base -fno-peephole peep "" \
+    ${2:+"$2"}
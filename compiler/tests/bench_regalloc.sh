@@ -0,0 +1,15 @@
+#!/bin/sh
+# Compares the native run time of the benchmark programs of
+# bench_flags.sh with the register allocator against the spill
+# everything baseline.
+#
+# Usage: bench_regalloc.sh <path to necc> [runs]
+
+set -eu
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <path to necc> [runs]" >&2
+    exit 1
+fi
+exec "$(dirname "$0")/bench_flags.sh" "$1" spill --no-regalloc \
+    regalloc "" ${2:+"$2"}
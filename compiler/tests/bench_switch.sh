@@ -0,0 +1,94 @@
+#!/bin/sh
+# Compares 256 arm else-if chains compiled as compare chains, with
+# -fswitch-min-cases=0, against the switches they become by default. The
+# dense chain tests the keys 0 to 255 and becomes a jump table, the
+# sparse one spreads them out and becomes a binary search. Both are timed
+# in the interpreter and as native code.
+#
+# Usage: bench_switch.sh <path to necc> [runs]
+
+set -eu
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <path to necc> [runs]" >&2
+    exit 1
+fi
+NECC=$1
+RUNS=${2:-5}
+CC=${CC:-cc}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+# Keeps the benchmark loop from being evaluated at compile time
+FLAGS=-fconsteval-steps=0
+
+# Writes a program calling a 256 arm chain a million times, the keys are
+# i * $2 + $3
+write_program() {
+    {
+        echo "fn main() i32 {"
+        echo "    return run(1000000, 0) % 256;"
+        echo "}"
+        echo
+        echo "fn run(i32 n, i32 acc) i32 {"
+        echo "    if (n == 0) {"
+        echo "        return acc;"
+        echo "    }"
+        echo "    return run(n - 1, acc + dispatch(n % 256 * $2 + $3));"
+        echo "}"
+        echo
+        echo "fn dispatch(i32 x) i32 {"
+        i=0
+        while [ "$i" -lt 256 ]; do
+            if [ "$i" -eq 0 ]; then
+                printf "    if"
+            else
+                printf "    } else if"
+            fi
+            echo " (x == $((i * $2 + $3))) {"
+            echo "        return $(((i * 7 + 3) % 251));"
+            i=$((i + 1))
+        done
+        echo "    }"
+        echo "    return 0;"
+        echo "}"
+    } > "$1"
+}
+
+# Prints the total milliseconds of RUNS runs of a command
+time_runs() {
+    start=$(date +%s%N)
+    i=0
+    while [ "$i" -lt "$RUNS" ]; do
+        "$@" >/dev/null || true
+        i=$((i + 1))
+    done
+    end=$(date +%s%N)
+    echo $(((end - start) / 1000000))
+}
+
+write_program "$WORK/dense.nc" 1 0
+write_program "$WORK/sparse.nc" 97 -5000
+
+printf "%-16s %12s %12s %8s\n" "program" "chain (ms)" "switch (ms)" \
+    "speedup"
+for name in dense sparse; do
+    src="$WORK/$name.nc"
+    "$NECC" -c $FLAGS -fswitch-min-cases=0 "$src" -o "$WORK/$name.base.o"
+    "$NECC" -c $FLAGS "$src" -o "$WORK/$name.switch.o"
+    "$CC" "$WORK/$name.base.o" -o "$WORK/$name.base" -lm
+    "$CC" "$WORK/$name.switch.o" -o "$WORK/$name.switch" -lm
+
+    for mode in vm native; do
+        if [ "$mode" = vm ]; then
+            base=$(time_runs "$NECC" run $FLAGS -fswitch-min-cases=0 "$src")
+            switch=$(time_runs "$NECC" run $FLAGS "$src")
+        else
+            base=$(time_runs "$WORK/$name.base")
+            switch=$(time_runs "$WORK/$name.switch")
+        fi
+        speedup=$(awk -v a="$base" -v b="$switch" \
+            'BEGIN { if (b > 0) printf "%.2fx", a / b; else print "-" }')
+        printf "%-16s %12s %12s %8s\n" "$name ($mode)" "$base" "$switch" \
+            "$speedup"
+    done
+done
@@ -0,0 +1,117 @@
+#!/bin/sh
+# Checks that a server and a watch print the lexer errors of a file on
+# every build, not only on the first: both keep what they built from a
+# file between builds, and the lexer prints its errors only as it makes
+# the tokens. A server is sent a file with an invalid token twice, then
+# edits of it, and its exit codes and errors are compared with those of
+# compiling each version on its own. A watch is given the file and it is
+# touched, which has to rebuild it with the same errors.
+#
+# Usage: check_cached_errors.sh <path to necc>
+
+set -eu
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <path to necc>" >&2
+    exit 1
+fi
+NECC=$1
+WORK=$(mktemp -d)
+SERVER=
+WATCH=
+trap '[ -z "$SERVER" ] || kill "$SERVER" 2>/dev/null;
+    [ -z "$WATCH" ] || kill "$WATCH" 2>/dev/null; rm -rf "$WORK"' EXIT
+FAILED=0
+SRC=$WORK/bad.nc
+
+# Writes a program whose x is 1 <$1> 2 and whose result is x <$2>
+write_program() {
+    cat >"$SRC" <<EOF
+fn main() i32 {
+    i32 x = 1 $1 2;
+    return x$2;
+}
+EOF
+}
+
+# Sends a run of the file to the server, after compiling the file on its
+# own to add its exit code and errors to those the server should give
+request() {
+    code=0
+    "$NECC" run "$SRC" 2>>"$WORK/expected.err" || code=$?
+    echo "$code" >>"$WORK/expected.out"
+    echo "run $SRC" >&3
+    read -r got <&4
+    echo "$got" >>"$WORK/server.out"
+}
+
+# compare <what> <expected> <got>
+compare() {
+    if cmp -s "$2" "$3"; then
+        echo "ok   $1: $(wc -l <"$2") line(s)"
+    else
+        echo "FAIL $1 differs from compiling each version on its own"
+        diff "$2" "$3" || true
+        FAILED=1
+    fi
+}
+
+mkfifo "$WORK/in" "$WORK/out"
+"$NECC" --server <"$WORK/in" >"$WORK/out" 2>"$WORK/server.err" &
+SERVER=$!
+exec 3>"$WORK/in" 4<"$WORK/out"
+: >"$WORK/expected.err"
+
+# A good file, an edit relexing it to a bad one sent twice, then an edit
+# away from the bad token, one replacing it with another and one fixing
+# it. A whole file is lexed before it is parsed, so each version has one
+# error, the compile of a file on its own stopping at the first.
+write_program '+' ''
+request
+write_program '$' ''
+request
+request
+write_program '$' ' + 1'
+request
+request
+write_program '#' ' + 1'
+request
+request
+write_program '+' ' + 1'
+request
+exec 3>&-
+wait "$SERVER" || true
+SERVER=
+compare "server exit codes" "$WORK/expected.out" "$WORK/server.out"
+compare "server errors" "$WORK/expected.err" "$WORK/server.err"
+
+# A touch leaves the bytes as they were, so the rebuild reuses the file
+write_program '$' ''
+"$NECC" --watch -c "$SRC" -o "$WORK/bad.o" 2>"$WORK/watch.err" &
+WATCH=$!
+tries=0
+while [ "$(grep -c '^Watch:' "$WORK/watch.err")" -lt 1 ] &&
+    [ "$tries" -lt 50 ]; do
+    sleep 0.1
+    tries=$((tries + 1))
+done
+touch "$SRC"
+while [ "$(grep -c '^Watch:' "$WORK/watch.err")" -lt 2 ] &&
+    [ "$tries" -lt 100 ]; do
+    sleep 0.1
+    tries=$((tries + 1))
+done
+kill "$WATCH"
+wait "$WATCH" 2>/dev/null || true
+WATCH=
+"$NECC" -c "$SRC" -o "$WORK/bad.o" 2>"$WORK/once.err" || true
+cat "$WORK/once.err" "$WORK/once.err" >"$WORK/expected.watch"
+grep -v '^Watch:' "$WORK/watch.err" >"$WORK/watch.got" || true
+if [ "$(grep -c '^Watch:' "$WORK/watch.err")" -lt 2 ]; then
+    echo "FAIL watch: the touch was not rebuilt"
+    FAILED=1
+else
+    compare "watch errors" "$WORK/expected.watch" "$WORK/watch.got"
+fi
+
+exit "$FAILED"
@@ -0,0 +1,72 @@
+#!/bin/sh
+# Checks that the streaming lexer gives the same tree whatever the size of
+# the chunks it reads: the --dump-ast output and exit code of each test
+# program at chunk sizes 1 to 17, so tokens, comments, byte order marks
+# and multibyte characters straddle every chunk boundary, are compared
+# against those of the lexer given the whole file. The chunk size is set
+# with the -flexer-chunk option the usage leaves out.
+#
+# Usage: check_lexer_chunks.sh <path to necc>
+
+set -eu
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <path to necc>" >&2
+    exit 1
+fi
+NECC=$1
+DIR=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+# A byte order mark, multibyte characters in comments and the operators
+# of two characters, none of which the other programs have
+printf '\357\273\277' >"$WORK/chunks.nc"
+cat >>"$WORK/chunks.nc" <<'EOF'
+/// Größe — ∑ of the ranges, ✓
+fn main() i32 {
+    mut i32 total = 0; // ünïcödé
+    total += scale(3, 4);
+    total -= 1;
+    /* ≤ and ≥ are spelled <= and >= */
+    if (total >= 10 && total <= 100 || total != 7) {
+        return total % 256;
+    }
+    return 0;
+}
+
+fn scale(i32 a, i32 b) i32 {
+    f64 ratio = 2.5;
+    return (i32)((f64)(a * b) * ratio);
+}
+EOF
+
+for src in "$DIR"/*.nc "$WORK/chunks.nc"; do
+    name=$(basename "$src" .nc)
+    expected=0
+    bad=0
+    "$NECC" --dump-ast -flexer-chunk=0 "$src" >"$WORK/$name.whole" 2>&1 ||
+        expected=$?
+    size=1
+    while [ "$size" -le 17 ]; do
+        code=0
+        "$NECC" --dump-ast -flexer-chunk="$size" "$src" \
+            >"$WORK/$name.$size" 2>&1 || code=$?
+        if [ "$code" -ne "$expected" ] ||
+            ! cmp -s "$WORK/$name.whole" "$WORK/$name.$size"; then
+            echo "FAIL $name: chunks of $size byte(s) differ from the"\
+                "whole file"
+            diff "$WORK/$name.whole" "$WORK/$name.$size" | head -n 10 || true
+            bad=1
+        fi
+        size=$((size + 1))
+    done
+    if [ "$bad" -ne 0 ]; then
+        FAILED=1
+        continue
+    fi
+    echo "ok   $name: $(wc -l <"$WORK/$name.whole") line(s), exit $expected"
+done
+
+exit "$FAILED"
@@ -0,0 +1,111 @@
+#!/bin/sh
+# Compiles a small program for each peephole pattern with the patterns
+# and with -fno-peephole and checks the .text bytes: the exact sequence
+# a pattern rewrites, with the instructions around it, has to be in the
+# -fno-peephole object and not in the other one, and the exact sequence
+# the rewrite emits in its place the other way around.
+#
+# Usage: check_peephole.sh <path to necc>
+
+set -eu
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <path to necc>" >&2
+    exit 1
+fi
+NECC=$1
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+FLAGS=-fconsteval-steps=0
+FAILED=0
+
+# Prints the .text bytes of an object file as one line of hex pairs
+text_bytes() {
+    objdump -d -j .text "$1" |
+        awk -F '\t' 'NF >= 2 && $1 ~ /:$/ { printf "%s", $2 }' |
+        tr -s ' ' | sed 's/ $//'
+    echo
+}
+
+# Compiles $WORK/<name>.nc to <name>.base.o and <name>.peep.o, passing
+# the remaining arguments to both
+compile() {
+    name=$1
+    shift
+    "$NECC" -c $FLAGS -fno-peephole "$@" "$WORK/$name.nc" \
+        -o "$WORK/$name.base.o"
+    "$NECC" -c $FLAGS "$@" "$WORK/$name.nc" -o "$WORK/$name.peep.o"
+}
+
+# check <pattern> <name> <bytes before> <bytes after>, checking that
+# the bytes before are in <name>.base.o only and the bytes after in
+# <name>.peep.o only
+check() {
+    for bytes in "$3" "$4"; do
+        for obj in base peep; do
+            if text_bytes "$WORK/$2.$obj.o" | grep -Fq -- "$bytes"; then
+                found=present
+            else
+                found=absent
+            fi
+            expected=absent
+            if { [ "$bytes" = "$3" ] && [ "$obj" = base ]; } ||
+                { [ "$bytes" = "$4" ] && [ "$obj" = peep ]; }; then
+                expected=present
+            fi
+            if [ "$found" = "$expected" ]; then
+                printf "ok   %s: %s.%s.o, %s: %s\n" "$1" "$2" "$obj" \
+                    "$found" "$bytes"
+            else
+                printf "FAIL %s: %s.%s.o, %s: %s\n" "$1" "$2" "$obj" \
+                    "$found" "$bytes"
+                FAILED=1
+            fi
+        done
+    done
+}
+
+cat >"$WORK/branch.nc" <<'EOF'
+fn f(i32 a, i32 b) i32 {
+    i32 c = a + b;
+    if (a < b) {
+        return c;
+    }
+    return c * 2;
+}
+EOF
+cat >"$WORK/zero.nc" <<'EOF'
+fn f(i32 a, i32 b) i32 {
+    i32 z = 0;
+    i64 w = (i64)a + (i64)z;
+    i64 v = (i64)b - (i64)z;
+    return (i32)w + (i32)v;
+}
+EOF
+
+# movsxd rax, eax, mov [rbp - 40], rax, mov rax, [rbp - 40], leave
+# drops the load
+compile branch --no-regalloc
+check store_load branch '48 63 c0 48 89 45 d8 48 8b 45 d8 c9' \
+    '48 63 c0 48 89 45 d8 c9'
+
+# movsxd rax, eax, mov r10, rax, mov rax, r10, pop r12 keeps the first
+# move
+compile branch
+check move_back branch '48 63 c0 4c 8b d0 49 8b c2 41 5c' \
+    '48 63 c0 4c 8b d0 41 5c'
+
+# cmp rax, rcx, setl al, movzx eax, al, test eax, eax, je +7 becomes
+# cmp rax, rcx, jge +7
+check setcc_branch branch \
+    '48 3b c1 0f 9c c0 0f b6 c0 85 c0 0f 84 07 00 00 00 48 8b c3' \
+    '48 3b c1 0f 8d 07 00 00 00 48 8b c3'
+
+# mov ecx, 0, then add or sub rax, rcx and a move drops the arithmetic
+compile zero
+check zero_arith zero '49 8b c2 b9 00 00 00 00 48 03 c1 48 8b d8' \
+    '49 8b c2 b9 00 00 00 00 48 8b d8'
+check zero_arith zero '49 8b c3 b9 00 00 00 00 48 2b c1 4c 8b d0' \
+    '49 8b c3 b9 00 00 00 00 4c 8b d0'
+
+exit "$FAILED"
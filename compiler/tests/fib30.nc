@@ -0,0 +1,12 @@
+/// Benchmark for the interpreter, exits with fibonacci(30) % 256
+fn main() i32 {
+    return fibonacci(30) % 256;
+}
+
+/// Calculates the nth Fibonacci number
+fn fibonacci(i32 n) i32 {
+    if (n < 2) {
+        return n;
+    }
+    return fibonacci(n - 1) + fibonacci(n - 2);
+}